@@ -93,3 +93,12 @@ CONFIG_DEF_BOOL(inline_mem, true);
 
 CONFIG_DEF_BOOL(log_verbose, false);
 CONFIG_DEF_BOOL(log_stdout, false);
+
+CONFIG_DEF_BOOL(headless, false);
+CONFIG_DEF_BOOL(soft_render, false);
+CONFIG_DEF_BOOL(render_hash, false);
+
+CONFIG_DEF_INT(frame_limit, 0);
+CONFIG_DEF_INT(emu_time_limit, 0);
+
+CONFIG_DEF_STRING(frame_dump_path);
@@ -104,4 +104,35 @@ CONFIG_DECL_BOOL(inline_mem);
 CONFIG_DECL_BOOL(log_stdout);
 CONFIG_DECL_BOOL(log_verbose);
 
+/*
+ * if true, there is no window, no graphics API and nothing is drawn.  The
+ * null renderer gets used instead of OpenGL.
+ */
+CONFIG_DECL_BOOL(headless);
+
+/*
+ * if true (and headless is also true), the software renderer is used instead
+ * of the null renderer so that everything still gets drawn.
+ */
+CONFIG_DECL_BOOL(soft_render);
+
+/*
+ * if true, the headless renderer hashes everything it is given (for the
+ * software renderer this is every frame it outputs).
+ */
+CONFIG_DECL_BOOL(render_hash);
+
+/*
+ * if nonzero, emulation stops after this many frames or this many seconds of
+ * emulated time, whichever comes first.
+ */
+CONFIG_DECL_INT(frame_limit);
+CONFIG_DECL_INT(emu_time_limit);
+
+/*
+ * if not empty, every frame gets written to this path.  Paths ending in .y4m
+ * get YUV4MPEG2, everything else gets raw RGBA.
+ */
+CONFIG_DECL_STRING(frame_dump_path);
+
 #endif
@@ -112,10 +112,30 @@ static void cfg_create_default_config(void) {
         "; Order-Independent Transparency algorithm.  choices are:\n"
         ";     disabled - no order-independent transparency\n"
         ";     per-group - groups of transparent polygons are sorted by depth\n"
+        ";     per-triangle - individual transparent triangles are sorted by\n"
+        ";                    depth\n"
         "; Ideally there would be a per-pixel mode, as well, but that hasn't\n"
-        "; been implemented yet.  per-group is far from perfect but it does\n"
+        "; been implemented yet.  per-triangle is far from perfect but it does\n"
         "; seem to be a good enough approximation most of the time.\n"
-        "gfx.rend.oit-mode per-group\n"
+        "gfx.rend.oit-mode per-triangle\n"
+        "\n"
+        "; set this to true to save compiled shaders in the data directory so\n"
+        "; that they don't need to be compiled again the next time WashingtonDC\n"
+        "; starts.  The saved shaders are discarded automatically whenever\n"
+        "; the graphics driver changes.\n"
+        "gfx.rend.shader-cache true\n"
+        "\n"
+        "; maximum amount of memory (in megabytes) to use for decoded textures.\n"
+        "; when the texture cache goes over this, the textures which have gone\n"
+        "; the longest without being used get evicted.  Textures which are\n"
+        "; in use by the current frame are never evicted, so this can be\n"
+        "; exceeded temporarily.\n"
+        "gfx.tex-cache.budget-mb 64\n"
+        "\n"
+        "; maximum number of frames in a row which can go undrawn when\n"
+        "; emulation falls behind realtime.  Set this to 0 to draw every\n"
+        "; frame.\n"
+        "gfx.frameskip.max 2\n"
         "\n"
         "; set this to true to mute audio.  Set it to false to allow audio \n"
         "; to play\n"
@@ -132,6 +152,16 @@ static void cfg_create_default_config(void) {
         ";     pause: start the emulator paused\n"
         "exec.speed full\n"
         "\n"
+        "; how long the GD-ROM drive takes to carry out commands.  choices are:\n"
+        ";     fixed - every command takes the same short amount of time\n"
+        ";     accurate - seeks and reads take about as long as they would\n"
+        ";                on a real drive.  Use this for games that are\n"
+        ";                sensitive to loading times.\n"
+        ";     turbo - everything finishes as quickly as possible\n"
+        "; turbo can also be toggled while the emulator is running with the\n"
+        "; wash.ctrl.toggle-turbo-load bind.\n"
+        "gdrom.timing fixed\n"
+        "\n"
         /*
          * TODO: find a way to explain the naming convention for control
          * bindings to end-users
@@ -145,6 +175,7 @@ static void cfg_create_default_config(void) {
         "wash.ctrl.pause-execution kbd.f7\n"
 
         "wash.ctrl.toggle-mute kbd.f8\n"
+        "wash.ctrl.toggle-turbo-load kbd.f9\n"
         "wash.ctrl.toggle-fullscreen kbd.f11\n"
         "wash.ctrl.screenshot kbd.f12\n"
         "\n"
@@ -27,6 +27,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <string.h>
 #include <math.h>
 
 #include "config.h"
@@ -70,9 +71,12 @@
 #include "washdc/config_file.h"
 #include "mount.h"
 #include "gdi.h"
+#include "gdz.h"
 #include "washdc/win.h"
 #include "washdc/sound_intf.h"
 #include "sound.h"
+#include "screenshot.h"
+#include "frameskip.h"
 #include "washdc/hostfile.h"
 
 #ifdef ENABLE_TCP_SERIAL
@@ -420,7 +424,10 @@ dreamcast_init(char const *gdi_path,
     struct mount_meta content_meta; // only valid if gdi_path is non-null
 
     if (gdi_path) {
-        mount_gdi(gdi_path);
+        if (gdz_probe(gdi_path))
+            mount_gdz(gdi_path);
+        else
+            mount_gdi(gdi_path);
         if (mount_get_meta(&content_meta) == 0) {
             // dump meta to stdout and set the window title to the game title
             title_content = content_meta.title;
@@ -590,6 +597,19 @@ do_init_win_gfx:
 
     win_init(win_width, win_height);
     gfx_init(win_width, win_height);
+    screenshot_init();
+
+    char const *dump_path = config_get_frame_dump_path();
+    if (dump_path[0]) {
+        size_t dump_path_len = strlen(dump_path);
+        enum frame_dump_fmt fmt = FRAME_DUMP_FMT_RGBA;
+        if (dump_path_len >= 4 &&
+            strcmp(dump_path + dump_path_len - 4, ".y4m") == 0)
+            fmt = FRAME_DUMP_FMT_Y4M;
+        frame_dump_start(dump_path, fmt);
+    }
+
+    frameskip_init();
 
     dc_sound_init(snd_intf);
 
@@ -608,6 +628,7 @@ void dreamcast_cleanup() {
 #endif
 
     dc_sound_cleanup();
+    screenshot_cleanup();
     gfx_cleanup();
 
     win_cleanup();
@@ -669,10 +690,35 @@ unsigned dc_get_frame_count(void) {
     return frame_count;
 }
 
+// returns true if the frame limit or emulated-time limit has been reached
+static bool exec_limit_reached(void) {
+    unsigned frame_limit = config_get_frame_limit();
+    unsigned emu_time_limit = config_get_emu_time_limit();
+
+    if (frame_limit && frame_count >= frame_limit) {
+        LOG_INFO("frame limit of %u reached\n", frame_limit);
+        return true;
+    }
+
+    if (emu_time_limit &&
+        clock_cycle_stamp(&sh4_clock) >=
+        (dc_cycle_stamp_t)emu_time_limit * SCHED_FREQUENCY) {
+        LOG_INFO("emulated time limit of %u seconds reached\n",
+                 emu_time_limit);
+        return true;
+    }
+
+    return false;
+}
+
 static void main_loop_sched(void) {
     while (atomic_load_explicit(&is_running, memory_order_relaxed)) {
         run_one_frame();
         frame_count++;
+        if (exec_limit_reached()) {
+            atomic_store_explicit(&is_running, false, memory_order_relaxed);
+            break;
+        }
         if (frame_stop) {
             frame_stop = false;
             if (dc_state == DC_STATE_RUNNING) {
@@ -1087,6 +1133,23 @@ void dc_print_perf_stats(void) {
                  hz / 1000000.0, hz_ratio * 100.0);
         printf("Average Performance is %f MHz (%f%%)\n",
                hz / 1000000.0, hz_ratio * 100.0);
+
+        double emu_seconds =
+            (double)clock_cycle_stamp(&sh4_clock) / (double)SCHED_FREQUENCY;
+        double fps = frame_count / seconds;
+        double speed = emu_seconds / seconds;
+
+        LOG_INFO("%u frames in %f seconds of emulated time\n",
+                 frame_count, emu_seconds);
+        printf("%u frames in %f seconds of emulated time\n",
+               frame_count, emu_seconds);
+
+        LOG_INFO("Average framerate is %f FPS (%f%% of realtime)\n",
+                 fps, speed * 100.0);
+        printf("Average framerate is %f FPS (%f%% of realtime)\n",
+               fps, speed * 100.0);
+
+        aica_print_stats(&aica);
     } else {
         LOG_INFO("Program execution halted before WashingtonDC was completely "
                  "initialized.\n");
@@ -1239,6 +1302,9 @@ void dc_end_frame(void) {
 
     win_update_title();
     framebuffer_render(&dc_pvr2);
+    frame_dump_frame();
+    frameskip_end_frame(delta.tv_sec + delta.tv_nsec / 1000000000.0,
+                        virt_frametime_seconds);
     win_check_events();
 }
 
@@ -1437,8 +1503,24 @@ void dc_ch2_dma_xfer(addr32_t xfer_src, addr32_t xfer_dst, unsigned n_words) {
     memory_map_read32_func read32 = src_region->intf->read32;
     void *ctxt = src_region->ctxt;
     uint32_t mask = src_region->mask;
+
+    /*
+     * Almost every channel-2 DMA comes out of system RAM, in which case the
+     * whole transfer can be handed off in one piece instead of being read
+     * out one word at a time.
+     */
+    void const *src_ptr = NULL;
+    if (xfer_src % sizeof(uint32_t) == 0)
+        src_ptr = memory_dma_ptr(&mem_map, xfer_src, n_words * 4);
+
     if ((xfer_dst >= ADDR_TA_FIFO_POLY_FIRST) &&
         (xfer_dst <= ADDR_TA_FIFO_POLY_LAST)) {
+        if (src_ptr) {
+            pvr2_ta_fifo_poly_write_bulk(&dc_pvr2, (uint32_t const*)src_ptr,
+                                         n_words);
+            return;
+        }
+
         while (n_words--) {
             uint32_t buf = read32(xfer_src & mask, ctxt);
             pvr2_ta_fifo_poly_write_32(xfer_dst, buf, &dc_pvr2);
@@ -1447,9 +1529,14 @@ void dc_ch2_dma_xfer(addr32_t xfer_src, addr32_t xfer_dst, unsigned n_words) {
         }
     } else if ((xfer_dst >= ADDR_AREA4_TEX64_FIRST) &&
                (xfer_dst <= ADDR_AREA4_TEX64_LAST)) {
-        // TODO: do tex DMA transfers in large chuks instead of 4-byte increments
         xfer_dst = xfer_dst - ADDR_AREA4_TEX64_FIRST + ADDR_TEX64_FIRST;
 
+        if (src_ptr) {
+            pvr2_tex_mem_area64_write_bulk(&dc_pvr2, xfer_dst,
+                                           src_ptr, n_words * 4);
+            return;
+        }
+
         while (n_words--) {
             uint32_t buf = read32(xfer_src & mask, ctxt);
             pvr2_tex_mem_area64_write_32(xfer_dst, buf, &dc_pvr2);
@@ -1458,9 +1545,14 @@ void dc_ch2_dma_xfer(addr32_t xfer_src, addr32_t xfer_dst, unsigned n_words) {
         }
     } else if ((xfer_dst >= ADDR_AREA4_TEX32_FIRST) &&
                (xfer_dst <= ADDR_AREA4_TEX32_LAST)) {
-        // TODO: do tex DMA transfers in large chuks instead of 4-byte increments
         xfer_dst = xfer_dst - ADDR_AREA4_TEX32_FIRST + ADDR_TEX32_FIRST;
 
+        if (src_ptr) {
+            pvr2_tex_mem_area32_write_bulk(&dc_pvr2, xfer_dst,
+                                           src_ptr, n_words * 4);
+            return;
+        }
+
         while (n_words--) {
             uint32_t buf = read32(xfer_src & mask, ctxt);
             pvr2_tex_mem_area32_write_32(xfer_dst, buf, &dc_pvr2);
@@ -1469,6 +1561,11 @@ void dc_ch2_dma_xfer(addr32_t xfer_src, addr32_t xfer_dst, unsigned n_words) {
         }
     } else if (xfer_dst >= ADDR_TA_FIFO_YUV_FIRST &&
                xfer_dst <= ADDR_TA_FIFO_YUV_LAST) {
+        if (src_ptr) {
+            pvr2_yuv_input_data(&dc_pvr2, src_ptr, n_words * 4);
+            return;
+        }
+
         while (n_words--) {
             uint32_t in = read32(xfer_src & mask, ctxt);
             xfer_src += sizeof(in);
@@ -0,0 +1,120 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "washdc/config_file.h"
+#include "config.h"
+#include "log.h"
+
+#include "frameskip.h"
+
+/*
+ * lag is capped at this many seconds so that a long stall (loading from disc,
+ * the host being busy, etc) can't leave it skipping frames for a long time
+ * afterwards.
+ */
+#define FRAMESKIP_MAX_LAG (3.0 / 60.0)
+
+/*
+ * frames that take longer than this in wall-clock time are assumed to be the
+ * result of emulation being paused or suspended, and they reset the lag.
+ */
+#define FRAMESKIP_STALL_SECONDS 0.25
+
+static unsigned max_skip;
+static double lag;
+static unsigned n_consecutive;
+static bool skipping;
+
+static unsigned n_total;
+
+// one bit for each of the last 64 frames, set if the frame was skipped
+static uint64_t history;
+
+void frameskip_init(void) {
+    int max_cfg;
+    if (cfg_get_int("gfx.frameskip.max", &max_cfg) != 0 || max_cfg < 0)
+        max_cfg = FRAMESKIP_DEFAULT_MAX;
+
+    /*
+     * frame skipping would make the output of headless runs and frame dumps
+     * depend on the speed of the host
+     */
+    if (config_get_headless() || config_get_frame_dump_path()[0])
+        max_cfg = 0;
+
+    max_skip = max_cfg;
+    lag = 0.0;
+    n_consecutive = 0;
+    skipping = false;
+    n_total = 0;
+    history = 0;
+
+    if (max_skip)
+        LOG_INFO("frameskip: skipping at most %u frames in a row\n", max_skip);
+    else
+        LOG_INFO("frameskip: disabled\n");
+}
+
+void frameskip_end_frame(double real_seconds, double virt_seconds) {
+    history = (history << 1) | (skipping ? 1 : 0);
+
+    if (!max_skip)
+        return;
+
+    if (real_seconds > FRAMESKIP_STALL_SECONDS) {
+        lag = 0.0;
+    } else {
+        lag += real_seconds - virt_seconds;
+        if (lag < 0.0)
+            lag = 0.0;
+        else if (lag > FRAMESKIP_MAX_LAG)
+            lag = FRAMESKIP_MAX_LAG;
+    }
+
+    /*
+     * every max_skip skipped frames, one frame always gets drawn so that
+     * something still makes it to the screen.
+     */
+    if (lag > virt_seconds && n_consecutive < max_skip) {
+        skipping = true;
+        n_consecutive++;
+        n_total++;
+    } else {
+        skipping = false;
+        n_consecutive = 0;
+    }
+}
+
+bool frameskip_skipping(void) {
+    return skipping;
+}
+
+unsigned frameskip_total(void) {
+    return n_total;
+}
+
+unsigned frameskip_recent(void) {
+    return __builtin_popcountll(history);
+}
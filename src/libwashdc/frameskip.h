@@ -0,0 +1,60 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+/*
+ * Automatic frame skipping.
+ *
+ * When the host can't keep up with realtime, the time by which emulation is
+ * lagging behind the wall-clock builds up from one frame to the next.  Once
+ * it's more than a frame's worth, the next frame is skipped: the PVR2 still
+ * does everything the guest can see (interrupts, framebuffer bookkeeping,
+ * and render targets the guest reads back still get drawn) but nothing gets
+ * submitted to the renderer and the result doesn't get presented.
+ */
+
+#ifndef FRAMESKIP_H_
+#define FRAMESKIP_H_
+
+#include <stdbool.h>
+
+// default for gfx.frameskip.max
+#define FRAMESKIP_DEFAULT_MAX 2
+
+void frameskip_init(void);
+
+/*
+ * called at the end of every frame with the amount of wall-clock time and
+ * emulated time that frame took.  This decides whether the next frame will
+ * be skipped.
+ */
+void frameskip_end_frame(double real_seconds, double virt_seconds);
+
+// returns true if the current frame is being skipped
+bool frameskip_skipping(void);
+
+// total number of frames skipped
+unsigned frameskip_total(void);
+
+// number of frames skipped out of the last 64
+unsigned frameskip_recent(void);
+
+#endif
@@ -25,11 +25,16 @@
 
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "washdc/stringlib.h"
 #include "washdc/error.h"
@@ -39,10 +44,41 @@
 
 #include "gdi.h"
 
+/*
+ * number of sectors past the end of each read that the read-ahead thread
+ * brings in.  This is 1MB of user data.
+ */
+#define GDI_READAHEAD_SECTORS 512
+
+/*
+ * The read-ahead thread pulls sectors into memory ahead of the emulation
+ * thread so that it doesn't have to wait on the disk.  Only the most recent
+ * request matters, so a new request replaces whatever the thread was working
+ * on.
+ */
+struct gdi_readahead {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool running, quit;
+
+    bool pending;
+    unsigned fad_first, n_sectors;
+};
+
 struct gdi_mount {
     struct gdi_info meta;
-    FILE **track_streams;
+    int *track_fds;
     size_t *track_lengths; // length of each track, in bytes
+
+    /*
+     * each track gets mapped into memory so that sectors can be handed out by
+     * reference.  If a track can't be mapped this is NULL and that track gets
+     * read with pread instead.
+     */
+    uint8_t const **track_maps;
+
+    struct gdi_readahead readahead;
 };
 
 static void mount_gdi_cleanup(struct mount *mount);
@@ -50,6 +86,21 @@ static unsigned mount_gdi_session_count(struct mount *mount);
 static int mount_gdi_read_toc(struct mount *mount, struct mount_toc *toc,
                               unsigned session_no);
 static int mount_read_sector(struct mount *mount, void *buf, unsigned fad);
+static void const *mount_gdi_get_sector(struct mount *mount, void *buf,
+                                        unsigned fad);
+static bool mount_gdi_has_sector(struct mount *mount, unsigned fad);
+static void mount_gdi_prefetch(struct mount *mount, unsigned fad,
+                               unsigned n_sectors);
+
+static int gdi_find_sector(struct gdi_mount const *gdi_mount, unsigned fad,
+                           unsigned *track_idx_out, size_t *byte_offset_out);
+static int gdi_read_bytes(struct gdi_mount const *gdi_mount,
+                          unsigned track_idx, size_t offset,
+                          void *buf, size_t n_bytes);
+
+static void gdi_readahead_init(struct gdi_mount *gdi_mount);
+static void gdi_readahead_cleanup(struct gdi_mount *gdi_mount);
+static void *gdi_readahead_main(void *arg);
 
 // return true if this is a legitimate gd-rom; else return false
 static bool gdi_validate_fmt(struct gdi_info const *info);
@@ -60,6 +111,9 @@ static struct mount_ops gdi_mount_ops = {
     .session_count = mount_gdi_session_count,
     .read_toc = mount_gdi_read_toc,
     .read_sector = mount_read_sector,
+    .get_sector = mount_gdi_get_sector,
+    .has_sector = mount_gdi_has_sector,
+    .prefetch = mount_gdi_prefetch,
     .cleanup = mount_gdi_cleanup,
     .get_meta = mount_gdi_get_meta
 };
@@ -244,14 +298,22 @@ void mount_gdi(char const *path) {
     if (!gdi_validate_fmt(&mount->meta))
         RAISE_ERROR(ERROR_INVALID_PARAM);
 
-    mount->track_streams = (FILE**)calloc(mount->meta.n_tracks, sizeof(FILE*));
-    if (!mount->track_streams)
+    mount->track_fds = (int*)calloc(mount->meta.n_tracks, sizeof(int));
+    if (!mount->track_fds)
         RAISE_ERROR(ERROR_FAILED_ALLOC);
 
     mount->track_lengths = (size_t*)calloc(mount->meta.n_tracks,
                                            sizeof(size_t));
     if (!mount->track_lengths) {
-        free(mount->track_streams);
+        free(mount->track_fds);
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    }
+
+    mount->track_maps = (uint8_t const**)calloc(mount->meta.n_tracks,
+                                                sizeof(uint8_t const*));
+    if (!mount->track_maps) {
+        free(mount->track_lengths);
+        free(mount->track_fds);
         RAISE_ERROR(ERROR_FAILED_ALLOC);
     }
 
@@ -259,39 +321,57 @@ void mount_gdi(char const *path) {
     for (track_no = 0; track_no < mount->meta.n_tracks; track_no++) {
         struct string const *track_path =
             &mount->meta.tracks[track_no].abs_path;
-        mount->track_streams[track_no] = fopen(string_get(track_path), "rb");
-        if (!mount->track_streams[track_no]) {
-            error_set_file_path(string_get(track_path));
-            error_set_errno_val(errno);
-            RAISE_ERROR(ERROR_FILE_IO);
-        }
-
-        if (fseek(mount->track_streams[track_no], 0, SEEK_END) != 0) {
+        int fd = open(string_get(track_path), O_RDONLY);
+        if (fd < 0) {
             error_set_file_path(string_get(track_path));
             error_set_errno_val(errno);
             RAISE_ERROR(ERROR_FILE_IO);
         }
+        mount->track_fds[track_no] = fd;
 
-        long len = ftell(mount->track_streams[track_no]);
-        if (len < 0) {
+        struct stat track_stat;
+        if (fstat(fd, &track_stat) != 0) {
             error_set_file_path(string_get(track_path));
             error_set_errno_val(errno);
             RAISE_ERROR(ERROR_FILE_IO);
         }
 
+        size_t len = track_stat.st_size;
         mount->track_lengths[track_no] = len;
+
+        if (len) {
+            void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED) {
+                LOG_WARN("unable to map %s into memory (errno %d); it will "
+                         "be read from the disk instead\n",
+                         string_get(track_path), errno);
+            } else {
+                mount->track_maps[track_no] = (uint8_t const*)map;
+            }
+        }
     }
 
+    gdi_readahead_init(mount);
+
     mount_insert(&gdi_mount_ops, mount);
 }
 
 static void mount_gdi_cleanup(struct mount *mount) {
     struct gdi_mount *state = (struct gdi_mount*)mount->state;
 
+    gdi_readahead_cleanup(state);
+
     unsigned track_no;
-    for (track_no = 0; track_no < state->meta.n_tracks; track_no++)
-        fclose(state->track_streams[track_no]);
-    free(state->track_streams);
+    for (track_no = 0; track_no < state->meta.n_tracks; track_no++) {
+        if (state->track_maps[track_no]) {
+            munmap((void*)state->track_maps[track_no],
+                   state->track_lengths[track_no]);
+        }
+        close(state->track_fds[track_no]);
+    }
+    free(state->track_maps);
+    free(state->track_lengths);
+    free(state->track_fds);
     free(state);
 }
 
@@ -360,8 +440,13 @@ static int mount_gdi_read_toc(struct mount *mount, struct mount_toc *toc,
     return 0;
 }
 
-static int mount_read_sector(struct mount *mount, void *buf, unsigned fad) {
-    struct gdi_mount const *gdi_mount = (struct gdi_mount const*)mount->state;
+/*
+ * find the track that holds the given sector, and the offset of the sector's
+ * data within that track's file.  Returns 0 on success or -1 if the sector
+ * isn't on the disc.
+ */
+static int gdi_find_sector(struct gdi_mount const *gdi_mount, unsigned fad,
+                           unsigned *track_idx_out, size_t *byte_offset_out) {
     struct gdi_info const *info = &gdi_mount->meta;
 
     unsigned track_idx;
@@ -375,28 +460,196 @@ static int mount_read_sector(struct mount *mount, void *buf, unsigned fad) {
 
             // TODO: support MODE2 FORM1, MODE2 FORM2, CDDA, etc...
             unsigned fad_relative = fad - trackp->fad_start;
-            unsigned byte_offset = CDROM_FRAME_SIZE * fad_relative +
+
+            // TODO: don't ignore the offset
+            *track_idx_out = track_idx;
+            *byte_offset_out = (size_t)CDROM_FRAME_SIZE * fad_relative +
                 CDROM_MODE1_DATA_OFFSET;
+            return 0;
+        }
+    }
 
-            LOG_DBG("Select track %d (%u blocks starting from %u)\n",
-                     track_idx + 1, track_fad_count, (unsigned)trackp->fad_start);
-            LOG_DBG("read 1 sector starting at byte %u\n", byte_offset);
+    return -1;
+}
 
-            // TODO: don't ignore the offset
-            if (fseek(gdi_mount->track_streams[track_idx],
-                      byte_offset, SEEK_SET) != 0) {
-                goto return_err;
-            }
+static int gdi_read_bytes(struct gdi_mount const *gdi_mount,
+                          unsigned track_idx, size_t offset,
+                          void *buf, size_t n_bytes) {
+    if (offset + n_bytes > gdi_mount->track_lengths[track_idx])
+        return -1;
+
+    uint8_t const *map = gdi_mount->track_maps[track_idx];
+    if (map) {
+        memcpy(buf, map + offset, n_bytes);
+        return 0;
+    }
 
-            if (fread(buf, 2048, 1, gdi_mount->track_streams[track_idx]) != 1)
-                goto return_err;
+    uint8_t *outp = (uint8_t*)buf;
+    while (n_bytes) {
+        ssize_t n_read = pread(gdi_mount->track_fds[track_idx],
+                               outp, n_bytes, offset);
+        if (n_read < 0 && errno == EINTR)
+            continue;
+        if (n_read <= 0)
+            return -1;
+        outp += n_read;
+        offset += n_read;
+        n_bytes -= n_read;
+    }
 
-            return 0;
+    return 0;
+}
+
+static void const *mount_gdi_get_sector(struct mount *mount, void *buf,
+                                        unsigned fad) {
+    struct gdi_mount const *gdi_mount = (struct gdi_mount const*)mount->state;
+    unsigned track_idx;
+    size_t byte_offset;
+
+    if (gdi_find_sector(gdi_mount, fad, &track_idx, &byte_offset) != 0)
+        return NULL;
+
+    LOG_DBG("read 1 sector from track %u starting at byte %u\n",
+            track_idx + 1, (unsigned)byte_offset);
+
+    uint8_t const *map = gdi_mount->track_maps[track_idx];
+    if (map)
+        return map + byte_offset;
+
+    if (gdi_read_bytes(gdi_mount, track_idx, byte_offset,
+                       buf, CDROM_FRAME_DATA_SIZE) != 0)
+        return NULL;
+    return buf;
+}
+
+static int mount_read_sector(struct mount *mount, void *buf, unsigned fad) {
+    void const *dat = mount_gdi_get_sector(mount, buf, fad);
+    if (!dat)
+        return -1;
+    if (dat != buf)
+        memcpy(buf, dat, CDROM_FRAME_DATA_SIZE);
+    return 0;
+}
+
+static bool mount_gdi_has_sector(struct mount *mount, unsigned fad) {
+    struct gdi_mount const *gdi_mount = (struct gdi_mount const*)mount->state;
+    unsigned track_idx;
+    size_t byte_offset;
+
+    return gdi_find_sector(gdi_mount, fad, &track_idx, &byte_offset) == 0;
+}
+
+static void mount_gdi_prefetch(struct mount *mount, unsigned fad,
+                               unsigned n_sectors) {
+    struct gdi_mount *gdi_mount = (struct gdi_mount*)mount->state;
+    struct gdi_readahead *ra = &gdi_mount->readahead;
+
+    if (!ra->running)
+        return;
+
+    pthread_mutex_lock(&ra->lock);
+    ra->fad_first = fad;
+    ra->n_sectors = n_sectors + GDI_READAHEAD_SECTORS;
+    ra->pending = true;
+    pthread_cond_signal(&ra->cond);
+    pthread_mutex_unlock(&ra->lock);
+}
+
+static void gdi_readahead_init(struct gdi_mount *gdi_mount) {
+    struct gdi_readahead *ra = &gdi_mount->readahead;
+
+    if (pthread_mutex_init(&ra->lock, NULL) != 0 ||
+        pthread_cond_init(&ra->cond, NULL) != 0)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+
+    if (pthread_create(&ra->thread, NULL, gdi_readahead_main, gdi_mount) != 0) {
+        LOG_WARN("unable to create GD-ROM read-ahead thread\n");
+        pthread_cond_destroy(&ra->cond);
+        pthread_mutex_destroy(&ra->lock);
+        return;
+    }
+
+    ra->running = true;
+}
+
+static void gdi_readahead_cleanup(struct gdi_mount *gdi_mount) {
+    struct gdi_readahead *ra = &gdi_mount->readahead;
+
+    if (!ra->running)
+        return;
+
+    pthread_mutex_lock(&ra->lock);
+    ra->quit = true;
+    pthread_cond_signal(&ra->cond);
+    pthread_mutex_unlock(&ra->lock);
+
+    pthread_join(ra->thread, NULL);
+    pthread_cond_destroy(&ra->cond);
+    pthread_mutex_destroy(&ra->lock);
+    ra->running = false;
+}
+
+/*
+ * Pull the given sector into memory.  Mapped tracks get the sector's pages
+ * touched so that the emulation thread doesn't take the page fault, and
+ * everything else gets handed to the kernel as a read-ahead hint.
+ */
+static void gdi_readahead_sector(struct gdi_mount const *gdi_mount,
+                                 unsigned fad) {
+    unsigned track_idx;
+    size_t byte_offset;
+
+    if (gdi_find_sector(gdi_mount, fad, &track_idx, &byte_offset) != 0)
+        return;
+
+    uint8_t const *map = gdi_mount->track_maps[track_idx];
+    if (map) {
+        volatile uint8_t const *dat = map + byte_offset;
+        (void)dat[0];
+        (void)dat[CDROM_FRAME_DATA_SIZE - 1];
+    } else {
+#ifdef POSIX_FADV_WILLNEED
+        posix_fadvise(gdi_mount->track_fds[track_idx], byte_offset,
+                      CDROM_FRAME_DATA_SIZE, POSIX_FADV_WILLNEED);
+#endif
+    }
+}
+
+// how many sectors the read-ahead thread does between checking for new work
+#define GDI_READAHEAD_BATCH 16
+
+static void *gdi_readahead_main(void *arg) {
+    struct gdi_mount *gdi_mount = (struct gdi_mount*)arg;
+    struct gdi_readahead *ra = &gdi_mount->readahead;
+    unsigned fad = 0, n_sectors = 0;
+
+    pthread_mutex_lock(&ra->lock);
+    for (;;) {
+        while (!ra->quit && !ra->pending && !n_sectors)
+            pthread_cond_wait(&ra->cond, &ra->lock);
+
+        if (ra->quit)
+            break;
+
+        if (ra->pending) {
+            fad = ra->fad_first;
+            n_sectors = ra->n_sectors;
+            ra->pending = false;
         }
+
+        pthread_mutex_unlock(&ra->lock);
+
+        unsigned batch = n_sectors < GDI_READAHEAD_BATCH ?
+            n_sectors : GDI_READAHEAD_BATCH;
+        n_sectors -= batch;
+        while (batch--)
+            gdi_readahead_sector(gdi_mount, fad++);
+
+        pthread_mutex_lock(&ra->lock);
     }
+    pthread_mutex_unlock(&ra->lock);
 
-return_err:
-    return -1;
+    return NULL;
 }
 
 static int mount_gdi_get_meta(struct mount *mount, struct mount_meta *meta) {
@@ -407,25 +660,10 @@ static int mount_gdi_get_meta(struct mount *mount, struct mount_meta *meta) {
     if (info->n_tracks < 3)
         return -1;
 
-    if (fseek(gdi_mount->track_streams[2], 16, SEEK_SET))
-        return -1;
-
-    if (fread(buffer, sizeof(buffer), 1, gdi_mount->track_streams[2]) != 1)
+    if (gdi_read_bytes(gdi_mount, 2, 16, buffer, sizeof(buffer)) != 0)
         return -1;
 
-    memset(meta, 0, sizeof(*meta));
-
-    memcpy(meta->hardware, buffer, MOUNT_META_HARDWARE_LEN);
-    memcpy(meta->maker, buffer + 16, MOUNT_META_MAKER_LEN);
-    memcpy(meta->dev_info, buffer + 32, MOUNT_META_DEV_INFO_LEN);
-    memcpy(meta->region, buffer + 48, MOUNT_META_REGION_LEN);
-    memcpy(meta->periph_support, buffer + 56, MOUNT_META_PERIPH_LEN);
-    memcpy(meta->product_id, buffer + 64, MOUNT_META_PRODUCT_ID_LEN);
-    memcpy(meta->product_version, buffer + 74, MOUNT_META_PRODUCT_VERSION_LEN);
-    memcpy(meta->rel_date, buffer + 80, MOUNT_META_REL_DATE_LEN);
-    memcpy(meta->boot_file, buffer + 96, MOUNT_META_BOOT_FILE_LEN);
-    memcpy(meta->company, buffer + 112, MOUNT_META_COMPANY_LEN);
-    memcpy(meta->title, buffer + 128, MOUNT_META_TITLE_LEN);
+    mount_decode_meta(meta, buffer);
 
     return 0;
 }
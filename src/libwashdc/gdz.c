@@ -0,0 +1,667 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "zlib.h"
+
+#include "washdc/error.h"
+#include "mount.h"
+#include "cdrom.h"
+#include "log.h"
+
+#include "gdz.h"
+
+#define GDZ_HEADER_LEN 32
+#define GDZ_TRACK_ENT_LEN 16
+#define GDZ_HUNK_ENT_LEN 16
+
+// enforce sane limits on what the header can ask for
+#define GDZ_MIN_TRACKS 3
+#define GDZ_MAX_TRACKS 99
+#define GDZ_MAX_HUNK_SECTORS 1024
+
+// number of decompressed hunks that can be held in memory at once
+#define GDZ_CACHE_SLOTS 64
+
+// number of hunks past the one being read that get decompressed ahead of time
+#define GDZ_READAHEAD_HUNKS 8
+
+#define GDZ_N_WORKERS 2
+
+struct gdz_track {
+    unsigned fad_start;
+    unsigned ctrl;
+    unsigned n_sectors;
+    unsigned first_hunk;
+};
+
+struct gdz_hunk {
+    uint64_t offset;
+    uint32_t len;
+    uint32_t tp;
+
+    // length of the hunk once it's been decompressed
+    unsigned n_bytes;
+};
+
+enum gdz_slot_state {
+    GDZ_SLOT_EMPTY,
+
+    // waiting for a worker to decompress it
+    GDZ_SLOT_QUEUED,
+
+    // currently being decompressed
+    GDZ_SLOT_BUSY,
+
+    GDZ_SLOT_READY,
+
+    // the hunk couldn't be decompressed
+    GDZ_SLOT_ERROR
+};
+
+struct gdz_slot {
+    enum gdz_slot_state state;
+    unsigned hunk_no;
+    uint64_t last_used;
+    uint8_t *dat;
+};
+
+struct gdz_mount {
+    int fd;
+    unsigned hunk_sectors, n_tracks, n_hunks;
+    struct gdz_track *tracks;
+    struct gdz_hunk *hunks;
+
+    // the slot each hunk is in, or -1 if it isn't in the cache
+    int *hunk_slots;
+
+    struct gdz_slot slots[GDZ_CACHE_SLOTS];
+    uint64_t stamp;
+
+    /*
+     * the slot holding the sector most recently returned by get_sector.  This
+     * doesn't get evicted so that the pointer stays valid.
+     */
+    int pinned_slot;
+
+    // the hunk that read-ahead was last started from
+    unsigned readahead_hunk;
+
+    // ring of slots waiting for a worker
+    unsigned jobs[GDZ_CACHE_SLOTS];
+    unsigned job_first, n_jobs;
+
+    pthread_t workers[GDZ_N_WORKERS];
+    unsigned n_workers;
+
+    // everything above here is protected by the lock (except the file tables)
+    pthread_mutex_t lock;
+    pthread_cond_t job_cond, done_cond;
+    bool quit;
+};
+
+static void mount_gdz_cleanup(struct mount *mount);
+static unsigned mount_gdz_session_count(struct mount *mount);
+static int mount_gdz_read_toc(struct mount *mount, struct mount_toc *toc,
+                              unsigned session_no);
+static int mount_gdz_read_sector(struct mount *mount, void *buf, unsigned fad);
+static void const *mount_gdz_get_sector(struct mount *mount, void *buf,
+                                        unsigned fad);
+static bool mount_gdz_has_sector(struct mount *mount, unsigned fad);
+static void mount_gdz_prefetch(struct mount *mount, unsigned fad,
+                               unsigned n_sectors);
+static int mount_gdz_get_meta(struct mount *mount, struct mount_meta *meta);
+
+static struct mount_ops gdz_mount_ops = {
+    .session_count = mount_gdz_session_count,
+    .read_toc = mount_gdz_read_toc,
+    .read_sector = mount_gdz_read_sector,
+    .get_sector = mount_gdz_get_sector,
+    .has_sector = mount_gdz_has_sector,
+    .prefetch = mount_gdz_prefetch,
+    .cleanup = mount_gdz_cleanup,
+    .get_meta = mount_gdz_get_meta
+};
+
+static int gdz_pread(int fd, void *buf, size_t n_bytes, uint64_t offset);
+static int gdz_find_sector(struct gdz_mount const *gdz, unsigned fad,
+                           unsigned *hunk_no_out, unsigned *offset_out);
+static int gdz_decompress(struct gdz_mount const *gdz, unsigned hunk_no,
+                          uint8_t *dst);
+static int gdz_alloc_slot(struct gdz_mount *gdz);
+static void gdz_queue_hunk(struct gdz_mount *gdz, unsigned hunk_no);
+static int gdz_get_hunk(struct gdz_mount *gdz, unsigned hunk_no);
+static void *gdz_worker_main(void *arg);
+
+static inline uint32_t gdz_le32(uint8_t const *dat) {
+    return (uint32_t)dat[0] | ((uint32_t)dat[1] << 8) |
+        ((uint32_t)dat[2] << 16) | ((uint32_t)dat[3] << 24);
+}
+
+static inline uint64_t gdz_le64(uint8_t const *dat) {
+    return (uint64_t)gdz_le32(dat) | ((uint64_t)gdz_le32(dat + 4) << 32);
+}
+
+bool gdz_probe(char const *path) {
+    char magic[sizeof(GDZ_MAGIC)];
+    FILE *stream = fopen(path, "rb");
+    if (!stream)
+        return false;
+
+    bool match = fread(magic, sizeof(magic), 1, stream) == 1 &&
+        memcmp(magic, GDZ_MAGIC, sizeof(magic)) == 0;
+    fclose(stream);
+    return match;
+}
+
+void mount_gdz(char const *path) {
+    uint8_t header[GDZ_HEADER_LEN];
+
+    struct gdz_mount *gdz =
+        (struct gdz_mount*)calloc(1, sizeof(struct gdz_mount));
+    if (!gdz)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+
+    gdz->fd = open(path, O_RDONLY);
+    if (gdz->fd < 0) {
+        error_set_file_path(path);
+        error_set_errno_val(errno);
+        RAISE_ERROR(ERROR_FILE_IO);
+    }
+
+    if (gdz_pread(gdz->fd, header, sizeof(header), 0) != 0) {
+        error_set_file_path(path);
+        RAISE_ERROR(ERROR_FILE_IO);
+    }
+
+    if (memcmp(header, GDZ_MAGIC, sizeof(GDZ_MAGIC)) != 0 ||
+        gdz_le32(header + 8) != GDZ_VERSION) {
+        error_set_file_path(path);
+        RAISE_ERROR(ERROR_INVALID_PARAM);
+    }
+
+    gdz->hunk_sectors = gdz_le32(header + 12);
+    gdz->n_tracks = gdz_le32(header + 16);
+    gdz->n_hunks = gdz_le32(header + 20);
+    uint64_t hunk_tbl_offs = gdz_le64(header + 24);
+
+    if (!gdz->hunk_sectors || gdz->hunk_sectors > GDZ_MAX_HUNK_SECTORS) {
+        error_set_file_path(path);
+        error_set_param_name("sectors per hunk");
+        error_set_max_val(GDZ_MAX_HUNK_SECTORS);
+        RAISE_ERROR(ERROR_TOO_BIG);
+    }
+
+    if (gdz->n_tracks < GDZ_MIN_TRACKS) {
+        error_set_file_path(path);
+        error_set_param_name("track_count");
+        RAISE_ERROR(ERROR_TOO_SMALL);
+    }
+
+    if (gdz->n_tracks > GDZ_MAX_TRACKS) {
+        error_set_file_path(path);
+        error_set_param_name("track_count");
+        error_set_max_val(GDZ_MAX_TRACKS);
+        RAISE_ERROR(ERROR_TOO_BIG);
+    }
+
+    size_t track_tbl_len = (size_t)gdz->n_tracks * GDZ_TRACK_ENT_LEN;
+    size_t hunk_tbl_len = (size_t)gdz->n_hunks * GDZ_HUNK_ENT_LEN;
+    uint8_t *track_tbl = (uint8_t*)malloc(track_tbl_len);
+    uint8_t *hunk_tbl = (uint8_t*)malloc(hunk_tbl_len ? hunk_tbl_len : 1);
+    gdz->tracks = (struct gdz_track*)calloc(gdz->n_tracks,
+                                            sizeof(struct gdz_track));
+    gdz->hunks = (struct gdz_hunk*)calloc(gdz->n_hunks + 1,
+                                          sizeof(struct gdz_hunk));
+    gdz->hunk_slots = (int*)malloc((gdz->n_hunks + 1) * sizeof(int));
+    if (!track_tbl || !hunk_tbl || !gdz->tracks || !gdz->hunks ||
+        !gdz->hunk_slots)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+
+    if (gdz_pread(gdz->fd, track_tbl, track_tbl_len, GDZ_HEADER_LEN) != 0 ||
+        gdz_pread(gdz->fd, hunk_tbl, hunk_tbl_len, hunk_tbl_offs) != 0) {
+        error_set_file_path(path);
+        RAISE_ERROR(ERROR_FILE_IO);
+    }
+
+    unsigned hunk_no;
+    for (hunk_no = 0; hunk_no < gdz->n_hunks; hunk_no++) {
+        uint8_t const *ent = hunk_tbl + hunk_no * GDZ_HUNK_ENT_LEN;
+        gdz->hunks[hunk_no].offset = gdz_le64(ent);
+        gdz->hunks[hunk_no].len = gdz_le32(ent + 8);
+        gdz->hunks[hunk_no].tp = gdz_le32(ent + 12);
+        gdz->hunk_slots[hunk_no] = -1;
+    }
+
+    unsigned track_no;
+    for (track_no = 0; track_no < gdz->n_tracks; track_no++) {
+        uint8_t const *ent = track_tbl + track_no * GDZ_TRACK_ENT_LEN;
+        struct gdz_track *track = gdz->tracks + track_no;
+        track->fad_start = gdz_le32(ent);
+        track->ctrl = gdz_le32(ent + 4);
+        track->n_sectors = gdz_le32(ent + 8);
+        track->first_hunk = gdz_le32(ent + 12);
+
+        unsigned n_hunks = (track->n_sectors + gdz->hunk_sectors - 1) /
+            gdz->hunk_sectors;
+        if (track->first_hunk > gdz->n_hunks ||
+            n_hunks > gdz->n_hunks - track->first_hunk) {
+            error_set_file_path(path);
+            error_set_param_name("track hunk range");
+            RAISE_ERROR(ERROR_INVALID_PARAM);
+        }
+
+        unsigned sectors_left = track->n_sectors;
+        for (hunk_no = track->first_hunk;
+             hunk_no < track->first_hunk + n_hunks; hunk_no++) {
+            unsigned n_sectors = sectors_left < gdz->hunk_sectors ?
+                sectors_left : gdz->hunk_sectors;
+            gdz->hunks[hunk_no].n_bytes = n_sectors * CDROM_FRAME_DATA_SIZE;
+            sectors_left -= n_sectors;
+        }
+    }
+
+    free(hunk_tbl);
+    free(track_tbl);
+
+    size_t hunk_bytes = (size_t)gdz->hunk_sectors * CDROM_FRAME_DATA_SIZE;
+    unsigned slot_no;
+    for (slot_no = 0; slot_no < GDZ_CACHE_SLOTS; slot_no++) {
+        gdz->slots[slot_no].state = GDZ_SLOT_EMPTY;
+        if (!(gdz->slots[slot_no].dat = (uint8_t*)malloc(hunk_bytes)))
+            RAISE_ERROR(ERROR_FAILED_ALLOC);
+    }
+    gdz->pinned_slot = -1;
+    gdz->readahead_hunk = gdz->n_hunks;
+
+    if (pthread_mutex_init(&gdz->lock, NULL) != 0 ||
+        pthread_cond_init(&gdz->job_cond, NULL) != 0 ||
+        pthread_cond_init(&gdz->done_cond, NULL) != 0)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+
+    unsigned idx;
+    for (idx = 0; idx < GDZ_N_WORKERS; idx++) {
+        if (pthread_create(gdz->workers + gdz->n_workers, NULL,
+                           gdz_worker_main, gdz) != 0) {
+            LOG_WARN("unable to create .gdz decompression thread\n");
+            break;
+        }
+        gdz->n_workers++;
+    }
+
+    LOG_INFO("mounted %s: %u tracks, %u hunks of %u sectors\n",
+             path, gdz->n_tracks, gdz->n_hunks, gdz->hunk_sectors);
+
+    mount_insert(&gdz_mount_ops, gdz);
+}
+
+static void mount_gdz_cleanup(struct mount *mount) {
+    struct gdz_mount *gdz = (struct gdz_mount*)mount->state;
+
+    pthread_mutex_lock(&gdz->lock);
+    gdz->quit = true;
+    pthread_cond_broadcast(&gdz->job_cond);
+    pthread_mutex_unlock(&gdz->lock);
+
+    unsigned idx;
+    for (idx = 0; idx < gdz->n_workers; idx++)
+        pthread_join(gdz->workers[idx], NULL);
+
+    pthread_cond_destroy(&gdz->done_cond);
+    pthread_cond_destroy(&gdz->job_cond);
+    pthread_mutex_destroy(&gdz->lock);
+
+    for (idx = 0; idx < GDZ_CACHE_SLOTS; idx++)
+        free(gdz->slots[idx].dat);
+    free(gdz->hunk_slots);
+    free(gdz->hunks);
+    free(gdz->tracks);
+    close(gdz->fd);
+    free(gdz);
+}
+
+static int gdz_pread(int fd, void *buf, size_t n_bytes, uint64_t offset) {
+    uint8_t *outp = (uint8_t*)buf;
+    while (n_bytes) {
+        ssize_t n_read = pread(fd, outp, n_bytes, offset);
+        if (n_read < 0 && errno == EINTR)
+            continue;
+        if (n_read <= 0)
+            return -1;
+        outp += n_read;
+        offset += n_read;
+        n_bytes -= n_read;
+    }
+    return 0;
+}
+
+static int gdz_find_sector(struct gdz_mount const *gdz, unsigned fad,
+                           unsigned *hunk_no_out, unsigned *offset_out) {
+    unsigned track_no;
+    for (track_no = 0; track_no < gdz->n_tracks; track_no++) {
+        struct gdz_track const *track = gdz->tracks + track_no;
+        if (fad >= track->fad_start &&
+            fad < track->fad_start + track->n_sectors) {
+            unsigned fad_relative = fad - track->fad_start;
+            *hunk_no_out = track->first_hunk +
+                fad_relative / gdz->hunk_sectors;
+            *offset_out = (fad_relative % gdz->hunk_sectors) *
+                CDROM_FRAME_DATA_SIZE;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// this gets called without the lock held, so it only uses the file tables
+static int gdz_decompress(struct gdz_mount const *gdz, unsigned hunk_no,
+                          uint8_t *dst) {
+    struct gdz_hunk const *hunk = gdz->hunks + hunk_no;
+
+    if (!hunk->n_bytes)
+        return -1;
+
+    if (hunk->tp == GDZ_HUNK_RAW) {
+        if (hunk->len != hunk->n_bytes)
+            return -1;
+        return gdz_pread(gdz->fd, dst, hunk->n_bytes, hunk->offset);
+    }
+
+    if (hunk->tp != GDZ_HUNK_ZLIB)
+        return -1;
+
+    uint8_t *src = (uint8_t*)malloc(hunk->len ? hunk->len : 1);
+    if (!src)
+        return -1;
+
+    int ret = -1;
+    if (gdz_pread(gdz->fd, src, hunk->len, hunk->offset) == 0) {
+        uLongf dst_len = hunk->n_bytes;
+        if (uncompress(dst, &dst_len, src, hunk->len) == Z_OK &&
+            dst_len == hunk->n_bytes)
+            ret = 0;
+    }
+
+    free(src);
+
+    if (ret != 0)
+        LOG_ERROR("failed to decompress .gdz hunk %u\n", hunk_no);
+    return ret;
+}
+
+/*
+ * find a slot for a new hunk, evicting the least-recently-used hunk if
+ * necessary.  Returns -1 if every slot is in use.  Call with the lock held.
+ */
+static int gdz_alloc_slot(struct gdz_mount *gdz) {
+    int lru_slot = -1;
+
+    unsigned slot_no;
+    for (slot_no = 0; slot_no < GDZ_CACHE_SLOTS; slot_no++) {
+        struct gdz_slot *slot = gdz->slots + slot_no;
+        if (slot->state == GDZ_SLOT_EMPTY)
+            return slot_no;
+        if ((slot->state == GDZ_SLOT_READY ||
+             slot->state == GDZ_SLOT_ERROR) &&
+            (int)slot_no != gdz->pinned_slot &&
+            (lru_slot < 0 ||
+             slot->last_used < gdz->slots[lru_slot].last_used))
+            lru_slot = slot_no;
+    }
+
+    if (lru_slot >= 0) {
+        struct gdz_slot *slot = gdz->slots + lru_slot;
+        gdz->hunk_slots[slot->hunk_no] = -1;
+        slot->state = GDZ_SLOT_EMPTY;
+    }
+
+    return lru_slot;
+}
+
+// hand the given hunk to a worker if it isn't cached yet.  Call with the lock held.
+static void gdz_queue_hunk(struct gdz_mount *gdz, unsigned hunk_no) {
+    if (!gdz->n_workers || hunk_no >= gdz->n_hunks ||
+        !gdz->hunks[hunk_no].n_bytes || gdz->hunk_slots[hunk_no] >= 0)
+        return;
+
+    int slot_no = gdz_alloc_slot(gdz);
+    if (slot_no < 0)
+        return;
+
+    struct gdz_slot *slot = gdz->slots + slot_no;
+    slot->state = GDZ_SLOT_QUEUED;
+    slot->hunk_no = hunk_no;
+    slot->last_used = ++gdz->stamp;
+    gdz->hunk_slots[hunk_no] = slot_no;
+
+    gdz->jobs[(gdz->job_first + gdz->n_jobs++) % GDZ_CACHE_SLOTS] = slot_no;
+    pthread_cond_signal(&gdz->job_cond);
+}
+
+/*
+ * return the slot holding the given hunk, decompressing it on this thread if
+ * no worker has gotten to it yet.  Returns -1 if the hunk can't be
+ * decompressed.  Call with the lock held.
+ */
+static int gdz_get_hunk(struct gdz_mount *gdz, unsigned hunk_no) {
+    for (;;) {
+        int slot_no = gdz->hunk_slots[hunk_no];
+
+        if (slot_no < 0) {
+            slot_no = gdz_alloc_slot(gdz);
+            if (slot_no < 0) {
+                // every slot is being decompressed; wait for one to finish
+                pthread_cond_wait(&gdz->done_cond, &gdz->lock);
+                continue;
+            }
+            gdz->slots[slot_no].state = GDZ_SLOT_QUEUED;
+            gdz->slots[slot_no].hunk_no = hunk_no;
+            gdz->hunk_slots[hunk_no] = slot_no;
+        }
+
+        struct gdz_slot *slot = gdz->slots + slot_no;
+        switch (slot->state) {
+        case GDZ_SLOT_READY:
+            slot->last_used = ++gdz->stamp;
+            return slot_no;
+        case GDZ_SLOT_ERROR:
+            // forget about it so that the next access tries again
+            slot->state = GDZ_SLOT_EMPTY;
+            gdz->hunk_slots[hunk_no] = -1;
+            return -1;
+        case GDZ_SLOT_BUSY:
+            pthread_cond_wait(&gdz->done_cond, &gdz->lock);
+            break;
+        case GDZ_SLOT_QUEUED:
+            // don't wait for a worker to get around to it
+            slot->state = GDZ_SLOT_BUSY;
+            pthread_mutex_unlock(&gdz->lock);
+            int err = gdz_decompress(gdz, hunk_no, slot->dat);
+            pthread_mutex_lock(&gdz->lock);
+            slot->state = err ? GDZ_SLOT_ERROR : GDZ_SLOT_READY;
+            pthread_cond_broadcast(&gdz->done_cond);
+            break;
+        default:
+            RAISE_ERROR(ERROR_INTEGRITY);
+        }
+    }
+}
+
+static void *gdz_worker_main(void *arg) {
+    struct gdz_mount *gdz = (struct gdz_mount*)arg;
+
+    pthread_mutex_lock(&gdz->lock);
+    for (;;) {
+        while (!gdz->quit && !gdz->n_jobs)
+            pthread_cond_wait(&gdz->job_cond, &gdz->lock);
+
+        if (gdz->quit)
+            break;
+
+        struct gdz_slot *slot = gdz->slots + gdz->jobs[gdz->job_first];
+        gdz->job_first = (gdz->job_first + 1) % GDZ_CACHE_SLOTS;
+        gdz->n_jobs--;
+
+        // the emulation thread may have already taken care of it
+        if (slot->state != GDZ_SLOT_QUEUED)
+            continue;
+
+        slot->state = GDZ_SLOT_BUSY;
+        unsigned hunk_no = slot->hunk_no;
+        pthread_mutex_unlock(&gdz->lock);
+
+        int err = gdz_decompress(gdz, hunk_no, slot->dat);
+
+        pthread_mutex_lock(&gdz->lock);
+        slot->state = err ? GDZ_SLOT_ERROR : GDZ_SLOT_READY;
+        pthread_cond_broadcast(&gdz->done_cond);
+    }
+    pthread_mutex_unlock(&gdz->lock);
+
+    return NULL;
+}
+
+static void const *mount_gdz_get_sector(struct mount *mount, void *buf,
+                                        unsigned fad) {
+    struct gdz_mount *gdz = (struct gdz_mount*)mount->state;
+    unsigned hunk_no, offset;
+
+    if (gdz_find_sector(gdz, fad, &hunk_no, &offset) != 0)
+        return NULL;
+
+    pthread_mutex_lock(&gdz->lock);
+
+    int slot_no = gdz_get_hunk(gdz, hunk_no);
+    if (slot_no < 0) {
+        pthread_mutex_unlock(&gdz->lock);
+        return NULL;
+    }
+    gdz->pinned_slot = slot_no;
+
+    // keep the workers ahead of the read cursor
+    if (hunk_no != gdz->readahead_hunk) {
+        unsigned idx;
+        for (idx = 1; idx <= GDZ_READAHEAD_HUNKS; idx++)
+            gdz_queue_hunk(gdz, hunk_no + idx);
+        gdz->readahead_hunk = hunk_no;
+    }
+
+    pthread_mutex_unlock(&gdz->lock);
+
+    return gdz->slots[slot_no].dat + offset;
+}
+
+static int mount_gdz_read_sector(struct mount *mount, void *buf, unsigned fad) {
+    void const *dat = mount_gdz_get_sector(mount, buf, fad);
+    if (!dat)
+        return -1;
+    memcpy(buf, dat, CDROM_FRAME_DATA_SIZE);
+    return 0;
+}
+
+static bool mount_gdz_has_sector(struct mount *mount, unsigned fad) {
+    struct gdz_mount const *gdz = (struct gdz_mount const*)mount->state;
+    unsigned hunk_no, offset;
+    return gdz_find_sector(gdz, fad, &hunk_no, &offset) == 0;
+}
+
+static void mount_gdz_prefetch(struct mount *mount, unsigned fad,
+                               unsigned n_sectors) {
+    struct gdz_mount *gdz = (struct gdz_mount*)mount->state;
+    unsigned hunk_first, hunk_last, offset;
+
+    if (!n_sectors || gdz_find_sector(gdz, fad, &hunk_first, &offset) != 0)
+        return;
+    if (gdz_find_sector(gdz, fad + n_sectors - 1, &hunk_last, &offset) != 0 ||
+        hunk_last < hunk_first)
+        hunk_last = hunk_first;
+
+    // don't let one big read push everything else out of the cache
+    hunk_last += GDZ_READAHEAD_HUNKS;
+    if (hunk_last - hunk_first >= GDZ_CACHE_SLOTS / 2)
+        hunk_last = hunk_first + GDZ_CACHE_SLOTS / 2 - 1;
+
+    pthread_mutex_lock(&gdz->lock);
+    unsigned hunk_no;
+    for (hunk_no = hunk_first; hunk_no <= hunk_last; hunk_no++)
+        gdz_queue_hunk(gdz, hunk_no);
+    pthread_mutex_unlock(&gdz->lock);
+}
+
+static unsigned mount_gdz_session_count(struct mount *mount) {
+    return 2;
+}
+
+static int mount_gdz_read_toc(struct mount *mount, struct mount_toc *toc,
+                              unsigned session_no) {
+    struct gdz_mount const *gdz = (struct gdz_mount const*)mount->state;
+
+    // GD-ROM disks have two sessions
+    if (session_no > 1)
+        return -1;
+
+    memset(toc->tracks, 0, sizeof(toc->tracks));
+
+    // session 0 contains the first two tracks, session 1 has the rest
+    unsigned first_track = session_no == 0 ? 1 : 3;
+    unsigned last_track = session_no == 0 ? 2 : gdz->n_tracks;
+
+    unsigned track_no;
+    for (track_no = first_track; track_no <= last_track; track_no++) {
+        toc->tracks[track_no - 1].fad = gdz->tracks[track_no - 1].fad_start;
+        toc->tracks[track_no - 1].adr = 1;
+        toc->tracks[track_no - 1].ctrl = gdz->tracks[track_no - 1].ctrl;
+        toc->tracks[track_no - 1].valid = true;
+    }
+
+    toc->first_track = first_track;
+    toc->last_track = last_track;
+
+    struct gdz_track const *last = gdz->tracks + (last_track - 1);
+    toc->leadout = last->fad_start + last->n_sectors;
+    toc->leadout_adr = 1;
+
+    return 0;
+}
+
+static int mount_gdz_get_meta(struct mount *mount, struct mount_meta *meta) {
+    struct gdz_mount const *gdz = (struct gdz_mount const*)mount->state;
+    uint8_t sector[CDROM_FRAME_DATA_SIZE];
+
+    if (gdz->n_tracks < 3)
+        return -1;
+
+    if (mount_gdz_read_sector(mount, sector, gdz->tracks[2].fad_start) != 0)
+        return -1;
+
+    mount_decode_meta(meta, sector);
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+/*
+ * .gdz - hunk-compressed GD-ROM images
+ *
+ * A .gdz holds the same 2048-byte user-data sectors that WashingtonDC reads
+ * out of a .gdi's track files, split up into fixed-size hunks which are each
+ * compressed with zlib.  tool/gdi2gdz.py converts a .gdi into a .gdz.
+ *
+ * All integers are little-endian.  The file starts with this header:
+ *
+ *     offset  size  field
+ *     0       8     magic, "WASHGDZ\0"
+ *     8       4     version (GDZ_VERSION)
+ *     12      4     number of sectors per hunk
+ *     16      4     number of tracks
+ *     20      4     number of hunks
+ *     24      8     offset of the hunk table
+ *
+ * followed immediately by the track table, which has 16 bytes for each track:
+ *
+ *     0       4     FAD of the track's first sector
+ *     4       4     ctrl (the same value that's in the .gdi)
+ *     8       4     number of sectors in the track
+ *     12      4     index of the track's first hunk
+ *
+ * Hunks never span more than one track, so the last hunk of a track may have
+ * fewer sectors than the others.  The hunk table has 16 bytes for each hunk:
+ *
+ *     0       8     offset of the hunk's data
+ *     8       4     length of the hunk's data
+ *     12      4     GDZ_HUNK_ZLIB if the data is a zlib stream, or
+ *                   GDZ_HUNK_RAW if it's stored uncompressed
+ *
+ * Only cooked sectors are stored, so audio tracks and the CD-ROM headers
+ * aren't preserved.
+ */
+
+#ifndef GDZ_H_
+#define GDZ_H_
+
+#include <stdbool.h>
+
+#define GDZ_MAGIC "WASHGDZ"
+#define GDZ_VERSION 1
+
+#define GDZ_HUNK_ZLIB 0
+#define GDZ_HUNK_RAW 1
+
+// return true if the given file looks like a .gdz
+bool gdz_probe(char const *path);
+
+void mount_gdz(char const *path);
+
+#endif
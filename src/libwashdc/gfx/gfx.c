@@ -82,16 +82,21 @@ void gfx_resize(int xres, int yres) {
 }
 
 static void gfx_do_init(void) {
+    bool headless = config_get_headless();
+
     win_make_context_current();
 
-    glewExperimental = GL_TRUE;
-    glewInit();
-    glViewport(0, 0, win_width, win_height);
+    if (!headless) {
+        glewExperimental = GL_TRUE;
+        glewInit();
+        glViewport(0, 0, win_width, win_height);
+    }
 
     gfx_tex_cache_init();
     rend_init();
 
-    glClear(GL_COLOR_BUFFER_BIT);
+    if (!headless)
+        glClear(GL_COLOR_BUFFER_BIT);
 }
 
 void gfx_post_framebuffer(int obj_handle,
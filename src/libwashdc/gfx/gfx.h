@@ -24,25 +24,32 @@
 #define GFX_THREAD_H_
 
 #include <assert.h>
+#include <stdint.h>
 
 #include "gfx/gfx_tex_cache.h"
 #include "washdc/washdc.h"
 
 /*
- * offsets to vertex components within the vert array.
- * these are in terms of sizeof(float)
+ * vertex format used between the TA and the rendering backends.  Positions
+ * and texture coordinates need full precision, but PVR2 only has 8 bits per
+ * color channel so the colors are stored as packed RGBA bytes.  This keeps
+ * each vertex at 28 bytes.
  */
-#define GFX_VERT_POS_OFFSET 0
-#define GFX_VERT_BASE_COLOR_OFFSET 3
-#define GFX_VERT_OFFS_COLOR_OFFSET 7
-#define GFX_VERT_TEX_COORD_OFFSET 11
+struct gfx_vert {
+    float pos[3];
+    float tex_coord[2];
+    uint8_t base_color[4];
+    uint8_t offs_color[4];
+};
+
+static_assert(sizeof(struct gfx_vert) == 28,
+              "struct gfx_vert is not tightly packed");
 
 /*
- * the number of elements per vertex.  Currently this means 3 floats for the
- * coordinates, 4 floats for the base color, 4 floats for the offset color and
- * two floats for the texture coordinates
+ * index which terminates a triangle strip in a draw_array's index list.  The
+ * next index after this starts a new strip.
  */
-#define GFX_VERT_LEN 13
+#define GFX_PRIM_RESTART 0xffffffff
 
 /*
  * how to combine a polygon's vertex color with a texture
@@ -0,0 +1,274 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "washdc/error.h"
+#include "gfx/gfx.h"
+
+#include "gfx_depth_sort.h"
+
+#define GFX_DEPTH_SORT_MIN_ALLOC 256
+
+static void grow_groups(struct gfx_depth_sort *sort, unsigned n_groups);
+static void grow_tris(struct gfx_depth_sort *sort, unsigned n_tris);
+static void radix_sort(struct gfx_depth_sort *sort);
+
+void gfx_depth_sort_init(struct gfx_depth_sort *sort) {
+    memset(sort, 0, sizeof(*sort));
+}
+
+void gfx_depth_sort_cleanup(struct gfx_depth_sort *sort) {
+    free(sort->groups);
+    free(sort->tri_order);
+    free(sort->tri_group);
+    free(sort->tri_idx);
+    free(sort->keys);
+    free(sort->keys_tmp);
+    free(sort->order_tmp);
+    memset(sort, 0, sizeof(*sort));
+}
+
+void gfx_depth_sort_begin(struct gfx_depth_sort *sort,
+                          enum gfx_depth_sort_mode mode) {
+    sort->mode = mode;
+    sort->n_groups = 0;
+    sort->n_verts = 0;
+    sort->n_tris = 0;
+}
+
+// returns the number of triangles in a list of strips
+static unsigned count_strip_tris(uint32_t const *indices, unsigned n_indices) {
+    unsigned n_tris = 0, strip_len = 0, idx;
+    for (idx = 0; idx < n_indices; idx++) {
+        if (indices[idx] == GFX_PRIM_RESTART) {
+            strip_len = 0;
+        } else if (++strip_len >= 3) {
+            n_tris++;
+        }
+    }
+    return n_tris;
+}
+
+void gfx_depth_sort_add(struct gfx_depth_sort *sort,
+                        struct gfx_rend_param const *param,
+                        struct gfx_vert const *verts, unsigned n_verts,
+                        uint32_t const *indices, unsigned n_indices) {
+    unsigned n_tris = count_strip_tris(indices, n_indices);
+    if (!n_tris)
+        return;
+
+    if (sort->n_groups >= sort->groups_alloc)
+        grow_groups(sort, sort->n_groups + 1);
+
+    struct gfx_depth_sort_group *grp = sort->groups + sort->n_groups++;
+    grp->verts = verts;
+    grp->n_verts = n_verts;
+    grp->indices = indices;
+    grp->n_indices = n_indices;
+    grp->first_vert = sort->n_verts;
+    grp->rend_param = *param;
+
+    sort->n_verts += n_verts;
+    sort->n_tris += n_tris;
+}
+
+/*
+ * maps a float onto a uint32_t such that the unsigned ordering of the output
+ * matches the ordering of the input.  The result is then inverted because
+ * larger depth values are farther away and they need to be drawn first.
+ */
+static inline uint32_t depth_key(float depth) {
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    if (bits & 0x80000000)
+        bits = ~bits;
+    else
+        bits |= 0x80000000;
+    return ~bits;
+}
+
+void gfx_depth_sort_finish(struct gfx_depth_sort *sort) {
+    if (!sort->n_tris)
+        return;
+
+    if (sort->n_tris > sort->tris_alloc)
+        grow_tris(sort, sort->n_tris);
+
+    unsigned grp_no, tri_no = 0;
+    for (grp_no = 0; grp_no < sort->n_groups; grp_no++) {
+        struct gfx_depth_sort_group const *grp = sort->groups + grp_no;
+        struct gfx_vert const *verts = grp->verts;
+        uint32_t const *indices = grp->indices;
+        uint32_t group_key = 0;
+        unsigned idx, strip_len = 0;
+
+        if (sort->mode == GFX_DEPTH_SORT_PER_GROUP) {
+            float avg_depth = 0.0f;
+            for (idx = 0; idx < grp->n_verts; idx++)
+                avg_depth += verts[idx].pos[2];
+            group_key = depth_key(avg_depth / grp->n_verts);
+        }
+
+        for (idx = 0; idx < grp->n_indices; idx++) {
+            if (indices[idx] == GFX_PRIM_RESTART) {
+                strip_len = 0;
+                continue;
+            }
+            if (++strip_len < 3)
+                continue;
+
+            uint32_t v0 = indices[idx - 2];
+            uint32_t v1 = indices[idx - 1];
+            uint32_t v2 = indices[idx];
+            if (!(strip_len & 1)) {
+                uint32_t tmp = v0;
+                v0 = v1;
+                v1 = tmp;
+            }
+
+            if (sort->mode == GFX_DEPTH_SORT_PER_GROUP) {
+                sort->keys[tri_no] = group_key;
+            } else {
+                float avg_depth = (verts[v0].pos[2] + verts[v1].pos[2] +
+                                   verts[v2].pos[2]) / 3.0f;
+                sort->keys[tri_no] = depth_key(avg_depth);
+            }
+
+            uint32_t *tri_idx = sort->tri_idx + 3 * tri_no;
+            tri_idx[0] = grp->first_vert + v0;
+            tri_idx[1] = grp->first_vert + v1;
+            tri_idx[2] = grp->first_vert + v2;
+            sort->tri_order[tri_no] = tri_no;
+            sort->tri_group[tri_no] = grp_no;
+            tri_no++;
+        }
+    }
+
+    radix_sort(sort);
+}
+
+bool gfx_rend_param_equal(struct gfx_rend_param const *lhs,
+                          struct gfx_rend_param const *rhs) {
+    if (lhs->tex_enable != rhs->tex_enable)
+        return false;
+    if (lhs->tex_enable &&
+        (lhs->tex_idx != rhs->tex_idx ||
+         lhs->tex_inst != rhs->tex_inst ||
+         lhs->tex_filter != rhs->tex_filter ||
+         lhs->tex_wrap_mode[0] != rhs->tex_wrap_mode[0] ||
+         lhs->tex_wrap_mode[1] != rhs->tex_wrap_mode[1]))
+        return false;
+    return lhs->src_blend_factor == rhs->src_blend_factor &&
+        lhs->dst_blend_factor == rhs->dst_blend_factor &&
+        lhs->enable_depth_writes == rhs->enable_depth_writes &&
+        lhs->depth_func == rhs->depth_func &&
+        lhs->pt_mode == rhs->pt_mode &&
+        (!lhs->pt_mode || lhs->pt_ref == rhs->pt_ref) &&
+        lhs->shadow == rhs->shadow;
+}
+
+/*
+ * LSD radix sort on 8-bit digits.  Passes where every key has the same digit
+ * are skipped, which is common for the exponent byte since most of a frame's
+ * translucent polygons tend to sit within the same power-of-two depth range.
+ */
+static void radix_sort(struct gfx_depth_sort *sort) {
+    unsigned n_tris = sort->n_tris;
+    unsigned shift;
+
+    for (shift = 0; shift < 32; shift += 8) {
+        uint32_t const *keys_in = sort->keys;
+        uint32_t *keys_out = sort->keys_tmp;
+        unsigned const *order_in = sort->tri_order;
+        unsigned *order_out = sort->order_tmp;
+        unsigned hist[256];
+        unsigned idx;
+
+        memset(hist, 0, sizeof(hist));
+        for (idx = 0; idx < n_tris; idx++)
+            hist[(keys_in[idx] >> shift) & 0xff]++;
+
+        if (hist[(keys_in[0] >> shift) & 0xff] == n_tris)
+            continue;
+
+        unsigned sum = 0;
+        for (idx = 0; idx < 256; idx++) {
+            unsigned cnt = hist[idx];
+            hist[idx] = sum;
+            sum += cnt;
+        }
+
+        for (idx = 0; idx < n_tris; idx++) {
+            unsigned dst = hist[(keys_in[idx] >> shift) & 0xff]++;
+            keys_out[dst] = keys_in[idx];
+            order_out[dst] = order_in[idx];
+        }
+
+        // ping-pong the buffers so that the output is always in tri_order
+        uint32_t *tmp_keys = sort->keys;
+        sort->keys = sort->keys_tmp;
+        sort->keys_tmp = tmp_keys;
+
+        unsigned *tmp_order = sort->tri_order;
+        sort->tri_order = sort->order_tmp;
+        sort->order_tmp = tmp_order;
+    }
+}
+
+static void grow_groups(struct gfx_depth_sort *sort, unsigned n_groups) {
+    unsigned alloc = sort->groups_alloc ?
+        sort->groups_alloc : GFX_DEPTH_SORT_MIN_ALLOC;
+    while (alloc < n_groups)
+        alloc *= 2;
+
+    struct gfx_depth_sort_group *groups =
+        (struct gfx_depth_sort_group*)realloc(sort->groups,
+                                              alloc * sizeof(*groups));
+    if (!groups)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    sort->groups = groups;
+    sort->groups_alloc = alloc;
+}
+
+static void *grow_array(void *ptr, size_t n_bytes) {
+    void *ret = realloc(ptr, n_bytes);
+    if (!ret)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    return ret;
+}
+
+static void grow_tris(struct gfx_depth_sort *sort, unsigned n_tris) {
+    unsigned alloc = sort->tris_alloc ?
+        sort->tris_alloc : GFX_DEPTH_SORT_MIN_ALLOC;
+    while (alloc < n_tris)
+        alloc *= 2;
+
+    sort->tri_order = grow_array(sort->tri_order, alloc * sizeof(unsigned));
+    sort->tri_group = grow_array(sort->tri_group, alloc * sizeof(unsigned));
+    sort->tri_idx = grow_array(sort->tri_idx, 3 * alloc * sizeof(uint32_t));
+    sort->order_tmp = grow_array(sort->order_tmp, alloc * sizeof(unsigned));
+    sort->keys = grow_array(sort->keys, alloc * sizeof(uint32_t));
+    sort->keys_tmp = grow_array(sort->keys_tmp, alloc * sizeof(uint32_t));
+    sort->tris_alloc = alloc;
+}
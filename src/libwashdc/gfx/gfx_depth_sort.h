@@ -0,0 +1,131 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef GFX_DEPTH_SORT_H_
+#define GFX_DEPTH_SORT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "gfx/gfx_il.h"
+
+/*
+ * translucent-polygon sorting stage shared by the rendering backends.
+ *
+ * Everything sent between GFX_IL_BEGIN_DEPTH_SORT and GFX_IL_END_DEPTH_SORT
+ * gets recorded here as a list of groups (one per draw_array).  When the sort
+ * ends, each group's triangle strips are broken up into individual triangles
+ * and every triangle is given a 32-bit key derived from its depth and the
+ * triangles are put into back-to-front order with an LSD radix sort.  The
+ * sort is stable, so triangles which have the same key stay in the order the
+ * guest submitted them.
+ *
+ * There is no limit on the number of groups or triangles; all of the arrays
+ * in here grow as needed and keep their storage between frames.
+ */
+
+enum gfx_depth_sort_mode {
+    // every triangle in a group shares the group's average depth
+    GFX_DEPTH_SORT_PER_GROUP,
+
+    // every triangle is keyed on the average depth of its own three verts
+    GFX_DEPTH_SORT_PER_TRI
+};
+
+struct gfx_depth_sort_group {
+    struct gfx_vert const *verts;
+    unsigned n_verts;
+
+    // strip indices, in the same format as gfx_il's draw_array
+    uint32_t const *indices;
+    unsigned n_indices;
+
+    /*
+     * index of this group's first vertex when all of the groups are
+     * concatenated together in submission order.
+     */
+    unsigned first_vert;
+
+    struct gfx_rend_param rend_param;
+};
+
+struct gfx_depth_sort {
+    enum gfx_depth_sort_mode mode;
+
+    struct gfx_depth_sort_group *groups;
+    unsigned n_groups, groups_alloc;
+
+    // total number of verts in all groups
+    unsigned n_verts;
+
+    /*
+     * After gfx_depth_sort_finish, tri_order holds the number of every
+     * triangle in back-to-front order.  tri_group and tri_idx are indexed by
+     * triangle number (not by sorted position); tri_group holds the
+     * triangle's group index and tri_idx holds its three vertex indices
+     * (3 * tri_no through 3 * tri_no + 2) within the concatenated vertex
+     * array.  Odd triangles in a strip have their first two indices swapped
+     * so that every triangle keeps the winding order of its strip.
+     */
+    unsigned *tri_order;
+    unsigned *tri_group;
+    uint32_t *tri_idx;
+    unsigned n_tris;
+
+    // scratch space for the radix sort
+    uint32_t *keys, *keys_tmp;
+    unsigned *order_tmp;
+    unsigned tris_alloc;
+};
+
+void gfx_depth_sort_init(struct gfx_depth_sort *sort);
+void gfx_depth_sort_cleanup(struct gfx_depth_sort *sort);
+
+// discard all groups and start recording a new sort
+void gfx_depth_sort_begin(struct gfx_depth_sort *sort,
+                          enum gfx_depth_sort_mode mode);
+
+/*
+ * record a group of triangle strips.  Neither verts nor indices is copied, so
+ * they must remain valid until the caller is done with the sorted output.
+ */
+void gfx_depth_sort_add(struct gfx_depth_sort *sort,
+                        struct gfx_rend_param const *param,
+                        struct gfx_vert const *verts, unsigned n_verts,
+                        uint32_t const *indices, unsigned n_indices);
+
+// compute keys and sort everything that was recorded since the last begin
+void gfx_depth_sort_finish(struct gfx_depth_sort *sort);
+
+static inline struct gfx_depth_sort_group const*
+gfx_depth_sort_tri_group(struct gfx_depth_sort const *sort, unsigned tri_idx) {
+    return sort->groups + sort->tri_group[tri_idx];
+}
+
+/*
+ * returns true if two render params would configure the renderer identically.
+ * This is used to merge consecutive sorted triangles into one draw call.
+ */
+bool gfx_rend_param_equal(struct gfx_rend_param const *lhs,
+                          struct gfx_rend_param const *rhs);
+
+#endif
@@ -0,0 +1,95 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef GFX_HASH_H_
+#define GFX_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * 64-bit MurmurHash2 (MurmurHash64A).  This is what everything in the gfx code
+ * uses to fingerprint data: the texture cache, the shader binary cache, and
+ * the headless renderers' output (see config_get_render_hash).  It only needs
+ * to be fast and to spread bits well; it is not used for anything
+ * security-related.
+ *
+ * The hash parameter is the seed, so the hash of several buffers can be built
+ * up by passing the result of one call into the next.  Start with
+ * GFX_HASH_INIT, which is an arbitrary seed; any constant works as long as
+ * every caller agrees on it.
+ */
+
+#define GFX_HASH_INIT 0ULL
+
+static inline uint64_t
+gfx_hash_bytes(uint64_t hash, void const *dat, size_t n_bytes) {
+    uint64_t const mul = 0xc6a4a7935bd1e995ULL;
+    int const shift = 47;
+    uint8_t const *bytes = (uint8_t const*)dat;
+
+    hash ^= n_bytes * mul;
+
+    while (n_bytes >= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        word *= mul;
+        word ^= word >> shift;
+        word *= mul;
+        hash ^= word;
+        hash *= mul;
+        bytes += 8;
+        n_bytes -= 8;
+    }
+
+    switch (n_bytes) {
+    case 7:
+        hash ^= (uint64_t)bytes[6] << 48;
+        // fall through
+    case 6:
+        hash ^= (uint64_t)bytes[5] << 40;
+        // fall through
+    case 5:
+        hash ^= (uint64_t)bytes[4] << 32;
+        // fall through
+    case 4:
+        hash ^= (uint64_t)bytes[3] << 24;
+        // fall through
+    case 3:
+        hash ^= (uint64_t)bytes[2] << 16;
+        // fall through
+    case 2:
+        hash ^= (uint64_t)bytes[1] << 8;
+        // fall through
+    case 1:
+        hash ^= (uint64_t)bytes[0];
+        hash *= mul;
+    }
+
+    hash ^= hash >> shift;
+    hash *= mul;
+    hash ^= hash >> shift;
+    return hash;
+}
+
+#endif
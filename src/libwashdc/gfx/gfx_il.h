@@ -94,7 +94,21 @@ enum gfx_il {
      * GFX_IL_END_DEPTH_SORT will be depth-sorted.
      */
     GFX_IL_BEGIN_DEPTH_SORT,
-    GFX_IL_END_DEPTH_SORT
+    GFX_IL_END_DEPTH_SORT,
+
+    /*
+     * add a closed modifier volume to the current set of volumes.  Pixels
+     * inside (or outside, for exclusion volumes) of any volume in the set are
+     * considered to be in shadow.
+     */
+    GFX_IL_DRAW_MOD_VOL,
+
+    /*
+     * switch every shadowed pixel which was drawn by a polygon with
+     * gfx_rend_param.shadow set over to the second parameter set, then empty
+     * the set of modifier volumes.
+     */
+    GFX_IL_APPLY_MOD_VOL
 };
 
 struct gfx_rend_param {
@@ -114,10 +128,20 @@ struct gfx_rend_param {
     // punch-through polygon mode
     bool pt_mode;
     unsigned pt_ref; // 0-255
+
+    // polygon is affected by modifier volumes
+    bool shadow;
 };
 
+/*
+ * dat and dat_len are both in and out: if the caller provides a buffer then
+ * the framebuffer gets read into it, else (or if it isn't big enough) the
+ * buffer gets reallocated.  Either way the caller is responsible for freeing
+ * dat afterwards.
+ */
 struct gfx_framebuffer {
     void *dat;
+    size_t dat_len;
     unsigned width, height;
     bool valid;
     bool flip;
@@ -176,11 +200,14 @@ union gfx_il_arg {
 
     struct {
         /*
-         * each vert has a len of GFX_IL_VERT_LEN; ergo the total length of
-         * verts (in terms of sizeof float) is n_verts * GFX_IL_VERT_LEN.
+         * verts holds n_verts unique vertices.  indices holds n_indices
+         * indices into verts which describe a series of triangle strips, each
+         * one terminated by GFX_PRIM_RESTART.
          */
         unsigned n_verts;
-        float const *verts;
+        struct gfx_vert const *verts;
+        unsigned n_indices;
+        uint32_t const *indices;
     } draw_array;
 
     struct {
@@ -213,6 +240,26 @@ union gfx_il_arg {
     struct {
         struct gfx_framebuffer *fb;
     } grab_framebuffer;
+
+    struct {
+        /*
+         * every three verts make up one triangle of the volume; only the
+         * positions are meaningful.
+         */
+        unsigned n_verts;
+        struct gfx_vert const *verts;
+
+        // shadow the pixels outside the volume instead of inside it
+        bool exclude;
+    } draw_mod_vol;
+
+    struct {
+        /*
+         * the second parameter set is the first one with its color scaled by
+         * this factor.
+         */
+        float shadow_scale;
+    } apply_mod_vol;
 };
 
 struct gfx_il_inst {
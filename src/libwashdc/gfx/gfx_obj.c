@@ -45,6 +45,7 @@ void gfx_obj_free(int handle) {
     obj->dat = NULL;
     obj->on_read = NULL;
     obj->on_write = NULL;
+    obj->arg = NULL;
     obj->dat_len = 0;
 }
 
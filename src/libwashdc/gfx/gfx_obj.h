@@ -27,13 +27,18 @@
 #include <stdlib.h>
 
 #include "washdc/error.h"
+#include "gfx/gfx_tex_cache.h"
 
 /*
  * An obj represents a blob of data sent to the gfx system.  It will be the
  * underlying storage class for textures and render targets.
  */
 
-#define GFX_OBJ_COUNT 768
+/*
+ * enough for every texture in the cache to have its own gfx_obj, with plenty
+ * left over for framebuffers and render targets.
+ */
+#define GFX_OBJ_COUNT (GFX_TEX_CACHE_SIZE + 256)
 
 void gfx_obj_init(int handle, size_t n_bytes);
 void gfx_obj_free(int handle);
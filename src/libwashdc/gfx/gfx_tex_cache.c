@@ -47,12 +47,24 @@ void gfx_tex_cache_bind(unsigned tex_no, int obj_no, unsigned width,
     struct gfx_obj *obj = gfx_obj_get(obj_no);
     struct gfx_tex *tex = tex_cache + tex_no;
 
+    gfx_tex_cache_evict(tex_no);
+
     tex->obj_handle = obj_no;
     tex->tex_fmt = tex_fmt;
     tex->width = width;
     tex->height = height;
     tex->valid = true;
 
+    // push the texture onto the front of the obj's list of textures
+    struct gfx_tex *head = (struct gfx_tex*)obj->arg;
+    tex->obj_prev = -1;
+    if (head) {
+        tex->obj_next = head - tex_cache;
+        head->obj_prev = tex_no;
+    } else {
+        tex->obj_next = -1;
+    }
+
     obj->arg = tex;
     obj->on_write = update_tex_from_obj;
 
@@ -70,10 +82,30 @@ void gfx_tex_cache_unbind(unsigned tex_no) {
  * doesn't accidentally double-free something.
  */
 void gfx_tex_cache_evict(unsigned idx) {
-    tex_cache[idx].valid = false;
-    struct gfx_obj *obj = gfx_obj_get(tex_cache[idx].obj_handle);
-    obj->on_write = NULL;
-    obj->arg = NULL;
+    struct gfx_tex *tex = tex_cache + idx;
+    if (!tex->valid)
+        return;
+    tex->valid = false;
+    struct gfx_obj *obj = gfx_obj_get(tex->obj_handle);
+
+    /*
+     * the same gfx_obj can be bound to more than one texture (see
+     * pvr2_tex_cache_xmit), so if another texture still has it bound then
+     * that texture gets the obj's write notifications from now on.
+     */
+    if (tex->obj_next >= 0)
+        tex_cache[tex->obj_next].obj_prev = tex->obj_prev;
+
+    if (tex->obj_prev >= 0) {
+        tex_cache[tex->obj_prev].obj_next = tex->obj_next;
+    } else if (tex->obj_next >= 0) {
+        obj->arg = tex_cache + tex->obj_next;
+    } else {
+        obj->on_write = NULL;
+        obj->arg = NULL;
+    }
+
+    tex->obj_prev = tex->obj_next = -1;
 }
 
 struct gfx_tex const* gfx_tex_cache_get(unsigned idx) {
@@ -42,7 +42,7 @@ enum gfx_tex_fmt {
  * the PVR2 STARTRENDER command.
  */
 
-#define GFX_TEX_CACHE_SIZE 512
+#define GFX_TEX_CACHE_SIZE 4096
 #define GFX_TEX_CACHE_MASK (GFX_TEX_CACHE_SIZE - 1)
 
 struct gfx_tex {
@@ -50,6 +50,13 @@ struct gfx_tex {
     enum gfx_tex_fmt tex_fmt;
     unsigned width, height;
     bool valid;
+
+    /*
+     * The same gfx_obj can be bound to more than one texture.  All of the
+     * textures bound to a gfx_obj are kept on a list whose head is the obj's
+     * arg pointer; these are the indices of the neighbors on that list, or -1.
+     */
+    int obj_prev, obj_next;
 };
 
 /*
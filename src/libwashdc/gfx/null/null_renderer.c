@@ -0,0 +1,176 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "config.h"
+#include "log.h"
+#include "gfx/gfx_obj.h"
+#include "gfx/gfx_hash.h"
+
+#include "null_renderer.h"
+
+static bool hash_enable;
+static uint64_t rend_hash;
+
+static struct null_fb {
+    int obj_handle;
+    unsigned width, height;
+    bool do_flip;
+} cur_fb;
+
+static void hash_bytes(void const *dat, size_t n_bytes) {
+    rend_hash = gfx_hash_bytes(rend_hash, dat, n_bytes);
+}
+
+static void null_rend_init(void) {
+    hash_enable = config_get_render_hash();
+    rend_hash = GFX_HASH_INIT;
+    cur_fb.obj_handle = -1;
+    LOG_INFO("GFX: using the null renderer; nothing will be drawn\n");
+}
+
+static void null_rend_cleanup(void) {
+    if (hash_enable) {
+        LOG_INFO("render hash: %016" PRIx64 "\n", rend_hash);
+        printf("render hash: %016" PRIx64 "\n", rend_hash);
+    }
+}
+
+static void null_rend_update_tex(unsigned tex_obj) {
+}
+
+static void null_rend_release_tex(unsigned tex_obj) {
+}
+
+static void null_rend_set_blend_enable(bool do_enable) {
+}
+
+static void null_rend_set_rend_param(struct gfx_rend_param const *param) {
+}
+
+static void null_rend_set_screen_dim(unsigned width, unsigned height) {
+}
+
+static void null_rend_set_clip_range(float clip_min, float clip_max) {
+}
+
+static void null_rend_draw_array(struct gfx_vert const *verts, unsigned n_verts,
+                                 uint32_t const *indices, unsigned n_indices) {
+    if (hash_enable) {
+        hash_bytes(verts, n_verts * sizeof(struct gfx_vert));
+        hash_bytes(indices, n_indices * sizeof(uint32_t));
+    }
+}
+
+static void null_rend_clear(float const bgcolor[4]) {
+    if (hash_enable)
+        hash_bytes(bgcolor, 4 * sizeof(float));
+}
+
+static void null_rend_begin_sort_mode(void) {
+}
+
+static void null_rend_end_sort_mode(void) {
+}
+
+static void null_rend_draw_mod_vol(struct gfx_vert const *verts,
+                                   unsigned n_verts, bool exclude) {
+}
+
+static void null_rend_apply_mod_vol(float shadow_scale) {
+}
+
+static void null_rend_target_bind_obj(int handle) {
+}
+
+static void null_rend_target_unbind_obj(int handle) {
+}
+
+static void null_rend_target_begin(unsigned width, unsigned height,
+                                   int tgt_handle) {
+}
+
+static void null_rend_target_end(int tgt_handle) {
+}
+
+static int null_rend_video_get_fb(int *obj_handle_out, unsigned *width_out,
+                                  unsigned *height_out, bool *flip_out) {
+    if (cur_fb.obj_handle < 0)
+        return -1;
+
+    *obj_handle_out = cur_fb.obj_handle;
+    *width_out = cur_fb.width;
+    *height_out = cur_fb.height;
+    *flip_out = cur_fb.do_flip;
+    return 0;
+}
+
+static void null_rend_video_present(void) {
+}
+
+static void null_rend_video_new_framebuffer(int obj_handle,
+                                            unsigned fb_new_width,
+                                            unsigned fb_new_height,
+                                            bool do_flip) {
+    cur_fb.obj_handle = obj_handle;
+    cur_fb.width = fb_new_width;
+    cur_fb.height = fb_new_height;
+    cur_fb.do_flip = do_flip;
+
+    if (hash_enable) {
+        struct gfx_obj *obj = gfx_obj_get(obj_handle);
+        size_t n_bytes = (size_t)fb_new_width * fb_new_height * 4;
+        if (obj->dat && n_bytes <= obj->dat_len)
+            hash_bytes(obj->dat, n_bytes);
+    }
+}
+
+static void null_rend_video_toggle_filter(void) {
+}
+
+struct rend_if const null_rend_if = {
+    .init = null_rend_init,
+    .cleanup = null_rend_cleanup,
+    .update_tex = null_rend_update_tex,
+    .release_tex = null_rend_release_tex,
+    .set_blend_enable = null_rend_set_blend_enable,
+    .set_rend_param = null_rend_set_rend_param,
+    .set_screen_dim = null_rend_set_screen_dim,
+    .set_clip_range = null_rend_set_clip_range,
+    .draw_array = null_rend_draw_array,
+    .clear = null_rend_clear,
+    .begin_sort_mode = null_rend_begin_sort_mode,
+    .end_sort_mode = null_rend_end_sort_mode,
+    .draw_mod_vol = null_rend_draw_mod_vol,
+    .apply_mod_vol = null_rend_apply_mod_vol,
+    .target_bind_obj = null_rend_target_bind_obj,
+    .target_unbind_obj = null_rend_target_unbind_obj,
+    .target_begin = null_rend_target_begin,
+    .target_end = null_rend_target_end,
+    .video_get_fb = null_rend_video_get_fb,
+    .video_present = null_rend_video_present,
+    .video_new_framebuffer = null_rend_video_new_framebuffer,
+    .video_toggle_filter = null_rend_video_toggle_filter
+};
@@ -0,0 +1,44 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef NULL_RENDERER_H_
+#define NULL_RENDERER_H_
+
+#include "gfx/rend_common.h"
+
+/*
+ * renderer which draws nothing.  This is used for headless mode, where there
+ * is no window and no graphics API.
+ *
+ * gfx_objs keep working as plain memory, so framebuffers which are sent to
+ * the host from texture memory are still readable (eg for screenshots), but
+ * anything that the PVR2 would have rendered into a texture is left blank.
+ *
+ * If config_get_render_hash() is true then everything the renderer is given
+ * (geometry, clear colors and the contents of every framebuffer posted to
+ * the screen) is run through gfx_hash_bytes, a 64-bit MurmurHash2 (see
+ * gfx_hash.h).  The final hash is printed when the renderer is cleaned up so
+ * that regression tests can compare runs without needing a GPU.
+ */
+extern struct rend_if const null_rend_if;
+
+#endif
@@ -192,6 +192,9 @@ opengl_video_update_framebuffer(int obj_handle,
         return;
 
     struct gfx_obj *obj = gfx_obj_get(obj_handle);
+
+    if (!(obj->state & GFX_OBJ_STATE_TEX))
+        opengl_renderer_tex_make_mutable(obj_handle);
     GLuint tex_obj = opengl_renderer_tex(obj_handle);
 
     glBindTexture(GL_TEXTURE_2D, tex_obj);
@@ -20,6 +20,7 @@
  *
  ******************************************************************************/
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -31,11 +32,15 @@
 #include "gfx/gfx_config.h"
 #include "gfx/gfx_tex_cache.h"
 #include "gfx/gfx.h"
+#include "gfx/gfx_depth_sort.h"
+#include "gfx/gfx_hash.h"
 #include "log.h"
 #include "washdc/pix_conv.h"
 #include "washdc/config_file.h"
+#include "washdc/hostfile.h"
 #include "opengl_output.h"
 #include "opengl_target.h"
+#include "opengl_tex_stream.h"
 #include "washdc/gfx/gl/shader.h"
 #include "shader_cache.h"
 
@@ -47,16 +52,38 @@
 #define TEX_COORD_SLOT         3
 
 static struct shader_cache shader_cache;
+
+// true if linked programs can be saved to and loaded from disk
+static bool shader_bin_enable;
 static GLint trans_mat_slot = -1;
 
-static GLuint vbo, vao;
+static GLuint vbo, ibo, vao;
+
+/*
+ * Stencil bits used for modifier volumes.  STENCIL_SHADOW marks pixels which
+ * were last drawn by a polygon that modifier volumes affect.  STENCIL_PARITY
+ * gets flipped by every triangle of a volume that's in front of the pixel, so
+ * once the whole volume has been drawn it's set for pixels inside of it.
+ * STENCIL_IN_VOL accumulates that over every volume in the current set.
+ */
+#define STENCIL_PARITY 0x01
+#define STENCIL_IN_VOL 0x02
+#define STENCIL_SHADOW 0x80
 
 struct obj_tex_meta {
     unsigned width, height;
 
+    GLenum internal_fmt; // internalformat parameter for glTexStorage2D
     GLenum format;   // internalformat and format parameter for glTexImage2D
     GLenum dat_type; // type parameter for glTexImage2D
 
+    /*
+     * set if the texture's storage was allocated with glTexStorage2D, in which
+     * case it can never be re-specified and has to be replaced by a new
+     * texture object when its shape changes.
+     */
+    bool immutable;
+
     /*
      * if this is set, the OpenGL texture object will be re-initialized
      * regardless of the other parameters.
@@ -123,32 +150,36 @@ static const GLenum depth_funcs[PVR2_DEPTH_FUNC_COUNT] = {
     [PVR2_DEPTH_ALWAYS]              = GL_ALWAYS
 };
 
-#define OIT_MAX_GROUPS (4*1024)
-
-struct oit_group {
-    float const *verts;
-    unsigned n_verts;
-
-    float avg_depth;
-
-    struct gfx_rend_param rend_param;
-};
-
 static struct oit_state {
-    unsigned tri_count;
-    unsigned group_count;
     bool enabled;
+    enum gfx_depth_sort_mode mode;
 
-    struct oit_group groups[OIT_MAX_GROUPS];
+    struct gfx_depth_sort sort;
+
+    /*
+     * every group's verts get copied into vert_buf so they can be uploaded to
+     * the GPU with a single glBufferData; idx_buf holds the sorted triangles.
+     */
+    struct gfx_vert *vert_buf;
+    unsigned vert_buf_alloc;
+    GLuint *idx_buf;
+    unsigned idx_buf_alloc;
 
     struct gfx_rend_param cur_rend_param;
 } oit_state;
 
 // converts pixels from ARGB 4444 to RGBA 4444
-static void render_conv_argb_4444(uint16_t *pixels, size_t n_pixels);
+static void render_conv_argb_4444(uint16_t *dst, uint16_t const *src,
+                                  size_t n_pixels);
 
 // converts pixels from ARGB 1555 to ABGR1555
-static void render_conv_argb_1555(uint16_t *pixels, size_t n_pizels);
+static void render_conv_argb_1555(uint16_t *dst, uint16_t const *src,
+                                  size_t n_pixels);
+
+static void tex_set_default_params(GLuint tex);
+static void tex_alloc_storage(unsigned obj_no, unsigned width, unsigned height,
+                              GLenum internal_fmt, GLenum format,
+                              GLenum dat_type);
 
 static void opengl_render_init(void);
 static void opengl_render_cleanup(void);
@@ -156,13 +187,19 @@ static void opengl_renderer_update_tex(unsigned tex_obj);
 static void opengl_renderer_release_tex(unsigned tex_obj);
 static void opengl_renderer_set_blend_enable(bool enable);
 static void opengl_renderer_set_rend_param(struct gfx_rend_param const *param);
-static void opengl_renderer_draw_array(float const *verts, unsigned n_verts);
+static void opengl_renderer_draw_array(struct gfx_vert const *verts,
+                                       unsigned n_verts,
+                                       uint32_t const *indices,
+                                       unsigned n_indices);
 static void opengl_renderer_clear(float const bgcolor[4]);
 static void opengl_renderer_set_screen_dim(unsigned width, unsigned height);
 static void opengl_renderer_set_clip_range(float new_clip_min,
                                            float new_clip_max);
 static void opengl_renderer_begin_sort_mode(void);
 static void opengl_renderer_end_sort_mode(void);
+static void opengl_renderer_draw_mod_vol(struct gfx_vert const *verts,
+                                         unsigned n_verts, bool exclude);
+static void opengl_renderer_apply_mod_vol(float shadow_scale);
 
 struct rend_if const opengl_rend_if = {
     .init = opengl_render_init,
@@ -177,6 +214,8 @@ struct rend_if const opengl_rend_if = {
     .set_clip_range = opengl_renderer_set_clip_range,
     .begin_sort_mode = opengl_renderer_begin_sort_mode,
     .end_sort_mode = opengl_renderer_end_sort_mode,
+    .draw_mod_vol = opengl_renderer_draw_mod_vol,
+    .apply_mod_vol = opengl_renderer_apply_mod_vol,
     .target_bind_obj = opengl_target_bind_obj,
     .target_unbind_obj = opengl_target_unbind_obj,
     .target_begin = opengl_target_begin,
@@ -329,9 +368,14 @@ static char const * const pvr2_ta_frag_glsl =
     "    out_color = color;\n"
     "}\n";
 
-static struct shader_cache_ent* create_shader(shader_key key) {
-    #define PREAMBLE_LEN 256
-    static char preamble[PREAMBLE_LEN];
+static DEF_ERROR_INT_ATTR(shader_cache_key)
+
+static void find_shader_slots(struct shader_cache_ent *ent);
+
+#define PREAMBLE_LEN 256
+
+// build the preamble that sets up the given shader variant
+static void shader_preamble(shader_key key, char preamble[PREAMBLE_LEN]) {
     bool tex_en = (bool)(key & SHADER_KEY_TEX_ENABLE_BIT);
     bool color_en = (bool)(key & SHADER_KEY_COLOR_ENABLE_BIT);
     bool punchthrough = (bool)(key & SHADER_KEY_PUNCH_THROUGH_BIT);
@@ -368,6 +412,12 @@ static struct shader_cache_ent* create_shader(shader_key key) {
              punchthrough ? "#define PUNCH_THROUGH_ENABLE\n" : "",
              tex_inst_str);
     preamble[PREAMBLE_LEN - 1] = '\0';
+}
+
+static struct shader_cache_ent* create_shader(shader_key key) {
+    static char preamble[PREAMBLE_LEN];
+
+    shader_preamble(key, preamble);
 
     struct shader_cache_ent *ent = shader_cache_add_ent(&shader_cache, key);
 
@@ -378,8 +428,17 @@ static struct shader_cache_ent* create_shader(shader_key key) {
 
     shader_load_vert_with_preamble(&ent->shader, pvr2_ta_vert_glsl, preamble);
     shader_load_frag_with_preamble(&ent->shader, pvr2_ta_frag_glsl, preamble);
-    shader_link(&ent->shader);
+    if (shader_bin_enable)
+        shader_link_retrievable(&ent->shader);
+    else
+        shader_link(&ent->shader);
+
+    find_shader_slots(ent);
+
+    return ent;
+}
 
+static void find_shader_slots(struct shader_cache_ent *ent) {
     /*
      * not all of these are valid for every shader.  This is alright because
      * glGetUniformLocation will return -1 for invalid uniform handles.
@@ -392,11 +451,94 @@ static struct shader_cache_ent* create_shader(shader_key key) {
         glGetUniformLocation(ent->shader.shader_prog_obj, "pt_alpha_ref");
     ent->slots[SHADER_CACHE_SLOT_TRANS_MAT] =
         glGetUniformLocation(ent->shader.shader_prog_obj, "trans_mat");
+}
 
-    return ent;
+/*
+ * hash every string that create_shader hands to glShaderSource, for every
+ * variant, so that saved program binaries get thrown out whenever anything
+ * that goes into them changes.
+ */
+static uint32_t shader_src_hash(void) {
+    char preamble[PREAMBLE_LEN];
+    uint64_t hash = GFX_HASH_INIT;
+    shader_key key;
+
+    for (key = 0; key < SHADER_KEY_COUNT; key++) {
+        if (!shader_cache_key_used(key))
+            continue;
+
+        shader_preamble(key, preamble);
+
+        char const *srcs[] = {
+            SHADER_VERSION_STR, preamble, pvr2_ta_vert_glsl,
+            SHADER_VERSION_STR, preamble, pvr2_ta_frag_glsl
+        };
+
+        hash = gfx_hash_bytes(hash, &key, sizeof(key));
+        unsigned src_no;
+        for (src_no = 0; src_no < sizeof(srcs) / sizeof(srcs[0]); src_no++) {
+            // include the terminator so the boundaries between strings count
+            hash = gfx_hash_bytes(hash, srcs[src_no],
+                                  strlen(srcs[src_no]) + 1);
+        }
+    }
+
+    return (uint32_t)(hash ^ (hash >> 32));
 }
 
-static DEF_ERROR_INT_ATTR(shader_cache_key)
+#define SHADER_BIN_PATH_LEN 1024
+
+static void shader_bin_path(char *path) {
+    char const *data_dir = washdc_hostfile_data_dir();
+    strncpy(path, data_dir ? data_dir : ".", SHADER_BIN_PATH_LEN);
+    path[SHADER_BIN_PATH_LEN - 1] = '\0';
+    washdc_hostfile_path_append(path, "gl_shader_cache.bin",
+                                SHADER_BIN_PATH_LEN);
+}
+
+/*
+ * compile every shader variant the renderer can ask for up-front so that no
+ * compilation happens in the middle of a frame.  If the on-disk cache is
+ * enabled, programs are loaded from there first and the cache is rewritten if
+ * anything needed to be compiled.
+ */
+static void build_shader_cache(void) {
+    static char path[SHADER_BIN_PATH_LEN];
+    uint32_t src_hash = shader_src_hash();
+    unsigned n_compiled = 0, n_loaded = 0;
+    shader_key key;
+
+    bool cache_enable = true;
+    cfg_get_bool("gfx.rend.shader-cache", &cache_enable);
+    shader_bin_enable = cache_enable && shader_cache_bin_supported();
+
+    if (shader_bin_enable) {
+        shader_bin_path(path);
+        n_loaded = shader_cache_load_bin(&shader_cache, path, src_hash);
+    }
+
+    for (key = 0; key < SHADER_KEY_COUNT; key++) {
+        if (!shader_cache_key_used(key))
+            continue;
+
+        struct shader_cache_ent *ent = shader_cache_find(&shader_cache, key);
+        if (ent) {
+            find_shader_slots(ent);
+        } else {
+            if (!create_shader(key)) {
+                error_set_shader_cache_key(key);
+                RAISE_ERROR(ERROR_FAILED_ALLOC);
+            }
+            n_compiled++;
+        }
+    }
+
+    LOG_INFO("%u shader variants loaded from disk, %u compiled\n",
+             n_loaded, n_compiled);
+
+    if (shader_bin_enable && n_compiled)
+        shader_cache_save_bin(&shader_cache, path, src_hash);
+}
 
 static struct shader_cache_ent* fetch_shader(shader_key key) {
     struct shader_cache_ent *shader_ent =
@@ -416,21 +558,29 @@ static void opengl_render_init(void) {
     opengl_target_init();
 
     char const *oit_mode_str = cfg_get_node("gfx.rend.oit-mode");
+    oit_state.mode = GFX_DEPTH_SORT_PER_TRI;
     if (oit_mode_str) {
-        if (strcmp(oit_mode_str, "per-group") == 0)
+        if (strcmp(oit_mode_str, "per-triangle") == 0) {
+            gfx_config_oit_enable();
+        } else if (strcmp(oit_mode_str, "per-group") == 0) {
+            oit_state.mode = GFX_DEPTH_SORT_PER_GROUP;
             gfx_config_oit_enable();
-        else if (strcmp(oit_mode_str, "disabled") == 0)
+        } else if (strcmp(oit_mode_str, "disabled") == 0) {
             gfx_config_oit_disable();
-        else
+        } else {
             gfx_config_oit_disable();
+        }
     } else {
         gfx_config_oit_enable();
     }
 
     shader_cache_init(&shader_cache);
+    build_shader_cache();
+    gfx_depth_sort_init(&oit_state.sort);
 
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ibo);
     glGenTextures(GFX_OBJ_COUNT, obj_tex_array);
 
     memset(obj_tex_meta_array, 0, sizeof(obj_tex_meta_array));
@@ -438,27 +588,45 @@ static void opengl_render_init(void) {
     unsigned tex_no;
     for (tex_no = 0; tex_no < GFX_OBJ_COUNT; tex_no++) {
         obj_tex_meta_array[tex_no].dirty = true;
-
-        /*
-         * unconditionally set the texture wrapping mode to repeat.
-         *
-         * TODO: I know for sure that a lot of games need repeating texture,
-         * coordinates but I don't know if there are any that need clamped
-         * texture coordinates.  In the future I will need to determine if this
-         * functionality exists in PVR2.
-         */
-        glBindTexture(GL_TEXTURE_2D, obj_tex_array[tex_no]);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        tex_set_default_params(obj_tex_array[tex_no]);
     }
+
+    opengl_tex_stream_init();
+}
+
+static void tex_set_default_params(GLuint tex) {
+    /*
+     * unconditionally set the texture wrapping mode to repeat.
+     *
+     * TODO: I know for sure that a lot of games need repeating texture,
+     * coordinates but I don't know if there are any that need clamped
+     * texture coordinates.  In the future I will need to determine if this
+     * functionality exists in PVR2.
+     */
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 static void opengl_render_cleanup(void) {
+    opengl_tex_stream_cleanup();
+    opengl_target_cleanup();
+
     glDeleteTextures(GFX_OBJ_COUNT, obj_tex_array);
+    glDeleteBuffers(1, &ibo);
     glDeleteBuffers(1, &vbo);
     glDeleteVertexArrays(1, &vao);
 
+    gfx_depth_sort_cleanup(&oit_state.sort);
+    free(oit_state.vert_buf);
+    free(oit_state.idx_buf);
+    oit_state.vert_buf = NULL;
+    oit_state.idx_buf = NULL;
+    oit_state.vert_buf_alloc = 0;
+    oit_state.idx_buf_alloc = 0;
+    ibo = 0;
+
     shader_cache_cleanup(&shader_cache);
 
     vao = 0;
@@ -479,120 +647,173 @@ static void opengl_renderer_update_tex(unsigned tex_obj) {
     gfx_obj_alloc(obj);
 
     void const *tex_dat = obj->dat;
-    GLenum format = tex->tex_fmt == GFX_TEX_FMT_RGB_565 ?
-        GL_RGB : GL_RGBA;
-
     unsigned tex_w = tex->width;
     unsigned tex_h = tex->height;
+    size_t n_pixels = (size_t)tex_w * tex_h;
+
+    GLenum internal_fmt, format, dat_type;
+    size_t src_bytes, n_bytes;
+    switch (tex->tex_fmt) {
+    case GFX_TEX_FMT_ARGB_4444:
+        internal_fmt = GL_RGBA4;
+        format = GL_RGBA;
+        dat_type = tex_fmt_to_data_type(tex->tex_fmt);
+        src_bytes = n_bytes = n_pixels * sizeof(uint16_t);
+        break;
+    case GFX_TEX_FMT_ARGB_1555:
+        internal_fmt = GL_RGB5_A1;
+        format = GL_RGBA;
+        dat_type = tex_fmt_to_data_type(tex->tex_fmt);
+        src_bytes = n_bytes = n_pixels * sizeof(uint16_t);
+        break;
+    case GFX_TEX_FMT_RGB_565:
+        // GL_RGB565 was only added to desktop GL in 4.1
+        internal_fmt = GLEW_ARB_ES2_compatibility ? GL_RGB565 : GL_RGB8;
+        format = GL_RGB;
+        dat_type = tex_fmt_to_data_type(tex->tex_fmt);
+        src_bytes = n_bytes = n_pixels * sizeof(uint16_t);
+        break;
+    case GFX_TEX_FMT_YUV_422:
+        internal_fmt = GL_RGB8;
+        format = GL_RGB;
+        dat_type = GL_UNSIGNED_BYTE;
+        src_bytes = n_pixels * sizeof(uint16_t);
+        n_bytes = n_pixels * 3 * sizeof(uint8_t);
+        break;
+    case GFX_TEX_FMT_ARGB_8888:
+        internal_fmt = GL_RGBA8;
+        format = GL_RGBA;
+        dat_type = tex_fmt_to_data_type(tex->tex_fmt);
+        src_bytes = n_bytes = n_pixels * sizeof(uint32_t);
+        break;
+    default:
+        error_set_gfx_tex_fmt(tex->tex_fmt);
+        RAISE_ERROR(ERROR_UNIMPLEMENTED);
+    }
+
+    if (src_bytes > obj->dat_len) {
+        error_set_length(src_bytes);
+        error_set_max_length(obj->dat_len);
+        RAISE_ERROR(ERROR_OVERFLOW);
+    }
+
+    // only allocates new storage if the texture's shape changed
+    tex_alloc_storage(tex->obj_handle, tex_w, tex_h,
+                      internal_fmt, format, dat_type);
 
     glBindTexture(GL_TEXTURE_2D, obj_tex_array[tex->obj_handle]);
     // TODO: maybe don't always set this to 1
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
     /*
-     * TODO: ideally I wouldn't need to copy ARGB_4444 and ARGB_1555 into a
-     * separate buffer to do the pixel conversion.  The reason I do this is that
-     * the tex-dump command in the cmd thread also sees the texture data in the
-     * struct gfx_tex, so I don't want to modify that.  Maybe someday I'll
-     * change things to remove this mostly-unnecessary buffering...
+     * Formats which need converting get converted straight into the upload
+     * buffer.  The source data stays untouched because the tex-dump command
+     * in the cmd thread also sees the texture data in the struct gfx_tex.
      */
-    if (tex->tex_fmt == GFX_TEX_FMT_ARGB_4444) {
-        size_t n_bytes = tex->width * tex->height * sizeof(uint16_t);
-#ifdef INVARIANTS
-        if (n_bytes > obj->dat_len) {
-            error_set_length(n_bytes);
-            error_set_max_length(obj->dat_len);
-            RAISE_ERROR(ERROR_OVERFLOW);
-        }
-#endif
-        uint16_t *tex_dat_conv = (uint16_t*)malloc(n_bytes);
-        if (!tex_dat_conv)
-            RAISE_ERROR(ERROR_FAILED_ALLOC);
-        memcpy(tex_dat_conv, tex_dat, n_bytes);
-        render_conv_argb_4444(tex_dat_conv, tex_w * tex_h);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, tex_w, tex_h, 0,
-                     format, tex_fmt_to_data_type(GFX_TEX_FMT_ARGB_4444),
-                     tex_dat_conv);
-        opengl_renderer_tex_set_dims(tex->obj_handle, tex_w, tex_h);
-        opengl_renderer_tex_set_format(tex->obj_handle, format);
-        opengl_renderer_tex_set_dat_type(tex->obj_handle,
-                                         tex_fmt_to_data_type(GFX_TEX_FMT_ARGB_4444));
-        opengl_renderer_tex_set_dirty(tex->obj_handle, false);
-        free(tex_dat_conv);
-    } else if (tex->tex_fmt == GFX_TEX_FMT_ARGB_1555) {
-        size_t n_bytes = tex->width * tex->height * sizeof(uint16_t);
-#ifdef INVARIANTS
-        if (n_bytes > obj->dat_len) {
-            error_set_length(n_bytes);
-            error_set_max_length(obj->dat_len);
-            RAISE_ERROR(ERROR_OVERFLOW);
+    switch (tex->tex_fmt) {
+    case GFX_TEX_FMT_ARGB_4444:
+        render_conv_argb_4444(opengl_tex_stream_begin(n_bytes),
+                              tex_dat, n_pixels);
+        opengl_tex_stream_end(tex_w, tex_h, format, dat_type);
+        break;
+    case GFX_TEX_FMT_ARGB_1555:
+        render_conv_argb_1555(opengl_tex_stream_begin(n_bytes),
+                              tex_dat, n_pixels);
+        opengl_tex_stream_end(tex_w, tex_h, format, dat_type);
+        break;
+    case GFX_TEX_FMT_YUV_422:
+        washdc_conv_yuv422_rgb888(opengl_tex_stream_begin(n_bytes),
+                                  tex_dat, tex_w, tex_h);
+        opengl_tex_stream_end(tex_w, tex_h, format, dat_type);
+        break;
+    default:
+        if (opengl_tex_stream_mapped()) {
+            memcpy(opengl_tex_stream_begin(n_bytes), tex_dat, n_bytes);
+            opengl_tex_stream_end(tex_w, tex_h, format, dat_type);
+        } else {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tex_w, tex_h,
+                            format, dat_type, tex_dat);
         }
-#endif
-        uint16_t *tex_dat_conv = (uint16_t*)malloc(n_bytes);
-        if (!tex_dat_conv)
-            RAISE_ERROR(ERROR_FAILED_ALLOC);
-        memcpy(tex_dat_conv, tex_dat, n_bytes);
-        render_conv_argb_1555(tex_dat_conv, tex_w * tex_h);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, tex_w, tex_h, 0,
-                     format, tex_fmt_to_data_type(GFX_TEX_FMT_ARGB_1555),
-                     tex_dat_conv);
-        opengl_renderer_tex_set_dims(tex->obj_handle, tex_w, tex_h);
-        opengl_renderer_tex_set_format(tex->obj_handle, format);
-        opengl_renderer_tex_set_dat_type(tex->obj_handle,
-                                         tex_fmt_to_data_type(GFX_TEX_FMT_ARGB_1555));
-        opengl_renderer_tex_set_dirty(tex->obj_handle, false);
-        free(tex_dat_conv);
-    } else if (tex->tex_fmt == GFX_TEX_FMT_YUV_422) {
-        uint8_t *tmp_dat =
-            (uint8_t*)malloc(sizeof(uint8_t) * 3 * tex_w * tex_h);
-        if (!tmp_dat)
-            RAISE_ERROR(ERROR_FAILED_ALLOC);
-        washdc_conv_yuv422_rgb888(tmp_dat, tex_dat, tex_w, tex_h);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, tex_w, tex_h, 0,
-                     GL_RGB, GL_UNSIGNED_BYTE, tmp_dat);
-        opengl_renderer_tex_set_dims(tex->obj_handle, tex_w, tex_h);
-        opengl_renderer_tex_set_format(tex->obj_handle, GL_RGB);
-        opengl_renderer_tex_set_dat_type(tex->obj_handle, GL_UNSIGNED_BYTE);
-        opengl_renderer_tex_set_dirty(tex->obj_handle, false);
-        free(tmp_dat);
-    } else {
-        glTexImage2D(GL_TEXTURE_2D, 0, format, tex_w, tex_h, 0,
-                     format, tex_fmt_to_data_type(tex->tex_fmt), tex_dat);
-        opengl_renderer_tex_set_dims(tex->obj_handle, tex_w, tex_h);
-        opengl_renderer_tex_set_format(tex->obj_handle, format);
-        opengl_renderer_tex_set_dat_type(tex->obj_handle,
-                                         tex_fmt_to_data_type(tex->tex_fmt));
-        opengl_renderer_tex_set_dirty(tex->obj_handle, false);
     }
+
     obj->state |= GFX_OBJ_STATE_TEX;
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+/*
+ * make sure the given texture has storage of the given shape.  Storage only
+ * gets allocated when the shape changes; otherwise the existing storage gets
+ * reused and the caller just needs to glTexSubImage2D the new data into it.
+ */
+static void tex_alloc_storage(unsigned obj_no, unsigned width, unsigned height,
+                              GLenum internal_fmt, GLenum format,
+                              GLenum dat_type) {
+    struct obj_tex_meta *meta = obj_tex_meta_array + obj_no;
+
+    if (!meta->dirty && meta->width == width && meta->height == height &&
+        meta->internal_fmt == internal_fmt && meta->format == format &&
+        meta->dat_type == dat_type)
+        return;
+
+    opengl_renderer_tex_make_mutable(obj_no);
+
+    glBindTexture(GL_TEXTURE_2D, obj_tex_array[obj_no]);
+    if (GLEW_ARB_texture_storage) {
+        glTexStorage2D(GL_TEXTURE_2D, 1, internal_fmt, width, height);
+        meta->immutable = true;
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_fmt, width, height, 0,
+                     format, dat_type, NULL);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    opengl_renderer_tex_set_dims(obj_no, width, height);
+    opengl_renderer_tex_set_format(obj_no, format);
+    opengl_renderer_tex_set_dat_type(obj_no, dat_type);
+    opengl_renderer_tex_set_dirty(obj_no, false);
+    meta->internal_fmt = internal_fmt;
+}
+
+void opengl_renderer_tex_make_mutable(unsigned obj_no) {
+    struct obj_tex_meta *meta = obj_tex_meta_array + obj_no;
+    if (!meta->immutable)
+        return;
+
+    glDeleteTextures(1, obj_tex_array + obj_no);
+    glGenTextures(1, obj_tex_array + obj_no);
+    tex_set_default_params(obj_tex_array[obj_no]);
+
+    meta->immutable = false;
+    meta->dirty = true;
+}
+
 static void opengl_renderer_release_tex(unsigned tex_obj) {
     // do nothing
 }
 
-static void render_conv_argb_4444(uint16_t *pixels, size_t n_pixels) {
-    for (size_t pix_no = 0; pix_no < n_pixels; pix_no++, pixels++) {
-        uint16_t pix_current = *pixels;
+static void render_conv_argb_4444(uint16_t *dst, uint16_t const *src,
+                                  size_t n_pixels) {
+    for (size_t pix_no = 0; pix_no < n_pixels; pix_no++) {
+        uint16_t pix_current = src[pix_no];
         uint16_t b = (pix_current & 0x000f) >> 0;
         uint16_t g = (pix_current & 0x00f0) >> 4;
         uint16_t r = (pix_current & 0x0f00) >> 8;
         uint16_t a = (pix_current & 0xf000) >> 12;
 
-        *pixels = a | (b << 4) | (g << 8) | (r << 12);
+        dst[pix_no] = a | (b << 4) | (g << 8) | (r << 12);
     }
 }
 
-static void render_conv_argb_1555(uint16_t *pixels, size_t n_pixels) {
-    for (size_t pix_no = 0; pix_no < n_pixels; pix_no++, pixels++) {
-        uint16_t pix_current = *pixels;
+static void render_conv_argb_1555(uint16_t *dst, uint16_t const *src,
+                                  size_t n_pixels) {
+    for (size_t pix_no = 0; pix_no < n_pixels; pix_no++) {
+        uint16_t pix_current = src[pix_no];
         uint16_t b = (pix_current & 0x001f) >> 0;
         uint16_t g = (pix_current & 0x03e0) >> 5;
         uint16_t r = (pix_current & 0x7c00) >> 10;
         uint16_t a = (pix_current & 0x8000) >> 15;
 
-        *pixels = (a << 15) | (b << 10) | (g << 5) | (r << 0);
+        dst[pix_no] = (a << 15) | (b << 10) | (g << 5) | (r << 0);
     }
 }
 
@@ -606,7 +827,6 @@ static void opengl_renderer_set_blend_enable(bool enable) {
 }
 
 static float clip_min, clip_max;
-static bool tex_enable;
 static unsigned screen_width, screen_height;
 
 static void opengl_renderer_set_rend_param(struct gfx_rend_param const *param) {
@@ -728,35 +948,13 @@ static void opengl_renderer_set_rend_param(struct gfx_rend_param const *param) {
     glDepthMask(param->enable_depth_writes ? GL_TRUE : GL_FALSE);
     glDepthFunc(depth_funcs[param->depth_func]);
 
-    tex_enable = param->tex_enable;
+    // remember which pixels modifier volumes are allowed to affect
+    glStencilFunc(GL_ALWAYS, param->shadow ? STENCIL_SHADOW : 0, 0xff);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+    glStencilMask(STENCIL_SHADOW);
 }
 
-static void opengl_renderer_draw_array(float const *verts, unsigned n_verts) {
-    if (!n_verts)
-        return;
-
-    if (oit_state.enabled) {
-        oit_state.tri_count += n_verts / 3;
-
-        if (oit_state.group_count < OIT_MAX_GROUPS) {
-            struct oit_group *grp = oit_state.groups + oit_state.group_count++;
-            grp->rend_param = oit_state.cur_rend_param;
-            grp->verts = verts;
-            grp->n_verts = n_verts;
-
-            float avg_depth = 0.0f;
-            unsigned vert_no;
-            for (vert_no = 0; vert_no < n_verts; vert_no++)
-                avg_depth += verts[vert_no * GFX_VERT_LEN + 2];
-            avg_depth /= n_verts;
-
-            grp->avg_depth = avg_depth;
-        } else {
-            LOG_ERROR("OPENGL GFX: OIT BUFFER OVERFLOW!!!\n");
-        }
-        return;
-    }
-
+static void opengl_renderer_set_trans_mat(void) {
     float clip_min_actual = clip_min * 1.01f;
     float clip_max_actual = clip_max * 1.01f;
 
@@ -774,34 +972,76 @@ static void opengl_renderer_draw_array(float const *verts, unsigned n_verts) {
     };
 
     glUniformMatrix4fv(trans_mat_slot, 1, GL_TRUE, trans_mat);
+}
 
-    // now draw the geometry itself
+/*
+ * upload n_verts verts to the vbo and n_indices indices to the ibo, then
+ * configure the vertex attributes.  The vao, vbo and ibo are left bound.
+ */
+static void opengl_renderer_load_verts(struct gfx_vert const *verts,
+                                       unsigned n_verts,
+                                       GLuint const *indices,
+                                       unsigned n_indices) {
     glBindVertexArray(vao);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER,
-                 sizeof(float) * n_verts * GFX_VERT_LEN,
+    glBufferData(GL_ARRAY_BUFFER, sizeof(struct gfx_vert) * n_verts,
                  verts, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * n_indices,
+                 indices, GL_DYNAMIC_DRAW);
+
     glEnableVertexAttribArray(POSITION_SLOT);
     glEnableVertexAttribArray(BASE_COLOR_SLOT);
     glEnableVertexAttribArray(OFFS_COLOR_SLOT);
     glVertexAttribPointer(POSITION_SLOT, 3, GL_FLOAT, GL_FALSE,
-                          GFX_VERT_LEN * sizeof(float),
-                          (GLvoid*)(GFX_VERT_POS_OFFSET * sizeof(float)));
-    glVertexAttribPointer(BASE_COLOR_SLOT, 4, GL_FLOAT, GL_FALSE,
-                          GFX_VERT_LEN * sizeof(float),
-                          (GLvoid*)(GFX_VERT_BASE_COLOR_OFFSET * sizeof(float)));
-    glVertexAttribPointer(OFFS_COLOR_SLOT, 4, GL_FLOAT, GL_FALSE,
-                          GFX_VERT_LEN * sizeof(float),
-                          (GLvoid*)(GFX_VERT_OFFS_COLOR_OFFSET * sizeof(float)));
-    if (tex_enable) {
-        glEnableVertexAttribArray(TEX_COORD_SLOT);
-        glVertexAttribPointer(TEX_COORD_SLOT, 2, GL_FLOAT, GL_FALSE,
-                              GFX_VERT_LEN * sizeof(float),
-                              (GLvoid*)(GFX_VERT_TEX_COORD_OFFSET * sizeof(float)));
+                          sizeof(struct gfx_vert),
+                          (GLvoid*)offsetof(struct gfx_vert, pos));
+
+    // colors are stored as bytes and normalized to [0, 1] by the GPU
+    glVertexAttribPointer(BASE_COLOR_SLOT, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                          sizeof(struct gfx_vert),
+                          (GLvoid*)offsetof(struct gfx_vert, base_color));
+    glVertexAttribPointer(OFFS_COLOR_SLOT, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                          sizeof(struct gfx_vert),
+                          (GLvoid*)offsetof(struct gfx_vert, offs_color));
+
+    /*
+     * the texture coordinates are always wired up.  Shaders which don't have
+     * TEX_ENABLE defined simply won't read from this slot.
+     */
+    glEnableVertexAttribArray(TEX_COORD_SLOT);
+    glVertexAttribPointer(TEX_COORD_SLOT, 2, GL_FLOAT, GL_FALSE,
+                          sizeof(struct gfx_vert),
+                          (GLvoid*)offsetof(struct gfx_vert, tex_coord));
+}
+
+static void opengl_renderer_draw_array(struct gfx_vert const *verts,
+                                       unsigned n_verts,
+                                       uint32_t const *indices,
+                                       unsigned n_indices) {
+    if (!n_verts || !n_indices)
+        return;
+
+    if (oit_state.enabled) {
+        gfx_depth_sort_add(&oit_state.sort, &oit_state.cur_rend_param,
+                           verts, n_verts, indices, n_indices);
+        return;
     }
-    glDrawArrays(GL_TRIANGLES, 0, n_verts);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    opengl_renderer_set_trans_mat();
+
+    /*
+     * now draw the geometry itself.  Every strip ends with GFX_PRIM_RESTART,
+     * so the whole group goes out in one draw call.
+     */
+    opengl_renderer_load_verts(verts, n_verts, indices, n_indices);
+    glEnable(GL_PRIMITIVE_RESTART);
+    glPrimitiveRestartIndex(GFX_PRIM_RESTART);
+    glDrawElements(GL_TRIANGLE_STRIP, n_indices, GL_UNSIGNED_INT, NULL);
+    glDisable(GL_PRIMITIVE_RESTART);
     glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     glBindTexture(GL_TEXTURE_2D, 0);
 }
@@ -833,7 +1073,10 @@ static void opengl_renderer_clear(float const bgcolor[4]) {
         glClearColor(0.0, 0.0, 0.0, 1.0);
     }
     glDepthMask(GL_TRUE);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glStencilMask(0xff);
+    glClearStencil(0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    glEnable(GL_STENCIL_TEST);
 
     if (rend_cfg.depth_enable)
         glEnable(GL_DEPTH_TEST);
@@ -881,6 +1124,7 @@ void opengl_renderer_tex_set_dims(unsigned obj_no,
 
 void opengl_renderer_tex_set_format(unsigned obj_no, GLenum fmt) {
     obj_tex_meta_array[obj_no].format = fmt;
+    obj_tex_meta_array[obj_no].internal_fmt = fmt;
 }
 
 void opengl_renderer_tex_set_dat_type(unsigned obj_no, GLenum dat_tp) {
@@ -909,11 +1153,26 @@ static void opengl_renderer_begin_sort_mode(void) {
 
     if (gfx_config_read().depth_sort_enable) {
         oit_state.enabled = true;
-        oit_state.tri_count = 0;
-        oit_state.group_count = 0;
+        gfx_depth_sort_begin(&oit_state.sort, oit_state.mode);
     }
 }
 
+static void *oit_grow_buf(void *buf, unsigned *alloc_p,
+                          unsigned n_elem, size_t elem_sz) {
+    if (n_elem <= *alloc_p)
+        return buf;
+
+    unsigned alloc = *alloc_p ? *alloc_p : 1024;
+    while (alloc < n_elem)
+        alloc *= 2;
+
+    void *ret = realloc(buf, alloc * elem_sz);
+    if (!ret)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    *alloc_p = alloc;
+    return ret;
+}
+
 static void opengl_renderer_end_sort_mode(void) {
     if (!gfx_config_read().depth_sort_enable)
         return;
@@ -922,29 +1181,165 @@ static void opengl_renderer_end_sort_mode(void) {
 
     oit_state.enabled = false;
 
-    // do an insertion sort because i'm a pleb
-    unsigned src_idx, dst_idx;
-    unsigned grp_cnt = oit_state.group_count;
-    if (grp_cnt) {
-        struct oit_group tmp;
-        for (src_idx = 0; src_idx < grp_cnt - 1; src_idx++) {
-            struct oit_group *grp_src = oit_state.groups + src_idx;
-            for (dst_idx = src_idx + 1; dst_idx < grp_cnt; dst_idx++) {
-                struct oit_group *grp_dst = oit_state.groups + dst_idx;
-                if (grp_dst->avg_depth >= grp_src->avg_depth) {
-                    tmp = *grp_src;
-                    *grp_src = *grp_dst;
-                    *grp_dst = tmp;
-                }
-            }
-        }
+    struct gfx_depth_sort *sort = &oit_state.sort;
+    gfx_depth_sort_finish(sort);
 
-        for (src_idx = 0; src_idx < grp_cnt; src_idx++) {
-            struct oit_group *grp_src = oit_state.groups + src_idx;
-            opengl_renderer_set_rend_param(&grp_src->rend_param);
-            opengl_renderer_draw_array(grp_src->verts, grp_src->n_verts);
+    unsigned n_tris = sort->n_tris;
+    if (!n_tris)
+        return;
+
+    // gather every group into one vertex array
+    oit_state.vert_buf =
+        (struct gfx_vert*)oit_grow_buf(oit_state.vert_buf,
+                                       &oit_state.vert_buf_alloc,
+                                       sort->n_verts, sizeof(struct gfx_vert));
+    unsigned grp_no;
+    for (grp_no = 0; grp_no < sort->n_groups; grp_no++) {
+        struct gfx_depth_sort_group const *grp = sort->groups + grp_no;
+        memcpy(oit_state.vert_buf + grp->first_vert,
+               grp->verts, grp->n_verts * sizeof(struct gfx_vert));
+    }
+
+    // build the index buffer in back-to-front order
+    oit_state.idx_buf = (GLuint*)oit_grow_buf(oit_state.idx_buf,
+                                              &oit_state.idx_buf_alloc,
+                                              n_tris * 3, sizeof(GLuint));
+    unsigned pos;
+    for (pos = 0; pos < n_tris; pos++) {
+        uint32_t const *tri_idx = sort->tri_idx + 3 * sort->tri_order[pos];
+        oit_state.idx_buf[3 * pos] = tri_idx[0];
+        oit_state.idx_buf[3 * pos + 1] = tri_idx[1];
+        oit_state.idx_buf[3 * pos + 2] = tri_idx[2];
+    }
+
+    opengl_renderer_load_verts(oit_state.vert_buf, sort->n_verts,
+                               oit_state.idx_buf, n_tris * 3);
+
+    /*
+     * Walk the sorted triangles and issue one draw for every run which shares
+     * the same rendering parameters.  If everything in the list uses the same
+     * parameters then this is one draw call.
+     */
+    unsigned run_start = 0;
+    struct gfx_rend_param const *run_param =
+        &gfx_depth_sort_tri_group(sort, sort->tri_order[0])->rend_param;
+    for (pos = 1; pos <= n_tris; pos++) {
+        struct gfx_rend_param const *param = NULL;
+        if (pos < n_tris) {
+            param = &gfx_depth_sort_tri_group(sort,
+                                              sort->tri_order[pos])->rend_param;
+            if (param == run_param || gfx_rend_param_equal(param, run_param))
+                continue;
         }
+
+        opengl_renderer_set_rend_param(run_param);
+        opengl_renderer_set_trans_mat();
+        glBindVertexArray(vao);
+        glDrawElements(GL_TRIANGLES, (pos - run_start) * 3, GL_UNSIGNED_INT,
+                       (GLvoid*)(run_start * 3 * sizeof(GLuint)));
+
+        run_start = pos;
+        run_param = param;
     }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/*
+ * select the plain untextured shader for drawing volumes and full-screen
+ * passes.  Nothing it outputs is used except for its position.
+ */
+static void opengl_renderer_use_flat_shader(void) {
+    struct shader_cache_ent *shader_ent = fetch_shader(0);
+    glUseProgram(shader_ent->shader.shader_prog_obj);
+    trans_mat_slot = shader_ent->slots[SHADER_CACHE_SLOT_TRANS_MAT];
+    opengl_renderer_set_trans_mat();
+}
+
+// draw a quad covering the whole render target
+static void opengl_renderer_draw_screen_quad(void) {
+    struct gfx_vert quad[4] = {
+        { .pos = { 0.0f, 0.0f, 1.0f } },
+        { .pos = { (float)screen_width, 0.0f, 1.0f } },
+        { .pos = { 0.0f, (float)screen_height, 1.0f } },
+        { .pos = { (float)screen_width, (float)screen_height, 1.0f } }
+    };
+
+    opengl_renderer_load_verts(quad, 4, NULL, 0);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+static void opengl_renderer_draw_mod_vol(struct gfx_vert const *verts,
+                                         unsigned n_verts, bool exclude) {
+    if (!n_verts)
+        return;
+
+    opengl_renderer_use_flat_shader();
+
+    /*
+     * count the volume's faces which are in front of what's already been
+     * drawn.  Only the parity matters.
+     */
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glDepthFunc(depth_funcs[PVR2_DEPTH_GREATER]);
+    glStencilMask(STENCIL_PARITY);
+    glStencilFunc(GL_ALWAYS, 0, 0xff);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_INVERT);
+
+    opengl_renderer_load_verts(verts, n_verts, NULL, 0);
+    glDrawArrays(GL_TRIANGLES, 0, n_verts);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // merge this volume into the set, then clear the parity for the next one
+    glDisable(GL_DEPTH_TEST);
+    glStencilMask(STENCIL_IN_VOL);
+    glStencilFunc(GL_EQUAL,
+                  exclude ? STENCIL_IN_VOL : (STENCIL_IN_VOL | STENCIL_PARITY),
+                  STENCIL_PARITY);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+    opengl_renderer_draw_screen_quad();
+
+    glStencilMask(STENCIL_PARITY);
+    glClear(GL_STENCIL_BUFFER_BIT);
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    if (gfx_config_read().depth_enable)
+        glEnable(GL_DEPTH_TEST);
+}
+
+static void opengl_renderer_apply_mod_vol(float shadow_scale) {
+    opengl_renderer_use_flat_shader();
+
+    /*
+     * There's no need to draw the shadowed polygons a second time since the
+     * second parameter set only differs from the first by a scale factor;
+     * scaling what's already in the framebuffer does the same thing.
+     */
+    glDisable(GL_DEPTH_TEST);
+    glStencilMask(0);
+    glStencilFunc(GL_EQUAL, STENCIL_SHADOW | STENCIL_IN_VOL,
+                  STENCIL_SHADOW | STENCIL_IN_VOL);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    glEnable(GL_BLEND);
+    glBlendColor(shadow_scale, shadow_scale, shadow_scale, 1.0f);
+    glBlendFunc(GL_ZERO, GL_CONSTANT_COLOR);
+    opengl_renderer_draw_screen_quad();
+    glDisable(GL_BLEND);
+
+    glStencilMask(STENCIL_IN_VOL | STENCIL_PARITY);
+    glClear(GL_STENCIL_BUFFER_BIT);
+
+    if (gfx_config_read().depth_enable)
+        glEnable(GL_DEPTH_TEST);
 }
 
 static GLenum tex_fmt_to_data_type(enum gfx_tex_fmt gfx_fmt) {
@@ -43,4 +43,12 @@ GLenum opengl_renderer_tex_get_format(unsigned obj_no);
 GLenum opengl_renderer_tex_get_dat_type(unsigned obj_no);
 bool opengl_renderer_tex_get_dirty(unsigned obj_no);
 
+/*
+ * Textures uploaded by the texture cache have immutable storage.  Call this
+ * before re-specifying a texture with glTexImage2D; if it's immutable it
+ * gets replaced by a new texture object, so opengl_renderer_tex has to be
+ * called again afterwards.
+ */
+void opengl_renderer_tex_make_mutable(unsigned obj_no);
+
 #endif
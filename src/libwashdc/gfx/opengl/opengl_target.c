@@ -20,6 +20,7 @@
  *
  ******************************************************************************/
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
@@ -40,9 +41,38 @@ static GLuint depth_buf_tex;
 static GLenum draw_buffer = GL_COLOR_ATTACHMENT0;
 static unsigned fbo_width, fbo_height;
 
+/*
+ * Asynchronous readback.
+ *
+ * Reading a render target back with glGetTexImage forces the CPU to wait for
+ * the GPU to finish everything it has been given, so targets which have been
+ * read before get their pixels copied into a pixel-buffer object as soon as
+ * rendering ends.  The copy runs on the GPU alongside whatever else is
+ * queued, and the fence is only waited on if the guest actually ends up
+ * reading the target.
+ *
+ * read_hist is a small saturating counter.  It goes up every time a target is
+ * read and goes down every time a readback is started that nobody consumes
+ * before the next render, so targets which stop being read stop paying for
+ * the copy.
+ */
+#define READ_HIST_MAX 3
+
+static struct target_readback {
+    GLuint pbo;
+    GLsync fence;
+    size_t pbo_len;
+    unsigned width, height;
+    unsigned read_hist;
+    bool pending;
+} readback[GFX_OBJ_COUNT];
+
 static void opengl_target_obj_read(struct gfx_obj  *obj, void *out,
                                    size_t n_bytes);
 static void opengl_target_grab_pixels(int handle, void *out, GLsizei buf_size);
+static void readback_start(int obj_handle);
+static bool readback_finish(int obj_handle, void *out, GLsizei buf_size);
+static void readback_discard(int obj_handle);
 
 void opengl_target_init(void) {
     fbo_width = 0;
@@ -50,6 +80,21 @@ void opengl_target_init(void) {
 
     glGenFramebuffers(1, &fbo);
     glGenTextures(1, &depth_buf_tex);
+
+    memset(readback, 0, sizeof(readback));
+}
+
+void opengl_target_cleanup(void) {
+    unsigned handle;
+    for (handle = 0; handle < GFX_OBJ_COUNT; handle++) {
+        readback_discard(handle);
+        if (readback[handle].pbo)
+            glDeleteBuffers(1, &readback[handle].pbo);
+    }
+    memset(readback, 0, sizeof(readback));
+
+    glDeleteTextures(1, &depth_buf_tex);
+    glDeleteFramebuffers(1, &fbo);
 }
 
 void opengl_target_begin(unsigned width, unsigned height, int tgt_handle) {
@@ -60,14 +105,13 @@ void opengl_target_begin(unsigned width, unsigned height, int tgt_handle) {
 
     glBindFramebuffer(GL_FRAMEBUFFER, fbo);
 
-    GLuint color_buf_tex = opengl_renderer_tex(tgt_handle);
-
     if (opengl_renderer_tex_get_dirty(tgt_handle) ||
         opengl_renderer_tex_get_width(tgt_handle) != width ||
         opengl_renderer_tex_get_height(tgt_handle) != height ||
         opengl_renderer_tex_get_format(tgt_handle) != GL_RGBA ||
         opengl_renderer_tex_get_dat_type(tgt_handle) != GL_UNSIGNED_BYTE) {
-        glBindTexture(GL_TEXTURE_2D, color_buf_tex);
+        opengl_renderer_tex_make_mutable(tgt_handle);
+        glBindTexture(GL_TEXTURE_2D, opengl_renderer_tex(tgt_handle));
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
                      GL_UNSIGNED_BYTE, NULL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -85,13 +129,16 @@ void opengl_target_begin(unsigned width, unsigned height, int tgt_handle) {
         fbo_width = width;
         fbo_height = height;
 
+        // the stencil bits are used for modifier volumes
         glBindTexture(GL_TEXTURE_2D, depth_buf_tex);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0,
-                     GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0,
+                     GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     }
 
+    GLuint color_buf_tex = opengl_renderer_tex(tgt_handle);
+
     /*
      * it is guaranteed that fbo_width == width && fbo_height == height due to
      * the above if statement.
@@ -100,7 +147,7 @@ void opengl_target_begin(unsigned width, unsigned height, int tgt_handle) {
 
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
                            GL_TEXTURE_2D, color_buf_tex, 0);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
                            GL_TEXTURE_2D, depth_buf_tex, 0);
     glBindTexture(GL_TEXTURE_2D, color_buf_tex);
     glDrawBuffers(1, &draw_buffer);
@@ -136,18 +183,105 @@ void opengl_target_end(int tgt_handle) {
 
     static GLenum back_buffer = GL_BACK;
     glDrawBuffers(1, &back_buffer);
+    glDisable(GL_STENCIL_TEST);
     glBindTexture(GL_TEXTURE_2D, 0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
     // or should i do this in opengl_target_end ?
     gfx_obj_get(tgt_handle)->state = GFX_OBJ_STATE_TEX;
+
+    struct target_readback *rb = readback + tgt_handle;
+    if (rb->pending) {
+        // the last readback was never consumed
+        readback_discard(tgt_handle);
+        if (rb->read_hist)
+            rb->read_hist--;
+    }
+
+    if (rb->read_hist)
+        readback_start(tgt_handle);
+}
+
+static void readback_start(int obj_handle) {
+    struct target_readback *rb = readback + obj_handle;
+    size_t len = fbo_width * fbo_height * 4 * sizeof(uint8_t);
+
+    if (!rb->pbo)
+        glGenBuffers(1, &rb->pbo);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbo);
+    if (rb->pbo_len != len) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, len, NULL, GL_STREAM_READ);
+        rb->pbo_len = len;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, opengl_renderer_tex(obj_handle));
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    rb->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    rb->width = fbo_width;
+    rb->height = fbo_height;
+    rb->pending = true;
+}
+
+/*
+ * copy the pixels from a pending readback into out, waiting for the GPU if it
+ * hasn't gotten there yet.  Returns false if there was no usable readback, in
+ * which case the caller needs to read the texture the slow way.
+ */
+static bool readback_finish(int obj_handle, void *out, GLsizei buf_size) {
+    struct target_readback *rb = readback + obj_handle;
+
+    if (!rb->pending)
+        return false;
+
+    if (buf_size < 0 || rb->pbo_len > (size_t)buf_size) {
+        readback_discard(obj_handle);
+        return false;
+    }
+
+    GLenum stat;
+    do {
+        stat = glClientWaitSync(rb->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                1000000000);
+    } while (stat == GL_TIMEOUT_EXPIRED);
+
+    if (stat == GL_WAIT_FAILED) {
+        LOG_ERROR("%s - glClientWaitSync failed\n", __func__);
+        readback_discard(obj_handle);
+        return false;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbo);
+    void const *pix = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                       rb->pbo_len, GL_MAP_READ_BIT);
+    bool success = pix != NULL;
+    if (success) {
+        memcpy(out, pix, rb->pbo_len);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    readback_discard(obj_handle);
+    return success;
+}
+
+static void readback_discard(int obj_handle) {
+    struct target_readback *rb = readback + obj_handle;
+    if (rb->pending) {
+        glDeleteSync(rb->fence);
+        rb->fence = NULL;
+        rb->pending = false;
+    }
 }
 
 static void opengl_target_grab_pixels(int obj_handle, void *out,
                                       GLsizei buf_size) {
     size_t length_expect = fbo_width * fbo_height * 4 * sizeof(uint8_t);
 
-    if (buf_size < length_expect) {
+    if (buf_size < 0 || (size_t)buf_size < length_expect) {
         LOG_ERROR("need at least 0x%08x bytes (have 0x%08x)\n",
                   (unsigned)length_expect, (unsigned)buf_size);
         error_set_length(buf_size);
@@ -155,6 +289,13 @@ static void opengl_target_grab_pixels(int obj_handle, void *out,
         RAISE_ERROR(ERROR_MEM_OUT_OF_BOUNDS);
     }
 
+    struct target_readback *rb = readback + obj_handle;
+    if (rb->read_hist < READ_HIST_MAX)
+        rb->read_hist++;
+
+    if (readback_finish(obj_handle, out, buf_size))
+        return;
+
     GLuint color_buf_tex = opengl_renderer_tex(obj_handle);
     glBindTexture(GL_TEXTURE_2D, color_buf_tex);
     glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, out);
@@ -180,6 +321,7 @@ void opengl_target_unbind_obj(int obj_handle) {
     gfx_obj_alloc(obj);
     if (gfx_obj_get(obj_handle)->state == GFX_OBJ_STATE_TEX)
         opengl_target_grab_pixels(gfx_obj_handle(obj), obj->dat, obj->dat_len);
+    readback_discard(obj_handle);
 
     obj->on_read = NULL;
 }
@@ -189,6 +331,8 @@ static void opengl_target_obj_read(struct gfx_obj *obj, void *out,
     if (obj->state == GFX_OBJ_STATE_TEX) {
         opengl_target_grab_pixels(gfx_obj_handle(obj), out, n_bytes);
     } else {
+        // the texture has been overwritten since the last render
+        readback_discard(gfx_obj_handle(obj));
         gfx_obj_alloc(obj);
         memcpy(out, obj->dat, n_bytes);
     }
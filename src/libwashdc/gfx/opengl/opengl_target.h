@@ -26,6 +26,7 @@
 /* code for configuring opengl's rendering target (which is a texture+FBO) */
 
 void opengl_target_init(void);
+void opengl_target_cleanup(void);
 
 void opengl_target_bind_obj(int obj_handle);
 void opengl_target_unbind_obj(int obj_handle);
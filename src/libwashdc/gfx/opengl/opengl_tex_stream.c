@@ -0,0 +1,204 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define GL3_PROTOTYPES 1
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "washdc/error.h"
+#include "log.h"
+
+#include "opengl_tex_stream.h"
+
+/*
+ * The unpack buffer is split into segments.  Each segment gets a fence when
+ * uploads move on to the next one, and that fence is waited on before the
+ * segment gets written again, so the CPU only ever blocks if the GPU is an
+ * entire ring behind.  A single upload never spans two segments, so a
+ * segment needs to be big enough for the largest texture (1024x1024 at four
+ * bytes per pixel).
+ */
+#define TEX_STREAM_SEG_LEN (1024 * 1024 * 4)
+#define TEX_STREAM_N_SEGS 4
+#define TEX_STREAM_LEN (TEX_STREAM_SEG_LEN * TEX_STREAM_N_SEGS)
+
+// glTexSubImage2D wants the offset to be a multiple of the pixel size
+#define TEX_STREAM_ALIGN 16
+
+#define TEX_STREAM_MAP_FLAGS \
+    (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)
+
+static GLuint stream_pbo;
+static uint8_t *stream_map;
+static GLsync seg_fence[TEX_STREAM_N_SEGS];
+static unsigned cur_seg;
+static size_t seg_offs;
+
+// offset into the unpack buffer of the upload in progress
+static size_t pending_offs;
+static bool pending_scratch;
+
+// fallback for when the unpack buffer isn't available
+static void *scratch;
+static size_t scratch_len;
+
+static void next_seg(void);
+
+void opengl_tex_stream_init(void) {
+    stream_pbo = 0;
+    stream_map = NULL;
+    cur_seg = 0;
+    seg_offs = 0;
+    pending_offs = 0;
+    pending_scratch = false;
+    scratch = NULL;
+    scratch_len = 0;
+
+    unsigned seg_no;
+    for (seg_no = 0; seg_no < TEX_STREAM_N_SEGS; seg_no++)
+        seg_fence[seg_no] = NULL;
+
+    if (!GLEW_ARB_buffer_storage) {
+        LOG_INFO("%s - GL_ARB_buffer_storage is not supported; textures will "
+                 "be uploaded from system memory\n", __func__);
+        return;
+    }
+
+    glGenBuffers(1, &stream_pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream_pbo);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, TEX_STREAM_LEN, NULL,
+                    TEX_STREAM_MAP_FLAGS);
+    stream_map = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+                                            TEX_STREAM_LEN,
+                                            TEX_STREAM_MAP_FLAGS);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (!stream_map) {
+        LOG_WARN("%s - unable to map texture upload buffer; textures will "
+                 "be uploaded from system memory\n", __func__);
+        glDeleteBuffers(1, &stream_pbo);
+        stream_pbo = 0;
+    }
+}
+
+void opengl_tex_stream_cleanup(void) {
+    unsigned seg_no;
+    for (seg_no = 0; seg_no < TEX_STREAM_N_SEGS; seg_no++) {
+        if (seg_fence[seg_no]) {
+            glDeleteSync(seg_fence[seg_no]);
+            seg_fence[seg_no] = NULL;
+        }
+    }
+
+    if (stream_map) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream_pbo);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        stream_map = NULL;
+    }
+
+    if (stream_pbo) {
+        glDeleteBuffers(1, &stream_pbo);
+        stream_pbo = 0;
+    }
+
+    free(scratch);
+    scratch = NULL;
+    scratch_len = 0;
+}
+
+bool opengl_tex_stream_mapped(void) {
+    return stream_map != NULL;
+}
+
+void *opengl_tex_stream_begin(size_t n_bytes) {
+    if (!stream_map || n_bytes > TEX_STREAM_SEG_LEN) {
+        if (n_bytes > scratch_len) {
+            void *new_scratch = realloc(scratch, n_bytes);
+            if (!new_scratch)
+                RAISE_ERROR(ERROR_FAILED_ALLOC);
+            scratch = new_scratch;
+            scratch_len = n_bytes;
+        }
+        pending_scratch = true;
+        return scratch;
+    }
+
+    size_t offs = (seg_offs + TEX_STREAM_ALIGN - 1) &
+        ~(size_t)(TEX_STREAM_ALIGN - 1);
+    if (offs + n_bytes > TEX_STREAM_SEG_LEN) {
+        next_seg();
+        offs = 0;
+    }
+
+    seg_offs = offs + n_bytes;
+    pending_offs = cur_seg * (size_t)TEX_STREAM_SEG_LEN + offs;
+    pending_scratch = false;
+    return stream_map + pending_offs;
+}
+
+void opengl_tex_stream_end(GLsizei width, GLsizei height,
+                           GLenum format, GLenum dat_type) {
+    if (pending_scratch) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+                        format, dat_type, scratch);
+        return;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream_pbo);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, dat_type,
+                    (void const*)(uintptr_t)pending_offs);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+/*
+ * fence off the current segment and move on to the next one, waiting for the
+ * GPU to finish reading it if it hasn't already.
+ */
+static void next_seg(void) {
+    if (seg_fence[cur_seg])
+        glDeleteSync(seg_fence[cur_seg]);
+    seg_fence[cur_seg] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    cur_seg = (cur_seg + 1) % TEX_STREAM_N_SEGS;
+    seg_offs = 0;
+
+    GLsync fence = seg_fence[cur_seg];
+    if (!fence)
+        return;
+
+    GLenum stat;
+    do {
+        stat = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    } while (stat == GL_TIMEOUT_EXPIRED);
+
+    if (stat == GL_WAIT_FAILED)
+        LOG_ERROR("%s - glClientWaitSync failed\n", __func__);
+
+    glDeleteSync(fence);
+    seg_fence[cur_seg] = NULL;
+}
@@ -0,0 +1,61 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef OPENGL_TEX_STREAM_H_
+#define OPENGL_TEX_STREAM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <GL/gl.h>
+
+/*
+ * Texture upload staging.
+ *
+ * Texture data gets written to memory handed out by opengl_tex_stream_begin
+ * and then uploaded into the currently-bound GL_TEXTURE_2D with
+ * opengl_tex_stream_end.  When the driver supports persistent buffer mapping,
+ * that memory is a slice of a pixel-unpack buffer, so the copy into the
+ * texture happens on the GPU without blocking on rendering; otherwise it's a
+ * reusable scratch buffer in system memory.
+ */
+
+void opengl_tex_stream_init(void);
+void opengl_tex_stream_cleanup(void);
+
+// true if uploads go through the persistently-mapped unpack buffer
+bool opengl_tex_stream_mapped(void);
+
+/*
+ * returns a buffer with room for n_bytes of pixel data.  It is only valid
+ * until the matching call to opengl_tex_stream_end.
+ */
+void *opengl_tex_stream_begin(size_t n_bytes);
+
+/*
+ * upload the data written since opengl_tex_stream_begin into the bound
+ * texture with glTexSubImage2D.
+ */
+void opengl_tex_stream_end(GLsizei width, GLsizei height,
+                           GLenum format, GLenum dat_type);
+
+#endif
@@ -21,6 +21,7 @@
  ******************************************************************************/
 
 #include <err.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -51,12 +52,12 @@ void shader_load_vert_with_preamble(struct shader *out,
     char const *shader_strings[3];
 
     if (preamble) {
-        shader_strings[0] = "#version 330 core\n";
+        shader_strings[0] = SHADER_VERSION_STR;
         shader_strings[1] = preamble;
         shader_strings[2] = vert_shader_src;
         n_shader_strings = 3;
     } else {
-        shader_strings[0] = "#version 330 core\n";
+        shader_strings[0] = SHADER_VERSION_STR;
         shader_strings[1] = vert_shader_src;
         shader_strings[2] = NULL;
         n_shader_strings = 2;
@@ -86,12 +87,12 @@ void shader_load_frag_with_preamble(struct shader *out,
     char const *shader_strings[3];
 
     if (preamble) {
-        shader_strings[0] = "#version 330 core\n";
+        shader_strings[0] = SHADER_VERSION_STR;
         shader_strings[1] = preamble;
         shader_strings[2] = frag_shader_src;
         n_shader_strings = 3;
     } else {
-        shader_strings[0] = "#version 330 core\n";
+        shader_strings[0] = SHADER_VERSION_STR;
         shader_strings[1] = frag_shader_src;
         n_shader_strings = 2;
     }
@@ -143,8 +144,22 @@ void shader_load_frag_from_file(struct shader *out, char const *frag_shader_path
     shader_load_frag_from_file_with_preamble(out, frag_shader_path, NULL);
 }
 
+static void do_link(struct shader *out, bool retrievable);
+
 void shader_link(struct shader *out) {
+    do_link(out, false);
+}
+
+void shader_link_retrievable(struct shader *out) {
+    do_link(out, true);
+}
+
+static void do_link(struct shader *out, bool retrievable) {
     GLuint shader_obj = glCreateProgram();
+    if (retrievable) {
+        glProgramParameteri(shader_obj, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                            GL_TRUE);
+    }
     glAttachShader(shader_obj, out->vert_shader);
     glAttachShader(shader_obj, out->frag_shader);
     glLinkProgram(shader_obj);
@@ -20,9 +20,16 @@
  *
  ******************************************************************************/
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
+#define GL3_PROTOTYPES 1
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "log.h"
+
 #include "shader_cache.h"
 
 void shader_cache_init(struct shader_cache *cache) {
@@ -30,13 +37,11 @@ void shader_cache_init(struct shader_cache *cache) {
 }
 
 void shader_cache_cleanup(struct shader_cache *cache) {
-    struct shader_cache_ent *next = cache->ents;
-    while (next) {
-        struct shader_cache_ent *ent = next;
-        next = next->next;
-
-        shader_cleanup(&ent->shader);
-        free(ent);
+    unsigned key;
+    for (key = 0; key < SHADER_KEY_COUNT; key++) {
+        struct shader_cache_ent *ent = cache->ents + key;
+        if (ent->valid)
+            shader_cleanup(&ent->shader);
     }
 
     memset(cache, 0, sizeof(*cache));
@@ -44,10 +49,14 @@ void shader_cache_cleanup(struct shader_cache *cache) {
 
 struct shader_cache_ent *shader_cache_add_ent(struct shader_cache *cache,
                                               shader_key key) {
-    struct shader_cache_ent *ent =
-        (struct shader_cache_ent*)calloc(1, sizeof(struct shader_cache_ent));
-    ent->next = cache->ents;
-    cache->ents = ent;
+    if (key >= SHADER_KEY_COUNT)
+        return NULL;
+
+    struct shader_cache_ent *ent = cache->ents + key;
+    if (ent->valid)
+        shader_cleanup(&ent->shader);
+    memset(ent, 0, sizeof(*ent));
+    ent->valid = true;
     ent->key = key;
 
     int slot_no;
@@ -57,13 +66,208 @@ struct shader_cache_ent *shader_cache_add_ent(struct shader_cache *cache,
     return ent;
 }
 
-struct shader_cache_ent *shader_cache_find(struct shader_cache *cache,
-                                           shader_key key) {
-    struct shader_cache_ent *next = cache->ents;
-    while (next) {
-        if (next->key == key)
-            return next;
-        next = next->next;
+#define SHADER_BIN_MAGIC "WDCGLBIN"
+#define SHADER_BIN_MAGIC_LEN 8
+#define SHADER_BIN_VERSION 1
+
+// longest vendor/renderer/version string that will be stored
+#define SHADER_BIN_STR_MAX 256
+
+bool shader_cache_bin_supported(void) {
+    if (!GLEW_ARB_get_program_binary && !GLEW_VERSION_4_1)
+        return false;
+
+    GLint n_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n_formats);
+    return n_formats > 0;
+}
+
+static char const *gl_str(GLenum name) {
+    char const *str = (char const*)glGetString(name);
+    return str ? str : "";
+}
+
+static int write_u32(FILE *fp, uint32_t val) {
+    return fwrite(&val, sizeof(val), 1, fp) == 1 ? 0 : -1;
+}
+
+static int read_u32(FILE *fp, uint32_t *val) {
+    return fread(val, sizeof(*val), 1, fp) == 1 ? 0 : -1;
+}
+
+static int write_str(FILE *fp, char const *str) {
+    size_t len = strlen(str);
+    if (len > SHADER_BIN_STR_MAX)
+        len = SHADER_BIN_STR_MAX;
+    if (write_u32(fp, len) < 0)
+        return -1;
+    return fwrite(str, 1, len, fp) == len ? 0 : -1;
+}
+
+// returns 0 if the next string in the file matches str
+static int check_str(FILE *fp, char const *str) {
+    char buf[SHADER_BIN_STR_MAX];
+    size_t len = strlen(str);
+    uint32_t file_len;
+    if (len > SHADER_BIN_STR_MAX)
+        len = SHADER_BIN_STR_MAX;
+    if (read_u32(fp, &file_len) < 0 || file_len != len)
+        return -1;
+    if (fread(buf, 1, len, fp) != len)
+        return -1;
+    return memcmp(buf, str, len) == 0 ? 0 : -1;
+}
+
+static int check_header(FILE *fp, uint32_t src_hash) {
+    char magic[SHADER_BIN_MAGIC_LEN];
+    uint32_t version, file_hash;
+
+    if (fread(magic, 1, SHADER_BIN_MAGIC_LEN, fp) != SHADER_BIN_MAGIC_LEN ||
+        memcmp(magic, SHADER_BIN_MAGIC, SHADER_BIN_MAGIC_LEN) != 0)
+        return -1;
+    if (read_u32(fp, &version) < 0 || version != SHADER_BIN_VERSION)
+        return -1;
+    if (read_u32(fp, &file_hash) < 0 || file_hash != src_hash)
+        return -1;
+    if (check_str(fp, gl_str(GL_VENDOR)) < 0 ||
+        check_str(fp, gl_str(GL_RENDERER)) < 0 ||
+        check_str(fp, gl_str(GL_VERSION)) < 0)
+        return -1;
+    return 0;
+}
+
+unsigned shader_cache_load_bin(struct shader_cache *cache, char const *path,
+                               uint32_t src_hash) {
+    unsigned n_loaded = 0;
+    void *bin = NULL;
+    uint32_t n_ents, ent_no;
+
+    if (!shader_cache_bin_supported())
+        return 0;
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return 0;
+
+    if (check_header(fp, src_hash) < 0) {
+        LOG_INFO("%s - ignoring stale shader binaries in %s\n",
+                 __func__, path);
+        goto close_file;
+    }
+
+    if (read_u32(fp, &n_ents) < 0)
+        goto close_file;
+
+    for (ent_no = 0; ent_no < n_ents; ent_no++) {
+        uint32_t key, bin_fmt, bin_len;
+        if (read_u32(fp, &key) < 0 || read_u32(fp, &bin_fmt) < 0 ||
+            read_u32(fp, &bin_len) < 0)
+            break;
+
+        void *new_bin = realloc(bin, bin_len ? bin_len : 1);
+        if (!new_bin)
+            break;
+        bin = new_bin;
+        if (fread(bin, 1, bin_len, fp) != bin_len)
+            break;
+
+        if (!shader_cache_key_used(key))
+            continue;
+
+        GLuint prog = glCreateProgram();
+        glProgramBinary(prog, bin_fmt, bin, bin_len);
+
+        GLint success;
+        glGetProgramiv(prog, GL_LINK_STATUS, &success);
+        if (!success) {
+            // the driver is allowed to reject binaries for any reason
+            glDeleteProgram(prog);
+            continue;
+        }
+
+        struct shader_cache_ent *ent = shader_cache_add_ent(cache, key);
+        ent->shader.shader_prog_obj = prog;
+        n_loaded++;
+    }
+
+close_file:
+    free(bin);
+    fclose(fp);
+    return n_loaded;
+}
+
+int shader_cache_save_bin(struct shader_cache const *cache, char const *path,
+                          uint32_t src_hash) {
+    uint32_t n_ents = 0;
+    unsigned key;
+    int err_val = 0;
+    void *bin = NULL;
+
+    if (!shader_cache_bin_supported())
+        return -1;
+
+    for (key = 0; key < SHADER_KEY_COUNT; key++)
+        if (cache->ents[key].valid)
+            n_ents++;
+
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        LOG_ERROR("%s - unable to open %s\n", __func__, path);
+        return -1;
+    }
+
+    if (fwrite(SHADER_BIN_MAGIC, 1, SHADER_BIN_MAGIC_LEN, fp) !=
+        SHADER_BIN_MAGIC_LEN ||
+        write_u32(fp, SHADER_BIN_VERSION) < 0 ||
+        write_u32(fp, src_hash) < 0 ||
+        write_str(fp, gl_str(GL_VENDOR)) < 0 ||
+        write_str(fp, gl_str(GL_RENDERER)) < 0 ||
+        write_str(fp, gl_str(GL_VERSION)) < 0 ||
+        write_u32(fp, n_ents) < 0) {
+        err_val = -1;
+        goto close_file;
+    }
+
+    for (key = 0; key < SHADER_KEY_COUNT; key++) {
+        struct shader_cache_ent const *ent = cache->ents + key;
+        if (!ent->valid)
+            continue;
+
+        GLuint prog = ent->shader.shader_prog_obj;
+        GLint bin_len = 0;
+        GLenum bin_fmt = 0;
+        glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &bin_len);
+
+        void *new_bin = realloc(bin, bin_len > 0 ? bin_len : 1);
+        if (!new_bin) {
+            err_val = -1;
+            goto close_file;
+        }
+        bin = new_bin;
+
+        GLsizei actual_len = 0;
+        if (bin_len > 0)
+            glGetProgramBinary(prog, bin_len, &actual_len, &bin_fmt, bin);
+
+        /*
+         * an entry with a zero-length binary gets rejected by
+         * shader_cache_load_bin and recompiled next time.
+         */
+        if (write_u32(fp, key) < 0 || write_u32(fp, bin_fmt) < 0 ||
+            write_u32(fp, actual_len) < 0 ||
+            fwrite(bin, 1, actual_len, fp) != (size_t)actual_len) {
+            err_val = -1;
+            goto close_file;
+        }
+    }
+
+close_file:
+    free(bin);
+    if (fclose(fp) != 0)
+        err_val = -1;
+    if (err_val < 0) {
+        LOG_ERROR("%s - failed to write %s\n", __func__, path);
+        remove(path);
     }
-    return NULL;
+    return err_val;
 }
@@ -23,6 +23,9 @@
 #ifndef SHADER_CACHE_H_
 #define SHADER_CACHE_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include <GL/gl.h>
 
 #include "washdc/gfx/gl/shader.h"
@@ -46,6 +49,9 @@ typedef unsigned shader_key;
 #define SHADER_KEY_TEX_INST_DECAL_ALPHA_BIT (2 << SHADER_KEY_TEX_INST_SHIFT)
 #define SHADER_KEY_TEX_INST_MOD_ALPHA_BIT (3 << SHADER_KEY_TEX_INST_SHIFT)
 
+// total number of keys, valid or not
+#define SHADER_KEY_COUNT (1 << 5)
+
 enum {
     // only valid if SHADER_KEY_TEX_ENABLE_BIT is set
     SHADER_CACHE_SLOT_BOUND_TEX,
@@ -60,14 +66,18 @@ enum {
 };
 
 struct shader_cache_ent {
-    struct shader_cache_ent *next;
+    bool valid;
     shader_key key;
     GLint slots[SHADER_CACHE_SLOT_COUNT];
     struct shader shader;
 };
 
+/*
+ * the key space is small enough that there's one entry for every possible
+ * key, so lookups are just an array index.
+ */
 struct shader_cache {
-    struct shader_cache_ent *ents;
+    struct shader_cache_ent ents[SHADER_KEY_COUNT];
 };
 
 void shader_cache_init(struct shader_cache *cache);
@@ -76,7 +86,41 @@ void shader_cache_cleanup(struct shader_cache *cache);
 struct shader_cache_ent *shader_cache_add_ent(struct shader_cache *cache,
                                               shader_key key);
 
-struct shader_cache_ent *shader_cache_find(struct shader_cache *cache,
-                                           shader_key key);
+static inline struct shader_cache_ent *
+shader_cache_find(struct shader_cache *cache, shader_key key) {
+    if (key >= SHADER_KEY_COUNT)
+        return NULL;
+    struct shader_cache_ent *ent = cache->ents + key;
+    return ent->valid ? ent : NULL;
+}
+
+/*
+ * returns true if the renderer can ever ask for the given key.  Keys which
+ * set texture-instruction bits without enabling textures are never used.
+ */
+static inline bool shader_cache_key_used(shader_key key) {
+    if (key >= SHADER_KEY_COUNT)
+        return false;
+    return (key & SHADER_KEY_TEX_ENABLE_BIT) ||
+        !(key & SHADER_KEY_TEX_INST_MASK);
+}
+
+/*
+ * On-disk cache of linked program binaries.
+ *
+ * The file records the GL vendor, renderer and version strings along with
+ * src_hash (which the caller derives from the shader source); if any of these
+ * don't match then the whole file is ignored.  Program binaries are only
+ * usable if the driver supports ARB_get_program_binary.
+ *
+ * shader_cache_load_bin adds an entry for every program it was able to load
+ * and returns the number of entries loaded.  shader_cache_save_bin returns 0
+ * on success or -1 on failure.
+ */
+bool shader_cache_bin_supported(void);
+unsigned shader_cache_load_bin(struct shader_cache *cache, char const *path,
+                               uint32_t src_hash);
+int shader_cache_save_bin(struct shader_cache const *cache, char const *path,
+                          uint32_t src_hash);
 
 #endif
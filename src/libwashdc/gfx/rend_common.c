@@ -25,16 +25,25 @@
 
 #include "gfx/gfx_tex_cache.h"
 #include "gfx/opengl/opengl_renderer.h"
+#include "gfx/null/null_renderer.h"
+#include "gfx/soft/soft_renderer.h"
+#include "config.h"
 #include "dreamcast.h"
 #include "log.h"
 #include "gfx_il.h"
 
 #include "rend_common.h"
 
-struct rend_if const * const gfx_rend_ifp = &opengl_rend_if;
+struct rend_if const *gfx_rend_ifp = &opengl_rend_if;
 
 // initialize and clean up the graphics renderer
 void rend_init(void) {
+    if (!config_get_headless())
+        gfx_rend_ifp = &opengl_rend_if;
+    else if (config_get_soft_render())
+        gfx_rend_ifp = &soft_rend_if;
+    else
+        gfx_rend_ifp = &null_rend_if;
     gfx_rend_ifp->init();
 }
 
@@ -96,8 +105,10 @@ static void rend_set_clip_range(struct gfx_il_inst *cmd) {
 
 static void rend_draw_array(struct gfx_il_inst *cmd) {
     unsigned n_verts = cmd->arg.draw_array.n_verts;
-    float const *verts = cmd->arg.draw_array.verts;
-    gfx_rend_ifp->draw_array(verts, n_verts);
+    struct gfx_vert const *verts = cmd->arg.draw_array.verts;
+    unsigned n_indices = cmd->arg.draw_array.n_indices;
+    uint32_t const *indices = cmd->arg.draw_array.indices;
+    gfx_rend_ifp->draw_array(verts, n_verts, indices, n_indices);
 }
 
 static void rend_clear(struct gfx_il_inst *cmd) {
@@ -162,11 +173,17 @@ static void rend_grab_framebuffer(struct gfx_il_inst *cmd) {
         return;
     }
 
+    struct gfx_framebuffer *fb = cmd->arg.grab_framebuffer.fb;
     size_t n_bytes = obj->dat_len;
-    void *dat = malloc(n_bytes);
-    if (!dat) {
-        cmd->arg.grab_framebuffer.fb->valid = false;
-        return;
+    void *dat = fb->dat;
+    if (!dat || fb->dat_len < n_bytes) {
+        dat = realloc(fb->dat, n_bytes);
+        if (!dat) {
+            fb->valid = false;
+            return;
+        }
+        fb->dat = dat;
+        fb->dat_len = n_bytes;
     }
 
     gfx_obj_read(handle, dat, n_bytes);
@@ -186,6 +203,16 @@ static void rend_end_depth_sort(struct gfx_il_inst *cmd) {
     gfx_rend_ifp->end_sort_mode();
 }
 
+static void rend_draw_mod_vol(struct gfx_il_inst *cmd) {
+    gfx_rend_ifp->draw_mod_vol(cmd->arg.draw_mod_vol.verts,
+                               cmd->arg.draw_mod_vol.n_verts,
+                               cmd->arg.draw_mod_vol.exclude);
+}
+
+static void rend_apply_mod_vol(struct gfx_il_inst *cmd) {
+    gfx_rend_ifp->apply_mod_vol(cmd->arg.apply_mod_vol.shadow_scale);
+}
+
 void rend_exec_il(struct gfx_il_inst *cmd, unsigned n_cmd) {
     /* bool rendering = false; */
 
@@ -250,6 +277,12 @@ void rend_exec_il(struct gfx_il_inst *cmd, unsigned n_cmd) {
         case GFX_IL_END_DEPTH_SORT:
             rend_end_depth_sort(cmd);
             break;
+        case GFX_IL_DRAW_MOD_VOL:
+            rend_draw_mod_vol(cmd);
+            break;
+        case GFX_IL_APPLY_MOD_VOL:
+            rend_apply_mod_vol(cmd);
+            break;
         }
         cmd++;
     }
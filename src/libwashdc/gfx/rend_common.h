@@ -57,7 +57,8 @@ struct rend_if {
 
     void (*set_clip_range)(float clip_min, float clip_max);
 
-    void (*draw_array)(float const *verts, unsigned n_verts);
+    void (*draw_array)(struct gfx_vert const *verts, unsigned n_verts,
+                       uint32_t const *indices, unsigned n_indices);
 
     void (*clear)(float const bgcolor[4]);
 
@@ -65,6 +66,11 @@ struct rend_if {
 
     void (*end_sort_mode)(void);
 
+    void (*draw_mod_vol)(struct gfx_vert const *verts, unsigned n_verts,
+                         bool exclude);
+
+    void (*apply_mod_vol)(float shadow_scale);
+
     void (*target_bind_obj)(int handle);
 
     void (*target_unbind_obj)(int handle);
@@ -95,6 +101,7 @@ void rend_update_tex(unsigned tex_no);
 // tell the renderer to release the given texture from the cache
 void rend_release_tex(unsigned tex_no);
 
-struct rend_if const * const gfx_rend_ifp;
+// this gets set by rend_init
+extern struct rend_if const *gfx_rend_ifp;
 
 #endif
@@ -0,0 +1,764 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "washdc/error.h"
+#include "log.h"
+
+#include "soft_raster.h"
+
+/*
+ * vertex positions get snapped to 1/16 of a pixel before the edge functions
+ * are set up.
+ */
+#define SOFT_SUBPIXEL 16.0f
+
+#define SOFT_MAX_THREADS 32
+
+/*
+ * worker pool.  soft_raster_run hands a frame to every worker by bumping
+ * job_gen, then all of the threads (including the caller) pull tiles off of
+ * next_tile until there are none left.
+ */
+static pthread_t workers[SOFT_MAX_THREADS - 1];
+static unsigned n_workers;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static unsigned job_gen, workers_busy;
+static bool pool_exit;
+
+static struct soft_frame *job_frame;
+static atomic_uint next_tile;
+
+static void *soft_raster_worker(void *arg);
+static void soft_raster_run_tiles(struct soft_frame *frame);
+static void soft_raster_tile(struct soft_frame *frame, unsigned tile_no);
+static void soft_raster_bin(struct soft_frame *frame);
+
+static void *soft_grow_buf(void *buf, unsigned *alloc_p,
+                           unsigned n_elem, size_t elem_sz) {
+    if (n_elem <= *alloc_p)
+        return buf;
+
+    unsigned alloc = *alloc_p ? *alloc_p : 1024;
+    while (alloc < n_elem)
+        alloc *= 2;
+
+    void *ret = realloc(buf, alloc * elem_sz);
+    if (!ret)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    *alloc_p = alloc;
+    return ret;
+}
+
+void soft_raster_init(unsigned n_threads) {
+    if (!n_threads) {
+        long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = n_cpus > 0 ? (unsigned)n_cpus : 1;
+    }
+    if (n_threads > SOFT_MAX_THREADS)
+        n_threads = SOFT_MAX_THREADS;
+
+    pool_exit = false;
+    job_gen = 0;
+    workers_busy = 0;
+
+    for (n_workers = 0; n_workers < n_threads - 1; n_workers++) {
+        if (pthread_create(workers + n_workers, NULL,
+                           soft_raster_worker, NULL) != 0) {
+            LOG_WARN("%s - unable to create worker thread %u\n",
+                     __func__, n_workers);
+            break;
+        }
+    }
+
+    LOG_INFO("GFX: software rasterizer running on %u thread(s)\n",
+             n_workers + 1);
+}
+
+void soft_raster_cleanup(void) {
+    pthread_mutex_lock(&pool_lock);
+    pool_exit = true;
+    pthread_cond_broadcast(&pool_start);
+    pthread_mutex_unlock(&pool_lock);
+
+    unsigned idx;
+    for (idx = 0; idx < n_workers; idx++)
+        pthread_join(workers[idx], NULL);
+    n_workers = 0;
+}
+
+static void *soft_raster_worker(void *arg) {
+    unsigned gen_seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&pool_lock);
+        while (!pool_exit && job_gen == gen_seen)
+            pthread_cond_wait(&pool_start, &pool_lock);
+        if (pool_exit) {
+            pthread_mutex_unlock(&pool_lock);
+            return NULL;
+        }
+        gen_seen = job_gen;
+        struct soft_frame *frame = job_frame;
+        pthread_mutex_unlock(&pool_lock);
+
+        soft_raster_run_tiles(frame);
+
+        pthread_mutex_lock(&pool_lock);
+        if (--workers_busy == 0)
+            pthread_cond_signal(&pool_done);
+        pthread_mutex_unlock(&pool_lock);
+    }
+}
+
+void soft_frame_init(struct soft_frame *frame) {
+    memset(frame, 0, sizeof(*frame));
+}
+
+void soft_frame_cleanup(struct soft_frame *frame) {
+    free(frame->states);
+    free(frame->tris);
+    free(frame->tile_start);
+    free(frame->tile_tris);
+    memset(frame, 0, sizeof(*frame));
+}
+
+unsigned soft_frame_add_state(struct soft_frame *frame,
+                              struct soft_draw_state const *state) {
+    frame->states = (struct soft_draw_state*)
+        soft_grow_buf(frame->states, &frame->states_alloc,
+                      frame->n_states + 1, sizeof(struct soft_draw_state));
+    frame->states[frame->n_states] = *state;
+    return frame->n_states++;
+}
+
+static inline float soft_plane_eval(float const plane[3], float x, float y) {
+    return plane[0] * x + plane[1] * y + plane[2];
+}
+
+void soft_raster_add_tri(struct soft_frame *frame,
+                         struct gfx_vert const *v0,
+                         struct gfx_vert const *v1,
+                         struct gfx_vert const *v2,
+                         unsigned state_idx) {
+    struct gfx_vert const *verts[3] = { v0, v1, v2 };
+    float x[3], y[3], attr[SOFT_ATTR_COUNT][3];
+
+    if (!frame->color.texels)
+        return;
+
+    float x_scale = frame->screen_width ?
+        (float)frame->color.width / frame->screen_width : 1.0f;
+    float y_scale = frame->screen_height ?
+        (float)frame->color.height / frame->screen_height : 1.0f;
+
+    // same depth mapping as opengl_renderer_set_trans_mat
+    float clip_min_actual = frame->clip_min * 1.01f;
+    float clip_delta = frame->clip_max * 1.01f - clip_min_actual;
+    if (clip_delta == 0.0f)
+        clip_delta = 1.0f;
+
+    unsigned vert_no;
+    for (vert_no = 0; vert_no < 3; vert_no++) {
+        struct gfx_vert const *vert = verts[vert_no];
+
+        /*
+         * the z-component is used as w for perspective-correct interpolation
+         * (see the comment in opengl_renderer.c's vertex shader).  OpenGL
+         * would clip anything behind w=0; just drop the whole triangle.
+         */
+        float w = vert->pos[2];
+        if (!(w > 0.0f) || !isfinite(w))
+            return;
+        float q = 1.0f / w;
+
+        x[vert_no] = floorf(vert->pos[0] * x_scale * SOFT_SUBPIXEL + 0.5f) /
+            SOFT_SUBPIXEL;
+        y[vert_no] = floorf(vert->pos[1] * y_scale * SOFT_SUBPIXEL + 0.5f) /
+            SOFT_SUBPIXEL;
+        if (!isfinite(x[vert_no]) || !isfinite(y[vert_no]))
+            return;
+
+        attr[SOFT_ATTR_Q][vert_no] = q;
+        attr[SOFT_ATTR_DEPTH][vert_no] = (w - clip_min_actual) / clip_delta;
+        attr[SOFT_ATTR_BASE_R][vert_no] = vert->base_color[0] * q / 255.0f;
+        attr[SOFT_ATTR_BASE_G][vert_no] = vert->base_color[1] * q / 255.0f;
+        attr[SOFT_ATTR_BASE_B][vert_no] = vert->base_color[2] * q / 255.0f;
+        attr[SOFT_ATTR_BASE_A][vert_no] = vert->base_color[3] * q / 255.0f;
+        attr[SOFT_ATTR_OFFS_R][vert_no] = vert->offs_color[0] * q / 255.0f;
+        attr[SOFT_ATTR_OFFS_G][vert_no] = vert->offs_color[1] * q / 255.0f;
+        attr[SOFT_ATTR_OFFS_B][vert_no] = vert->offs_color[2] * q / 255.0f;
+        attr[SOFT_ATTR_U][vert_no] = vert->tex_coord[0] * q;
+        attr[SOFT_ATTR_V][vert_no] = vert->tex_coord[1] * q;
+    }
+
+    float dx1 = x[1] - x[0], dy1 = y[1] - y[0];
+    float dx2 = x[2] - x[0], dy2 = y[2] - y[0];
+    float area = dx1 * dy2 - dx2 * dy1;
+    if (area == 0.0f || !isfinite(area))
+        return;
+
+    // pixel centers covered by the bounding box, clamped to the viewport
+    float x_lo = fminf(x[0], fminf(x[1], x[2]));
+    float x_hi = fmaxf(x[0], fmaxf(x[1], x[2]));
+    float y_lo = fminf(y[0], fminf(y[1], y[2]));
+    float y_hi = fmaxf(y[0], fmaxf(y[1], y[2]));
+    float width = frame->color.width, height = frame->color.height;
+    if (x_hi < 0.0f || y_hi < 0.0f || x_lo > width || y_lo > height)
+        return;
+
+    int x_min = (int)ceilf(fmaxf(x_lo, 0.0f) - 0.5f);
+    int x_max = (int)floorf(fminf(x_hi, width) - 0.5f) + 1;
+    int y_min = (int)ceilf(fmaxf(y_lo, 0.0f) - 0.5f);
+    int y_max = (int)floorf(fminf(y_hi, height) - 0.5f) + 1;
+    if (x_min < 0)
+        x_min = 0;
+    if (y_min < 0)
+        y_min = 0;
+    if (x_max > (int)frame->color.width)
+        x_max = frame->color.width;
+    if (y_max > (int)frame->color.height)
+        y_max = frame->color.height;
+    if (x_min >= x_max || y_min >= y_max)
+        return;
+
+    frame->tris = (struct soft_tri*)
+        soft_grow_buf(frame->tris, &frame->tris_alloc,
+                      frame->n_tris + 1, sizeof(struct soft_tri));
+    struct soft_tri *tri = frame->tris + frame->n_tris++;
+
+    tri->x_min = x_min;
+    tri->x_max = x_max;
+    tri->y_min = y_min;
+    tri->y_max = y_max;
+    tri->state_idx = state_idx;
+
+    /*
+     * Edge functions are positive on the inside of the triangle.  There's no
+     * backface culling, so clockwise triangles get their edges negated.
+     *
+     * Every edge is computed with its endpoints in a canonical order so that
+     * two triangles which share an edge get exactly-negated coefficients.
+     * That way a pixel center which lands on the edge evaluates to zero in
+     * both triangles and the edge_incl tie-breaker gives it to exactly one of
+     * them.
+     */
+    unsigned edge_no;
+    for (edge_no = 0; edge_no < 3; edge_no++) {
+        unsigned idx_a = edge_no, idx_b = (edge_no + 1) % 3;
+        float sign = area > 0.0f ? 1.0f : -1.0f;
+        if (x[idx_b] < x[idx_a] ||
+            (x[idx_b] == x[idx_a] && y[idx_b] < y[idx_a])) {
+            unsigned tmp = idx_a;
+            idx_a = idx_b;
+            idx_b = tmp;
+            sign = -sign;
+        }
+
+        float edge_dx = x[idx_b] - x[idx_a];
+        float edge_dy = y[idx_b] - y[idx_a];
+        float coeff_a = -edge_dy;
+        float coeff_b = edge_dx;
+        float coeff_c = edge_dy * x[idx_a] - edge_dx * y[idx_a];
+
+        tri->edge[edge_no][0] = sign * coeff_a;
+        tri->edge[edge_no][1] = sign * coeff_b;
+        tri->edge[edge_no][2] = sign * coeff_c;
+        tri->edge_incl[edge_no] = tri->edge[edge_no][0] > 0.0f ||
+            (tri->edge[edge_no][0] == 0.0f && tri->edge[edge_no][1] > 0.0f);
+    }
+
+    unsigned attr_no;
+    for (attr_no = 0; attr_no < SOFT_ATTR_COUNT; attr_no++) {
+        float f0 = attr[attr_no][0];
+        float df1 = attr[attr_no][1] - f0;
+        float df2 = attr[attr_no][2] - f0;
+        float plane_a = (df1 * dy2 - df2 * dy1) / area;
+        float plane_b = (dx1 * df2 - dx2 * df1) / area;
+
+        tri->attr[attr_no][0] = plane_a;
+        tri->attr[attr_no][1] = plane_b;
+        tri->attr[attr_no][2] = f0 - plane_a * x[0] - plane_b * y[0];
+    }
+}
+
+void soft_raster_run(struct soft_frame *frame) {
+    if (!frame->n_tris)
+        return;
+
+    soft_raster_bin(frame);
+
+    if (n_workers) {
+        pthread_mutex_lock(&pool_lock);
+        job_frame = frame;
+        atomic_store(&next_tile, 0);
+        workers_busy = n_workers;
+        job_gen++;
+        pthread_cond_broadcast(&pool_start);
+        pthread_mutex_unlock(&pool_lock);
+
+        soft_raster_run_tiles(frame);
+
+        pthread_mutex_lock(&pool_lock);
+        while (workers_busy)
+            pthread_cond_wait(&pool_done, &pool_lock);
+        pthread_mutex_unlock(&pool_lock);
+    } else {
+        atomic_store(&next_tile, 0);
+        soft_raster_run_tiles(frame);
+    }
+
+    frame->n_tris = 0;
+}
+
+static void soft_raster_run_tiles(struct soft_frame *frame) {
+    unsigned n_tiles = frame->tiles_x * frame->tiles_y;
+    unsigned tile_no;
+    while ((tile_no = atomic_fetch_add(&next_tile, 1)) < n_tiles)
+        soft_raster_tile(frame, tile_no);
+}
+
+/*
+ * returns true if the triangle's edge functions are negative over the whole
+ * tile, which happens a lot for long thin triangles whose bounding box covers
+ * many tiles they never touch.
+ */
+static bool soft_tile_reject(struct soft_tri const *tri,
+                             unsigned tile_x, unsigned tile_y) {
+    /*
+     * this tests the tile's outer boundary instead of its outermost pixel
+     * centers so that rounding can never reject a pixel that lies exactly on
+     * an edge.
+     */
+    float x_lo = (float)(tile_x << SOFT_TILE_SHIFT);
+    float y_lo = (float)(tile_y << SOFT_TILE_SHIFT);
+    float x_hi = x_lo + SOFT_TILE_SIZE;
+    float y_hi = y_lo + SOFT_TILE_SIZE;
+
+    unsigned edge_no;
+    for (edge_no = 0; edge_no < 3; edge_no++) {
+        float const *edge = tri->edge[edge_no];
+        float max_val = edge[2] +
+            edge[0] * (edge[0] > 0.0f ? x_hi : x_lo) +
+            edge[1] * (edge[1] > 0.0f ? y_hi : y_lo);
+        if (max_val < 0.0f)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * sort every triangle into the tiles it overlaps.  This is a counting sort,
+ * so each tile's list stays in submission order.
+ */
+static void soft_raster_bin(struct soft_frame *frame) {
+    unsigned tiles_x = (frame->color.width + SOFT_TILE_SIZE - 1) >>
+        SOFT_TILE_SHIFT;
+    unsigned tiles_y = (frame->color.height + SOFT_TILE_SIZE - 1) >>
+        SOFT_TILE_SHIFT;
+    unsigned n_tiles = tiles_x * tiles_y;
+
+    frame->tiles_x = tiles_x;
+    frame->tiles_y = tiles_y;
+    frame->tile_start = (unsigned*)
+        soft_grow_buf(frame->tile_start, &frame->tile_start_alloc,
+                      n_tiles + 1, sizeof(unsigned));
+    memset(frame->tile_start, 0, (n_tiles + 1) * sizeof(unsigned));
+
+    unsigned *tile_start = frame->tile_start;
+    unsigned tri_no, tile_x, tile_y;
+
+    for (tri_no = 0; tri_no < frame->n_tris; tri_no++) {
+        struct soft_tri const *tri = frame->tris + tri_no;
+        unsigned tx_first = tri->x_min >> SOFT_TILE_SHIFT;
+        unsigned tx_last = (tri->x_max - 1) >> SOFT_TILE_SHIFT;
+        unsigned ty_first = tri->y_min >> SOFT_TILE_SHIFT;
+        unsigned ty_last = (tri->y_max - 1) >> SOFT_TILE_SHIFT;
+        for (tile_y = ty_first; tile_y <= ty_last; tile_y++)
+            for (tile_x = tx_first; tile_x <= tx_last; tile_x++)
+                if (!soft_tile_reject(tri, tile_x, tile_y))
+                    tile_start[tile_y * tiles_x + tile_x + 1]++;
+    }
+
+    unsigned tile_no;
+    for (tile_no = 0; tile_no < n_tiles; tile_no++)
+        tile_start[tile_no + 1] += tile_start[tile_no];
+
+    frame->tile_tris = (uint32_t*)
+        soft_grow_buf(frame->tile_tris, &frame->tile_tris_alloc,
+                      tile_start[n_tiles] ? tile_start[n_tiles] : 1,
+                      sizeof(uint32_t));
+
+    // use tile_start as the insertion cursor, then shift it back into place
+    for (tri_no = 0; tri_no < frame->n_tris; tri_no++) {
+        struct soft_tri const *tri = frame->tris + tri_no;
+        unsigned tx_first = tri->x_min >> SOFT_TILE_SHIFT;
+        unsigned tx_last = (tri->x_max - 1) >> SOFT_TILE_SHIFT;
+        unsigned ty_first = tri->y_min >> SOFT_TILE_SHIFT;
+        unsigned ty_last = (tri->y_max - 1) >> SOFT_TILE_SHIFT;
+        for (tile_y = ty_first; tile_y <= ty_last; tile_y++)
+            for (tile_x = tx_first; tile_x <= tx_last; tile_x++)
+                if (!soft_tile_reject(tri, tile_x, tile_y))
+                    frame->tile_tris[tile_start[tile_y * tiles_x + tile_x]++] =
+                        tri_no;
+    }
+
+    for (tile_no = n_tiles; tile_no > 0; tile_no--)
+        tile_start[tile_no] = tile_start[tile_no - 1];
+    tile_start[0] = 0;
+}
+
+/*
+ * returns a 4-bit mask of which of the four pixels starting at (x, y) are
+ * inside the triangle.  row_edge holds each edge function's b * y + c.
+ */
+static inline unsigned soft_coverage4(struct soft_tri const *tri,
+                                      float const row_edge[3], int x) {
+#ifdef __SSE2__
+    __m128 px = _mm_add_ps(_mm_set1_ps((float)x),
+                           _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+    __m128 zero = _mm_setzero_ps();
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+    unsigned edge_no;
+    for (edge_no = 0; edge_no < 3; edge_no++) {
+        __m128 val = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri->edge[edge_no][0]),
+                                           px),
+                                _mm_set1_ps(row_edge[edge_no]));
+        __m128 pass = _mm_cmpgt_ps(val, zero);
+        if (tri->edge_incl[edge_no])
+            pass = _mm_or_ps(pass, _mm_cmpeq_ps(val, zero));
+        inside = _mm_and_ps(inside, pass);
+    }
+
+    return _mm_movemask_ps(inside);
+#else
+    unsigned mask = 0, lane, edge_no;
+    for (lane = 0; lane < 4; lane++) {
+        float px = (float)x + (lane + 0.5f);
+        bool inside = true;
+        for (edge_no = 0; edge_no < 3; edge_no++) {
+            float val = tri->edge[edge_no][0] * px + row_edge[edge_no];
+            if (!(val > 0.0f || (val == 0.0f && tri->edge_incl[edge_no])))
+                inside = false;
+        }
+        if (inside)
+            mask |= 1 << lane;
+    }
+    return mask;
+#endif
+}
+
+/*
+ * the PVR2 depth functions are inverted relative to the values we compare;
+ * see the comment above depth_funcs in opengl_renderer.c.
+ */
+static inline bool
+soft_depth_test(enum Pvr2DepthFunc func, float frag, float buf) {
+    switch (func) {
+    case PVR2_DEPTH_NEVER:
+        return false;
+    case PVR2_DEPTH_LESS:
+        return frag >= buf;
+    case PVR2_DEPTH_EQUAL:
+        return frag == buf;
+    case PVR2_DEPTH_LEQUAL:
+        return frag > buf;
+    case PVR2_DEPTH_GREATER:
+        return frag <= buf;
+    case PVR2_DEPTH_NOTEQUAL:
+        return frag != buf;
+    case PVR2_DEPTH_GEQUAL:
+        return frag < buf;
+    case PVR2_DEPTH_ALWAYS:
+    default:
+        return true;
+    }
+}
+
+static inline int soft_tex_wrap(int coord, int size, enum tex_wrap_mode mode) {
+    int period;
+
+    switch (mode) {
+    case TEX_WRAP_CLAMP:
+        return coord < 0 ? 0 : (coord >= size ? size - 1 : coord);
+    case TEX_WRAP_FLIP:
+        period = 2 * size;
+        coord %= period;
+        if (coord < 0)
+            coord += period;
+        return coord >= size ? period - 1 - coord : coord;
+    case TEX_WRAP_REPEAT:
+    default:
+        coord %= size;
+        return coord < 0 ? coord + size : coord;
+    }
+}
+
+// keeps float-to-int conversions of huge texture coordinates in range
+static inline int soft_tex_floor(float coord) {
+    if (coord > 1e9f)
+        coord = 1e9f;
+    else if (coord < -1e9f)
+        coord = -1e9f;
+    return (int)floorf(coord);
+}
+
+static inline void soft_tex_fetch(struct soft_img const *tex,
+                                  struct soft_draw_state const *state,
+                                  int col, int row, float out[4]) {
+    col = soft_tex_wrap(col, tex->width, state->tex_wrap_mode[0]);
+    row = soft_tex_wrap(row, tex->height, state->tex_wrap_mode[1]);
+    uint8_t const *texel = tex->texels + 4 * ((size_t)row * tex->width + col);
+    out[0] = texel[0] / 255.0f;
+    out[1] = texel[1] / 255.0f;
+    out[2] = texel[2] / 255.0f;
+    out[3] = texel[3] / 255.0f;
+}
+
+static void soft_tex_sample(struct soft_draw_state const *state,
+                            float u, float v, float out[4]) {
+    struct soft_img const *tex = &state->tex;
+
+    if (!tex->texels || !tex->width || !tex->height) {
+        // same as sampling texture 0 in OpenGL
+        out[0] = out[1] = out[2] = 0.0f;
+        out[3] = 1.0f;
+        return;
+    }
+
+    float s = u * tex->width, t = v * tex->height;
+
+    if (state->tex_filter != TEX_FILTER_BILINEAR) {
+        // trilinear isn't supported, same as the OpenGL renderer
+        soft_tex_fetch(tex, state, soft_tex_floor(s), soft_tex_floor(t), out);
+        return;
+    }
+
+    s -= 0.5f;
+    t -= 0.5f;
+    int col = soft_tex_floor(s), row = soft_tex_floor(t);
+    float frac_s = s - floorf(s), frac_t = t - floorf(t);
+    float t00[4], t10[4], t01[4], t11[4];
+    soft_tex_fetch(tex, state, col, row, t00);
+    soft_tex_fetch(tex, state, col + 1, row, t10);
+    soft_tex_fetch(tex, state, col, row + 1, t01);
+    soft_tex_fetch(tex, state, col + 1, row + 1, t11);
+
+    unsigned comp;
+    for (comp = 0; comp < 4; comp++) {
+        float top = t00[comp] + (t10[comp] - t00[comp]) * frac_s;
+        float bot = t01[comp] + (t11[comp] - t01[comp]) * frac_s;
+        out[comp] = top + (bot - top) * frac_t;
+    }
+}
+
+static inline void soft_blend_factor(enum Pvr2BlendFactor factor, bool is_src,
+                                     float const src[4], float const dst[4],
+                                     float out[4]) {
+    float const *other = is_src ? dst : src;
+    unsigned comp;
+
+    switch (factor) {
+    case PVR2_BLEND_ZERO:
+        out[0] = out[1] = out[2] = out[3] = 0.0f;
+        break;
+    case PVR2_BLEND_ONE:
+    default:
+        out[0] = out[1] = out[2] = out[3] = 1.0f;
+        break;
+    case PVR2_BLEND_OTHER:
+        for (comp = 0; comp < 4; comp++)
+            out[comp] = other[comp];
+        break;
+    case PVR2_BLEND_ONE_MINUS_OTHER:
+        for (comp = 0; comp < 4; comp++)
+            out[comp] = 1.0f - other[comp];
+        break;
+    case PVR2_BLEND_SRC_ALPHA:
+        out[0] = out[1] = out[2] = out[3] = src[3];
+        break;
+    case PVR2_BLEND_ONE_MINUS_SRC_ALPHA:
+        out[0] = out[1] = out[2] = out[3] = 1.0f - src[3];
+        break;
+    case PVR2_BLEND_DST_ALPHA:
+        out[0] = out[1] = out[2] = out[3] = dst[3];
+        break;
+    case PVR2_BLEND_ONE_MINUS_DST_ALPHA:
+        out[0] = out[1] = out[2] = out[3] = 1.0f - dst[3];
+        break;
+    }
+}
+
+static inline float soft_clamp01(float val) {
+    return val < 0.0f ? 0.0f : (val > 1.0f ? 1.0f : val);
+}
+
+/*
+ * per-fragment work; this does the same thing as the OpenGL renderer's
+ * fragment shader followed by the fixed-function depth test and blending.
+ */
+static void soft_shade_pixel(struct soft_frame *frame,
+                             struct soft_tri const *tri,
+                             struct soft_draw_state const *state,
+                             int x, int y) {
+    float px = x + 0.5f, py = y + 0.5f;
+    float *depth_p = frame->depth + (size_t)y * frame->color.width + x;
+
+    float depth =
+        soft_clamp01(soft_plane_eval(tri->attr[SOFT_ATTR_DEPTH], px, py));
+    if (state->depth_enable &&
+        !soft_depth_test(state->depth_func, depth, *depth_p))
+        return;
+
+    float w = 1.0f / soft_plane_eval(tri->attr[SOFT_ATTR_Q], px, py);
+
+    float base[4], offs[3];
+    unsigned comp;
+    if (state->color_enable) {
+        for (comp = 0; comp < 4; comp++)
+            base[comp] = soft_plane_eval(tri->attr[SOFT_ATTR_BASE_R + comp],
+                                         px, py) * w;
+        for (comp = 0; comp < 3; comp++)
+            offs[comp] = soft_plane_eval(tri->attr[SOFT_ATTR_OFFS_R + comp],
+                                         px, py) * w;
+    } else {
+        base[0] = base[1] = base[2] = base[3] = 1.0f;
+        offs[0] = offs[1] = offs[2] = 0.0f;
+    }
+
+    float color[4];
+    if (state->tex_enable) {
+        float tex[4];
+        float u = soft_plane_eval(tri->attr[SOFT_ATTR_U], px, py) * w;
+        float v = soft_plane_eval(tri->attr[SOFT_ATTR_V], px, py) * w;
+        soft_tex_sample(state, u, v, tex);
+
+        switch (state->tex_inst) {
+        case TEX_INST_DECAL:
+            for (comp = 0; comp < 3; comp++)
+                color[comp] = tex[comp] + offs[comp];
+            color[3] = tex[3];
+            break;
+        case TEX_INST_MOD:
+            for (comp = 0; comp < 3; comp++)
+                color[comp] = tex[comp] * base[comp] + offs[comp];
+            color[3] = tex[3];
+            break;
+        case TEXT_INST_DECAL_ALPHA:
+            for (comp = 0; comp < 3; comp++)
+                color[comp] = tex[comp] * tex[3] +
+                    base[comp] * (1.0f - tex[3]) + offs[comp];
+            color[3] = base[3];
+            break;
+        case TEX_INST_MOD_ALPHA:
+        default:
+            for (comp = 0; comp < 3; comp++)
+                color[comp] = tex[comp] * base[comp] + offs[comp];
+            color[3] = tex[3] * base[3];
+            break;
+        }
+    } else {
+        for (comp = 0; comp < 4; comp++)
+            color[comp] = base[comp];
+    }
+
+    if (state->pt_enable && (int)(color[3] * 255) < state->pt_ref)
+        return;
+
+    if (state->depth_enable && state->enable_depth_writes)
+        *depth_p = depth;
+
+    // the color buffer is stored upside-down, the same as an OpenGL texture
+    uint8_t *pix = frame->color.texels +
+        4 * ((size_t)(frame->color.height - 1 - y) * frame->color.width + x);
+
+    for (comp = 0; comp < 4; comp++)
+        color[comp] = soft_clamp01(color[comp]);
+
+    if (state->blend_enable) {
+        float dst[4], src_fact[4], dst_fact[4];
+        for (comp = 0; comp < 4; comp++)
+            dst[comp] = pix[comp] / 255.0f;
+        soft_blend_factor(state->src_blend_factor, true, color, dst, src_fact);
+        soft_blend_factor(state->dst_blend_factor, false, color, dst, dst_fact);
+        for (comp = 0; comp < 4; comp++)
+            color[comp] = soft_clamp01(color[comp] * src_fact[comp] +
+                                       dst[comp] * dst_fact[comp]);
+    }
+
+    for (comp = 0; comp < 4; comp++)
+        pix[comp] = (uint8_t)(color[comp] * 255.0f + 0.5f);
+}
+
+static void soft_raster_tile(struct soft_frame *frame, unsigned tile_no) {
+    int tile_x_min = (tile_no % frame->tiles_x) << SOFT_TILE_SHIFT;
+    int tile_y_min = (tile_no / frame->tiles_x) << SOFT_TILE_SHIFT;
+    int tile_x_max = tile_x_min + SOFT_TILE_SIZE;
+    int tile_y_max = tile_y_min + SOFT_TILE_SIZE;
+
+    unsigned idx;
+    for (idx = frame->tile_start[tile_no];
+         idx < frame->tile_start[tile_no + 1]; idx++) {
+        struct soft_tri const *tri = frame->tris + frame->tile_tris[idx];
+        struct soft_draw_state const *state = frame->states + tri->state_idx;
+
+        int x_min = tri->x_min > tile_x_min ? tri->x_min : tile_x_min;
+        int x_max = tri->x_max < tile_x_max ? tri->x_max : tile_x_max;
+        int y_min = tri->y_min > tile_y_min ? tri->y_min : tile_y_min;
+        int y_max = tri->y_max < tile_y_max ? tri->y_max : tile_y_max;
+
+        int x, y;
+        for (y = y_min; y < y_max; y++) {
+            float py = y + 0.5f;
+            float row_edge[3] = {
+                tri->edge[0][1] * py + tri->edge[0][2],
+                tri->edge[1][1] * py + tri->edge[1][2],
+                tri->edge[2][1] * py + tri->edge[2][2]
+            };
+
+            for (x = x_min; x < x_max; x += 4) {
+                unsigned mask = soft_coverage4(tri, row_edge, x);
+                if (x_max - x < 4)
+                    mask &= (1 << (x_max - x)) - 1;
+                while (mask) {
+                    unsigned lane = __builtin_ctz(mask);
+                    mask &= mask - 1;
+                    soft_shade_pixel(frame, tri, state, x + lane, y);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,170 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef SOFT_RASTER_H_
+#define SOFT_RASTER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "gfx/gfx.h"
+
+/*
+ * tile-binned triangle rasterizer used by the software renderer.
+ *
+ * Triangles are set up (transformed to screen space and turned into edge and
+ * attribute plane equations) as they are submitted and appended to a
+ * soft_frame.  Nothing gets drawn until soft_raster_run, which sorts every
+ * triangle into the SOFT_TILE_SIZE x SOFT_TILE_SIZE tiles it touches and then
+ * rasterizes the tiles in parallel on a pool of worker threads.  Each tile
+ * draws its triangles in submission order and no two threads ever touch the
+ * same tile, so the output does not depend on the number of threads.
+ */
+
+#define SOFT_TILE_SHIFT 5
+#define SOFT_TILE_SIZE (1 << SOFT_TILE_SHIFT)
+
+// RGBA8 image, 4 bytes per texel with row 0 at the bottom (like OpenGL)
+struct soft_img {
+    uint8_t *texels;
+    unsigned width, height;
+};
+
+/*
+ * everything a fragment needs to know about the state it was drawn with.
+ * This is a snapshot of the gfx_rend_param combined with the gfx_cfg
+ * settings that were current when the triangle was submitted.
+ */
+struct soft_draw_state {
+    bool tex_enable;
+    struct soft_img tex;
+    enum tex_inst tex_inst;
+    enum tex_filter tex_filter;
+    enum tex_wrap_mode tex_wrap_mode[2];
+
+    // if false, base color is white and offset color is black
+    bool color_enable;
+
+    bool blend_enable;
+    enum Pvr2BlendFactor src_blend_factor, dst_blend_factor;
+
+    bool depth_enable;
+    bool enable_depth_writes;
+    enum Pvr2DepthFunc depth_func;
+
+    bool pt_enable;
+    int pt_ref;
+};
+
+enum soft_attr {
+    SOFT_ATTR_Q,        // 1 / w, linear in screen space
+    SOFT_ATTR_DEPTH,    // window-space depth, linear in screen space
+
+    // the rest are all pre-multiplied by q for perspective correction
+    SOFT_ATTR_BASE_R,
+    SOFT_ATTR_BASE_G,
+    SOFT_ATTR_BASE_B,
+    SOFT_ATTR_BASE_A,
+    SOFT_ATTR_OFFS_R,
+    SOFT_ATTR_OFFS_G,
+    SOFT_ATTR_OFFS_B,
+    SOFT_ATTR_U,
+    SOFT_ATTR_V,
+
+    SOFT_ATTR_COUNT
+};
+
+/*
+ * every edge function and attribute is stored as a plane equation
+ * (a * x + b * y + c) which gets evaluated at pixel centers.
+ */
+struct soft_tri {
+    float edge[3][3];
+
+    // edges which own the pixels that lie exactly on them
+    bool edge_incl[3];
+
+    float attr[SOFT_ATTR_COUNT][3];
+
+    // pixel bounding box, [x_min, x_max) and [y_min, y_max)
+    int x_min, y_min, x_max, y_max;
+
+    unsigned state_idx;
+};
+
+struct soft_frame {
+    // color buffer is a soft_img, depth buffer is one float per pixel
+    struct soft_img color;
+    float *depth;
+
+    /*
+     * positions are given in the guest's screen coordinates, which get scaled
+     * to the color buffer's dimensions.
+     */
+    unsigned screen_width, screen_height;
+    float clip_min, clip_max;
+
+    struct soft_draw_state *states;
+    unsigned n_states, states_alloc;
+
+    struct soft_tri *tris;
+    unsigned n_tris, tris_alloc;
+
+    // tile bins; every tile's triangles are in tile_tris[tile_start[tile_no]]
+    unsigned tiles_x, tiles_y;
+    unsigned *tile_start;
+    unsigned tile_start_alloc;
+    uint32_t *tile_tris;
+    unsigned tile_tris_alloc;
+};
+
+/*
+ * n_threads is the total number of threads which rasterize tiles, including
+ * the thread that calls soft_raster_run.  0 means one per CPU.
+ */
+void soft_raster_init(unsigned n_threads);
+void soft_raster_cleanup(void);
+
+void soft_frame_init(struct soft_frame *frame);
+void soft_frame_cleanup(struct soft_frame *frame);
+
+/*
+ * append a copy of the given state to the frame and return its index for
+ * soft_raster_add_tri
+ */
+unsigned soft_frame_add_state(struct soft_frame *frame,
+                              struct soft_draw_state const *state);
+
+/*
+ * set up a triangle and append it to the frame.  Triangles which are
+ * degenerate, off-screen or behind the viewer are dropped here.
+ */
+void soft_raster_add_tri(struct soft_frame *frame,
+                         struct gfx_vert const *v0,
+                         struct gfx_vert const *v1,
+                         struct gfx_vert const *v2,
+                         unsigned state_idx);
+
+// draw every triangle that has been added since the last run
+void soft_raster_run(struct soft_frame *frame);
+
+#endif
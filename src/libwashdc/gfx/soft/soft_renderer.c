@@ -0,0 +1,596 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "washdc/error.h"
+#include "washdc/pix_conv.h"
+#include "washdc/config_file.h"
+#include "config.h"
+#include "log.h"
+#include "gfx/gfx_obj.h"
+#include "gfx/gfx_hash.h"
+#include "gfx/gfx_config.h"
+#include "gfx/gfx_depth_sort.h"
+#include "gfx/gfx_tex_cache.h"
+
+#include "soft_raster.h"
+#include "soft_renderer.h"
+
+/*
+ * one RGBA8 image for each gfx_obj.  This holds the decoded texture for
+ * objects which are bound as textures, and the color buffer for objects which
+ * are used as render targets (which can then be bound as textures).
+ */
+static struct soft_img obj_img[GFX_OBJ_COUNT];
+
+static struct soft_frame frame;
+static int tgt_handle = -1;
+
+static float *depth_buf;
+static unsigned depth_buf_width, depth_buf_height;
+
+static struct gfx_rend_param cur_rend_param;
+static bool blend_enable;
+
+/*
+ * if this is set, cur_rend_param or blend_enable have changed (or a texture
+ * has been updated) since the last soft_draw_state was added to the frame.
+ */
+static bool state_dirty = true;
+static unsigned cur_state_idx;
+
+static struct sort_state {
+    bool enabled;
+    enum gfx_depth_sort_mode mode;
+    struct gfx_depth_sort sort;
+    struct gfx_rend_param cur_rend_param;
+} sort_state;
+
+static bool hash_enable;
+static uint64_t rend_hash;
+
+static struct soft_fb {
+    int obj_handle;
+    unsigned width, height;
+    bool do_flip;
+} cur_fb;
+
+static DEF_ERROR_INT_ATTR(gfx_tex_fmt);
+static DEF_ERROR_INT_ATTR(max_length);
+
+static void soft_target_obj_read(struct gfx_obj *obj, void *out,
+                                 size_t n_bytes);
+
+static void soft_img_resize(struct soft_img *img,
+                            unsigned width, unsigned height) {
+    if (img->texels && img->width == width && img->height == height)
+        return;
+
+    free(img->texels);
+    img->texels = (uint8_t*)calloc((size_t)width * height, 4);
+    if (!img->texels)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    img->width = width;
+    img->height = height;
+}
+
+// draw everything that's been submitted to the current target
+static void soft_flush(void) {
+    if (tgt_handle >= 0)
+        soft_raster_run(&frame);
+}
+
+static void soft_rend_init(void) {
+    soft_raster_init(0);
+    soft_frame_init(&frame);
+
+    // same setting as the OpenGL renderer
+    char const *oit_mode_str = cfg_get_node("gfx.rend.oit-mode");
+    sort_state.mode = GFX_DEPTH_SORT_PER_TRI;
+    if (oit_mode_str) {
+        if (strcmp(oit_mode_str, "per-triangle") == 0) {
+            gfx_config_oit_enable();
+        } else if (strcmp(oit_mode_str, "per-group") == 0) {
+            sort_state.mode = GFX_DEPTH_SORT_PER_GROUP;
+            gfx_config_oit_enable();
+        } else {
+            gfx_config_oit_disable();
+        }
+    } else {
+        gfx_config_oit_enable();
+    }
+
+    gfx_depth_sort_init(&sort_state.sort);
+    sort_state.enabled = false;
+
+    tgt_handle = -1;
+    state_dirty = true;
+    blend_enable = false;
+    memset(&cur_rend_param, 0, sizeof(cur_rend_param));
+
+    hash_enable = config_get_render_hash();
+    rend_hash = GFX_HASH_INIT;
+    cur_fb.obj_handle = -1;
+
+    LOG_INFO("GFX: using the software renderer\n");
+}
+
+static void soft_rend_cleanup(void) {
+    if (hash_enable) {
+        LOG_INFO("render hash: %016" PRIx64 "\n", rend_hash);
+        printf("render hash: %016" PRIx64 "\n", rend_hash);
+    }
+
+    soft_raster_cleanup();
+    soft_frame_cleanup(&frame);
+    gfx_depth_sort_cleanup(&sort_state.sort);
+
+    unsigned idx;
+    for (idx = 0; idx < GFX_OBJ_COUNT; idx++) {
+        free(obj_img[idx].texels);
+        obj_img[idx].texels = NULL;
+        obj_img[idx].width = obj_img[idx].height = 0;
+    }
+
+    free(depth_buf);
+    depth_buf = NULL;
+    depth_buf_width = depth_buf_height = 0;
+}
+
+/*
+ * decode a texture into RGBA8.  The bit layouts here match what the OpenGL
+ * renderer uploads for each format.
+ */
+static void soft_rend_update_tex(unsigned tex_obj) {
+    struct gfx_tex const *tex = gfx_tex_cache_get(tex_obj);
+    struct gfx_obj *obj = gfx_obj_get(tex->obj_handle);
+
+    // nothing to do here
+    if (obj->state & GFX_OBJ_STATE_TEX)
+        return;
+
+    // anything already submitted still needs the old texels
+    soft_flush();
+    state_dirty = true;
+
+    gfx_obj_alloc(obj);
+
+    unsigned tex_w = tex->width, tex_h = tex->height;
+    size_t n_pix = (size_t)tex_w * tex_h;
+    size_t n_bytes = n_pix * (tex->tex_fmt == GFX_TEX_FMT_ARGB_8888 ? 4 : 2);
+    if (n_bytes > obj->dat_len) {
+        error_set_length(n_bytes);
+        error_set_max_length(obj->dat_len);
+        RAISE_ERROR(ERROR_OVERFLOW);
+    }
+
+    struct soft_img *img = obj_img + tex->obj_handle;
+    soft_img_resize(img, tex_w, tex_h);
+
+    uint8_t *out = img->texels;
+    size_t pix_no;
+
+    switch (tex->tex_fmt) {
+    case GFX_TEX_FMT_ARGB_1555:
+        for (pix_no = 0; pix_no < n_pix; pix_no++, out += 4) {
+            uint16_t pix = ((uint16_t const*)obj->dat)[pix_no];
+            out[0] = ((pix >> 10) & 0x1f) * 255 / 31;
+            out[1] = ((pix >> 5) & 0x1f) * 255 / 31;
+            out[2] = (pix & 0x1f) * 255 / 31;
+            out[3] = (pix & 0x8000) ? 255 : 0;
+        }
+        break;
+    case GFX_TEX_FMT_RGB_565:
+        for (pix_no = 0; pix_no < n_pix; pix_no++, out += 4) {
+            uint16_t pix = ((uint16_t const*)obj->dat)[pix_no];
+            out[0] = ((pix >> 11) & 0x1f) * 255 / 31;
+            out[1] = ((pix >> 5) & 0x3f) * 255 / 63;
+            out[2] = (pix & 0x1f) * 255 / 31;
+            out[3] = 255;
+        }
+        break;
+    case GFX_TEX_FMT_ARGB_4444:
+        for (pix_no = 0; pix_no < n_pix; pix_no++, out += 4) {
+            uint16_t pix = ((uint16_t const*)obj->dat)[pix_no];
+            out[0] = ((pix >> 8) & 0xf) * 17;
+            out[1] = ((pix >> 4) & 0xf) * 17;
+            out[2] = (pix & 0xf) * 17;
+            out[3] = ((pix >> 12) & 0xf) * 17;
+        }
+        break;
+    case GFX_TEX_FMT_ARGB_8888:
+        memcpy(out, obj->dat, n_pix * 4);
+        break;
+    case GFX_TEX_FMT_YUV_422:
+        /*
+         * convert to RGB888 in the back three-quarters of the buffer, then
+         * expand it forwards in place.
+         */
+        washdc_conv_yuv422_rgb888(out + n_pix, obj->dat, tex_w, tex_h);
+        for (pix_no = 0; pix_no < n_pix; pix_no++, out += 4) {
+            uint8_t const *rgb = img->texels + n_pix + 3 * pix_no;
+            uint8_t red = rgb[0], green = rgb[1], blue = rgb[2];
+            out[0] = red;
+            out[1] = green;
+            out[2] = blue;
+            out[3] = 255;
+        }
+        break;
+    default:
+        error_set_gfx_tex_fmt(tex->tex_fmt);
+        RAISE_ERROR(ERROR_UNIMPLEMENTED);
+    }
+
+    obj->state |= GFX_OBJ_STATE_TEX;
+}
+
+static void soft_rend_release_tex(unsigned tex_obj) {
+    // do nothing
+}
+
+static void soft_rend_set_blend_enable(bool do_enable) {
+    blend_enable = gfx_config_read().blend_enable && do_enable;
+    state_dirty = true;
+}
+
+static void soft_rend_set_rend_param(struct gfx_rend_param const *param) {
+    if (sort_state.enabled) {
+        sort_state.cur_rend_param = *param;
+        return;
+    }
+
+    cur_rend_param = *param;
+    state_dirty = true;
+}
+
+static void soft_rend_set_screen_dim(unsigned width, unsigned height) {
+    frame.screen_width = width;
+    frame.screen_height = height;
+}
+
+static void soft_rend_set_clip_range(float clip_min, float clip_max) {
+    frame.clip_min = clip_min;
+    frame.clip_max = clip_max;
+}
+
+// returns the index of a soft_draw_state matching the current parameters
+static unsigned soft_cur_state(void) {
+    if (!state_dirty)
+        return cur_state_idx;
+
+    struct gfx_cfg rend_cfg = gfx_config_read();
+    struct gfx_rend_param const *param = &cur_rend_param;
+    struct soft_draw_state state;
+    memset(&state, 0, sizeof(state));
+
+    // same as the OpenGL renderer, disabling color also disables textures
+    state.tex_enable =
+        param->tex_enable && rend_cfg.tex_enable && rend_cfg.color_enable;
+    if (state.tex_enable) {
+        struct gfx_tex const *tex = gfx_tex_cache_get(param->tex_idx);
+        if (tex->valid) {
+            state.tex = obj_img[tex->obj_handle];
+        } else {
+            LOG_WARN("WARNING: attempt to bind invalid texture %u\n",
+                     (unsigned)param->tex_idx);
+        }
+        state.tex_inst = param->tex_inst;
+        state.tex_filter = param->tex_filter;
+        state.tex_wrap_mode[0] = param->tex_wrap_mode[0];
+        state.tex_wrap_mode[1] = param->tex_wrap_mode[1];
+    }
+
+    state.color_enable = rend_cfg.color_enable;
+
+    state.blend_enable = blend_enable;
+    state.src_blend_factor = param->src_blend_factor;
+    state.dst_blend_factor = param->dst_blend_factor;
+
+    state.depth_enable = rend_cfg.depth_enable;
+    state.enable_depth_writes = param->enable_depth_writes;
+    state.depth_func = param->depth_func;
+
+    state.pt_enable = param->pt_mode && rend_cfg.pt_enable;
+    state.pt_ref = (int)param->pt_ref - 1;
+
+    cur_state_idx = soft_frame_add_state(&frame, &state);
+    state_dirty = false;
+    return cur_state_idx;
+}
+
+static void soft_rend_draw_array(struct gfx_vert const *verts, unsigned n_verts,
+                                 uint32_t const *indices, unsigned n_indices) {
+    if (!n_verts || !n_indices || tgt_handle < 0)
+        return;
+
+    if (sort_state.enabled) {
+        gfx_depth_sort_add(&sort_state.sort, &sort_state.cur_rend_param,
+                           verts, n_verts, indices, n_indices);
+        return;
+    }
+
+    unsigned state_idx = soft_cur_state();
+
+    /*
+     * break every strip up into triangles.  Odd triangles get their first two
+     * verts swapped to keep the strip's winding order.
+     */
+    unsigned strip_start = 0, idx;
+    for (idx = 0; idx < n_indices; idx++) {
+        if (indices[idx] == GFX_PRIM_RESTART) {
+            strip_start = idx + 1;
+            continue;
+        }
+
+        unsigned tri_no = idx - strip_start;
+        if (tri_no < 2)
+            continue;
+        tri_no -= 2;
+
+        uint32_t idx0 = indices[idx - 2];
+        uint32_t idx1 = indices[idx - 1];
+        uint32_t idx2 = indices[idx];
+        if (idx0 >= n_verts || idx1 >= n_verts || idx2 >= n_verts) {
+            LOG_ERROR("%s - vertex index out of range\n", __func__);
+            continue;
+        }
+
+        if (tri_no & 1) {
+            soft_raster_add_tri(&frame, verts + idx1, verts + idx0,
+                                verts + idx2, state_idx);
+        } else {
+            soft_raster_add_tri(&frame, verts + idx0, verts + idx1,
+                                verts + idx2, state_idx);
+        }
+    }
+}
+
+static void soft_rend_clear(float const bgcolor[4]) {
+    if (tgt_handle < 0)
+        return;
+
+    // the clear has to land after anything that was drawn before it
+    soft_flush();
+
+    struct gfx_cfg rend_cfg = gfx_config_read();
+    float const black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    float const *color = rend_cfg.bgcolor_enable ? bgcolor : black;
+
+    uint8_t clear_pix[4];
+    unsigned comp;
+    for (comp = 0; comp < 4; comp++) {
+        float val = color[comp];
+        val = val < 0.0f ? 0.0f : (val > 1.0f ? 1.0f : val);
+        clear_pix[comp] = (uint8_t)(val * 255.0f + 0.5f);
+    }
+
+    size_t n_pix = (size_t)frame.color.width * frame.color.height;
+    size_t pix_no;
+    uint8_t *pix = frame.color.texels;
+    for (pix_no = 0; pix_no < n_pix; pix_no++, pix += 4)
+        memcpy(pix, clear_pix, sizeof(clear_pix));
+    for (pix_no = 0; pix_no < n_pix; pix_no++)
+        depth_buf[pix_no] = 1.0f;
+}
+
+static void soft_rend_begin_sort_mode(void) {
+    if (sort_state.enabled)
+        RAISE_ERROR(ERROR_INTEGRITY);
+
+    if (gfx_config_read().depth_sort_enable) {
+        sort_state.enabled = true;
+        gfx_depth_sort_begin(&sort_state.sort, sort_state.mode);
+    }
+}
+
+/*
+ * modifier volumes are not implemented in the software renderer; shadowed
+ * polygons are always drawn with their first parameter set.
+ */
+static void soft_rend_draw_mod_vol(struct gfx_vert const *verts,
+                                   unsigned n_verts, bool exclude) {
+}
+
+static void soft_rend_apply_mod_vol(float shadow_scale) {
+}
+
+static void soft_rend_end_sort_mode(void) {
+    if (!gfx_config_read().depth_sort_enable)
+        return;
+    if (!sort_state.enabled)
+        RAISE_ERROR(ERROR_INTEGRITY);
+
+    sort_state.enabled = false;
+
+    struct gfx_depth_sort *sort = &sort_state.sort;
+    gfx_depth_sort_finish(sort);
+
+    /*
+     * submit the triangles in back-to-front order.  A new draw state is only
+     * needed when the rendering parameters change between triangles.
+     */
+    struct gfx_rend_param const *last_param = NULL;
+    unsigned pos;
+    for (pos = 0; pos < sort->n_tris; pos++) {
+        unsigned tri_no = sort->tri_order[pos];
+        struct gfx_depth_sort_group const *grp =
+            gfx_depth_sort_tri_group(sort, tri_no);
+
+        if (!last_param || (last_param != &grp->rend_param &&
+                            !gfx_rend_param_equal(last_param,
+                                                  &grp->rend_param))) {
+            cur_rend_param = grp->rend_param;
+            state_dirty = true;
+        }
+        last_param = &grp->rend_param;
+
+        uint32_t const *tri_idx = sort->tri_idx + 3 * tri_no;
+        soft_raster_add_tri(&frame,
+                            grp->verts + (tri_idx[0] - grp->first_vert),
+                            grp->verts + (tri_idx[1] - grp->first_vert),
+                            grp->verts + (tri_idx[2] - grp->first_vert),
+                            soft_cur_state());
+    }
+}
+
+static void soft_rend_target_bind_obj(int handle) {
+    gfx_obj_get(handle)->on_read = soft_target_obj_read;
+}
+
+static void soft_rend_target_unbind_obj(int handle) {
+    struct gfx_obj *obj = gfx_obj_get(handle);
+
+    gfx_obj_alloc(obj);
+    if (obj->state == GFX_OBJ_STATE_TEX)
+        soft_target_obj_read(obj, obj->dat, obj->dat_len);
+
+    obj->on_read = NULL;
+}
+
+static void soft_rend_target_begin(unsigned width, unsigned height,
+                                   int handle) {
+    if (handle < 0) {
+        LOG_ERROR("%s - no rendering target is bound\n", __func__);
+        return;
+    }
+
+    soft_img_resize(obj_img + handle, width, height);
+
+    if (!depth_buf || depth_buf_width != width || depth_buf_height != height) {
+        free(depth_buf);
+        size_t n_pix = (size_t)width * height;
+        depth_buf = (float*)malloc(n_pix * sizeof(float));
+        if (!depth_buf)
+            RAISE_ERROR(ERROR_FAILED_ALLOC);
+        size_t pix_no;
+        for (pix_no = 0; pix_no < n_pix; pix_no++)
+            depth_buf[pix_no] = 1.0f;
+        depth_buf_width = width;
+        depth_buf_height = height;
+    }
+
+    tgt_handle = handle;
+    frame.color = obj_img[handle];
+    frame.depth = depth_buf;
+    frame.n_states = 0;
+    frame.n_tris = 0;
+    state_dirty = true;
+}
+
+static void soft_rend_target_end(int handle) {
+    if (handle < 0) {
+        LOG_ERROR("%s ERROR: no target bound\n", __func__);
+        return;
+    }
+
+    soft_flush();
+
+    tgt_handle = -1;
+    frame.color.texels = NULL;
+    frame.depth = NULL;
+
+    gfx_obj_get(handle)->state = GFX_OBJ_STATE_TEX;
+}
+
+static void soft_target_obj_read(struct gfx_obj *obj, void *out,
+                                 size_t n_bytes) {
+    if (obj->state == GFX_OBJ_STATE_TEX) {
+        struct soft_img const *img = obj_img + gfx_obj_handle(obj);
+        size_t length_expect = (size_t)img->width * img->height * 4;
+        if (n_bytes < length_expect) {
+            LOG_ERROR("need at least 0x%08x bytes (have 0x%08x)\n",
+                      (unsigned)length_expect, (unsigned)n_bytes);
+            error_set_length(n_bytes);
+            error_set_expected_length(length_expect);
+            RAISE_ERROR(ERROR_MEM_OUT_OF_BOUNDS);
+        }
+        memcpy(out, img->texels, length_expect);
+    } else {
+        // the texture has been overwritten since the last render
+        gfx_obj_alloc(obj);
+        memcpy(out, obj->dat, n_bytes);
+    }
+}
+
+static int soft_rend_video_get_fb(int *obj_handle_out, unsigned *width_out,
+                                  unsigned *height_out, bool *flip_out) {
+    if (cur_fb.obj_handle < 0)
+        return -1;
+
+    *obj_handle_out = cur_fb.obj_handle;
+    *width_out = cur_fb.width;
+    *height_out = cur_fb.height;
+    *flip_out = cur_fb.do_flip;
+    return 0;
+}
+
+static void soft_rend_video_present(void) {
+}
+
+static void soft_rend_video_new_framebuffer(int obj_handle,
+                                            unsigned fb_new_width,
+                                            unsigned fb_new_height,
+                                            bool do_flip) {
+    cur_fb.obj_handle = obj_handle;
+    cur_fb.width = fb_new_width;
+    cur_fb.height = fb_new_height;
+    cur_fb.do_flip = do_flip;
+
+    if (hash_enable) {
+        struct gfx_obj *obj = gfx_obj_get(obj_handle);
+        size_t n_bytes = (size_t)fb_new_width * fb_new_height * 4;
+        if (obj->dat && n_bytes <= obj->dat_len)
+            rend_hash = gfx_hash_bytes(rend_hash, obj->dat, n_bytes);
+    }
+}
+
+static void soft_rend_video_toggle_filter(void) {
+}
+
+struct rend_if const soft_rend_if = {
+    .init = soft_rend_init,
+    .cleanup = soft_rend_cleanup,
+    .update_tex = soft_rend_update_tex,
+    .release_tex = soft_rend_release_tex,
+    .set_blend_enable = soft_rend_set_blend_enable,
+    .set_rend_param = soft_rend_set_rend_param,
+    .set_screen_dim = soft_rend_set_screen_dim,
+    .set_clip_range = soft_rend_set_clip_range,
+    .draw_array = soft_rend_draw_array,
+    .clear = soft_rend_clear,
+    .begin_sort_mode = soft_rend_begin_sort_mode,
+    .end_sort_mode = soft_rend_end_sort_mode,
+    .draw_mod_vol = soft_rend_draw_mod_vol,
+    .apply_mod_vol = soft_rend_apply_mod_vol,
+    .target_bind_obj = soft_rend_target_bind_obj,
+    .target_unbind_obj = soft_rend_target_unbind_obj,
+    .target_begin = soft_rend_target_begin,
+    .target_end = soft_rend_target_end,
+    .video_get_fb = soft_rend_video_get_fb,
+    .video_present = soft_rend_video_present,
+    .video_new_framebuffer = soft_rend_video_new_framebuffer,
+    .video_toggle_filter = soft_rend_video_toggle_filter
+};
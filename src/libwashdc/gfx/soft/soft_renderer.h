@@ -0,0 +1,42 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef SOFT_RENDERER_H_
+#define SOFT_RENDERER_H_
+
+#include "gfx/rend_common.h"
+
+/*
+ * software renderer.  This draws everything the OpenGL renderer does
+ * (textures, blending, punch-through and depth-sorting included) on the CPU
+ * using the tile-binned rasterizer in soft_raster.c, and writes the results
+ * into the render target gfx_objs so the guest can read them back.
+ *
+ * It has no way to put anything on a display, so it is only used in headless
+ * mode.  Posted framebuffers are tracked the same way the null renderer
+ * tracks them, and if config_get_render_hash() is true their contents are
+ * hashed so that regression tests can compare fully rendered frames without
+ * needing a GPU.
+ */
+extern struct rend_if const soft_rend_if;
+
+#endif
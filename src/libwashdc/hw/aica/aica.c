@@ -32,6 +32,10 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "sound.h"
 #include "log.h"
 #include "dc_sched.h"
@@ -88,6 +92,9 @@ typedef uint32_t aica_atten;
 
 #define AICA_RINGBUFFER_ADDRESS 0x2804
 
+// EFSDL/EFPAN for each of the DSP's effect outputs
+#define AICA_DSP_MIXER_FIRST 0x2000
+
 #define AICA_PLAYSTATUS 0x2810
 
 #define AICA_PLAYPOS 0x2814
@@ -243,13 +250,30 @@ static unsigned aica_read_sci(struct aica *aica, unsigned bit);
 
 static char const *fmt_name(enum aica_fmt fmt);
 
-static void aica_sync(struct aica *aica);
+static void aica_sync(struct aica *aica, enum aica_sync_src src);
+static void aica_sync_all_timers(struct aica *aica);
 
 static unsigned aica_chan_effective_rate(struct aica const *aica, unsigned chan_no);
 
 static unsigned aica_samples_per_step(unsigned effective_rate, unsigned step_no);
 
-static void aica_process_sample(struct aica *aica);
+/*
+ * Samples get rendered in blocks of up to this many at a time.  Each channel
+ * renders its share of the block in one go and then gets mixed in, instead of
+ * going through every channel once per sample.
+ */
+#define AICA_BLOCK_LEN 256
+
+static void aica_render_block(struct aica *aica, unsigned n_samples);
+
+/*
+ * Audio that nothing has forced to be generated yet gets generated this many
+ * samples at a time.  This bounds how far behind the output can fall.
+ */
+#define AICA_SYNC_SLICE AICA_BLOCK_LEN
+
+static void aica_sched_slice(struct aica *aica);
+static void aica_slice_handler(struct SchedEvent *evt);
 
 static int get_octave_signed(struct aica_chan const *chan);
 static aica_sample_pos get_sample_rate_multiplier(struct aica_chan const *chan);
@@ -260,6 +284,58 @@ static void aica_chan_reset_adpcm(struct aica_chan *chan) {
     chan->adpcm_next_step = true;
 }
 
+static bool aica_chan_cache_fmt(struct aica_chan const *chan,
+                                enum aica_sample_cache_fmt *fmt) {
+    switch (chan->fmt) {
+    case AICA_FMT_16_BIT_SIGNED:
+        // already linear PCM
+        return false;
+    case AICA_FMT_8_BIT_SIGNED:
+        *fmt = AICA_SAMPLE_CACHE_FMT_8_BIT;
+        return true;
+    default:
+        *fmt = AICA_SAMPLE_CACHE_FMT_ADPCM;
+        return true;
+    }
+}
+
+// called on key-on to decode the channel's sample into the cache
+static void aica_chan_cache_sample(struct aica *aica, struct aica_chan *chan) {
+    enum aica_sample_cache_fmt fmt;
+
+    chan->cache_ent = -1;
+    chan->cache_loop_pass = false;
+    if (!aica_chan_cache_fmt(chan, &fmt))
+        return;
+
+    chan->cache_ent = aica_sample_cache_get(&aica->sample_cache, fmt,
+                                            chan->addr_start, chan->loop_start,
+                                            chan->loop_end, chan->loop_en);
+    if (chan->cache_ent >= 0)
+        chan->cache_gen = aica->sample_cache.ents[chan->cache_ent].gen;
+}
+
+/*
+ * return the cache entry the channel is playing from, or NULL if it has to
+ * decode wave memory directly.  Once a channel stops using the cache it
+ * doesn't go back to it until the next key-on.
+ */
+static struct aica_sample_cache_ent const*
+aica_chan_cached(struct aica *aica, struct aica_chan *chan) {
+    enum aica_sample_cache_fmt fmt;
+    struct aica_sample_cache_ent const *ent = NULL;
+
+    if (chan->cache_ent >= 0 && aica_chan_cache_fmt(chan, &fmt)) {
+        ent = aica_sample_cache_check(&aica->sample_cache, chan->cache_ent,
+                                      chan->cache_gen, fmt, chan->addr_start,
+                                      chan->loop_start, chan->loop_end,
+                                      chan->loop_en);
+    }
+    if (!ent)
+        chan->cache_ent = -1;
+    return ent;
+}
+
 struct memory_interface aica_sys_intf = {
     .read32 = aica_sys_read_32,
     .read16 = aica_sys_read_16,
@@ -304,10 +380,25 @@ void aica_init(struct aica *aica, struct arm7 *arm7,
 
     aica_sched_all_timers(aica);
 
+    aica->slice_evt.handler = aica_slice_handler;
+    aica->slice_evt.arg_ptr = aica;
+    aica_sched_slice(aica);
+
+    unsigned chan_no;
+    for (chan_no = 0; chan_no < AICA_CHAN_COUNT; chan_no++)
+        aica->channels[chan_no].cache_ent = -1;
+
     aica_wave_mem_init(&aica->mem);
+    aica_dsp_init(&aica->dsp);
+    aica_sample_cache_init(&aica->sample_cache, &aica->mem);
 }
 
 void aica_cleanup(struct aica *aica) {
+    if (aica->slice_scheduled) {
+        cancel_event(aica->clk, &aica->slice_evt);
+        aica->slice_scheduled = false;
+    }
+    aica_sample_cache_cleanup(&aica->sample_cache);
     aica_wave_mem_cleanup(&aica->mem);
 }
 
@@ -343,14 +434,38 @@ static void aica_sys_write_double(addr32_t addr, double val, void *ctxt) {
     RAISE_ERROR(ERROR_UNIMPLEMENTED);
 }
 
+/*
+ * returns true if the given system register's value depends on how far along
+ * the channels are.  The timer registers also change with time, but those can
+ * be brought up to date without generating any audio.
+ */
+static bool aica_sys_reg_time_dependent(unsigned addr) {
+    switch (addr) {
+    case AICA_PLAYPOS:
+    case AICA_PLAYSTATUS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// returns true if writing to the given system register changes the output
+static bool aica_sys_reg_affects_output(unsigned addr) {
+    switch (addr) {
+    case AICA_MASTER_VOLUME:
+    case AICA_RINGBUFFER_ADDRESS:
+        return true;
+    default:
+        return false;
+    }
+}
+
 static void
 aica_sys_reg_pre_read(struct aica *aica, unsigned idx, bool from_sh4) {
-
-    /*
-     * TODO: this only really needs to be called for registers which may have
-     * changed due to time, such as PLAYPOS and the timer registers.
-     */
-    aica_sync(aica);
+    if (aica_sys_reg_time_dependent(4 * idx))
+        aica_sync(aica, AICA_SYNC_SRC_READ);
+    else
+        aica->sync_stats.n_read_nosync++;
 
     uint32_t val;
     struct aica_chan *chan;
@@ -420,18 +535,21 @@ aica_sys_reg_pre_read(struct aica *aica, unsigned idx, bool from_sh4) {
 
     case AICA_TIMERA_CTRL:
         LOG_DBG("read AICA_TIMERA_CTRL\n");
+        aica_sync_timer(aica, 0);
         aica->sys_reg[AICA_TIMERA_CTRL / 4] =
             ((aica->timers[0].prescale_log & 0x7) << 8) |
             (aica->timers[0].counter & 0xf);
         break;
     case AICA_TIMERB_CTRL:
         LOG_DBG("read AICA_TIMERB_CTRL\n");
+        aica_sync_timer(aica, 1);
         aica->sys_reg[AICA_TIMERB_CTRL / 4] =
             ((aica->timers[1].prescale_log & 0x7) << 8) |
             (aica->timers[1].counter & 0xf);
         break;
     case AICA_TIMERC_CTRL:
         LOG_DBG("read AICA_TIMERC_CTRL\n");
+        aica_sync_timer(aica, 2);
         aica->sys_reg[AICA_TIMERC_CTRL / 4] =
             ((aica->timers[2].prescale_log & 0x7) << 8) |
             (aica->timers[2].counter & 0xf);
@@ -640,6 +758,9 @@ static void aica_sys_reg_write(struct aica *aica, addr32_t addr,
     }
 #endif
 
+    if (aica_sys_reg_affects_output(addr & ~3))
+        aica_sync(aica, AICA_SYNC_SRC_WRITE);
+
     memcpy(((uint8_t*)aica->sys_reg) + addr, val_in, n_bytes);
     aica_sys_reg_post_write(aica, addr / 4, from_sh4);
 }
@@ -758,6 +879,7 @@ static void aica_do_keyon(struct aica *aica) {
             chan->loop_end_signaled = false;
 
             aica_chan_reset_adpcm(chan);
+            aica_chan_cache_sample(aica, chan);
 
             LOG_INFO("AICA channel %u key-on fmt %s ptr 0x%08x\n",
                    chan_no, fmt_name(chan->fmt),
@@ -798,6 +920,9 @@ static void aica_sys_channel_write(struct aica *aica, void const *src,
         RAISE_ERROR(ERROR_MEM_OUT_OF_BOUNDS);
     }
 
+    // samples up to now need to be generated with the old settings
+    aica_sync(aica, AICA_SYNC_SRC_WRITE);
+
     unsigned chan_no = addr / AICA_CHAN_LEN;
     unsigned chan_reg = addr % AICA_CHAN_LEN;
 
@@ -877,6 +1002,10 @@ static void aica_sys_channel_write(struct aica *aica, void const *src,
         chan->pan = tmp & 0x1f;
         break;
     case AICA_CHAN_DSP_SEND:
+        memcpy(&tmp, chan->raw + AICA_CHAN_DSP_SEND, sizeof(tmp));
+        chan->dsp_send_sel = tmp & 0xf;
+        chan->dsp_send_level = (tmp >> 4) & 0xf;
+        break;
     case AICA_CHAN_LPF1_VOL:
     case AICA_CHAN_LPF2:
     case AICA_CHAN_LPF3:
@@ -915,6 +1044,7 @@ static void aica_dsp_mixer_write(struct aica *aica, void const *src,
         LOG_DBG("AICA DSP MIXER: Writing %u bytes from 0x%08x\n",
                 len, (unsigned)addr);
     }
+    aica_sync(aica, AICA_SYNC_SRC_WRITE);
     memcpy(((uint8_t*)aica->sys_reg) + addr, src, len);
 }
 
@@ -932,7 +1062,12 @@ static void aica_dsp_reg_write(struct aica *aica, void const *src,
         LOG_DBG("AICA DSP REG: Writing %u bytes from 0x%08x\n",
                 len, (unsigned)addr);
     }
+    aica_sync(aica, AICA_SYNC_SRC_WRITE);
     memcpy(((uint8_t*)aica->sys_reg) + addr, src, len);
+
+    // COEF, MADRS and MPRO all get baked into the compiled program
+    if (addr_first <= AICA_DSP_MPRO_LAST)
+        aica_dsp_invalidate(&aica->dsp);
 }
 
 static uint32_t aica_sys_read_32(addr32_t addr, void *ctxt) {
@@ -1218,7 +1353,7 @@ static void
 on_timer_ctrl_write(struct aica *aica, unsigned tim_idx, uint32_t val) {
     struct aica_timer *timer = aica->timers + tim_idx;
 
-    aica_sync(aica);
+    aica_sync_timer(aica, tim_idx);
     aica_unsched_timer(aica, tim_idx);
 
     timer->counter = val & 0xff;
@@ -1253,7 +1388,7 @@ static void aica_timer_handler(struct aica *aica, unsigned tim_idx) {
     struct aica_timer *timer = aica->timers + tim_idx;
 
     timer->scheduled = false;
-    aica_sync(aica);
+    aica_sync_timer(aica, tim_idx);
 
     if (timer->counter) {
         LOG_ERROR("timer->counter is %u\n", timer->counter);
@@ -1321,10 +1456,16 @@ static dc_cycle_stamp_t aica_get_sample_count(struct aica *aica) {
     return clock_cycle_stamp(aica->clk) / TICKS_PER_SAMPLE;
 }
 
-static void aica_sync(struct aica *aica) {
+static void aica_sync_all_timers(struct aica *aica) {
     aica_sync_timer(aica, 0);
     aica_sync_timer(aica, 1);
     aica_sync_timer(aica, 2);
+}
+
+static void aica_sync(struct aica *aica, enum aica_sync_src src) {
+    aica->sync_stats.n_sync[src]++;
+
+    aica_sync_all_timers(aica);
 
     if (aica->last_sample_sync != aica_get_sample_count(aica)) {
         /*
@@ -1334,13 +1475,64 @@ static void aica_sync(struct aica *aica) {
         dc_cycle_stamp_t n_samples = AICA_FREQ_RATIO *
             (aica_get_sample_count(aica) - aica->last_sample_sync);
 
-        while (n_samples--)
-            aica_process_sample(aica);
+        aica->sync_stats.n_sync_render++;
+        aica->sync_stats.n_samples += n_samples;
+
+        while (n_samples) {
+            unsigned block_len = n_samples < AICA_BLOCK_LEN ?
+                n_samples : AICA_BLOCK_LEN;
+            aica_render_block(aica, block_len);
+            n_samples -= block_len;
+        }
 
         aica->last_sample_sync = aica_get_sample_count(aica);
     }
 }
 
+static void aica_sched_slice(struct aica *aica) {
+    if (aica->slice_scheduled)
+        return;
+
+    aica->slice_evt.when = clock_cycle_stamp(aica->clk) +
+        TICKS_PER_SAMPLE * (AICA_SYNC_SLICE / AICA_FREQ_RATIO);
+    sched_event(aica->clk, &aica->slice_evt);
+    aica->slice_scheduled = true;
+}
+
+static void aica_slice_handler(struct SchedEvent *evt) {
+    struct aica *aica = (struct aica*)evt->arg_ptr;
+
+    aica->slice_scheduled = false;
+    aica_sync(aica, AICA_SYNC_SRC_SLICE);
+    aica_sched_slice(aica);
+}
+
+void aica_print_stats(struct aica const *aica) {
+    struct aica_sync_stats const *stats = &aica->sync_stats;
+
+    LOG_INFO("AICA syncs: %llu on register read, %llu on register write, "
+             "%llu on time slice\n",
+             (unsigned long long)stats->n_sync[AICA_SYNC_SRC_READ],
+             (unsigned long long)stats->n_sync[AICA_SYNC_SRC_WRITE],
+             (unsigned long long)stats->n_sync[AICA_SYNC_SRC_SLICE]);
+    printf("AICA syncs: %llu on register read, %llu on register write, "
+           "%llu on time slice\n",
+           (unsigned long long)stats->n_sync[AICA_SYNC_SRC_READ],
+           (unsigned long long)stats->n_sync[AICA_SYNC_SRC_WRITE],
+           (unsigned long long)stats->n_sync[AICA_SYNC_SRC_SLICE]);
+
+    LOG_INFO("AICA: %llu syncs generated %llu samples; %llu register reads "
+             "did not need to sync\n",
+             (unsigned long long)stats->n_sync_render,
+             (unsigned long long)stats->n_samples,
+             (unsigned long long)stats->n_read_nosync);
+    printf("AICA: %llu syncs generated %llu samples; %llu register reads "
+           "did not need to sync\n",
+           (unsigned long long)stats->n_sync_render,
+           (unsigned long long)stats->n_samples,
+           (unsigned long long)stats->n_read_nosync);
+}
+
 static unsigned aica_chan_effective_rate(struct aica const *aica, unsigned chan_no) {
     struct aica_chan const *chan = aica->channels + chan_no;
     unsigned rate;
@@ -1635,32 +1827,77 @@ static aica_atten atten_scale(unsigned atten) {
     return scale;
 }
 
-static void aica_process_sample(struct aica *aica) {
-    unsigned chan_no;
+/*
+ * advance the amplitude envelope by one step.  This gets called once the
+ * channel has played samples_per_step samples since the last step.
+ */
+static void aica_chan_env_step(struct aica_chan *chan, unsigned effective_rate) {
+    unsigned step_mod = chan->step_no % 4;
+    unsigned rate_idx;
+    if (effective_rate >= 0x30 && effective_rate <= 0x3c)
+        rate_idx = effective_rate - 0x30;
+    else if (effective_rate < 0x30)
+        rate_idx = 0;
+    else
+        rate_idx = 0x3c - 0x30;
 
-    int32_t sample_total = 0;
+    if (chan->atten_env_state == AICA_ENV_ATTACK) {
+        chan->atten -=
+            (chan->atten >> attack_step_delta[rate_idx][step_mod]) + 1;
+        if (!chan->atten) {
+            chan->atten_env_state = AICA_ENV_DECAY;
+        }
+    } else {
+        chan->atten += decay_step_delta[rate_idx][step_mod];
 
-    for (chan_no = 0; chan_no < AICA_CHAN_COUNT; chan_no++) {
-        struct aica_chan *chan = aica->channels + chan_no;
+        if (chan->atten >= 0x3bf)
+            chan->atten = 0x1fff;
 
-        if (!chan->playing)
-            continue;
+        if (chan->atten_env_state == AICA_ENV_DECAY) {
+            if (chan->atten >= chan->decay_level)
+                chan->atten_env_state = AICA_ENV_SUSTAIN;
+        } else {
+            // sustain or release
+            if (chan->atten >= 0x3bf)
+                chan->playing = false;
+        }
+    }
 
-        aica_sample_pos sample_rate =
-            get_sample_rate_multiplier(chan) / AICA_FREQ_RATIO;
-        unsigned effective_rate = aica_chan_effective_rate(aica, chan_no);
-        unsigned samples_per_step = aica_samples_per_step(effective_rate,
-                                                          chan->step_no);
+    chan->sample_no = 0;
+    chan->step_no++;
+}
+
+/*
+ * render up to n_samples samples from the given channel into outp.  This
+ * returns early if the channel stops playing; the return value is the number
+ * of samples that were written.
+ *
+ * The channel's registers can't change in the middle of this, so the sample
+ * rate is only computed once and the envelope's rate only gets recomputed
+ * when it moves to the next step.
+ */
+static unsigned aica_chan_render(struct aica *aica, unsigned chan_no,
+                                 int32_t *outp, unsigned n_samples) {
+    struct aica_chan *chan = aica->channels + chan_no;
+
+    aica_sample_pos sample_rate =
+        get_sample_rate_multiplier(chan) / AICA_FREQ_RATIO;
+    enum aica_env_state env_state = chan->atten_env_state;
+    unsigned effective_rate = aica_chan_effective_rate(aica, chan_no);
+    unsigned samples_per_step = aica_samples_per_step(effective_rate,
+                                                      chan->step_no);
+    struct aica_sample_cache_ent const *cached = aica_chan_cached(aica, chan);
 
+    unsigned sample_no;
+    for (sample_no = 0; sample_no < n_samples && chan->playing; sample_no++) {
         bool did_increment = false;
-        if (chan->fmt == AICA_FMT_16_BIT_SIGNED) {
-            int32_t sample =
-                (int32_t)(int16_t)aica_wave_mem_read_16(chan->addr_cur,
-                                                        &aica->mem);
-            // TODO: linear interpolation
-            if (!chan->is_muted)
-                sample_total = add_sample32(sample_total, sample);
+        int32_t sample;
 
+        switch (chan->fmt) {
+        case AICA_FMT_16_BIT_SIGNED:
+            sample = (int32_t)(int16_t)aica_wave_mem_read_16(chan->addr_cur,
+                                                             &aica->mem);
+            // TODO: linear interpolation
             chan->sample_partial += sample_rate;
             while (chan->sample_partial >= AICA_SAMPLE_POS_UNIT) {
                 chan->sample_partial -= AICA_SAMPLE_POS_UNIT;
@@ -1668,16 +1905,20 @@ static void aica_process_sample(struct aica *aica) {
                 chan->sample_pos++;
                 did_increment = true;
             }
-        } else if (chan->fmt == AICA_FMT_8_BIT_SIGNED) {
-            int32_t sample =
-                (int32_t)(int8_t)aica_wave_mem_read_8(chan->addr_cur,
-                                                      &aica->mem);
-            sample = sat_shift(sample, 8);
+            break;
+        case AICA_FMT_8_BIT_SIGNED:
+            if (cached && chan->sample_pos <= cached->loop_end &&
+                chan->addr_cur == chan->addr_start + chan->sample_pos) {
+                sample = cached->samples[chan->sample_pos];
+            } else {
+                cached = NULL;
+                chan->cache_ent = -1;
+                sample = (int32_t)(int8_t)aica_wave_mem_read_8(chan->addr_cur,
+                                                               &aica->mem);
+                sample = sat_shift(sample, 8);
+            }
 
             // TODO: linear interpolation
-            if (!chan->is_muted)
-                sample_total = add_sample32(sample_total, sample);
-
             chan->sample_partial += sample_rate;
             while (chan->sample_partial >= AICA_SAMPLE_POS_UNIT) {
                 chan->sample_partial -= AICA_SAMPLE_POS_UNIT;
@@ -1685,23 +1926,43 @@ static void aica_process_sample(struct aica *aica) {
                 chan->sample_pos++;
                 did_increment = true;
             }
-        } else {
+            break;
+        default:
             // 4-bit ADPCM
             if (chan->adpcm_next_step) {
-                uint8_t sample = aica_wave_mem_read_8(chan->addr_cur, &aica->mem);
-                if (chan->sample_pos & 1)
-                    sample = (sample >> 4) & 0xf;
-                else
-                    sample &= 0xf;
-
-                chan->adpcm_sample = adpcm_yamaha_expand_nibble(chan, sample);
+                if (cached && chan->sample_pos <= cached->loop_end &&
+                    (!chan->cache_loop_pass ||
+                     chan->sample_pos >= cached->loop_start) &&
+                    chan->addr_cur == chan->addr_start + chan->sample_pos / 2) {
+                    /*
+                     * the cache also has the decoder state so that the
+                     * channel can switch back to decoding wave memory
+                     * directly without skipping a beat.
+                     */
+                    unsigned idx = chan->sample_pos;
+                    if (chan->cache_loop_pass)
+                        idx += cached->loop_end + 1 - cached->loop_start;
+                    chan->adpcm_sample = cached->samples[idx];
+                    chan->predictor = cached->samples[idx];
+                    chan->step = cached->steps[idx];
+                } else {
+                    cached = NULL;
+                    chan->cache_ent = -1;
+
+                    uint8_t nibble = aica_wave_mem_read_8(chan->addr_cur,
+                                                          &aica->mem);
+                    if (chan->sample_pos & 1)
+                        nibble = (nibble >> 4) & 0xf;
+                    else
+                        nibble &= 0xf;
+
+                    chan->adpcm_sample =
+                        adpcm_yamaha_expand_nibble(chan, nibble);
+                }
                 chan->adpcm_next_step = false;
             }
 
-            int32_t sample = chan->adpcm_sample;
-
-            if (!chan->is_muted)
-                sample_total = add_sample32(sample_total, sample);
+            sample = chan->adpcm_sample;
 
             chan->sample_partial += sample_rate;
             if (chan->sample_partial >= AICA_SAMPLE_POS_UNIT) {
@@ -1715,6 +1976,8 @@ static void aica_process_sample(struct aica *aica) {
             }
         }
 
+        outp[sample_no] = sample;
+
         if (chan->sample_pos > chan->loop_end) {
             aica_chan_reset_adpcm(chan);
 
@@ -1722,6 +1985,7 @@ static void aica_process_sample(struct aica *aica) {
                 chan->loop_end_playstatus_flag = true;
 
             if (chan->loop_en) {
+                chan->cache_loop_pass = true;
                 chan->sample_pos = chan->loop_start;
                 switch (chan->fmt) {
                 case AICA_FMT_16_BIT_SIGNED:
@@ -1744,44 +2008,194 @@ static void aica_process_sample(struct aica *aica) {
         if (did_increment) {
             chan->sample_no++;
             if (samples_per_step && chan->sample_no >= samples_per_step) {
-                unsigned step_mod = chan->step_no % 4;
-                unsigned rate_idx;
-                if (effective_rate >= 0x30 && effective_rate <= 0x3c)
-                    rate_idx = effective_rate - 0x30;
-                else if (effective_rate < 0x30)
-                    rate_idx = 0;
-                else
-                    rate_idx = 0x3c - 0x30;
-
-                if (chan->atten_env_state == AICA_ENV_ATTACK) {
-                    chan->atten -=
-                        (chan->atten >> attack_step_delta[rate_idx][step_mod]) + 1;
-                    if (!chan->atten) {
-                        chan->atten_env_state = AICA_ENV_DECAY;
-                    }
-                } else {
-                    chan->atten += decay_step_delta[rate_idx][step_mod];
-
-                    if (chan->atten >= 0x3bf)
-                        chan->atten = 0x1fff;
-
-                    if (chan->atten_env_state == AICA_ENV_DECAY) {
-                        if (chan->atten >= chan->decay_level)
-                            chan->atten_env_state = AICA_ENV_SUSTAIN;
-                    } else {
-                        // sustain or release
-                        if (chan->atten >= 0x3bf)
-                            chan->playing = false;
-                    }
+                aica_chan_env_step(chan, effective_rate);
+                if (chan->atten_env_state != env_state) {
+                    env_state = chan->atten_env_state;
+                    effective_rate = aica_chan_effective_rate(aica, chan_no);
                 }
+                samples_per_step = aica_samples_per_step(effective_rate,
+                                                         chan->step_no);
+            }
+        }
+    }
+
+    return sample_no;
+}
+
+/*
+ * gain for each 3dB step of attenuation, in 16.16 fixed-point.  This is used
+ * for the direct send level and the pan.
+ */
+static int32_t const atten_3db_steps[16] = {
+    65536, 46396, 32846, 23253, 16462, 11654, 8250, 5841,
+    4135,  2927,  2072,  1467,  1039,  735,   521,  369
+};
+
+// gain for a 4-bit send level, where 0 is off and every step below 0xf is 3dB
+static inline int32_t aica_level_gain(unsigned level) {
+    return level ? atten_3db_steps[0xf - (level & 0xf)] : 0;
+}
+
+/*
+ * compute the left and right gain of an output from its level and pan
+ * settings.  This is used for each channel's direct output (DISDL/DIPAN) and
+ * for the DSP's effect outputs (EFSDL/EFPAN).  The low four bits of the pan
+ * attenuate one side by 3dB per step (0xf mutes that side), and bit 4 selects
+ * whether it's the left side or the right side that gets attenuated.
+ */
+static void aica_level_pan_gain(unsigned level, unsigned pan,
+                                int32_t *gain_l, int32_t *gain_r) {
+    int32_t vol_gain = aica_level_gain(level);
+    unsigned pan_steps = pan & 0xf;
+    int32_t pan_gain = pan_steps == 0xf ?
+        0 : (vol_gain * atten_3db_steps[pan_steps]) >> 16;
+
+    if (pan & 0x10) {
+        *gain_l = pan_gain;
+        *gain_r = vol_gain;
+    } else {
+        *gain_l = vol_gain;
+        *gain_r = pan_gain;
+    }
+}
 
-                chan->sample_no = 0;
-                chan->step_no++;
+// expand mono samples into interleaved stereo frames with the given gains
+static void aica_pan_block(int32_t *frames, int32_t const *samples,
+                           unsigned n_samples, int32_t gain_l, int32_t gain_r) {
+    unsigned idx;
+    for (idx = 0; idx < n_samples; idx++) {
+        int64_t sample = samples[idx];
+        int32_t *frame = frames + idx * WASHDC_SOUND_CHAN_COUNT;
+        frame[WASHDC_SOUND_CHAN_LEFT] = (int32_t)((sample * gain_l) >> 16);
+        frame[WASHDC_SOUND_CHAN_RIGHT] = (int32_t)((sample * gain_r) >> 16);
+    }
+}
+
+// add n_samples samples into mix, saturating on overflow
+static void aica_mix_block(int32_t *mix, int32_t const *samples,
+                           unsigned n_samples) {
+    unsigned idx = 0;
+#ifdef __SSE2__
+    __m128i const max_val = _mm_set1_epi32(INT32_MAX);
+    for (; idx + 4 <= n_samples; idx += 4) {
+        __m128i lhs = _mm_loadu_si128((__m128i const*)(mix + idx));
+        __m128i rhs = _mm_loadu_si128((__m128i const*)(samples + idx));
+        __m128i sum = _mm_add_epi32(lhs, rhs);
+
+        /*
+         * signed overflow happened wherever both operands have the same sign
+         * and the sum's sign is different.  Those lanes get INT32_MAX or
+         * INT32_MIN depending on the sign of the operands.
+         */
+        __m128i ovf = _mm_srai_epi32(
+            _mm_andnot_si128(_mm_xor_si128(lhs, rhs),
+                             _mm_xor_si128(lhs, sum)), 31);
+        __m128i sat = _mm_xor_si128(_mm_srai_epi32(lhs, 31), max_val);
+        sum = _mm_or_si128(_mm_and_si128(ovf, sat),
+                           _mm_andnot_si128(ovf, sum));
+
+        _mm_storeu_si128((__m128i*)(mix + idx), sum);
+    }
+#endif
+    for (; idx < n_samples; idx++)
+        mix[idx] = add_sample32(mix[idx], samples[idx]);
+}
+
+/*
+ * accumulate a channel's effect send into the DSP's per-sample MIXS inputs.
+ * MIXS is 20 bits wide, so 16-bit samples go in at the top.
+ */
+static void aica_send_block(int32_t (*dsp_send)[AICA_DSP_N_MIXS],
+                            int32_t const *samples, unsigned n_samples,
+                            unsigned sel, int32_t gain) {
+    unsigned idx;
+    for (idx = 0; idx < n_samples; idx++)
+        dsp_send[idx][sel] += (int32_t)(((int64_t)samples[idx] * gain) >> 12);
+}
+
+/*
+ * run the DSP over the block and mix its effect outputs into mix.  Each
+ * EFREG has its own level and pan in the DSP mixer registers.
+ */
+static void aica_dsp_block(struct aica *aica, int32_t *mix,
+                           int32_t (*dsp_send)[AICA_DSP_N_MIXS],
+                           unsigned n_samples) {
+    int32_t gain[AICA_DSP_N_EFREG][WASHDC_SOUND_CHAN_COUNT];
+    unsigned efreg_no, idx;
+
+    for (efreg_no = 0; efreg_no < AICA_DSP_N_EFREG; efreg_no++) {
+        uint32_t reg = aica->sys_reg[AICA_DSP_MIXER_FIRST / 4 + efreg_no];
+        aica_level_pan_gain((reg >> 8) & 0xf, reg & 0x1f,
+                            &gain[efreg_no][WASHDC_SOUND_CHAN_LEFT],
+                            &gain[efreg_no][WASHDC_SOUND_CHAN_RIGHT]);
+    }
+
+    uint32_t rb_len_words = 8192 << aica->ringbuffer_size;
+
+    for (idx = 0; idx < n_samples; idx++) {
+        memcpy(aica->dsp.mixs, dsp_send[idx], sizeof(aica->dsp.mixs));
+        aica_dsp_exec(&aica->dsp, &aica->mem,
+                      aica->ringbuffer_addr, rb_len_words);
+
+        int32_t *frame = mix + idx * WASHDC_SOUND_CHAN_COUNT;
+        for (efreg_no = 0; efreg_no < AICA_DSP_N_EFREG; efreg_no++) {
+            int64_t efreg = aica->dsp.efreg[efreg_no];
+            unsigned chan;
+            if (!efreg)
+                continue;
+            for (chan = 0; chan < WASHDC_SOUND_CHAN_COUNT; chan++) {
+                frame[chan] =
+                    add_sample32(frame[chan],
+                                 (int32_t)((efreg * gain[efreg_no][chan]) >> 16));
             }
         }
     }
+}
+
+static void aica_render_block(struct aica *aica, unsigned n_samples) {
+    int32_t mix[AICA_BLOCK_LEN * WASHDC_SOUND_CHAN_COUNT];
+    int32_t chan_samples[AICA_BLOCK_LEN];
+    int32_t chan_frames[AICA_BLOCK_LEN * WASHDC_SOUND_CHAN_COUNT];
+    int32_t dsp_send[AICA_BLOCK_LEN][AICA_DSP_N_MIXS];
+    unsigned chan_no;
+
+    memset(mix, 0, n_samples * WASHDC_SOUND_CHAN_COUNT * sizeof(mix[0]));
+
+    aica_dsp_compile(&aica->dsp, aica->sys_reg);
+    bool dsp_active = aica_dsp_active(&aica->dsp);
+    if (dsp_active)
+        memset(dsp_send, 0, n_samples * sizeof(dsp_send[0]));
+
+    for (chan_no = 0; chan_no < AICA_CHAN_COUNT; chan_no++) {
+        struct aica_chan *chan = aica->channels + chan_no;
+
+        if (!chan->playing)
+            continue;
+
+        unsigned n_rendered = aica_chan_render(aica, chan_no,
+                                               chan_samples, n_samples);
+        if (chan->is_muted)
+            continue;
+
+        if (dsp_active && chan->dsp_send_level) {
+            aica_send_block(dsp_send, chan_samples, n_rendered,
+                            chan->dsp_send_sel,
+                            aica_level_gain(chan->dsp_send_level));
+        }
+
+        int32_t gain_l, gain_r;
+        aica_level_pan_gain(chan->volume, chan->pan, &gain_l, &gain_r);
+        if (!gain_l && !gain_r)
+            continue;
+
+        aica_pan_block(chan_frames, chan_samples, n_rendered, gain_l, gain_r);
+        aica_mix_block(mix, chan_frames, n_rendered * WASHDC_SOUND_CHAN_COUNT);
+    }
+
+    if (dsp_active)
+        aica_dsp_block(aica, mix, dsp_send, n_samples);
 
-    dc_submit_sound_samples(&sample_total, 1);
+    dc_submit_sound_frames(mix, n_samples);
 }
 
 static void raise_aica_sh4_int(struct aica *aica) {
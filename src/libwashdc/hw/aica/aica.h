@@ -27,6 +27,8 @@
 
 #include "dc_sched.h"
 #include "aica_wave_mem.h"
+#include "aica_dsp.h"
+#include "aica_sample_cache.h"
 #include "washdc/gameconsole.h"
 
 struct arm7;
@@ -86,6 +88,9 @@ struct aica_chan {
     // from the DirectPanVolSend channel register (offset 0x24)
     unsigned volume, pan;
 
+    // from the DSPChannelSend register (offset 0x20): ISEL and IMXL
+    unsigned dsp_send_sel, dsp_send_level;
+
     // the state of the amplitude envelope in the PlayStatus register
     enum aica_env_state atten_env_state;
 
@@ -135,6 +140,16 @@ struct aica_chan {
     bool adpcm_next_step;
     int32_t adpcm_sample;
 
+    /*
+     * entry in the sample cache this channel is playing from, or -1 if it's
+     * decoding wave memory directly.  cache_gen is the entry's generation
+     * when the channel got it, and cache_loop_pass is set once the channel
+     * has looped for the first time.
+     */
+    int cache_ent;
+    uint32_t cache_gen;
+    bool cache_loop_pass;
+
     // if true, this channel has been forcibly muted by the user through the UI.
     bool is_muted;
 };
@@ -150,6 +165,33 @@ struct aica_timer {
     unsigned prescale_log;
 };
 
+/*
+ * reasons the AICA might need to catch up on generating audio.  Register reads
+ * only do this if the register's value depends on how much time has passed,
+ * and register writes only do it if the register affects the output.
+ * Everything else gets batched until the next time slice.
+ */
+enum aica_sync_src {
+    AICA_SYNC_SRC_READ,
+    AICA_SYNC_SRC_WRITE,
+    AICA_SYNC_SRC_SLICE,
+
+    AICA_SYNC_SRC_COUNT
+};
+
+struct aica_sync_stats {
+    // number of times aica_sync was called for each aica_sync_src
+    uint64_t n_sync[AICA_SYNC_SRC_COUNT];
+
+    // number of syncs which actually had samples to generate
+    uint64_t n_sync_render;
+
+    // number of register reads which didn't need to sync
+    uint64_t n_read_nosync;
+
+    uint64_t n_samples;
+};
+
 struct aica {
     struct aica_wave_mem mem;
     struct arm7 *arm7;
@@ -206,8 +248,18 @@ struct aica {
 
     struct aica_chan channels[AICA_CHAN_COUNT];
 
+    struct aica_dsp dsp;
+
+    struct aica_sample_cache sample_cache;
+
     dc_cycle_stamp_t last_sample_sync;
 
+    // periodic event which catches up on audio generation
+    struct SchedEvent slice_evt;
+    bool slice_scheduled;
+
+    struct aica_sync_stats sync_stats;
+
     // timerA, timerB, timerC
     struct aica_timer timers[3];
 
@@ -219,6 +271,8 @@ void aica_init(struct aica *aica, struct arm7 *arm7,
                struct dc_clock *clk, struct dc_clock *sh4_clk);
 void aica_cleanup(struct aica *aica);
 
+void aica_print_stats(struct aica const *aica);
+
 extern struct memory_interface aica_sys_intf;
 
 extern bool aica_log_verbose_val;
@@ -0,0 +1,335 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "aica_dsp.h"
+
+// step flags
+#define AICA_DSP_STEP_TWT   (1 << 0)
+#define AICA_DSP_STEP_IWT   (1 << 1)
+#define AICA_DSP_STEP_XSEL  (1 << 2)
+#define AICA_DSP_STEP_TABLE (1 << 3)
+#define AICA_DSP_STEP_MWT   (1 << 4)
+#define AICA_DSP_STEP_MRD   (1 << 5)
+#define AICA_DSP_STEP_EWT   (1 << 6)
+#define AICA_DSP_STEP_ADRL  (1 << 7)
+#define AICA_DSP_STEP_FRCL  (1 << 8)
+#define AICA_DSP_STEP_YRL   (1 << 9)
+#define AICA_DSP_STEP_NEGB  (1 << 10)
+#define AICA_DSP_STEP_ZERO  (1 << 11)
+#define AICA_DSP_STEP_BSEL  (1 << 12)
+#define AICA_DSP_STEP_NOFL  (1 << 13)
+#define AICA_DSP_STEP_ADREB (1 << 14)
+#define AICA_DSP_STEP_NXADR (1 << 15)
+
+static inline int32_t sign_extend24(int32_t val) {
+    return ((int32_t)((uint32_t)val << 8)) >> 8;
+}
+
+static inline int32_t sign_extend13(int32_t val) {
+    return ((int32_t)((uint32_t)val << 19)) >> 19;
+}
+
+static inline int32_t clamp24(int32_t val) {
+    if (val > 0x7fffff)
+        return 0x7fffff;
+    if (val < -0x800000)
+        return -0x800000;
+    return val;
+}
+
+/*
+ * The ring buffer holds 16-bit values in a floating-point format: a sign
+ * bit, a 4-bit exponent and an 11-bit mantissa.  These convert between that
+ * and the DSP's 24-bit integers.
+ */
+static uint16_t pack_float(int32_t val) {
+    unsigned sign = (val >> 23) & 1;
+    uint32_t temp = ((uint32_t)val ^ ((uint32_t)val << 1)) & 0xffffff;
+    unsigned exponent = 0;
+
+    while (exponent < 12 && !(temp & 0x800000)) {
+        temp <<= 1;
+        exponent++;
+    }
+
+    if (exponent < 12)
+        val = ((uint32_t)val << exponent) & 0x3fffff;
+    else
+        val = (int32_t)((uint32_t)val << 11);
+    val >>= 11;
+
+    return (sign << 15) | (exponent << 11) | (val & 0x7ff);
+}
+
+static int32_t unpack_float(uint16_t val) {
+    unsigned sign = (val >> 15) & 1;
+    unsigned exponent = (val >> 11) & 0xf;
+    int32_t uval = (val & 0x7ff) << 11;
+
+    if (exponent > 11) {
+        exponent = 11;
+        uval |= sign << 22;
+    } else {
+        uval |= (sign ^ 1) << 22;
+    }
+    uval |= sign << 23;
+
+    return sign_extend24(uval) >> exponent;
+}
+
+void aica_dsp_init(struct aica_dsp *dsp) {
+    memset(dsp, 0, sizeof(*dsp));
+    dsp->dirty = true;
+}
+
+void aica_dsp_invalidate(struct aica_dsp *dsp) {
+    dsp->dirty = true;
+}
+
+// each step is four 16-bit words, and every word takes up a 32-bit register
+static inline unsigned mpro_word(uint32_t const *sys_reg,
+                                 unsigned step_no, unsigned word_no) {
+    return sys_reg[(AICA_DSP_MPRO_FIRST / 4) + step_no * 4 + word_no] & 0xffff;
+}
+
+void aica_dsp_compile(struct aica_dsp *dsp, uint32_t const *sys_reg) {
+    if (!dsp->dirty)
+        return;
+    dsp->dirty = false;
+
+    // trailing steps which are all zeroes don't get run at all
+    unsigned n_steps = AICA_DSP_N_STEPS;
+    while (n_steps &&
+           !(mpro_word(sys_reg, n_steps - 1, 0) |
+             mpro_word(sys_reg, n_steps - 1, 1) |
+             mpro_word(sys_reg, n_steps - 1, 2) |
+             mpro_word(sys_reg, n_steps - 1, 3)))
+        n_steps--;
+
+    unsigned step_no;
+    for (step_no = 0; step_no < n_steps; step_no++) {
+        struct aica_dsp_step *step = dsp->prog + step_no;
+        unsigned w0 = mpro_word(sys_reg, step_no, 0);
+        unsigned w1 = mpro_word(sys_reg, step_no, 1);
+        unsigned w2 = mpro_word(sys_reg, step_no, 2);
+        unsigned w3 = mpro_word(sys_reg, step_no, 3);
+        uint32_t flags = 0;
+
+        step->tra = (w0 >> 9) & 0x7f;
+        if (w0 & (1 << 8))
+            flags |= AICA_DSP_STEP_TWT;
+        step->twa = (w0 >> 1) & 0x7f;
+
+        if (w1 & (1 << 15))
+            flags |= AICA_DSP_STEP_XSEL;
+        step->ysel = (w1 >> 13) & 3;
+        step->ira = (w1 >> 7) & 0x3f;
+        if (w1 & (1 << 6))
+            flags |= AICA_DSP_STEP_IWT;
+        step->iwa = (w1 >> 1) & 0x1f;
+
+        if (w2 & (1 << 15))
+            flags |= AICA_DSP_STEP_TABLE;
+        if (w2 & (1 << 14))
+            flags |= AICA_DSP_STEP_MWT;
+        if (w2 & (1 << 13))
+            flags |= AICA_DSP_STEP_MRD;
+        if (w2 & (1 << 12))
+            flags |= AICA_DSP_STEP_EWT;
+        step->ewa = (w2 >> 8) & 0xf;
+        if (w2 & (1 << 7))
+            flags |= AICA_DSP_STEP_ADRL;
+        if (w2 & (1 << 6))
+            flags |= AICA_DSP_STEP_FRCL;
+        step->shift = (w2 >> 4) & 3;
+        if (w2 & (1 << 3))
+            flags |= AICA_DSP_STEP_YRL;
+        if (w2 & (1 << 2))
+            flags |= AICA_DSP_STEP_NEGB;
+        if (w2 & (1 << 1))
+            flags |= AICA_DSP_STEP_ZERO;
+        if (w2 & (1 << 0))
+            flags |= AICA_DSP_STEP_BSEL;
+
+        if (w3 & (1 << 15))
+            flags |= AICA_DSP_STEP_NOFL;
+        unsigned masa = (w3 >> 9) & 0x1f;
+        if (w3 & (1 << 8))
+            flags |= AICA_DSP_STEP_ADREB;
+        if (w3 & (1 << 7))
+            flags |= AICA_DSP_STEP_NXADR;
+
+        step->flags = flags;
+
+        // every step has its own coefficient
+        step->coef = sign_extend13(
+            (sys_reg[AICA_DSP_COEF_FIRST / 4 + step_no] & 0xffff) >> 3);
+        step->madrs = sys_reg[AICA_DSP_MADRS_FIRST / 4 + masa] & 0xffff;
+    }
+
+    dsp->n_steps = n_steps;
+}
+
+void aica_dsp_exec(struct aica_dsp *dsp, struct aica_wave_mem *mem,
+                   uint32_t rb_addr, uint32_t rb_len_words) {
+    struct aica_dsp_step const *step = dsp->prog;
+    struct aica_dsp_step const *end = step + dsp->n_steps;
+    int32_t acc = dsp->acc;
+    int32_t memval = dsp->memval;
+    int32_t frc_reg = dsp->frc_reg;
+    int32_t y_reg = dsp->y_reg;
+    uint32_t adrs_reg = dsp->adrs_reg;
+    uint32_t dec = dsp->dec;
+
+    memset(dsp->efreg, 0, sizeof(dsp->efreg));
+
+    for (; step < end; step++) {
+        uint32_t flags = step->flags;
+        int32_t inputs, b, x, y, shifted;
+
+        if (step->ira <= 0x1f)
+            inputs = dsp->mems[step->ira];
+        else if (step->ira <= 0x2f)
+            inputs = dsp->mixs[step->ira - 0x20] << 4;
+        else if (step->ira <= 0x31)
+            inputs = dsp->exts[step->ira - 0x30] << 8;
+        else
+            inputs = 0;
+        inputs = sign_extend24(inputs);
+
+        if (flags & AICA_DSP_STEP_IWT) {
+            dsp->mems[step->iwa] = memval;
+            if (step->ira == step->iwa)
+                inputs = memval;
+        }
+
+        int32_t temp_in = sign_extend24(dsp->temp[(step->tra + dec) & 0x7f]);
+
+        if (flags & AICA_DSP_STEP_ZERO) {
+            b = 0;
+        } else {
+            b = (flags & AICA_DSP_STEP_BSEL) ? acc : temp_in;
+            if (flags & AICA_DSP_STEP_NEGB)
+                b = -b;
+        }
+
+        x = (flags & AICA_DSP_STEP_XSEL) ? inputs : temp_in;
+
+        switch (step->ysel) {
+        case 0:
+            y = sign_extend13(frc_reg);
+            break;
+        case 1:
+            y = step->coef;
+            break;
+        case 2:
+            y = sign_extend13((y_reg >> 11) & 0x1fff);
+            break;
+        default:
+            y = sign_extend13((y_reg >> 4) & 0x0fff);
+        }
+
+        if (flags & AICA_DSP_STEP_YRL)
+            y_reg = inputs;
+
+        switch (step->shift) {
+        case 0:
+            shifted = clamp24(acc);
+            break;
+        case 1:
+            shifted = clamp24(acc * 2);
+            break;
+        case 2:
+            shifted = sign_extend24(acc * 2);
+            break;
+        default:
+            shifted = sign_extend24(acc);
+        }
+
+        acc = (int32_t)(((int64_t)x * (int64_t)y) >> 12) + b;
+
+        if (flags & AICA_DSP_STEP_TWT)
+            dsp->temp[(step->twa + dec) & 0x7f] = shifted;
+
+        if (flags & AICA_DSP_STEP_FRCL) {
+            if (step->shift == 3)
+                frc_reg = shifted & 0x0fff;
+            else
+                frc_reg = (shifted >> 11) & 0x1fff;
+        }
+
+        if (flags & (AICA_DSP_STEP_MRD | AICA_DSP_STEP_MWT)) {
+            uint32_t addr = step->madrs;
+            if (!(flags & AICA_DSP_STEP_TABLE))
+                addr += dec;
+            if (flags & AICA_DSP_STEP_ADREB)
+                addr += adrs_reg & 0x0fff;
+            if (flags & AICA_DSP_STEP_NXADR)
+                addr++;
+            if (flags & AICA_DSP_STEP_TABLE)
+                addr &= 0xffff;
+            else
+                addr &= rb_len_words - 1;
+
+            uint32_t byte_addr = (rb_addr + addr * 2) & AICA_WAVE_MEM_MASK;
+            uint16_t word;
+
+            if (flags & AICA_DSP_STEP_MRD) {
+                memcpy(&word, mem->mem + byte_addr, sizeof(word));
+                if (flags & AICA_DSP_STEP_NOFL)
+                    memval = sign_extend24((int32_t)word << 8);
+                else
+                    memval = unpack_float(word);
+            }
+            if (flags & AICA_DSP_STEP_MWT) {
+                if (flags & AICA_DSP_STEP_NOFL)
+                    word = shifted >> 8;
+                else
+                    word = pack_float(shifted);
+                aica_wave_mem_note_write(mem, byte_addr, sizeof(word));
+                memcpy(mem->mem + byte_addr, &word, sizeof(word));
+            }
+        }
+
+        if (flags & AICA_DSP_STEP_ADRL) {
+            if (step->shift == 3)
+                adrs_reg = (shifted >> 12) & 0xfff;
+            else
+                adrs_reg = inputs >> 16;
+        }
+
+        if (flags & AICA_DSP_STEP_EWT)
+            dsp->efreg[step->ewa] =
+                (int16_t)(dsp->efreg[step->ewa] + (shifted >> 8));
+    }
+
+    dsp->acc = acc;
+    dsp->memval = memval;
+    dsp->frc_reg = frc_reg;
+    dsp->y_reg = y_reg;
+    dsp->adrs_reg = adrs_reg;
+    dsp->dec = dec - 1;
+
+    memset(dsp->mixs, 0, sizeof(dsp->mixs));
+}
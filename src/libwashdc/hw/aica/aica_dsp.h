@@ -0,0 +1,119 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+/*
+ * AICA effects DSP.
+ *
+ * The DSP runs a microprogram of up to 128 steps once per output sample.  Its
+ * inputs are the channels' effect sends (MIXS) and its outputs are the 16
+ * effect registers (EFREG), which go through their own level/pan settings
+ * before being mixed into the output.  It can also read and write a ring
+ * buffer in wave memory, which is how reverb and echo get their delay lines.
+ *
+ * Decoding every field of every step once per sample would be expensive, so
+ * whenever the program changes it gets compiled into a list of pre-decoded
+ * steps.  Trailing steps that don't do anything are dropped, and the
+ * coefficients and memory addresses each step uses are resolved ahead of
+ * time.
+ */
+
+#ifndef AICA_DSP_H_
+#define AICA_DSP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "aica_wave_mem.h"
+
+#define AICA_DSP_N_STEPS 128
+#define AICA_DSP_N_TEMP 128
+#define AICA_DSP_N_MEMS 32
+#define AICA_DSP_N_MIXS 16
+#define AICA_DSP_N_EFREG 16
+#define AICA_DSP_N_EXTS 2
+
+// register areas in the AICA's address space
+#define AICA_DSP_COEF_FIRST 0x3000
+#define AICA_DSP_MADRS_FIRST 0x3200
+#define AICA_DSP_MPRO_FIRST 0x3400
+#define AICA_DSP_MPRO_LAST 0x3bff
+
+struct aica_dsp_step {
+    // AICA_DSP_STEP_* flags
+    uint32_t flags;
+
+    uint8_t tra, twa, ira, iwa, ewa, ysel, shift;
+
+    // sign-extended 13-bit coefficient
+    int32_t coef;
+
+    // MADRS value for memory reads/writes
+    uint32_t madrs;
+};
+
+struct aica_dsp {
+    struct aica_dsp_step prog[AICA_DSP_N_STEPS];
+    unsigned n_steps;
+
+    // if true, the program needs to be recompiled before it's run again
+    bool dirty;
+
+    int32_t temp[AICA_DSP_N_TEMP];
+    int32_t mems[AICA_DSP_N_MEMS];
+    int32_t mixs[AICA_DSP_N_MIXS];
+    int32_t efreg[AICA_DSP_N_EFREG];
+    int32_t exts[AICA_DSP_N_EXTS];
+
+    int32_t acc, memval, frc_reg, y_reg;
+    uint32_t adrs_reg;
+
+    // decrements once per sample; offsets TEMP and ring buffer addresses
+    uint32_t dec;
+};
+
+void aica_dsp_init(struct aica_dsp *dsp);
+
+// called whenever COEF, MADRS or MPRO get written to
+void aica_dsp_invalidate(struct aica_dsp *dsp);
+
+/*
+ * recompile the program if it's been invalidated.  sys_reg is the AICA's
+ * register backing, where the program and its coefficients live.
+ */
+void aica_dsp_compile(struct aica_dsp *dsp, uint32_t const *sys_reg);
+
+// returns true if the compiled program does anything
+static inline bool aica_dsp_active(struct aica_dsp const *dsp) {
+    return dsp->n_steps != 0;
+}
+
+/*
+ * run the program for one sample.  dsp->mixs holds this sample's effect sends
+ * going in and gets cleared.  The results are left in dsp->efreg.
+ *
+ * rb_addr is the byte address of the ring buffer in wave memory and
+ * rb_len_words is its length in 16-bit words.
+ */
+void aica_dsp_exec(struct aica_dsp *dsp, struct aica_wave_mem *mem,
+                   uint32_t rb_addr, uint32_t rb_len_words);
+
+#endif
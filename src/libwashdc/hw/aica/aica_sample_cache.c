@@ -0,0 +1,238 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "washdc/error.h"
+#include "intmath.h"
+#include "log.h"
+#include "adpcm.h"
+#include "aica.h"
+
+#include "aica_sample_cache.h"
+
+static void aica_sample_cache_on_write(void *arg, unsigned page_no);
+static void aica_sample_cache_drop(struct aica_sample_cache *cache,
+                                   struct aica_sample_cache_ent *ent);
+static int aica_sample_cache_alloc(struct aica_sample_cache *cache,
+                                   size_t n_bytes);
+static void decode_adpcm(int32_t *samples, int32_t *steps,
+                         uint8_t const *mem, uint32_t addr_start,
+                         unsigned pos_first, unsigned pos_last);
+
+void aica_sample_cache_init(struct aica_sample_cache *cache,
+                            struct aica_wave_mem *mem) {
+    memset(cache, 0, sizeof(*cache));
+    cache->mem = mem;
+
+    memset(mem->watched, 0, sizeof(mem->watched));
+    mem->on_watched_write = aica_sample_cache_on_write;
+    mem->on_watched_write_arg = cache;
+}
+
+void aica_sample_cache_cleanup(struct aica_sample_cache *cache) {
+    unsigned ent_no;
+    for (ent_no = 0; ent_no < AICA_SAMPLE_CACHE_N_ENT; ent_no++)
+        if (cache->ents[ent_no].valid)
+            aica_sample_cache_drop(cache, cache->ents + ent_no);
+
+    cache->mem->on_watched_write = NULL;
+    cache->mem->on_watched_write_arg = NULL;
+}
+
+int aica_sample_cache_get(struct aica_sample_cache *cache,
+                          enum aica_sample_cache_fmt fmt, uint32_t addr_start,
+                          uint32_t loop_start, uint32_t loop_end,
+                          bool loop_en) {
+    unsigned ent_no;
+    for (ent_no = 0; ent_no < AICA_SAMPLE_CACHE_N_ENT; ent_no++) {
+        struct aica_sample_cache_ent *ent = cache->ents + ent_no;
+        if (ent->valid && ent->fmt == fmt && ent->addr_start == addr_start &&
+            ent->loop_start == loop_start && ent->loop_end == loop_end &&
+            ent->loop_en == loop_en) {
+            ent->last_used = ++cache->stamp;
+            return ent_no;
+        }
+    }
+
+    /*
+     * a loop that starts after it ends never plays anything but the sample at
+     * loop_start, so there's no point in caching it.
+     */
+    if (loop_en && loop_start > loop_end)
+        return -1;
+
+    uint32_t addr_last;
+    unsigned n_samples;
+    if (fmt == AICA_SAMPLE_CACHE_FMT_ADPCM) {
+        addr_last = addr_start + loop_end / 2;
+        n_samples = loop_end + 1;
+        if (loop_en)
+            n_samples += loop_end - loop_start + 1;
+    } else {
+        addr_last = addr_start + loop_end;
+        n_samples = loop_end + 1;
+    }
+
+    // let the channel raise the out-of-bounds error when it gets there
+    if (addr_last >= AICA_WAVE_MEM_LEN)
+        return -1;
+
+    size_t n_bytes = n_samples * sizeof(int32_t);
+    if (fmt == AICA_SAMPLE_CACHE_FMT_ADPCM)
+        n_bytes *= 2;
+
+    int slot = aica_sample_cache_alloc(cache, n_bytes);
+    if (slot < 0)
+        return -1;
+    struct aica_sample_cache_ent *ent = cache->ents + slot;
+
+    int32_t *samples = (int32_t*)malloc(n_samples * sizeof(int32_t));
+    int32_t *steps = NULL;
+    if (fmt == AICA_SAMPLE_CACHE_FMT_ADPCM)
+        steps = (int32_t*)malloc(n_samples * sizeof(int32_t));
+    if (!samples || (fmt == AICA_SAMPLE_CACHE_FMT_ADPCM && !steps))
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+
+    uint8_t const *mem = cache->mem->mem;
+    if (fmt == AICA_SAMPLE_CACHE_FMT_ADPCM) {
+        decode_adpcm(samples, steps, mem, addr_start, 0, loop_end);
+        if (loop_en) {
+            decode_adpcm(samples + loop_end + 1, steps + loop_end + 1,
+                         mem, addr_start, loop_start, loop_end);
+        }
+    } else {
+        unsigned idx;
+        for (idx = 0; idx < n_samples; idx++)
+            samples[idx] = sat_shift((int32_t)(int8_t)mem[addr_start + idx], 8);
+    }
+
+    ent->valid = true;
+    ent->gen++;
+    ent->fmt = fmt;
+    ent->addr_start = addr_start;
+    ent->loop_start = loop_start;
+    ent->loop_end = loop_end;
+    ent->loop_en = loop_en;
+    ent->page_first = addr_start >> AICA_WAVE_MEM_PAGE_SHIFT;
+    ent->page_last = addr_last >> AICA_WAVE_MEM_PAGE_SHIFT;
+    ent->samples = samples;
+    ent->steps = steps;
+    ent->n_samples = n_samples;
+    ent->last_used = ++cache->stamp;
+    cache->n_bytes += n_bytes;
+
+    unsigned page_no;
+    for (page_no = ent->page_first; page_no <= ent->page_last; page_no++)
+        cache->mem->watched[page_no]++;
+
+    return slot;
+}
+
+/*
+ * decode positions pos_first through pos_last, starting from a freshly-reset
+ * decoder the same way a channel does on key-on and when it loops.
+ */
+static void decode_adpcm(int32_t *samples, int32_t *steps,
+                         uint8_t const *mem, uint32_t addr_start,
+                         unsigned pos_first, unsigned pos_last) {
+    struct aica_chan dec = { .predictor = 0, .step = 0 };
+    unsigned pos;
+    for (pos = pos_first; pos <= pos_last; pos++) {
+        uint8_t nibble = mem[addr_start + pos / 2];
+        if (pos & 1)
+            nibble = (nibble >> 4) & 0xf;
+        else
+            nibble &= 0xf;
+
+        *samples++ = adpcm_yamaha_expand_nibble(&dec, nibble);
+        *steps++ = dec.step;
+    }
+}
+
+/*
+ * find a free entry with room for n_bytes more of decoded data, evicting the
+ * least-recently-used entries until there is one.
+ */
+static int aica_sample_cache_alloc(struct aica_sample_cache *cache,
+                                   size_t n_bytes) {
+    if (n_bytes > AICA_SAMPLE_CACHE_MAX_BYTES)
+        return -1;
+
+    for (;;) {
+        int free_slot = -1, lru_slot = -1;
+        unsigned ent_no;
+        for (ent_no = 0; ent_no < AICA_SAMPLE_CACHE_N_ENT; ent_no++) {
+            struct aica_sample_cache_ent *ent = cache->ents + ent_no;
+            if (!ent->valid) {
+                if (free_slot < 0)
+                    free_slot = ent_no;
+            } else if (lru_slot < 0 ||
+                       ent->last_used < cache->ents[lru_slot].last_used) {
+                lru_slot = ent_no;
+            }
+        }
+
+        if (free_slot >= 0 &&
+            cache->n_bytes + n_bytes <= AICA_SAMPLE_CACHE_MAX_BYTES)
+            return free_slot;
+
+        if (lru_slot < 0)
+            return -1; // can't happen
+        aica_sample_cache_drop(cache, cache->ents + lru_slot);
+    }
+}
+
+static void aica_sample_cache_drop(struct aica_sample_cache *cache,
+                                   struct aica_sample_cache_ent *ent) {
+    unsigned page_no;
+    for (page_no = ent->page_first; page_no <= ent->page_last; page_no++)
+        cache->mem->watched[page_no]--;
+
+    size_t n_bytes = ent->n_samples * sizeof(int32_t);
+    if (ent->steps)
+        n_bytes *= 2;
+    cache->n_bytes -= n_bytes;
+
+    free(ent->samples);
+    free(ent->steps);
+    ent->samples = NULL;
+    ent->steps = NULL;
+    ent->valid = false;
+    ent->gen++;
+}
+
+static void aica_sample_cache_on_write(void *arg, unsigned page_no) {
+    struct aica_sample_cache *cache = (struct aica_sample_cache*)arg;
+
+    unsigned ent_no;
+    for (ent_no = 0; ent_no < AICA_SAMPLE_CACHE_N_ENT; ent_no++) {
+        struct aica_sample_cache_ent *ent = cache->ents + ent_no;
+        if (ent->valid && page_no >= ent->page_first &&
+            page_no <= ent->page_last) {
+            LOG_DBG("AICA: write to page %u invalidates cached sample at "
+                    "0x%08x\n", page_no, (unsigned)ent->addr_start);
+            aica_sample_cache_drop(cache, ent);
+        }
+    }
+}
@@ -0,0 +1,137 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+/*
+ * Cache of decoded AICA samples.
+ *
+ * 4-bit ADPCM has to be decoded one nibble at a time, and every nibble
+ * depends on the decoder state left behind by the one before it.  Most sounds
+ * are keyed on many times and loop many times, so instead of decoding the same
+ * data over and over the channel gets decoded once on key-on and then played
+ * back from this cache.  8-bit samples are cached too so that every cached
+ * channel reads the same 32-bit samples.
+ *
+ * Entries are keyed by everything that affects the decoded output: the start
+ * address, the format and the loop points.  Each ADPCM entry has two passes:
+ * the first pass covers positions 0 through loop_end, and the loop pass covers
+ * loop_start through loop_end.  These are different because the decoder gets
+ * reset whenever the channel loops.  Along with each decoded sample, ADPCM
+ * entries keep the decoder's step so that the channel's own decoder state can
+ * be kept in sync.  That way a channel can fall back to decoding wave memory
+ * directly at any point without changing what it outputs.
+ *
+ * Every page of wave memory which an entry covers gets watched (see
+ * aica_wave_mem.h), and writing to a watched page invalidates every entry
+ * that covers that page.  Entries also have a generation counter which changes
+ * whenever the entry gets invalidated or reused, so that channels holding onto
+ * an entry know to stop using it.
+ */
+
+#ifndef AICA_SAMPLE_CACHE_H_
+#define AICA_SAMPLE_CACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "aica_wave_mem.h"
+
+#define AICA_SAMPLE_CACHE_N_ENT 64
+
+// upper limit on the amount of decoded data the cache can hold at once
+#define AICA_SAMPLE_CACHE_MAX_BYTES (16 * 1024 * 1024)
+
+enum aica_sample_cache_fmt {
+    AICA_SAMPLE_CACHE_FMT_8_BIT,
+    AICA_SAMPLE_CACHE_FMT_ADPCM
+};
+
+struct aica_sample_cache_ent {
+    bool valid;
+    uint32_t gen;
+
+    // key
+    enum aica_sample_cache_fmt fmt;
+    uint32_t addr_start, loop_start, loop_end;
+    bool loop_en;
+
+    // pages of wave memory this entry is watching
+    unsigned page_first, page_last;
+
+    /*
+     * decoded samples.  For ADPCM, samples[0] through samples[loop_end] is the
+     * first pass and everything after that is the loop pass.  8-bit samples
+     * are the same every time through, so those don't have a loop pass.
+     */
+    int32_t *samples;
+
+    // decoder step after each sample (ADPCM only)
+    int32_t *steps;
+
+    unsigned n_samples;
+
+    uint64_t last_used;
+};
+
+struct aica_sample_cache {
+    struct aica_wave_mem *mem;
+
+    struct aica_sample_cache_ent ents[AICA_SAMPLE_CACHE_N_ENT];
+
+    size_t n_bytes;
+    uint64_t stamp;
+};
+
+void aica_sample_cache_init(struct aica_sample_cache *cache,
+                            struct aica_wave_mem *mem);
+void aica_sample_cache_cleanup(struct aica_sample_cache *cache);
+
+/*
+ * return the index of the entry for the given sample, decoding it into the
+ * cache if it isn't already there.  This returns -1 if the sample can't be
+ * cached.
+ */
+int aica_sample_cache_get(struct aica_sample_cache *cache,
+                          enum aica_sample_cache_fmt fmt, uint32_t addr_start,
+                          uint32_t loop_start, uint32_t loop_end,
+                          bool loop_en);
+
+/*
+ * return the given entry if it still holds the given sample, else NULL.  gen
+ * is the generation the entry had when the caller got it from
+ * aica_sample_cache_get.
+ */
+static inline struct aica_sample_cache_ent const*
+aica_sample_cache_check(struct aica_sample_cache const *cache, int ent_no,
+                        uint32_t gen, enum aica_sample_cache_fmt fmt,
+                        uint32_t addr_start, uint32_t loop_start,
+                        uint32_t loop_end, bool loop_en) {
+    if (ent_no < 0)
+        return NULL;
+    struct aica_sample_cache_ent const *ent = cache->ents + ent_no;
+    if (ent->valid && ent->gen == gen && ent->fmt == fmt &&
+        ent->addr_start == addr_start && ent->loop_start == loop_start &&
+        ent->loop_end == loop_end && ent->loop_en == loop_en)
+        return ent;
+    return NULL;
+}
+
+#endif
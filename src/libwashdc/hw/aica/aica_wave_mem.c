@@ -116,6 +116,7 @@ void aica_wave_mem_write_8(addr32_t addr, uint8_t val, void *ctxt) {
         RAISE_ERROR(ERROR_UNIMPLEMENTED);
     }
 
+    aica_wave_mem_note_write(wm, addr, sizeof(val));
     *outp = val;
 }
 
@@ -163,6 +164,7 @@ void aica_wave_mem_write_16(addr32_t addr, uint16_t val, void *ctxt) {
         RAISE_ERROR(ERROR_UNIMPLEMENTED);
     }
 
+    aica_wave_mem_note_write(wm, addr, sizeof(val));
     memcpy(wm->mem + addr, &val, sizeof(val));
 }
 
@@ -185,6 +187,7 @@ void aica_wave_mem_write_32(addr32_t addr, uint32_t val, void *ctxt) {
         RAISE_ERROR(ERROR_UNIMPLEMENTED);
     }
 
+    aica_wave_mem_note_write(wm, addr, sizeof(val));
     memcpy(wm->mem + addr, &val, sizeof(val));
 }
 
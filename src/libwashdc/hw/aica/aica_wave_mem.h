@@ -32,6 +32,7 @@
 #include "washdc/types.h"
 #include "washdc/MemoryMap.h"
 #include "dreamcast.h"
+#include "log.h"
 
 #define AICA_WAVE_MEM_LEN (0x009fffff - 0x00800000 + 1)
 
@@ -40,10 +41,35 @@ static_assert(!(AICA_WAVE_MEM_LEN & (AICA_WAVE_MEM_LEN - 1)),
 
 #define AICA_WAVE_MEM_MASK (AICA_WAVE_MEM_LEN - 1)
 
+#define AICA_WAVE_MEM_PAGE_SHIFT 12
+#define AICA_WAVE_MEM_N_PAGES (AICA_WAVE_MEM_LEN >> AICA_WAVE_MEM_PAGE_SHIFT)
+
 struct aica_wave_mem {
     uint8_t mem[AICA_WAVE_MEM_LEN];
+
+    /*
+     * number of decoded copies (see aica_sample_cache.h) that each page of
+     * wave memory has.  Writing to a page where this is nonzero calls
+     * on_watched_write so those copies can be thrown out.
+     */
+    uint8_t watched[AICA_WAVE_MEM_N_PAGES];
+    void (*on_watched_write)(void *arg, unsigned page_no);
+    void *on_watched_write_arg;
 };
 
+// this needs to be called for every write to wave memory
+static inline void
+aica_wave_mem_note_write(struct aica_wave_mem *wm, addr32_t addr, unsigned len) {
+    unsigned page_first = (addr & AICA_WAVE_MEM_MASK) >> AICA_WAVE_MEM_PAGE_SHIFT;
+    unsigned page_last =
+        ((addr + len - 1) & AICA_WAVE_MEM_MASK) >> AICA_WAVE_MEM_PAGE_SHIFT;
+
+    if (wm->watched[page_first])
+        wm->on_watched_write(wm->on_watched_write_arg, page_first);
+    if (page_last != page_first && wm->watched[page_last])
+        wm->on_watched_write(wm->on_watched_write_arg, page_last);
+}
+
 float aica_wave_mem_read_float(addr32_t addr, void *ctxt);
 void aica_wave_mem_write_float(addr32_t addr, float val, void *ctxt);
 double aica_wave_mem_read_double(addr32_t addr, void *ctxt);
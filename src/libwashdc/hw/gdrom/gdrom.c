@@ -28,12 +28,14 @@
 #include "dreamcast.h"
 #include "hw/sh4/sh4.h"
 #include "mount.h"
+#include "memory.h"
 #include "hw/sys/holly_intc.h"
 #include "washdc/error.h"
 #include "gdrom_response.h"
 #include "dc_sched.h"
 #include "hw/g1/g1_reg.h"
 
+#include "gdrom_timing.h"
 #include "gdrom.h"
 
 static DEF_ERROR_INT_ATTR(gdrom_command)
@@ -69,10 +71,20 @@ static void gdrom_delayed_processing(struct gdrom_ctxt *gdrom);
 
 static void post_delay_gdrom_delayed_processing(struct SchedEvent *event);
 
-// how long to wait before raising a gdrom interrupt event.
-// this value is arbitrary and completely made up.
-// TODO: come up with some latency measurements on real hardware.
-#define GDROM_INT_DELAY (SCHED_FREQUENCY / 1024)
+/*
+ * copy up to n_bytes of the data waiting to be sent to the host into dst.
+ * returns the number of bytes copied, which is less than n_bytes if the data
+ * ran out.
+ */
+static unsigned
+gdrom_data_read(struct gdrom_ctxt *gdrom, uint8_t *dst, unsigned n_bytes);
+
+/*
+ * charge the time it takes to read the next n_sectors sectors of the current
+ * READ packet to the next interrupt.
+ */
+static void gdrom_read_sectors_delay(struct gdrom_ctxt *gdrom,
+                                     unsigned n_sectors);
 
 /* static bool gdrom_int_scheduled; */
 /* struct SchedEvent gdrom_int_raise_event = { */
@@ -81,11 +93,47 @@ static void post_delay_gdrom_delayed_processing(struct SchedEvent *event);
 
 static void gdrom_delayed_processing(struct gdrom_ctxt *gdrom) {
     if (!gdrom->gdrom_int_scheduled) {
+        struct gdrom_timing_model const *timing = gdrom_timing_get();
         gdrom->gdrom_int_scheduled = true;
-        gdrom->gdrom_int_raise_event.when =
-            clock_cycle_stamp(gdrom->clk) + GDROM_INT_DELAY;
+        gdrom->gdrom_int_raise_event.when = clock_cycle_stamp(gdrom->clk) +
+            timing->cmd_delay() + gdrom->read_delay;
+        sched_event(gdrom->clk, &gdrom->gdrom_int_raise_event);
+    } else if (gdrom->read_delay) {
+        /*
+         * the drive is still busy with whatever the pending interrupt is for,
+         * so the time spent reading just pushes that interrupt back.
+         */
+        cancel_event(gdrom->clk, &gdrom->gdrom_int_raise_event);
+        gdrom->gdrom_int_raise_event.when += gdrom->read_delay;
         sched_event(gdrom->clk, &gdrom->gdrom_int_raise_event);
     }
+    gdrom->read_delay = 0;
+}
+
+// forget everything the timing model knows about the drive's state
+static void gdrom_timing_reset(struct gdrom_ctxt *gdrom) {
+    gdrom->head_fad = 0;
+    gdrom->timing_fad_next = 0;
+    gdrom->timing_n_sectors = 0;
+    gdrom->read_delay = 0;
+}
+
+static void gdrom_read_sectors_delay(struct gdrom_ctxt *gdrom,
+                                     unsigned n_sectors) {
+    struct gdrom_timing_model const *timing = gdrom_timing_get();
+
+    if (n_sectors > gdrom->timing_n_sectors)
+        n_sectors = gdrom->timing_n_sectors;
+    if (!n_sectors)
+        return;
+
+    unsigned fad = gdrom->timing_fad_next;
+    gdrom->read_delay += timing->seek_delay(gdrom->head_fad, fad) +
+        timing->read_delay(fad, n_sectors);
+
+    gdrom->timing_fad_next += n_sectors;
+    gdrom->timing_n_sectors -= n_sectors;
+    gdrom->head_fad = gdrom->timing_fad_next;
 }
 
 static void post_delay_gdrom_delayed_processing(struct SchedEvent *event) {
@@ -108,16 +156,19 @@ static void post_delay_gdrom_delayed_processing(struct SchedEvent *event) {
             gdrom->stat_reg.drq = false;
             gdrom->state = GDROM_STATE_NORM;
             gdrom->data_byte_count = 0;
-        } else if (gdrom->meta.read.byte_count > 0x8000) {
-            gdrom->data_byte_count = 0x8000;
-            gdrom->meta.read.byte_count -= 0x8000;
-            gdrom->stat_reg.drq = true;
-            gdrom->state = GDROM_STATE_PIO_READING;
         } else {
-            gdrom->data_byte_count = gdrom->meta.read.byte_count;
-            gdrom->meta.read.byte_count = 0;
+            if (gdrom->meta.read.byte_count > GDROM_PIO_BLOCK_MAX) {
+                gdrom->data_byte_count = GDROM_PIO_BLOCK_MAX;
+                gdrom->meta.read.byte_count -= GDROM_PIO_BLOCK_MAX;
+            } else {
+                gdrom->data_byte_count = gdrom->meta.read.byte_count;
+                gdrom->meta.read.byte_count = 0;
+            }
             gdrom->stat_reg.drq = true;
             gdrom->state = GDROM_STATE_PIO_READING;
+
+            gdrom->pio_buf_len = gdrom_data_read(gdrom, gdrom->pio_buf,
+                                                 gdrom->data_byte_count);
         }
 
         gdrom->stat_reg.bsy = false;
@@ -234,10 +285,19 @@ struct gdrom_bufq_node {
 static void bufq_clear(struct gdrom_ctxt *ctxt);
 
 /*
- * grab one byte from the queue, pop/clear a node (if necessary) and return 0.
- * this returns non-zero if the queue is empty.
+ * return a pointer to the next contiguous run of data waiting to be sent to
+ * the host and write its length to n_bytes, or return NULL if there's no more
+ * data.  Responses to most packets come from the bufq, and sectors from READ
+ * packets come from the sect_stream after that.
+ */
+static uint8_t const *
+gdrom_data_peek(struct gdrom_ctxt *gdrom, unsigned *n_bytes);
+
+/*
+ * mark the first n_bytes of the run returned by gdrom_data_peek as sent.
+ * n_bytes must not be more than the length of that run.
  */
-static int bufq_consume_byte(struct gdrom_ctxt *gdrom, unsigned *byte);
+static void gdrom_data_consume(struct gdrom_ctxt *gdrom, unsigned n_bytes);
 
 static void gdrom_clear_error(struct gdrom_ctxt *gdrom);
 
@@ -362,6 +422,9 @@ void gdrom_init(struct gdrom_ctxt *gdrom, struct dc_clock *gdrom_clk) {
     gdrom->gdrom_int_raise_event.handler = post_delay_gdrom_delayed_processing;
     gdrom->gdrom_int_raise_event.arg_ptr = gdrom;
 
+    gdrom_timing_init();
+    gdrom_timing_reset(gdrom);
+
     gdrom->clk = gdrom_clk;
     gdrom->gdapro_reg = GDROM_GDAPRO_DEFAULT;
     gdrom->g1gdrc_reg = GDROM_G1GDRC_DEFAULT;
@@ -432,26 +495,91 @@ static void bufq_clear(struct gdrom_ctxt *gdrom) {
         free(&FIFO_DEREF(fifo_pop(&gdrom->bufq),
                          struct gdrom_bufq_node, fifo_node));
     }
+
+    gdrom->sect_stream.n_sectors = 0;
+    gdrom->sect_stream.dat = NULL;
+    gdrom->sect_stream.idx = 0;
+    gdrom->sect_stream.len = 0;
+
+    /*
+     * drop any time charged for sectors that will now never be transferred.
+     * head_fad is left alone since flushing the buffer doesn't move the
+     * head; only a drive reset (gdrom_timing_reset) does that.
+     */
+    gdrom->timing_n_sectors = 0;
+    gdrom->read_delay = 0;
+}
+
+static unsigned
+gdrom_data_read(struct gdrom_ctxt *gdrom, uint8_t *dst, unsigned n_bytes) {
+    unsigned n_copied = 0;
+
+    while (n_copied < n_bytes) {
+        unsigned run_len;
+        uint8_t const *dat = gdrom_data_peek(gdrom, &run_len);
+        if (!dat)
+            break;
+
+        if (run_len > n_bytes - n_copied)
+            run_len = n_bytes - n_copied;
+        memcpy(dst + n_copied, dat, run_len);
+        gdrom_data_consume(gdrom, run_len);
+        n_copied += run_len;
+    }
+
+    return n_copied;
 }
 
-static int bufq_consume_byte(struct gdrom_ctxt *gdrom, unsigned *byte) {
+static uint8_t const *
+gdrom_data_peek(struct gdrom_ctxt *gdrom, unsigned *n_bytes) {
     struct fifo_node *node = fifo_peek(&gdrom->bufq);
 
     if (node) {
         struct gdrom_bufq_node *bufq_node =
             &FIFO_DEREF(node, struct gdrom_bufq_node, fifo_node);
+        *n_bytes = bufq_node->len - bufq_node->idx;
+        return bufq_node->dat + bufq_node->idx;
+    }
+
+    struct gdrom_sect_stream *stream = &gdrom->sect_stream;
+    if (stream->idx >= stream->len) {
+        if (!stream->n_sectors)
+            return NULL;
+
+        stream->dat = mount_get_sector(stream->buf, stream->fad_next);
+        if (!stream->dat) {
+            LOG_ERROR("GD-ROM failed to read fad %u\n", stream->fad_next);
+            stream->n_sectors = 0;
+            stream->idx = 0;
+            stream->len = 0;
+            return NULL;
+        }
 
-        *byte = (unsigned)bufq_node->dat[bufq_node->idx++];
+        stream->fad_next++;
+        stream->n_sectors--;
+        stream->idx = 0;
+        stream->len = CDROM_FRAME_DATA_SIZE;
+    }
+
+    *n_bytes = stream->len - stream->idx;
+    return stream->dat + stream->idx;
+}
+
+static void gdrom_data_consume(struct gdrom_ctxt *gdrom, unsigned n_bytes) {
+    struct fifo_node *node = fifo_peek(&gdrom->bufq);
+
+    if (node) {
+        struct gdrom_bufq_node *bufq_node =
+            &FIFO_DEREF(node, struct gdrom_bufq_node, fifo_node);
 
+        bufq_node->idx += n_bytes;
         if (bufq_node->idx >= bufq_node->len) {
             fifo_pop(&gdrom->bufq);
             free(bufq_node);
         }
-
-        return 0;
+    } else {
+        gdrom->sect_stream.idx += n_bytes;
     }
-
-    return -1;
 }
 
 static void gdrom_clear_error(struct gdrom_ctxt *gdrom) {
@@ -462,51 +590,68 @@ static void gdrom_complete_dma(struct gdrom_ctxt *gdrom) {
     unsigned bytes_transmitted = 0;
     unsigned bytes_to_transmit = gdrom->dma_len_reg;
     unsigned addr = gdrom->dma_start_addr_reg;
+    Sh4 *sh4 = dreamcast_get_cpu();
 
-    while (bytes_transmitted < bytes_to_transmit) {
-        struct fifo_node *fifo_node = fifo_pop(&gdrom->bufq);
+    /*
+     * enforce the gdapro register by only writing the part of the destination
+     * that falls between gdrom_dma_prot_top and gdrom_dma_prot_bot.
+     * bytes_transmitted will still count the data that doesn't get written
+     * because that seems like the logical behavior here.  I have not run any
+     * hardware tests to confirm that this is correct.
+     */
+    uint32_t win_first = gdrom_dma_prot_top(gdrom);
+    uint32_t win_last = gdrom_dma_prot_bot(gdrom);
+    if (bytes_to_transmit) {
+        if (addr > win_first)
+            win_first = addr;
+        if (addr + (bytes_to_transmit - 1) < win_last)
+            win_last = addr + (bytes_to_transmit - 1);
+    }
+    bool win_valid = bytes_to_transmit && win_first <= win_last;
 
-        if (!fifo_node)
-            goto done;
+    /*
+     * This will almost always be going into system RAM, in which case the
+     * destination only needs to be looked up once and then every run of data
+     * can be copied straight into it.
+     */
+    uint8_t *dst = NULL;
+    if (win_valid)
+        dst = (uint8_t*)memory_dma_ptr(sh4->mem.map, win_first & ~0xe0000000,
+                                       win_last - win_first + 1);
 
-        struct gdrom_bufq_node *bufq_node =
-            &FIFO_DEREF(fifo_node, struct gdrom_bufq_node, fifo_node);
+    while (bytes_transmitted < bytes_to_transmit) {
+        unsigned run_len;
+        uint8_t const *dat = gdrom_data_peek(gdrom, &run_len);
+
+        if (!dat)
+            break;
 
-        unsigned chunk_sz = bufq_node->len;
+        unsigned chunk_sz = run_len;
 
         if ((chunk_sz + bytes_transmitted) > bytes_to_transmit)
             chunk_sz = bytes_to_transmit - bytes_transmitted;
 
-        bytes_transmitted += chunk_sz;
-
-        /*
-         * enforce the gdapro register
-         * bytes_transmitted will still count the full length of chunk_sz
-         * because that seems like the logical behavior here.  I have not run
-         * any hardware tests to confirm that this is correct.
-         */
-        if (addr < gdrom_dma_prot_top(gdrom)) {
-            // don't do this chunk if the end is below gdrom_dma_prot_top
-            if ((chunk_sz + addr) < gdrom_dma_prot_top(gdrom))
-                goto chunk_finished;
-
-            chunk_sz -= (gdrom_dma_prot_top(gdrom) - addr);
-            addr = gdrom_dma_prot_top(gdrom);
-        }
-
-        if ((addr + chunk_sz - 1) > gdrom_dma_prot_bot(gdrom)) {
-            chunk_sz = gdrom_dma_prot_bot(gdrom) - addr + 1;
+        uint32_t first = addr, last = addr + (chunk_sz - 1);
+        if (first < win_first)
+            first = win_first;
+        if (last > win_last)
+            last = win_last;
+
+        if (win_valid && first <= last) {
+            uint8_t const *src = dat + (first - addr);
+            if (dst)
+                memcpy(dst + (first - win_first), src, last - first + 1);
+            else
+                sh4_dmac_transfer_to_mem(sh4, first, last - first + 1, 1, src);
         }
 
-        sh4_dmac_transfer_to_mem(dreamcast_get_cpu(), addr, chunk_sz,
-                                 1, bufq_node->dat);
-
-    chunk_finished:
         addr += chunk_sz;
-        free(bufq_node);
+        bytes_transmitted += chunk_sz;
+
+        // whatever's left of a partially-transferred run gets dropped
+        gdrom_data_consume(gdrom, run_len);
     }
 
-done:
     // set GD_LEND, etc here
     gdrom->gdlend_reg = bytes_transmitted;
     gdrom->dma_start_reg = 0;
@@ -562,35 +707,32 @@ static void gdrom_input_read_packet(struct gdrom_ctxt *gdrom) {
     if (!gdrom->feat_reg.dma_enable && gdrom->data_byte_count > UINT16_MAX)
         LOG_WARN("OVERFLOW: Reading %u bytes from gdrom PIO!\n", gdrom->data_byte_count);
 
-    unsigned fad_offs = 0;
-    while (trans_len--) {
-        struct gdrom_bufq_node *node =
-            (struct gdrom_bufq_node*)malloc(sizeof(struct gdrom_bufq_node));
-
-        if (!node)
-            RAISE_ERROR(ERROR_FAILED_ALLOC);
-
-        if (mount_read_sectors(node->dat, start_addr + fad_offs++, 1) < 0) {
-            LOG_ERROR("GD-ROM failed to read fad %u\n", fad_offs);
-
-            free(node);
+    if (mount_check_sectors(start_addr, trans_len) != 0) {
+        LOG_ERROR("GD-ROM failed to read %u sectors from fad %u\n",
+                  trans_len, start_addr);
 
-            gdrom->error_reg.sense_key = SENSE_KEY_ILLEGAL_REQ;
-            gdrom->stat_reg.check = true;
-            gdrom->state = GDROM_STATE_NORM;
-            return;
-        }
+        gdrom->error_reg.sense_key = SENSE_KEY_ILLEGAL_REQ;
+        gdrom->stat_reg.check = true;
+        gdrom->state = GDROM_STATE_NORM;
+        return;
+    }
 
-        node->idx = 0;
-        node->len = CDROM_FRAME_DATA_SIZE;
+    /*
+     * the sectors get read from the mount as they're transferred, so give it
+     * a chance to get them ready in the meantime.
+     */
+    gdrom->sect_stream.fad_next = start_addr;
+    gdrom->sect_stream.n_sectors = trans_len;
+    mount_prefetch(start_addr, trans_len);
 
-        fifo_push(&gdrom->bufq, &node->fifo_node);
-    }
+    gdrom->timing_fad_next = start_addr;
+    gdrom->timing_n_sectors = trans_len;
 
     if (gdrom->feat_reg.dma_enable) {
         // wait for them to write 1 to GDST before doing something
         GDROM_TRACE("DMA READ ACCESS\n");
     } else {
+        gdrom_read_sectors_delay(gdrom, GDROM_PIO_BLOCK_SECTORS);
         gdrom_state_transfer_pio_read(gdrom, byte_count);
     }
 }
@@ -1053,8 +1195,6 @@ unsigned gdrom_dma_prot_bot(struct gdrom_ctxt *gdrom) {
 }
 
 void gdrom_read_data(struct gdrom_ctxt *gdrom, uint8_t *buf, unsigned n_bytes) {
-    uint8_t *ptr = buf;
-
     if (gdrom->state != GDROM_STATE_PIO_READING) {
         LOG_WARN("Game tried to read from GD-ROM data register before data "
                  "was ready\n");
@@ -1062,16 +1202,18 @@ void gdrom_read_data(struct gdrom_ctxt *gdrom, uint8_t *buf, unsigned n_bytes) {
         return;
     }
 
-    while (n_bytes--) {
-        unsigned dat;
-        if (bufq_consume_byte(gdrom, &dat) == 0 &&
-            gdrom->meta.read.bytes_read < gdrom->data_byte_count) {
-            *ptr++ = dat;
-        } else {
-            *ptr++ = 0;
-        }
-        gdrom->meta.read.bytes_read++;
-    }
+    // anything past the end of the data reads back as 0
+    unsigned bytes_read = gdrom->meta.read.bytes_read;
+    unsigned avail = gdrom->pio_buf_len < gdrom->data_byte_count ?
+        gdrom->pio_buf_len : gdrom->data_byte_count;
+    unsigned n_copy = bytes_read < avail ? avail - bytes_read : 0;
+    if (n_copy > n_bytes)
+        n_copy = n_bytes;
+
+    if (n_copy)
+        memcpy(buf, gdrom->pio_buf + bytes_read, n_copy);
+    memset(buf + n_copy, 0, n_bytes - n_copy);
+    gdrom->meta.read.bytes_read += n_bytes;
 
     if (gdrom->meta.read.bytes_read == gdrom->data_byte_count) {
         if (!gdrom->meta.read.byte_count) {
@@ -1089,6 +1231,7 @@ void gdrom_read_data(struct gdrom_ctxt *gdrom, uint8_t *buf, unsigned n_bytes) {
             gdrom->stat_reg.drq = false;
             gdrom->stat_reg.bsy = true;
             gdrom->state = GDROM_STATE_PIO_READ_DELAY;
+            gdrom_read_sectors_delay(gdrom, GDROM_PIO_BLOCK_SECTORS);
             gdrom_delayed_processing(gdrom);
         }
     } else if (gdrom->meta.read.bytes_read > gdrom->data_byte_count) {
@@ -1163,6 +1306,9 @@ void gdrom_start_dma(struct gdrom_ctxt *gdrom) {
     if (gdrom->dma_start_reg) {
         gdrom->stat_reg.drq = false;
         gdrom->stat_reg.bsy = true;
+        unsigned n_sectors = (gdrom->dma_len_reg + CDROM_FRAME_DATA_SIZE - 1) /
+            CDROM_FRAME_DATA_SIZE;
+        gdrom_read_sectors_delay(gdrom, n_sectors);
         gdrom_complete_dma(gdrom);
     }
 
@@ -29,6 +29,7 @@
 #include "washdc/fifo.h"
 #include "log.h"
 #include "dc_sched.h"
+#include "cdrom.h"
 
 #define GDROM_TRACE(msg, ...)                                           \
     do {                                                                \
@@ -122,6 +123,10 @@ enum additional_sense {
 #define GDROM_MMIO_LEN (ADDR_GDROM_LAST - ADDR_GDROM_FIRST + 1)
 #define GDROM_REG_COUNT (GDROM_MMIO_LEN / 4)
 
+// the most data a PIO transfer will make available before the next interrupt
+#define GDROM_PIO_BLOCK_MAX 0x8000
+#define GDROM_PIO_BLOCK_SECTORS (GDROM_PIO_BLOCK_MAX / CDROM_FRAME_DATA_SIZE)
+
 struct gdrom_read_meta {
     // number of bytes to transfer
     unsigned byte_count;
@@ -133,6 +138,22 @@ union state_meta {
     struct gdrom_read_meta read;
 };
 
+/*
+ * sectors that a READ packet still has to transfer.  These get pulled from the
+ * mount one at a time as the transfer needs them instead of being copied into
+ * the bufq up-front.
+ */
+struct gdrom_sect_stream {
+    unsigned fad_next, n_sectors;
+
+    // the current sector and how much of it has been transferred
+    uint8_t const *dat;
+    unsigned idx, len;
+
+    // space for mounts which can't hand out a pointer to their own copy
+    uint8_t buf[CDROM_FRAME_DATA_SIZE];
+};
+
 struct gdrom_ctxt {
     struct dc_clock *clk;
 
@@ -193,6 +214,27 @@ struct gdrom_ctxt {
     unsigned n_bytes_received;
 
     struct fifo_head bufq;
+    struct gdrom_sect_stream sect_stream;
+
+    /*
+     * the block of data the host is currently reading out of the data
+     * register during a PIO transfer.  This gets filled all at once when the
+     * block becomes available so that register reads can just be copied out
+     * of it.
+     */
+    uint8_t pio_buf[GDROM_PIO_BLOCK_MAX];
+    unsigned pio_buf_len;
+
+    /*
+     * where the drive's head is, and the sectors that the current READ
+     * packet still has to pull off the disc.  These are only used to work
+     * out how long the drive takes.
+     */
+    unsigned head_fad;
+    unsigned timing_fad_next, timing_n_sectors;
+
+    // extra time to wait before the next interrupt, on top of cmd_delay
+    dc_cycle_stamp_t read_delay;
 };
 
 /*
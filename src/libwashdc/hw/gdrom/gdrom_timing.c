@@ -0,0 +1,155 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "washdc/config_file.h"
+#include "log.h"
+
+#include "gdrom_timing.h"
+
+// the delay the GD-ROM has always used.  This is arbitrary.
+#define GDROM_FIXED_DELAY (SCHED_FREQUENCY / 1024)
+
+/*
+ * The drive reads at a constant linear velocity of 12x (1x being the 75
+ * sectors per second of an audio CD), so the transfer rate is the same
+ * everywhere on the disc.
+ */
+#define GDROM_CLV_SPEED 12
+#define GDROM_SECTORS_PER_SEC (75 * GDROM_CLV_SPEED)
+
+/*
+ * Seeks take a fixed amount of time to settle the head and get the spindle
+ * up to the right speed for the new radius, plus time proportional to how
+ * far the head has to move.  GDROM_FULL_STROKE_DELAY is the time to move from
+ * the start of the disc to GDROM_LAST_FAD.
+ */
+#define GDROM_SEEK_BASE_DELAY (SCHED_FREQUENCY / 25)
+#define GDROM_FULL_STROKE_DELAY (SCHED_FREQUENCY / 6)
+#define GDROM_LAST_FAD 549150
+
+/*
+ * an arbitrary short delay for turbo-load; it has not been measured against
+ * what real games will tolerate.
+ */
+#define GDROM_TURBO_DELAY (SCHED_FREQUENCY / 16384)
+
+static struct gdrom_timing_model const *cfg_model = &gdrom_timing_fixed;
+static atomic_bool turbo;
+
+static dc_cycle_stamp_t gdrom_fixed_cmd_delay(void) {
+    return GDROM_FIXED_DELAY;
+}
+
+static dc_cycle_stamp_t gdrom_no_seek_delay(unsigned fad_cur, unsigned fad_dst) {
+    return 0;
+}
+
+static dc_cycle_stamp_t gdrom_no_read_delay(unsigned fad, unsigned n_sectors) {
+    return 0;
+}
+
+static dc_cycle_stamp_t
+gdrom_accurate_seek_delay(unsigned fad_cur, unsigned fad_dst) {
+    if (fad_cur == fad_dst)
+        return 0;
+
+    dc_cycle_stamp_t dist = fad_cur < fad_dst ?
+        fad_dst - fad_cur : fad_cur - fad_dst;
+    if (dist > GDROM_LAST_FAD)
+        dist = GDROM_LAST_FAD;
+
+    return GDROM_SEEK_BASE_DELAY +
+        dist * GDROM_FULL_STROKE_DELAY / GDROM_LAST_FAD;
+}
+
+static dc_cycle_stamp_t
+gdrom_accurate_read_delay(unsigned fad, unsigned n_sectors) {
+    return (dc_cycle_stamp_t)n_sectors * SCHED_FREQUENCY /
+        GDROM_SECTORS_PER_SEC;
+}
+
+static dc_cycle_stamp_t gdrom_turbo_cmd_delay(void) {
+    return GDROM_TURBO_DELAY;
+}
+
+struct gdrom_timing_model const gdrom_timing_fixed = {
+    .name = "fixed",
+    .cmd_delay = gdrom_fixed_cmd_delay,
+    .seek_delay = gdrom_no_seek_delay,
+    .read_delay = gdrom_no_read_delay
+};
+
+struct gdrom_timing_model const gdrom_timing_accurate = {
+    .name = "accurate",
+    .cmd_delay = gdrom_fixed_cmd_delay,
+    .seek_delay = gdrom_accurate_seek_delay,
+    .read_delay = gdrom_accurate_read_delay
+};
+
+struct gdrom_timing_model const gdrom_timing_turbo = {
+    .name = "turbo",
+    .cmd_delay = gdrom_turbo_cmd_delay,
+    .seek_delay = gdrom_no_seek_delay,
+    .read_delay = gdrom_no_read_delay
+};
+
+void gdrom_timing_init(void) {
+    static struct gdrom_timing_model const *models[] = {
+        &gdrom_timing_fixed,
+        &gdrom_timing_accurate,
+        &gdrom_timing_turbo
+    };
+
+    cfg_model = &gdrom_timing_fixed;
+    atomic_store(&turbo, false);
+
+    char const *model_str = cfg_get_node("gdrom.timing");
+    if (!model_str)
+        return;
+
+    unsigned idx;
+    for (idx = 0; idx < sizeof(models) / sizeof(models[0]); idx++) {
+        if (strcmp(model_str, models[idx]->name) == 0) {
+            cfg_model = models[idx];
+            LOG_INFO("GD-ROM using the %s timing model\n", cfg_model->name);
+            return;
+        }
+    }
+
+    LOG_ERROR("unknown GD-ROM timing model \"%s\"\n", model_str);
+}
+
+struct gdrom_timing_model const *gdrom_timing_get(void) {
+    return atomic_load(&turbo) ? &gdrom_timing_turbo : cfg_model;
+}
+
+void gdrom_timing_set_turbo(bool enable) {
+    atomic_store(&turbo, enable);
+}
+
+bool gdrom_timing_get_turbo(void) {
+    return atomic_load(&turbo);
+}
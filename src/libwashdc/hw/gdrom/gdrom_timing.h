@@ -0,0 +1,77 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+/*
+ * GD-ROM drive timing models.
+ *
+ * These decide how long the drive spends on a command before it raises its
+ * interrupt.  Which model is used comes from the gdrom.timing config option,
+ * and the turbo model can also be switched on and off while the emulator is
+ * running.
+ */
+
+#ifndef GDROM_TIMING_H_
+#define GDROM_TIMING_H_
+
+#include <stdbool.h>
+
+#include "dc_sched.h"
+
+struct gdrom_timing_model {
+    char const *name;
+
+    // latency of a command that doesn't have to read anything off the disc
+    dc_cycle_stamp_t (*cmd_delay)(void);
+
+    // time it takes to move the head from fad_cur to fad_dst
+    dc_cycle_stamp_t (*seek_delay)(unsigned fad_cur, unsigned fad_dst);
+
+    // time it takes to read n_sectors sectors starting at fad
+    dc_cycle_stamp_t (*read_delay)(unsigned fad, unsigned n_sectors);
+};
+
+/*
+ * the original constant delay: every command takes the same amount of time no
+ * matter how much it has to read.
+ */
+extern struct gdrom_timing_model const gdrom_timing_fixed;
+
+// seeks and transfers take about as long as they would on a real drive
+extern struct gdrom_timing_model const gdrom_timing_accurate;
+
+// everything finishes as quickly as possible
+extern struct gdrom_timing_model const gdrom_timing_turbo;
+
+// read the gdrom.timing config option
+void gdrom_timing_init(void);
+
+// return the model that's currently in use
+struct gdrom_timing_model const *gdrom_timing_get(void);
+
+/*
+ * switch the turbo model on or off.  When it's off, the model from the config
+ * gets used.  This is safe to call from any thread.
+ */
+void gdrom_timing_set_turbo(bool enable);
+bool gdrom_timing_get_turbo(void);
+
+#endif
@@ -38,8 +38,10 @@
 #include "gfx/gfx_obj.h"
 #include "log.h"
 #include "title.h"
+#include "frameskip.h"
 
 #include "framebuffer.h"
+#include "framebuffer_conv.h"
 
 static DEF_ERROR_INT_ATTR(width)
 static DEF_ERROR_INT_ATTR(height)
@@ -80,548 +82,217 @@ static unsigned bytes_per_pix(uint32_t fb_r_ctrl) {
 static uint8_t *get_tex_mem_area(struct pvr2 *pvr2, addr32_t addr);
 
 /*
- * The concat parameter in these functions corresponds to the fb_concat value
- * in FB_R_CTRL; it is appended as the lower 3/2 bits to each color component
- * to convert that component from 5/6 bits to 8 bits.
- *
- * One "gotcha" to note about the below functions is that
- * conv_rgb555_to_argb8888 and conv_rgb565_to_rgb8888 expect their inputs to be
- * arrays of uint16_t with each element representing one pixel, and
- * conv_rgb0888_to_argb8888 expects its input to be uint32_t with each element
- * representing one pixel BUT conv_rgb888_to_argb8888 expects its input to be
- * uint8_t with every *three* elements representing one pixel.
+ * this is a simple "dumb" memcpy function that doesn't handle the framebuffer
+ * state (this is what makes it different from pvr2_tex_mem_area32_write).  It
+ * does, however, perform bounds-checking and raise an error for out-of-bounds
+ * memory access.
  */
-static void
-conv_rgb565_to_rgba8888(uint32_t *pixels_out,
-                        uint16_t const *pixels_in,
-                        unsigned n_pixels, uint8_t concat);
-static void
-conv_rgb555_to_rgba8888(uint32_t *pixels_out,
-                        uint16_t const *pixels_in,
-                        unsigned n_pixels, uint8_t concat);
-static void
-conv_rgb888_to_rgba8888(uint32_t *pixels_out,
-                        uint8_t const *pixels_in,
-                        unsigned n_pixels);
-static void
-conv_rgb0888_to_rgba8888(uint32_t *pixels_out,
-                         uint32_t const *pixels_in,
-                         unsigned n_pixels);
+static void copy_to_tex_mem(struct pvr2 *pvr2, void const *in,
+                            addr32_t offs, size_t len);
 
 static void
-sync_fb_from_tex_mem_rgb565_intl(struct pvr2 *pvr2, struct framebuffer *fb,
-                                 unsigned fb_width, unsigned fb_height,
-                                 uint32_t sof1, uint32_t sof2,
-                                 unsigned modulus, unsigned concat) {
-    /*
-     * field_adv represents the distand between the start of one row and the
-     * start of the next row in the same field in terms of bytes.
-     */
-    unsigned field_adv = fb_width * 2 + modulus * 4 - 4;
-    unsigned rows_per_field = fb_height;
-
-    addr32_t first_addr_field1 = sof1;
-    addr32_t last_addr_field1 = sof1 +
-        field_adv * (rows_per_field - 1) + 2 * (fb_width - 1);
-    addr32_t first_addr_field2 = sof2;
-    addr32_t last_addr_field2 = sof2 +
-        field_adv * (rows_per_field - 1) + 2 * (fb_width - 1);
-
-    // bounds checking.
-    addr32_t bounds_field1[2] = {
-        first_addr_field1 + ADDR_TEX32_FIRST,
-        last_addr_field1 + ADDR_TEX32_FIRST
-    };
-    addr32_t bounds_field2[2] = {
-        first_addr_field2 + ADDR_TEX32_FIRST,
-        last_addr_field2 + ADDR_TEX32_FIRST
-    };
-    if (bounds_field1[0] < ADDR_TEX32_FIRST ||
-        bounds_field1[0] > ADDR_TEX32_LAST ||
-        bounds_field1[1] < ADDR_TEX32_FIRST ||
-        bounds_field1[1] > ADDR_TEX32_LAST ||
-        bounds_field2[0] < ADDR_TEX32_FIRST ||
-        bounds_field2[0] > ADDR_TEX32_LAST ||
-        bounds_field2[1] < ADDR_TEX32_FIRST ||
-        bounds_field2[1] > ADDR_TEX32_LAST) {
-        error_set_feature("whatever happens when a framebuffer is configured "
-                          "to read outside of texture memory");
-        RAISE_ERROR(ERROR_UNIMPLEMENTED);
-    }
-
-    uint32_t *dst_fb = (uint32_t*)pvr2->fb.ogl_fb;
-
-    unsigned row;
-    uint8_t const *pvr2_tex32_mem = pvr2->mem.tex32;
-    for (row = 0; row < rows_per_field; row++) {
-        uint16_t const *ptr_row1 =
-            (uint16_t const*)(pvr2_tex32_mem + sof1 + row * field_adv);
-        uint16_t const *ptr_row2 =
-            (uint16_t const*)(pvr2_tex32_mem + sof2 + row * field_adv);
-
-        conv_rgb565_to_rgba8888(dst_fb + row * 2 * fb_width,
-                                ptr_row1, fb_width, concat);
-        conv_rgb565_to_rgba8888(dst_fb + (row * 2 + 1) * fb_width,
-                                ptr_row2, fb_width, concat);
-    }
-
-    fb->addr_key = first_addr_field1  < first_addr_field2 ?
-        first_addr_field1 : first_addr_field2;
-
-    fb->addr_first[0] = first_addr_field1;
-    fb->addr_first[1] = first_addr_field2;
-    fb->addr_last[0] = last_addr_field1;
-    fb->addr_last[1] = last_addr_field2;
-
-    fb->fb_read_width = fb_width;
-    fb->fb_read_height = fb_height;
-
-    fb->flags.state = FB_STATE_VIRT_AND_GFX;
-
-    fb->flags.vert_flip = true;
-    fb->stamp = pvr2->fb.stamp;
-    fb->flags.fmt = FB_PIX_FMT_RGB_565;
-
-    struct gfx_il_inst cmd;
+fb_mark_dirty(struct framebuffer *fb, uint32_t first_byte, uint32_t last_byte);
+static void fb_clear_dirty(struct framebuffer *fb);
 
-    cmd.op = GFX_IL_WRITE_OBJ;
-    cmd.arg.write_obj.dat = dst_fb;
-    cmd.arg.write_obj.obj_no = fb->obj_handle;
-    cmd.arg.write_obj.n_bytes = OGL_FB_W_MAX * OGL_FB_H_MAX * 4;
-
-    rend_exec_il(&cmd, 1);
-}
-
-static void
-sync_fb_from_tex_mem_rgb565_prog(struct pvr2 *pvr2, struct framebuffer *fb,
-                                 unsigned fb_width, unsigned fb_height,
-                                 uint32_t sof1, unsigned concat) {
-    unsigned field_adv = fb_width;
-    uint16_t const *pixels_in = (uint16_t*)(pvr2->mem.tex32 + sof1);
-    /*
-     * bounds checking
-     *
-     * TODO: is it really necessary to test for
-     * (last_byte < ADDR_TEX32_FIRST || first_byte > ADDR_TEX32_LAST) ?
-     */
-    addr32_t last_byte = sof1 + fb_width * fb_height * 2;
-    addr32_t first_byte = sof1;
+static bool fb_addr_set_has(struct fb_addr_set const *set, uint32_t addr_key);
+static void fb_addr_set_add(struct fb_addr_set *set, uint32_t addr_key);
 
-    // bounds checking.
-    addr32_t bounds_field1[2] = {
-        first_byte + ADDR_TEX32_FIRST,
-        last_byte + ADDR_TEX32_FIRST
-    };
-    if (bounds_field1[0] < ADDR_TEX32_FIRST ||
-        bounds_field1[0] > ADDR_TEX32_LAST ||
-        bounds_field1[1] < ADDR_TEX32_FIRST ||
-        bounds_field1[1] > ADDR_TEX32_LAST) {
-        error_set_feature("whatever happens when a framebuffer is configured "
-                          "to read outside of texture memory");
+/*
+ * convert one row of pixels from texture memory.  See framebuffer_conv.h for
+ * the meaning of concat.
+ */
+static void conv_row(enum fb_pix_fmt fmt, uint32_t *dst, uint8_t const *src,
+                     unsigned n_pixels, unsigned concat) {
+    switch (fmt) {
+    case FB_PIX_FMT_RGB_555:
+        fb_conv_rgb555_to_rgba8888(dst, (uint16_t const*)src,
+                                   n_pixels, concat);
+        break;
+    case FB_PIX_FMT_RGB_565:
+        fb_conv_rgb565_to_rgba8888(dst, (uint16_t const*)src,
+                                   n_pixels, concat);
+        break;
+    case FB_PIX_FMT_RGB_888:
+        fb_conv_rgb888_to_rgba8888(dst, src, n_pixels);
+        break;
+    case FB_PIX_FMT_0RGB_0888:
+        fb_conv_rgb0888_to_rgba8888(dst, (uint32_t const*)src, n_pixels);
+        break;
+    default:
+        error_set_fb_pix_fmt(fmt);
         RAISE_ERROR(ERROR_UNIMPLEMENTED);
     }
-
-    uint32_t *dst_fb = (uint32_t*)pvr2->fb.ogl_fb;
-    memset(pvr2->fb.ogl_fb, 0xff, sizeof(pvr2->fb.ogl_fb));
-
-    unsigned row;
-    for (row = 0; row < fb_height; row++) {
-        uint16_t const *in_col_start = pixels_in + field_adv * row;
-        uint32_t *out_col_start = dst_fb + row * fb_width;
-
-        conv_rgb565_to_rgba8888(out_col_start, in_col_start, fb_width, concat);
-    }
-
-    fb->fb_read_width = fb_width;
-    fb->fb_read_height = fb_height;
-    fb->addr_key = first_byte;
-    fb->addr_first[0] = first_byte;
-    fb->addr_first[1] = first_byte;
-    fb->addr_last[0] = last_byte;
-    fb->addr_last[1] = last_byte;
-
-    fb->flags.state = FB_STATE_VIRT_AND_GFX;
-
-    fb->flags.vert_flip = true;
-    fb->stamp = pvr2->fb.stamp;
-    fb->flags.fmt = FB_PIX_FMT_RGB_565;
-
-    struct gfx_il_inst cmd;
-
-    cmd.op = GFX_IL_WRITE_OBJ;
-    cmd.arg.write_obj.dat = dst_fb;
-    cmd.arg.write_obj.obj_no = fb->obj_handle;
-    cmd.arg.write_obj.n_bytes = OGL_FB_W_MAX * OGL_FB_H_MAX * 4;
-
-    rend_exec_il(&cmd, 1);
 }
 
-static void
-sync_fb_from_tex_mem_rgb555_intl(struct pvr2 *pvr2, struct framebuffer *fb,
-                                 unsigned fb_width, unsigned fb_height,
-                                 uint32_t sof1, uint32_t sof2,
-                                 unsigned modulus, unsigned concat) {
-    /*
-     * field_adv represents the distand between the start of one row and the
-     * start of the next row in the same field in terms of bytes.
-     */
-    unsigned field_adv = fb_width * 2 + modulus * 4 - 4;
-    unsigned rows_per_field = fb_height;
-
-    addr32_t first_addr_field1 = sof1;
-    addr32_t last_addr_field1 = sof1 +
-        field_adv * (rows_per_field - 1) + 2 * (fb_width - 1);
-    addr32_t first_addr_field2 = sof2;
-    addr32_t last_addr_field2 = sof2 +
-        field_adv * (rows_per_field - 1) + 2 * (fb_width - 1);
-
-    // bounds checking.
-    addr32_t bounds_field1[2] = {
-        first_addr_field1 + ADDR_TEX32_FIRST,
-        last_addr_field1 + ADDR_TEX32_FIRST
-    };
-    addr32_t bounds_field2[2] = {
-        first_addr_field2 + ADDR_TEX32_FIRST,
-        last_addr_field2 + ADDR_TEX32_FIRST
-    };
-    if (bounds_field1[0] < ADDR_TEX32_FIRST ||
-        bounds_field1[0] > ADDR_TEX32_LAST ||
-        bounds_field1[1] < ADDR_TEX32_FIRST ||
-        bounds_field1[1] > ADDR_TEX32_LAST ||
-        bounds_field2[0] < ADDR_TEX32_FIRST ||
-        bounds_field2[0] > ADDR_TEX32_LAST ||
-        bounds_field2[1] < ADDR_TEX32_FIRST ||
-        bounds_field2[1] > ADDR_TEX32_LAST) {
-        error_set_feature("whatever happens when a framebuffer is configured "
-                          "to read outside of texture memory");
-        RAISE_ERROR(ERROR_UNIMPLEMENTED);
-    }
-
-    uint32_t *dst_fb = (uint32_t*)pvr2->fb.ogl_fb;
-
-    uint8_t const *pvr2_tex32_mem = pvr2->mem.tex32;
-    unsigned row;
-    for (row = 0; row < rows_per_field; row++) {
-        uint16_t const *ptr_row1 =
-            (uint16_t const*)(pvr2_tex32_mem + sof1 + row * field_adv);
-        uint16_t const *ptr_row2 =
-            (uint16_t const*)(pvr2_tex32_mem + sof2 + row * field_adv);
-
-        conv_rgb555_to_rgba8888(dst_fb + row * 2 * fb_width,
-                                ptr_row1, fb_width, concat);
-        conv_rgb555_to_rgba8888(dst_fb + (row * 2 + 1) * fb_width,
-                                ptr_row2, fb_width, concat);
-    }
-
-    fb->addr_key = first_addr_field1  < first_addr_field2 ?
-        first_addr_field1 : first_addr_field2;
-
-    fb->addr_first[0] = first_addr_field1;
-    fb->addr_first[1] = first_addr_field2;
-    fb->addr_last[0] = last_addr_field1;
-    fb->addr_last[1] = last_addr_field2;
-
-    fb->fb_read_width = fb_width;
-    fb->fb_read_height = fb_height;
-
-    fb->flags.state = FB_STATE_VIRT_AND_GFX;
-
-    fb->flags.vert_flip = true;
-    fb->stamp = pvr2->fb.stamp;
-    fb->flags.fmt = FB_PIX_FMT_RGB_555;
-
-    struct gfx_il_inst cmd;
-
-    cmd.op = GFX_IL_WRITE_OBJ;
-    cmd.arg.write_obj.dat = dst_fb;
-    cmd.arg.write_obj.obj_no = fb->obj_handle;
-    cmd.arg.write_obj.n_bytes = OGL_FB_W_MAX * OGL_FB_H_MAX * 4;
-
-    rend_exec_il(&cmd, 1);
+static inline bool fb_line_dirty(struct framebuffer const *fb,
+                                 unsigned field, unsigned row) {
+    return fb->dirty_lines[field][row / 32] & ((uint32_t)1 << (row % 32));
 }
 
+/*
+ * Copy a framebuffer from texture memory into the framebuffer's gfx_obj.
+ *
+ * In interlace-scan mode the two fields are read from FB_R_SOF1 and FB_R_SOF2
+ * and woven together so that field 1 lands on the even rows and field 2 lands
+ * on the odd rows.  In progressive-scan mode there is only one field.
+ *
+ * If this framebuffer was already scanned out with the same settings and the
+ * CPU has only written to some of it since then, only the rows which were
+ * written to get converted again.  Software-rendered menus and FMVs tend to
+ * only touch a portion of the screen, so this saves a lot of work.
+ */
 static void
-sync_fb_from_tex_mem_rgb888_intl(struct pvr2 *pvr2, struct framebuffer *fb,
-                                 unsigned fb_width, unsigned fb_height,
-                                 uint32_t sof1, uint32_t sof2,
-                                 unsigned modulus) {
-    /*
-     * field_adv represents the distand between the start of one row and the
-     * start of the next row in the same field in terms of bytes.
-     */
-    unsigned field_adv = fb_width * 3 + modulus * 4 - 4;
-    unsigned rows_per_field = fb_height;
-
-    addr32_t first_addr_field1 = sof1;
-    addr32_t last_addr_field1 = sof1 +
-        field_adv * (rows_per_field - 1) + 3 * (fb_width - 1);
-    addr32_t first_addr_field2 = sof2;
-    addr32_t last_addr_field2 = sof2 +
-        field_adv * (rows_per_field - 1) + 3 * (fb_width - 1);
-
-    // bounds checking.
-    addr32_t bounds_field1[2] = {
-        first_addr_field1 + ADDR_TEX32_FIRST,
-        last_addr_field1 + ADDR_TEX32_FIRST
-    };
-    addr32_t bounds_field2[2] = {
-        first_addr_field2 + ADDR_TEX32_FIRST,
-        last_addr_field2 + ADDR_TEX32_FIRST
-    };
-    if (bounds_field1[0] < ADDR_TEX32_FIRST ||
-        bounds_field1[0] > ADDR_TEX32_LAST ||
-        bounds_field1[1] < ADDR_TEX32_FIRST ||
-        bounds_field1[1] > ADDR_TEX32_LAST ||
-        bounds_field2[0] < ADDR_TEX32_FIRST ||
-        bounds_field2[0] > ADDR_TEX32_LAST ||
-        bounds_field2[1] < ADDR_TEX32_FIRST ||
-        bounds_field2[1] > ADDR_TEX32_LAST) {
-        error_set_feature("whatever happens when a framebuffer is configured "
-                          "to read outside of texture memory");
-        RAISE_ERROR(ERROR_UNIMPLEMENTED);
-    }
+sync_fb_from_tex_mem(struct pvr2 *pvr2, struct framebuffer *fb,
+                     unsigned width, unsigned height,
+                     unsigned modulus, unsigned concat) {
+    bool interlace = get_spg_control(pvr2) & (1 << 4);
 
-    uint32_t *dst_fb = (uint32_t*)pvr2->fb.ogl_fb;
+    uint32_t sof[2] = {
+        get_fb_r_sof1(pvr2) & ~3,
+        get_fb_r_sof2(pvr2) & ~3
+    };
 
-    uint8_t const *pvr2_tex32_mem = pvr2->mem.tex32;
-    unsigned row;
-    for (row = 0; row < rows_per_field; row++) {
-        uint8_t const *ptr_row1 =
-            pvr2_tex32_mem + sof1 + row * field_adv;
-        uint8_t const *ptr_row2 =
-            pvr2_tex32_mem + sof2 + row * field_adv;
-
-        conv_rgb888_to_rgba8888(dst_fb + row * 2 * fb_width,
-                                ptr_row1, fb_width);
-        conv_rgb888_to_rgba8888(dst_fb + (row * 2 + 1) * fb_width,
-                                ptr_row2, fb_width);
+    enum fb_pix_fmt fmt;
+    unsigned pix_sz;
+    uint32_t fb_r_ctrl = get_fb_r_ctrl(pvr2);
+    unsigned px_tp = (fb_r_ctrl & 0xc) >> 2;
+    switch (px_tp) {
+    case 0:
+        // 16-bit 555 RGB
+        fmt = FB_PIX_FMT_RGB_555;
+        pix_sz = 2;
+        break;
+    case 1:
+        // 16-bit 565 RGB
+        fmt = FB_PIX_FMT_RGB_565;
+        pix_sz = 2;
+        break;
+    case 2:
+        // 24-bit 888 RGB
+        if (!interlace) {
+            error_set_feature("video mode RGB888 (progressive scan)");
+            RAISE_ERROR(ERROR_UNIMPLEMENTED);
+        }
+        fmt = FB_PIX_FMT_RGB_888;
+        pix_sz = 3;
+        break;
+    default:
+        // 32-bit 08888 RGB
+        fmt = FB_PIX_FMT_0RGB_0888;
+        pix_sz = 4;
+        break;
     }
 
-    fb->addr_key = first_addr_field1  < first_addr_field2 ?
-        first_addr_field1 : first_addr_field2;
-
-    fb->addr_first[0] = first_addr_field1;
-    fb->addr_first[1] = first_addr_field2;
-    fb->addr_last[0] = last_addr_field1;
-    fb->addr_last[1] = last_addr_field2;
-
-    fb->fb_read_width = fb_width;
-    fb->fb_read_height = fb_height;
-
-    fb->flags.state = FB_STATE_VIRT_AND_GFX;
-
-    fb->flags.vert_flip = true;
-    fb->stamp = pvr2->fb.stamp;
-    fb->flags.fmt = FB_PIX_FMT_RGB_888;
-
-    struct gfx_il_inst cmd;
-
-    cmd.op = GFX_IL_WRITE_OBJ;
-    cmd.arg.write_obj.dat = dst_fb;
-    cmd.arg.write_obj.obj_no = fb->obj_handle;
-    cmd.arg.write_obj.n_bytes = OGL_FB_W_MAX * OGL_FB_H_MAX * 4;
-
-    rend_exec_il(&cmd, 1);
-}
+    unsigned n_fields;
+    unsigned field_adv;
+    uint32_t addr_first[2], addr_last[2];
+    if (interlace) {
+        /*
+         * field_adv represents the distand between the start of one row and
+         * the start of the next row in the same field in terms of bytes.
+         */
+        n_fields = 2;
+        field_adv = width * pix_sz + modulus * 4 - 4;
+
+        unsigned field_no;
+        for (field_no = 0; field_no < 2; field_no++) {
+            addr_first[field_no] = sof[field_no];
+            addr_last[field_no] = sof[field_no] +
+                field_adv * (height - 1) + pix_sz * (width - 1);
+        }
+    } else {
+        n_fields = 1;
+        field_adv = width * pix_sz;
+        addr_first[0] = addr_first[1] = sof[0];
+        addr_last[0] = addr_last[1] = sof[0] + width * height * pix_sz;
+    }
 
-static void
-sync_fb_from_tex_mem_rgb555_prog(struct pvr2 *pvr2, struct framebuffer *fb,
-                                 unsigned fb_width, unsigned fb_height,
-                                 uint32_t sof1, unsigned concat) {
-    unsigned field_adv = fb_width;
-    uint16_t const *pixels_in = (uint16_t*)(pvr2->mem.tex32 + sof1);
     /*
      * bounds checking
      *
      * TODO: is it really necessary to test for
      * (last_byte < ADDR_TEX32_FIRST || first_byte > ADDR_TEX32_LAST) ?
      */
-    addr32_t last_byte = sof1 + fb_width * fb_height * 2;
-    addr32_t first_byte = sof1;
-
-    // bounds checking.
-    addr32_t bounds_field1[2] = {
-        first_byte + ADDR_TEX32_FIRST,
-        last_byte + ADDR_TEX32_FIRST
-    };
-    if (bounds_field1[0] < ADDR_TEX32_FIRST ||
-        bounds_field1[0] > ADDR_TEX32_LAST ||
-        bounds_field1[1] < ADDR_TEX32_FIRST ||
-        bounds_field1[1] > ADDR_TEX32_LAST) {
-        error_set_feature("whatever happens when a framebuffer is configured "
-                          "to read outside of texture memory");
-        RAISE_ERROR(ERROR_UNIMPLEMENTED);
-    }
-
-    uint32_t *dst_fb = (uint32_t*)pvr2->fb.ogl_fb;
-    memset(pvr2->fb.ogl_fb, 0xff, sizeof(pvr2->fb.ogl_fb));
-
-    unsigned row;
-    for (row = 0; row < fb_height; row++) {
-        uint16_t const *in_col_start = pixels_in + field_adv * row;
-        uint32_t *out_col_start = dst_fb + row * fb_width;
-
-        conv_rgb555_to_rgba8888(out_col_start, in_col_start, fb_width, concat);
+    unsigned field_no;
+    for (field_no = 0; field_no < n_fields; field_no++) {
+        addr32_t bounds[2] = {
+            addr_first[field_no] + ADDR_TEX32_FIRST,
+            addr_last[field_no] + ADDR_TEX32_FIRST
+        };
+        if (bounds[0] < ADDR_TEX32_FIRST ||
+            bounds[0] > ADDR_TEX32_LAST ||
+            bounds[1] < ADDR_TEX32_FIRST ||
+            bounds[1] > ADDR_TEX32_LAST) {
+            error_set_feature("whatever happens when a framebuffer is "
+                              "configured to read outside of texture memory");
+            RAISE_ERROR(ERROR_UNIMPLEMENTED);
+        }
     }
 
-    fb->fb_read_width = fb_width;
-    fb->fb_read_height = fb_height;
-    fb->addr_key = first_byte;
-    fb->addr_first[0] = first_byte;
-    fb->addr_first[1] = first_byte;
-    fb->addr_last[0] = last_byte;
-    fb->addr_last[1] = last_byte;
-
-    fb->flags.state = FB_STATE_VIRT_AND_GFX;
-
-    fb->flags.vert_flip = true;
-    fb->stamp = pvr2->fb.stamp;
-    fb->flags.fmt = FB_PIX_FMT_RGB_555;
-
-    struct gfx_il_inst cmd;
-
-    cmd.op = GFX_IL_WRITE_OBJ;
-    cmd.arg.write_obj.dat = dst_fb;
-    cmd.arg.write_obj.obj_no = fb->obj_handle;
-    cmd.arg.write_obj.n_bytes = OGL_FB_W_MAX * OGL_FB_H_MAX * 4;
-
-    rend_exec_il(&cmd, 1);
-}
-
-static void
-sync_fb_from_tex_mem_rgb0888_intl(struct pvr2 *pvr2, struct framebuffer *fb,
-                                  unsigned fb_width, unsigned fb_height,
-                                  uint32_t sof1, uint32_t sof2,
-                                  unsigned modulus) {
-    /*
-     * field_adv represents the distand between the start of one row and the
-     * start of the next row in the same field in terms of bytes.
-     */
-    unsigned field_adv = (fb_width * 4) + (modulus * 4) - 4;
-    unsigned rows_per_field = fb_height /* / 2 */;
-
-    addr32_t first_addr_field1 = sof1;
-    addr32_t last_addr_field1 = sof1 +
-        field_adv * (rows_per_field - 1) + 2 * (fb_width - 1);
-    addr32_t first_addr_field2 = sof2;
-    addr32_t last_addr_field2 = sof2 +
-        field_adv * (rows_per_field - 1) + 2 * (fb_width - 1);
-
-    // bounds checking.
-    addr32_t bounds_field1[2] = {
-        first_addr_field1 + ADDR_TEX32_FIRST,
-        last_addr_field1 + ADDR_TEX32_FIRST
-    };
-    addr32_t bounds_field2[2] = {
-        first_addr_field2 + ADDR_TEX32_FIRST,
-        last_addr_field2 + ADDR_TEX32_FIRST
-    };
-    if (bounds_field1[0] < ADDR_TEX32_FIRST ||
-        bounds_field1[0] > ADDR_TEX32_LAST ||
-        bounds_field1[1] < ADDR_TEX32_FIRST ||
-        bounds_field1[1] > ADDR_TEX32_LAST ||
-        bounds_field2[0] < ADDR_TEX32_FIRST ||
-        bounds_field2[0] > ADDR_TEX32_LAST ||
-        bounds_field2[1] < ADDR_TEX32_FIRST ||
-        bounds_field2[1] > ADDR_TEX32_LAST) {
-        error_set_feature("whatever happens when a framebuffer is configured "
-                          "to read outside of texture memory");
-        RAISE_ERROR(ERROR_UNIMPLEMENTED);
+    if (!fb->conv_buf) {
+        fb->conv_buf = (uint32_t*)malloc(OGL_FB_BYTES);
+        if (!fb->conv_buf)
+            RAISE_ERROR(ERROR_FAILED_ALLOC);
+        // the whole buffer gets uploaded, including what's outside the image
+        memset(fb->conv_buf, 0xff, OGL_FB_BYTES);
+        fb->flags.conv_valid = false;
     }
 
-    uint32_t *dst_fb = (uint32_t*)pvr2->fb.ogl_fb;
-
+    bool partial = fb->flags.conv_valid &&
+        fb->flags.fmt == fmt &&
+        fb->flags.interlace == interlace &&
+        fb->fb_read_width == width &&
+        fb->fb_read_height == height &&
+        fb->read_stride == field_adv &&
+        fb->read_concat == concat &&
+        fb->addr_first[0] == addr_first[0] &&
+        fb->addr_first[1] == addr_first[1];
+
+    uint32_t *dst_fb = fb->conv_buf;
     uint8_t const *pvr2_tex32_mem = pvr2->mem.tex32;
-    unsigned row;
-    for (row = 0; row < rows_per_field; row++) {
-        uint32_t const *ptr_row1 =
-            (uint32_t const*)(pvr2_tex32_mem + sof1 + row * field_adv);
-        uint32_t const *ptr_row2 =
-            (uint32_t const*)(pvr2_tex32_mem + sof2 + row * field_adv);
-
-        conv_rgb0888_to_rgba8888(dst_fb + (row << 1) * fb_width,
-                                 ptr_row1, fb_width);
-        conv_rgb0888_to_rgba8888(dst_fb + ((row << 1) + 1) * fb_width,
-                                 ptr_row2, fb_width);
+    unsigned n_rows_conv = 0;
+    for (field_no = 0; field_no < n_fields; field_no++) {
+        unsigned row;
+        for (row = 0; row < height; row++) {
+            if (partial && !fb_line_dirty(fb, field_no, row))
+                continue;
+
+            unsigned dst_row = row * n_fields + field_no;
+            conv_row(fmt, dst_fb + dst_row * width,
+                     pvr2_tex32_mem + sof[field_no] + row * field_adv,
+                     width, concat);
+            n_rows_conv++;
+        }
     }
 
-    fb->fb_read_width = fb_width;
-    fb->fb_read_height = fb_height;
+    fb->addr_key = addr_first[0] < addr_first[1] ?
+        addr_first[0] : addr_first[1];
 
-    fb->addr_key = first_addr_field1 < first_addr_field2 ?
-        first_addr_field1 : first_addr_field2;
+    fb->addr_first[0] = addr_first[0];
+    fb->addr_first[1] = addr_first[1];
+    fb->addr_last[0] = addr_last[0];
+    fb->addr_last[1] = addr_last[1];
 
-    fb->addr_first[0] = first_addr_field1;
-    fb->addr_first[1] = first_addr_field2;
-    fb->addr_last[0] = last_addr_field1;
-    fb->addr_last[1] = last_addr_field2;
+    fb->fb_read_width = width;
+    fb->fb_read_height = height;
+    fb->read_stride = field_adv;
+    fb->read_concat = concat;
 
     fb->flags.state = FB_STATE_VIRT_AND_GFX;
 
     fb->flags.vert_flip = true;
     fb->stamp = pvr2->fb.stamp;
-    fb->flags.fmt = FB_PIX_FMT_0RGB_0888;
-
-    struct gfx_il_inst cmd;
-
-    cmd.op = GFX_IL_WRITE_OBJ;
-    cmd.arg.write_obj.dat = dst_fb;
-    cmd.arg.write_obj.obj_no = fb->obj_handle;
-    cmd.arg.write_obj.n_bytes = OGL_FB_W_MAX * OGL_FB_H_MAX * 4;
-
-    rend_exec_il(&cmd, 1);
-}
-
-static void
-sync_fb_from_tex_mem_rgb0888_prog(struct pvr2 *pvr2, struct framebuffer *fb,
-                                  unsigned fb_width, unsigned fb_height,
-                                  uint32_t sof1) {
-    uint32_t const *pixels_in = (uint32_t const*)(pvr2->mem.tex32 + sof1);
-    addr32_t last_byte = sof1 + fb_width * fb_height * 4;
-    addr32_t first_byte = sof1;
+    fb->flags.fmt = fmt;
+    fb->flags.interlace = interlace;
+    fb->flags.conv_valid = true;
+    fb_clear_dirty(fb);
 
     /*
-     * bounds checking
-     *
-     * TODO: is it really necessary to test for
-     * (last_byte < ADDR_TEX32_FIRST || first_byte > ADDR_TEX32_LAST) ?
+     * the gfx_obj already holds the last conversion of this framebuffer, so
+     * there's nothing to upload if no rows changed.
      */
-    addr32_t bounds_field1[2] = {
-        first_byte + ADDR_TEX32_FIRST,
-        last_byte + ADDR_TEX32_FIRST
-    };
-    if (bounds_field1[0] < ADDR_TEX32_FIRST ||
-        bounds_field1[0] > ADDR_TEX32_LAST ||
-        bounds_field1[1] < ADDR_TEX32_FIRST ||
-        bounds_field1[1] > ADDR_TEX32_LAST) {
-        error_set_feature("whatever happens when a framebuffer is configured "
-                          "to read outside of texture memory");
-        RAISE_ERROR(ERROR_UNIMPLEMENTED);
-    }
-
-    uint32_t *dst_fb = (uint32_t*)pvr2->fb.ogl_fb;
-
-    unsigned row;
-    for (row = 0; row < fb_height; row++) {
-        uint32_t const *in_col_start = pixels_in + fb_width * row;
-        uint32_t *out_col_start = dst_fb + row * fb_width;
-
-        conv_rgb0888_to_rgba8888(out_col_start, in_col_start, fb_width);
-    }
-
-    fb->fb_read_width = fb_width;
-    fb->fb_read_height = fb_height;
-    fb->addr_key = first_byte;
-    fb->addr_first[0] = first_byte;
-    fb->addr_first[1] = first_byte;
-    fb->addr_last[0] = last_byte;
-    fb->addr_last[1] = last_byte;
-
-    fb->flags.state = FB_STATE_VIRT_AND_GFX;
-
-    fb->flags.vert_flip = true;
-    fb->stamp = pvr2->fb.stamp;
-    fb->flags.fmt = FB_PIX_FMT_0RGB_0888;
+    if (!n_rows_conv)
+        return;
 
     struct gfx_il_inst cmd;
 
@@ -633,128 +304,10 @@ sync_fb_from_tex_mem_rgb0888_prog(struct pvr2 *pvr2, struct framebuffer *fb,
     rend_exec_il(&cmd, 1);
 }
 
-static void
-sync_fb_from_tex_mem(struct pvr2 *pvr2, struct framebuffer *fb,
-                     unsigned width, unsigned height,
-                     unsigned modulus, unsigned concat) {
-    bool interlace = get_spg_control(pvr2) & (1 << 4);
-
-    uint32_t fb_r_sof1 = get_fb_r_sof1(pvr2) & ~3;
-    uint32_t fb_r_sof2 = get_fb_r_sof2(pvr2) & ~3;
-
-    uint32_t fb_r_ctrl = get_fb_r_ctrl(pvr2);
-    unsigned px_tp = (fb_r_ctrl & 0xc) >> 2;
-    switch (px_tp) {
-    case 0:
-        // 16-bit 555 RGB
-        if (interlace) {
-            sync_fb_from_tex_mem_rgb555_intl(pvr2, fb, width, height, fb_r_sof1,
-                                             fb_r_sof2, modulus, concat);
-        } else {
-            sync_fb_from_tex_mem_rgb555_prog(pvr2, fb, width, height,
-                                             fb_r_sof1, concat);
-        }
-        break;
-    case 1:
-        // 16-bit 565 RGB
-        if (interlace) {
-            sync_fb_from_tex_mem_rgb565_intl(pvr2, fb, width, height, fb_r_sof1,
-                                             fb_r_sof2, modulus, concat);
-        } else {
-            sync_fb_from_tex_mem_rgb565_prog(pvr2, fb, width, height,
-                                             fb_r_sof1, concat);
-        }
-        break;
-    case 2:
-        // 24-bit 888 RGB
-        if (interlace) {
-            sync_fb_from_tex_mem_rgb888_intl(pvr2, fb, width, height, fb_r_sof1,
-                                             fb_r_sof2, modulus);
-        } else {
-            error_set_feature("video mode RGB888 (progressive scan)");
-            RAISE_ERROR(ERROR_UNIMPLEMENTED);
-        }
-        break;
-    case 3:
-        // 32-bit 08888 RGB
-        if (interlace) {
-            sync_fb_from_tex_mem_rgb0888_intl(pvr2, fb, width, height, fb_r_sof1,
-                                              fb_r_sof2, modulus);
-        } else {
-            sync_fb_from_tex_mem_rgb0888_prog(pvr2, fb, width, height,
-                                              fb_r_sof1);
-        }
-    }
-}
-
-/*
- * this is a simple "dumb" memcpy function that doesn't handle the framebuffer
- * state (this is what makes it different from pvr2_tex_mem_area32_write).  It
- * does, however, perform bounds-checking and raise an error for out-of-bounds
- * memory access.
- */
-static void copy_to_tex_mem(struct pvr2 *pvr2, void const *in,
-                            addr32_t offs, size_t len);
-
-static void conv_rgb565_to_rgba8888(uint32_t *pixels_out,
-                                    uint16_t const *pixels_in,
-                                    unsigned n_pixels, uint8_t concat) {
-    for (unsigned idx = 0; idx < n_pixels; idx++) {
-        uint16_t pix = pixels_in[idx];
-        uint32_t r = (((pix & 0xf800) >> 11) << 3) | concat;
-        uint32_t g = (((pix & 0x07e0) >> 5) << 2) | (concat & 0x3);
-        uint32_t b = ((pix & 0x001f) << 3) | concat;
-
-        pixels_out[idx] = (255 << 24) | (b << 16) | (g << 8) | r;
-    }
-}
-
-static void
-conv_rgb555_to_rgba8888(uint32_t *pixels_out,
-                        uint16_t const *pixels_in,
-                        unsigned n_pixels, uint8_t concat) {
-    for (unsigned idx = 0; idx < n_pixels; idx++) {
-        uint16_t pix = pixels_in[idx];
-
-        uint32_t b = ((pix & 0x001f) << 3) | concat;
-        uint32_t g = (((pix & 0x03e0) >> 5) << 2) | (concat & 3);
-        uint32_t r = (((pix & 0xec00) >> 10) << 2) | concat;
-
-        pixels_out[idx] = (255 << 24) | (b << 16) | (g << 8) | r;
-    }
-}
-
-static void
-conv_rgb888_to_rgba8888(uint32_t *pixels_out,
-                        uint8_t const *pixels_in,
-                        unsigned n_pixels) {
-    for (unsigned idx = 0; idx < n_pixels; idx++) {
-        uint8_t const *pix = pixels_in + idx * 3;
-        uint32_t r = pix[0];
-        uint32_t g = pix[1];
-        uint32_t b = pix[2];
-
-        pixels_out[idx] = (255 << 24) | (r << 16) | (g << 8) | b;
-    }
-}
-
-static void
-conv_rgb0888_to_rgba8888(uint32_t *pixels_out,
-                         uint32_t const *pixels_in,
-                         unsigned n_pixels) {
-    for (unsigned idx = 0; idx < n_pixels; idx++) {
-        uint32_t pix = pixels_in[idx];
-        uint32_t r = (pix & 0x00ff0000) >> 16;
-        uint32_t g = (pix & 0x0000ff00) >> 8;
-        uint32_t b = (pix & 0x000000ff);
-        pixels_out[idx] = (255 << 24) | (b << 16) | (g << 8) | r;
-    }
-}
-
 static int
 pick_fb(struct pvr2 *pvr2, unsigned width, unsigned height, uint32_t addr);
 
-// reset all members except the gfx_obj handle
+// reset all members except the gfx_obj handle and the conversion buffer
 static void fb_reset(struct framebuffer *fb) {
     fb->fb_read_width = 0;
     fb->fb_read_height = 0;
@@ -774,14 +327,24 @@ static void fb_reset(struct framebuffer *fb) {
     fb->flags.state = FB_STATE_INVALID;
     fb->flags.fmt = FB_PIX_FMT_RGB_555;
     fb->flags.vert_flip = false;
+    fb->flags.conv_valid = false;
+    fb->flags.interlace = false;
+    fb->flags.skipped = false;
+    fb->read_stride = 0;
+    fb->read_concat = 0;
+    fb_clear_dirty(fb);
 }
 
 void pvr2_framebuffer_init(struct pvr2 *pvr2) {
     struct gfx_il_inst cmd;
     struct framebuffer *fb_heap = pvr2->fb.fb_heap;
 
+    memset(&pvr2->fb.scanout, 0, sizeof(pvr2->fb.scanout));
+    memset(&pvr2->fb.readback, 0, sizeof(pvr2->fb.readback));
+
     int fb_no;
     for (fb_no = 0; fb_no < FB_HEAP_SIZE; fb_no++) {
+        fb_heap[fb_no].conv_buf = NULL;
         fb_reset(fb_heap + fb_no);
         fb_heap[fb_no].obj_handle = pvr2_alloc_gfx_obj();
 
@@ -795,6 +358,14 @@ void pvr2_framebuffer_init(struct pvr2 *pvr2) {
 }
 
 void pvr2_framebuffer_cleanup(struct pvr2 *pvr2) {
+    struct framebuffer *fb_heap = pvr2->fb.fb_heap;
+
+    int fb_no;
+    for (fb_no = 0; fb_no < FB_HEAP_SIZE; fb_no++) {
+        free(fb_heap[fb_no].conv_buf);
+        fb_heap[fb_no].conv_buf = NULL;
+        fb_heap[fb_no].flags.conv_valid = false;
+    }
 }
 
 void framebuffer_render(struct pvr2 *pvr2) {
@@ -827,8 +398,10 @@ void framebuffer_render(struct pvr2 *pvr2) {
     struct gfx_il_inst cmd;
 
     uint32_t addr_first = fb_r_sof1;
+    fb_addr_set_add(&pvr2->fb.scanout, fb_r_sof1);
     if (interlace) {
         uint32_t fb_r_sof2 = get_fb_r_sof2(pvr2) & ~3;
+        fb_addr_set_add(&pvr2->fb.scanout, fb_r_sof2);
         if (fb_r_sof2 < addr_first)
             addr_first = fb_r_sof2;
     }
@@ -844,6 +417,9 @@ void framebuffer_render(struct pvr2 *pvr2) {
             fb->flags.state != FB_STATE_INVALID) {
 
             if (!(fb_heap[fb_idx].flags.state & FB_STATE_GFX)) {
+                // don't upload CPU-drawn framebuffers while skipping frames
+                if (frameskip_skipping())
+                    return;
                 sync_fb_from_tex_mem(pvr2, fb_heap + fb_idx, width,
                                      height, modulus, concat);
             }
@@ -852,6 +428,9 @@ void framebuffer_render(struct pvr2 *pvr2) {
         }
     }
 
+    if (frameskip_skipping())
+        return;
+
     fb_idx = pick_fb(pvr2, width, height, fb_r_sof1);
     sync_fb_from_tex_mem(pvr2, fb_heap + fb_idx,
                          width, height, modulus, concat);
@@ -859,6 +438,10 @@ void framebuffer_render(struct pvr2 *pvr2) {
 submit_the_fb:
     pvr2->fb.stamp++;
 
+    // leave the last frame up if this one's contents were never drawn
+    if (fb_heap[fb_idx].flags.skipped)
+        return;
+
     cmd.op = GFX_IL_POST_FRAMEBUFFER;
     cmd.arg.post_framebuffer.obj_handle = fb_heap[fb_idx].obj_handle;
     cmd.arg.post_framebuffer.width = fb_heap[fb_idx].fb_read_width;
@@ -1100,6 +683,10 @@ sync_fb_to_tex_mem(struct pvr2 *pvr2, struct framebuffer *fb) {
     if (fb->flags.state != FB_STATE_GFX)
         return;
 
+    // the host copy was never drawn, don't clobber texture memory with it
+    if (fb->flags.skipped)
+        return;
+
     fb->flags.state |= ~FB_STATE_VIRT;
 
     struct gfx_il_inst cmd = {
@@ -1286,6 +873,8 @@ int framebuffer_set_render_target(struct pvr2 *pvr2) {
 
     fb->flags.state = FB_STATE_GFX;
     fb->flags.vert_flip = false;
+    fb->flags.conv_valid = false;
+    fb->flags.skipped = false;
     fb->fb_read_width = width;
     fb->fb_read_height = height;
     fb->stamp = pvr2->fb.stamp;
@@ -1420,7 +1009,39 @@ int framebuffer_set_render_target(struct pvr2 *pvr2) {
     cmd.arg.bind_render_target.gfx_obj_handle = fb_heap[idx].obj_handle;
     rend_exec_il(&cmd, 1);
 
-    return fb_heap[idx].obj_handle;
+    return idx;
+}
+
+int framebuffer_get_render_target_obj(struct pvr2 *pvr2, int tgt) {
+    return pvr2->fb.fb_heap[tgt].obj_handle;
+}
+
+static bool fb_addr_set_has(struct fb_addr_set const *set, uint32_t addr_key) {
+    unsigned idx;
+    for (idx = 0; idx < set->n_keys; idx++)
+        if (set->keys[idx] == addr_key)
+            return true;
+    return false;
+}
+
+static void fb_addr_set_add(struct fb_addr_set *set, uint32_t addr_key) {
+    if (fb_addr_set_has(set, addr_key))
+        return;
+
+    set->keys[set->next] = addr_key;
+    set->next = (set->next + 1) % FB_HEAP_SIZE;
+    if (set->n_keys < FB_HEAP_SIZE)
+        set->n_keys++;
+}
+
+bool framebuffer_render_target_skippable(struct pvr2 *pvr2) {
+    uint32_t addr_key = get_fb_w_sof1(pvr2) & ~3;
+    return fb_addr_set_has(&pvr2->fb.scanout, addr_key) &&
+        !fb_addr_set_has(&pvr2->fb.readback, addr_key);
+}
+
+void framebuffer_mark_skipped(struct pvr2 *pvr2, int tgt) {
+    pvr2->fb.fb_heap[tgt].flags.skipped = true;
 }
 
 void framebuffer_get_render_target_dims(struct pvr2 *pvr2, int tgt,
@@ -1460,18 +1081,53 @@ void pvr2_framebuffer_notify_write(struct pvr2 *pvr2, uint32_t addr,
          * in mind.
          */
         struct framebuffer *fb = fb_heap + fb_idx;
-        if ((fb->flags.state & FB_STATE_GFX) &&
+        if (fb->flags.state != FB_STATE_INVALID &&
             (check_overlap(first_byte, last_byte,
                           fb->addr_first[0],
                           fb->addr_last[0]) ||
             check_overlap(first_byte, last_byte,
                           fb->addr_first[1],
                           fb->addr_last[1]))) {
+            if (fb->flags.conv_valid)
+                fb_mark_dirty(fb, first_byte, last_byte);
             fb->flags.state = FB_STATE_VIRT;
         }
     }
 }
 
+static void
+fb_mark_dirty(struct framebuffer *fb, uint32_t first_byte, uint32_t last_byte) {
+    unsigned n_fields = fb->flags.interlace ? 2 : 1;
+    unsigned stride = fb->read_stride;
+    unsigned n_rows = fb->fb_read_height;
+
+    if (!stride || !n_rows)
+        return;
+
+    unsigned field_no;
+    for (field_no = 0; field_no < n_fields; field_no++) {
+        uint32_t field_first = fb->addr_first[field_no];
+        uint32_t field_last = fb->addr_last[field_no];
+        if (!check_overlap(first_byte, last_byte, field_first, field_last))
+            continue;
+
+        unsigned row_first = first_byte <= field_first ?
+            0 : (first_byte - field_first) / stride;
+        unsigned row_last = (last_byte - field_first) / stride;
+        if (row_last >= n_rows)
+            row_last = n_rows - 1;
+
+        uint32_t *dirty = fb->dirty_lines[field_no];
+        unsigned row;
+        for (row = row_first; row <= row_last; row++)
+            dirty[row / 32] |= (uint32_t)1 << (row % 32);
+    }
+}
+
+static void fb_clear_dirty(struct framebuffer *fb) {
+    memset(fb->dirty_lines, 0, sizeof(fb->dirty_lines));
+}
+
 void pvr2_framebuffer_notify_texture(struct pvr2 *pvr2, uint32_t first_tex_addr,
                                      uint32_t last_tex_addr) {
     first_tex_addr &= TEX_MIRROR_MASK;
@@ -1513,8 +1169,20 @@ void pvr2_framebuffer_notify_texture(struct pvr2 *pvr2, uint32_t first_tex_addr,
                           addr_first[0] & TEX_MIRROR_MASK, addr_last[0] & TEX_MIRROR_MASK) ||
             check_overlap(first_tex_addr, last_tex_addr,
                           addr_first[1] & TEX_MIRROR_MASK, addr_last[1] & TEX_MIRROR_MASK)) {
-            sync_fb_to_tex_mem(pvr2, fb_heap + fb_idx);
-            fb_heap[fb_idx].flags.state = FB_STATE_VIRT_AND_GFX;
+            /*
+             * A framebuffer whose last render was skipped has nothing to
+             * write back, so texture memory still holds whatever was there
+             * before and it must not be marked as in sync; it gets written
+             * back once a real render lands in it.  The guest samples stale
+             * data this one time, which is a known limitation of frameskip.
+             * Adding it to the readback set keeps the renders that follow
+             * from being skipped.
+             */
+            if (!fb_heap[fb_idx].flags.skipped) {
+                sync_fb_to_tex_mem(pvr2, fb_heap + fb_idx);
+                fb_heap[fb_idx].flags.state = FB_STATE_VIRT_AND_GFX;
+            }
+            fb_addr_set_add(&pvr2->fb.readback, fb_heap[fb_idx].addr_key);
             sync_count++;
         }
     }
@@ -24,6 +24,7 @@
 #define PVR2_FRAMEBUFFER_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 
 struct pvr2;
 
@@ -90,8 +91,24 @@ struct fb_flags {
     uint8_t state : 2;
     uint8_t fmt : 3;
     uint8_t vert_flip : 1;
+
+    // set when conv_buf holds this framebuffer's last scan-out from tex mem
+    uint8_t conv_valid : 1;
+    uint8_t interlace : 1;
+
+    /*
+     * set when the last render to this framebuffer was skipped by the
+     * frameskip logic, so its contents are stale and it shouldn't be shown.
+     */
+    uint8_t skipped : 1;
 };
 
+#define OGL_FB_W_MAX (0x3ff + 1)
+#define OGL_FB_H_MAX (0x3ff + 1)
+#define OGL_FB_BYTES (OGL_FB_W_MAX * OGL_FB_H_MAX * 4)
+
+#define OGL_FB_DIRTY_WORDS (OGL_FB_H_MAX / 32)
+
 #define FB_HEAP_SIZE 8
 struct framebuffer {
     int obj_handle;
@@ -109,17 +126,49 @@ struct framebuffer {
     unsigned tile_w, tile_h, x_clip_min, x_clip_max,
         y_clip_min, y_clip_max;
 
+    /*
+     * Scan-out state, only valid if flags.conv_valid is set.
+     *
+     * conv_buf holds the RGBA8888 conversion of this framebuffer that was
+     * last sent to the gfx_obj.  It is allocated the first time the
+     * framebuffer is scanned out of texture memory and kept after that.
+     * dirty_lines has one bit per row of each field; pvr2_framebuffer_notify_write
+     * sets bits for rows the CPU writes to so that the next scan-out only needs
+     * to convert those rows.
+     */
+    uint32_t *conv_buf;
+    unsigned read_stride;
+    unsigned read_concat;
+    uint32_t dirty_lines[2][OGL_FB_DIRTY_WORDS];
+
     struct fb_flags flags;
 };
 
-#define OGL_FB_W_MAX (0x3ff + 1)
-#define OGL_FB_H_MAX (0x3ff + 1)
-#define OGL_FB_BYTES (OGL_FB_W_MAX * OGL_FB_H_MAX * 4)
+// a small set of framebuffer addresses; the oldest one gets overwritten
+struct fb_addr_set {
+    uint32_t keys[FB_HEAP_SIZE];
+    unsigned n_keys, next;
+};
 
 struct pvr2_fb {
     uint8_t ogl_fb[OGL_FB_BYTES];
     struct framebuffer fb_heap[FB_HEAP_SIZE];
     unsigned stamp;
+
+    /*
+     * addresses which have been sent to the display by FB_R_SOF1/FB_R_SOF2.
+     * Only renders to one of these addresses can be skipped when frames are
+     * being dropped; anything else may be a render-to-texture or a buffer
+     * the CPU reads back.
+     */
+    struct fb_addr_set scanout;
+
+    /*
+     * addr_keys of framebuffers which have been used as textures.  Renders
+     * to these addresses never get skipped because the guest will see the
+     * result.
+     */
+    struct fb_addr_set readback;
 };
 
 void pvr2_framebuffer_init(struct pvr2 *pvr2);
@@ -131,11 +180,29 @@ void framebuffer_render(struct pvr2 *pvr2);
 static inline void framebuffer_sync_from_host_maybe(void) {
 }
 
+/*
+ * bind the framebuffer that the next render will go to as the render target.
+ * The return value is that framebuffer's index in the fb_heap; this is what
+ * the other render-target functions below take as tgt.
+ */
 int framebuffer_set_render_target(struct pvr2 *pvr2);
 
+// returns the gfx_obj handle of the given render target
+int framebuffer_get_render_target_obj(struct pvr2 *pvr2, int tgt);
+
 void framebuffer_get_render_target_dims(struct pvr2 *pvr2, int tgt,
                                         unsigned *width, unsigned *height);
 
+/*
+ * returns true if the next render can be dropped by the frameskip logic.
+ * This is only the case when the render goes to a framebuffer that is only
+ * ever displayed, never read back by the guest.
+ */
+bool framebuffer_render_target_skippable(struct pvr2 *pvr2);
+
+// flag the given render target's contents as stale after a skipped render
+void framebuffer_mark_skipped(struct pvr2 *pvr2, int tgt);
+
 void pvr2_framebuffer_notify_write(struct pvr2 *pvr2, uint32_t addr,
                                    unsigned n_bytes);
 
@@ -0,0 +1,187 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+#include "framebuffer_conv.h"
+
+void fb_conv_rgb565_to_rgba8888(uint32_t *pixels_out,
+                                uint16_t const *pixels_in,
+                                unsigned n_pixels, uint8_t concat) {
+    unsigned idx = 0;
+
+#ifdef __SSE2__
+    /*
+     * eight pixels at a time.  Each channel is expanded in its own 16-bit
+     * lane, then red/green and blue/alpha are packed into bytes and
+     * interleaved into 32-bit pixels.
+     */
+    __m128i const mask5 = _mm_set1_epi16(0x1f);
+    __m128i const mask6 = _mm_set1_epi16(0x3f);
+    __m128i const cat = _mm_set1_epi16(concat);
+    __m128i const cat_g = _mm_set1_epi16(concat & 3);
+    __m128i const alpha = _mm_set1_epi16((int16_t)0xff00);
+
+    for (; idx + 8 <= n_pixels; idx += 8) {
+        __m128i pix = _mm_loadu_si128((__m128i const*)(pixels_in + idx));
+
+        __m128i r = _mm_or_si128(_mm_slli_epi16(_mm_srli_epi16(pix, 11), 3),
+                                 cat);
+        __m128i g = _mm_or_si128(
+            _mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(pix, 5), mask6), 2),
+            cat_g);
+        __m128i b = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(pix, mask5), 3),
+                                 cat);
+
+        __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+        __m128i ba = _mm_or_si128(b, alpha);
+
+        _mm_storeu_si128((__m128i*)(pixels_out + idx),
+                         _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i*)(pixels_out + idx + 4),
+                         _mm_unpackhi_epi16(rg, ba));
+    }
+#endif
+
+    for (; idx < n_pixels; idx++) {
+        uint16_t pix = pixels_in[idx];
+        uint32_t r = (((pix & 0xf800) >> 11) << 3) | concat;
+        uint32_t g = (((pix & 0x07e0) >> 5) << 2) | (concat & 0x3);
+        uint32_t b = ((pix & 0x001f) << 3) | concat;
+
+        pixels_out[idx] = (255 << 24) | (b << 16) | (g << 8) | r;
+    }
+}
+
+void fb_conv_rgb555_to_rgba8888(uint32_t *pixels_out,
+                                uint16_t const *pixels_in,
+                                unsigned n_pixels, uint8_t concat) {
+    unsigned idx = 0;
+
+#ifdef __SSE2__
+    __m128i const mask5 = _mm_set1_epi16(0x1f);
+    __m128i const cat = _mm_set1_epi16(concat);
+    __m128i const alpha = _mm_set1_epi16((int16_t)0xff00);
+
+    for (; idx + 8 <= n_pixels; idx += 8) {
+        __m128i pix = _mm_loadu_si128((__m128i const*)(pixels_in + idx));
+
+        __m128i r = _mm_or_si128(
+            _mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(pix, 10), mask5), 3),
+            cat);
+        __m128i g = _mm_or_si128(
+            _mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(pix, 5), mask5), 3),
+            cat);
+        __m128i b = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(pix, mask5), 3),
+                                 cat);
+
+        __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+        __m128i ba = _mm_or_si128(b, alpha);
+
+        _mm_storeu_si128((__m128i*)(pixels_out + idx),
+                         _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i*)(pixels_out + idx + 4),
+                         _mm_unpackhi_epi16(rg, ba));
+    }
+#endif
+
+    for (; idx < n_pixels; idx++) {
+        uint16_t pix = pixels_in[idx];
+
+        uint32_t b = ((pix & 0x001f) << 3) | concat;
+        uint32_t g = (((pix & 0x03e0) >> 5) << 3) | concat;
+        uint32_t r = (((pix & 0x7c00) >> 10) << 3) | concat;
+
+        pixels_out[idx] = (255 << 24) | (b << 16) | (g << 8) | r;
+    }
+}
+
+void fb_conv_rgb888_to_rgba8888(uint32_t *pixels_out,
+                                uint8_t const *pixels_in,
+                                unsigned n_pixels) {
+    unsigned idx = 0;
+
+#ifdef __SSSE3__
+    /*
+     * four pixels (12 bytes) at a time.  The load is 16 bytes wide, so stop
+     * while there are still at least 16 readable bytes left in the row.
+     */
+    __m128i const shuf = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1,
+                                       8, 7, 6, -1, 11, 10, 9, -1);
+    __m128i const alpha = _mm_set1_epi32((int32_t)0xff000000);
+
+    for (; idx + 6 <= n_pixels; idx += 4) {
+        __m128i pix = _mm_loadu_si128((__m128i const*)(pixels_in + idx * 3));
+        _mm_storeu_si128((__m128i*)(pixels_out + idx),
+                         _mm_or_si128(_mm_shuffle_epi8(pix, shuf), alpha));
+    }
+#endif
+
+    for (; idx < n_pixels; idx++) {
+        uint8_t const *pix = pixels_in + idx * 3;
+        uint32_t b = pix[0];
+        uint32_t g = pix[1];
+        uint32_t r = pix[2];
+
+        pixels_out[idx] = (255 << 24) | (b << 16) | (g << 8) | r;
+    }
+}
+
+void fb_conv_rgb0888_to_rgba8888(uint32_t *pixels_out,
+                                 uint32_t const *pixels_in,
+                                 unsigned n_pixels) {
+    unsigned idx = 0;
+
+#ifdef __SSE2__
+    __m128i const mask8 = _mm_set1_epi32(0xff);
+    __m128i const mask_g = _mm_set1_epi32(0xff00);
+    __m128i const alpha = _mm_set1_epi32((int32_t)0xff000000);
+
+    for (; idx + 4 <= n_pixels; idx += 4) {
+        __m128i pix = _mm_loadu_si128((__m128i const*)(pixels_in + idx));
+
+        __m128i r = _mm_and_si128(_mm_srli_epi32(pix, 16), mask8);
+        __m128i g = _mm_and_si128(pix, mask_g);
+        __m128i b = _mm_slli_epi32(_mm_and_si128(pix, mask8), 16);
+
+        _mm_storeu_si128((__m128i*)(pixels_out + idx),
+                         _mm_or_si128(_mm_or_si128(r, g),
+                                      _mm_or_si128(b, alpha)));
+    }
+#endif
+
+    for (; idx < n_pixels; idx++) {
+        uint32_t pix = pixels_in[idx];
+        uint32_t r = (pix & 0x00ff0000) >> 16;
+        uint32_t g = (pix & 0x0000ff00) >> 8;
+        uint32_t b = (pix & 0x000000ff);
+        pixels_out[idx] = (255 << 24) | (b << 16) | (g << 8) | r;
+    }
+}
@@ -0,0 +1,60 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef FRAMEBUFFER_CONV_H_
+#define FRAMEBUFFER_CONV_H_
+
+#include <stdint.h>
+
+/*
+ * pixel-conversion kernels used when scanning a framebuffer out of texture
+ * memory.  Each function converts one row of n_pixels pixels into RGBA8888
+ * (red in the lowest byte, alpha in the highest byte).
+ *
+ * The concat parameter corresponds to the fb_concat value in FB_R_CTRL; it is
+ * appended as the lower bits of each color component to expand that component
+ * to 8 bits.
+ *
+ * Neither the input nor the output needs to be aligned.  On x86 these use
+ * SSE2 (and SSSE3 for 24-bit pixels when the compiler is allowed to emit it);
+ * everywhere else they fall back to plain C.
+ */
+
+void fb_conv_rgb565_to_rgba8888(uint32_t *pixels_out,
+                                uint16_t const *pixels_in,
+                                unsigned n_pixels, uint8_t concat);
+
+void fb_conv_rgb555_to_rgba8888(uint32_t *pixels_out,
+                                uint16_t const *pixels_in,
+                                unsigned n_pixels, uint8_t concat);
+
+// input is three bytes per pixel: blue, green, red
+void fb_conv_rgb888_to_rgba8888(uint32_t *pixels_out,
+                                uint8_t const *pixels_in,
+                                unsigned n_pixels);
+
+// input is one 32-bit 0x00RRGGBB word per pixel
+void fb_conv_rgb0888_to_rgba8888(uint32_t *pixels_out,
+                                 uint32_t const *pixels_in,
+                                 unsigned n_pixels);
+
+#endif
@@ -85,7 +85,39 @@ struct pvr2_stat {
          * since that's generally how textures end up in this situation.
          */
         unsigned tex_eviction_count;
+
+        /*
+         * number of times an invalidated texture was not transmitted because
+         * its source data hashed the same as what was already uploaded.
+         */
+        unsigned tex_hash_match_count;
+
+        /*
+         * number of times a texture was not transmitted because another
+         * texture with identical source data was already uploaded, so the two
+         * share a gfx_obj.
+         */
+        unsigned tex_dedup_count;
+
+        /*
+         * number of times a texture got kicked out of the cache because the
+         * cache was over its byte budget.  These are also included in
+         * texture_overwrite_count.
+         */
+        unsigned tex_budget_eviction_count;
     } persistent_counters;
+
+    // the state of the texture cache as of the last time it changed
+    struct {
+        // bytes uploaded to all of the cache's gfx_objs, and the limit for that
+        size_t n_bytes, budget;
+
+        // number of textures in the cache
+        unsigned n_resident;
+
+        // number of slots the cache has allocated
+        unsigned n_slots;
+    } tex_cache;
 };
 
 struct pvr2 {
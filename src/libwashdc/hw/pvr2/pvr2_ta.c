@@ -41,6 +41,7 @@
 #include "log.h"
 #include "dc_sched.h"
 #include "dreamcast.h"
+#include "frameskip.h"
 #include "gfx/gfx_il.h"
 #include "pvr2.h"
 #include "pvr2_reg.h"
@@ -96,6 +97,9 @@
 #define TA_CMD_TYPE_UNKNOWN     0x6  // I can't find any info on what this is
 #define TA_CMD_TYPE_VERTEX      0x7
 
+#define ISP_MOD_VOL_INST_SHIFT 29
+#define ISP_MOD_VOL_INST_MASK (7 << ISP_MOD_VOL_INST_SHIFT)
+
 #define TA_COLOR_FMT_SHIFT 4
 #define TA_COLOR_FMT_MASK (3 << TA_COLOR_FMT_SHIFT)
 
@@ -211,12 +215,19 @@ static void pvr2_pt_complete_int_event_handler(struct SchedEvent *event);
 
 #define PVR2_TA_VERT_BUF_LEN (1024 * 1024)
 
+/*
+ * every strip needs one more index than it has verts for the restart, and
+ * the worst case is a strip with only one vert in it.
+ */
+#define PVR2_TA_IDX_BUF_LEN (2 * PVR2_TA_VERT_BUF_LEN)
+
 #define PVR2_GFX_IL_INST_BUF_LEN (1024 * 256)
 
 void pvr2_ta_init(struct pvr2 *pvr2) {
     struct pvr2_ta *ta = &pvr2->ta;
 
     ta->pt_alpha_ref = 0xff;
+    ta->pkt = ta->ta_fifo32;
 
     ta->pvr2_render_complete_int_event.handler =
         pvr2_render_complete_int_event_handler;
@@ -238,10 +249,15 @@ void pvr2_ta_init(struct pvr2 *pvr2) {
     ta->pvr2_trans_mod_complete_int_event.arg_ptr = pvr2;
     ta->pvr2_pt_complete_int_event.arg_ptr = pvr2;
 
-    pvr2->ta.pvr2_ta_vert_buf = (float*)malloc(PVR2_TA_VERT_BUF_LEN *
-                                               sizeof(float) * GFX_VERT_LEN);
+    pvr2->ta.pvr2_ta_vert_buf =
+        (struct gfx_vert*)malloc(PVR2_TA_VERT_BUF_LEN *
+                                 sizeof(struct gfx_vert));
     if (!pvr2->ta.pvr2_ta_vert_buf)
         RAISE_ERROR(ERROR_FAILED_ALLOC);
+    pvr2->ta.pvr2_ta_idx_buf =
+        (uint32_t*)malloc(PVR2_TA_IDX_BUF_LEN * sizeof(uint32_t));
+    if (!pvr2->ta.pvr2_ta_idx_buf)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
     ta->gfx_il_inst_buf = (struct gfx_il_inst_chain*)malloc(PVR2_GFX_IL_INST_BUF_LEN *
                                                         sizeof(struct gfx_il_inst_chain));
     if (!ta->gfx_il_inst_buf)
@@ -249,41 +265,76 @@ void pvr2_ta_init(struct pvr2 *pvr2) {
 
     pvr2->ta.pvr2_ta_vert_buf_count = 0;
     pvr2->ta.pvr2_ta_vert_cur_group = 0;
+    pvr2->ta.pvr2_ta_idx_buf_count = 0;
+    pvr2->ta.pvr2_ta_idx_cur_group = 0;
 
     render_frame_init(pvr2);
 }
 
 void pvr2_ta_cleanup(struct pvr2 *pvr2) {
     free(pvr2->ta.gfx_il_inst_buf);
+    free(pvr2->ta.pvr2_ta_idx_buf);
     free(pvr2->ta.pvr2_ta_vert_buf);
+    pvr2->ta.pvr2_ta_idx_buf = NULL;
     pvr2->ta.pvr2_ta_vert_buf = NULL;
     pvr2->ta.pvr2_ta_vert_buf_count = 0;
     pvr2->ta.pvr2_ta_vert_cur_group = 0;
+    pvr2->ta.pvr2_ta_idx_buf_count = 0;
+    pvr2->ta.pvr2_ta_idx_cur_group = 0;
+}
+
+static inline uint8_t pvr2_ta_pack_color(float val) {
+    if (val <= 0.0f)
+        return 0;
+    if (val >= 1.0f)
+        return 255;
+    return (uint8_t)(val * 255.0f + 0.5f);
 }
 
-static inline void pvr2_ta_push_vert(struct pvr2 *pvr2, struct pvr2_ta_vert vert) {
+/*
+ * adds a vert to the vertex buffer and its index to the index buffer.
+ * Returns false if there was no room for it.
+ */
+static inline bool
+pvr2_ta_push_vert(struct pvr2 *pvr2, struct pvr2_ta_vert const *vert) {
     struct pvr2_ta *ta = &pvr2->ta;
-    if (ta->pvr2_ta_vert_buf_count >= PVR2_TA_VERT_BUF_LEN) {
+    if (ta->pvr2_ta_vert_buf_count >= PVR2_TA_VERT_BUF_LEN ||
+        ta->pvr2_ta_idx_buf_count >= PVR2_TA_IDX_BUF_LEN) {
         LOG_WARN("PVR2 TA vertex buffer overflow\n");
-        return;
+        return false;
     }
 
-    float *outp = ta->pvr2_ta_vert_buf +
-        GFX_VERT_LEN * ta->pvr2_ta_vert_buf_count++;
+    ta->pvr2_ta_idx_buf[ta->pvr2_ta_idx_buf_count++] =
+        ta->pvr2_ta_vert_buf_count - ta->pvr2_ta_vert_cur_group;
+
+    struct gfx_vert *outp =
+        ta->pvr2_ta_vert_buf + ta->pvr2_ta_vert_buf_count++;
     PVR2_TRACE("vert_buf_count is now %u\n", ta->pvr2_ta_vert_buf_count);
-    outp[GFX_VERT_POS_OFFSET + 0] = vert.pos[0];
-    outp[GFX_VERT_POS_OFFSET + 1] = vert.pos[1];
-    outp[GFX_VERT_POS_OFFSET + 2] = vert.pos[2];
-    outp[GFX_VERT_BASE_COLOR_OFFSET + 0] = vert.base_color[0];
-    outp[GFX_VERT_BASE_COLOR_OFFSET + 1] = vert.base_color[1];
-    outp[GFX_VERT_BASE_COLOR_OFFSET + 2] = vert.base_color[2];
-    outp[GFX_VERT_BASE_COLOR_OFFSET + 3] = vert.base_color[3];
-    outp[GFX_VERT_OFFS_COLOR_OFFSET + 0] = vert.offs_color[0];
-    outp[GFX_VERT_OFFS_COLOR_OFFSET + 1] = vert.offs_color[1];
-    outp[GFX_VERT_OFFS_COLOR_OFFSET + 2] = vert.offs_color[2];
-    outp[GFX_VERT_OFFS_COLOR_OFFSET + 3] = vert.offs_color[3];
-    outp[GFX_VERT_TEX_COORD_OFFSET + 0] = vert.tex_coord[0];
-    outp[GFX_VERT_TEX_COORD_OFFSET + 1] = vert.tex_coord[1];
+    outp->pos[0] = vert->pos[0];
+    outp->pos[1] = vert->pos[1];
+    outp->pos[2] = vert->pos[2];
+    outp->tex_coord[0] = vert->tex_coord[0];
+    outp->tex_coord[1] = vert->tex_coord[1];
+
+    unsigned comp;
+    for (comp = 0; comp < 4; comp++) {
+        outp->base_color[comp] = pvr2_ta_pack_color(vert->base_color[comp]);
+        outp->offs_color[comp] = pvr2_ta_pack_color(vert->offs_color[comp]);
+    }
+
+    return true;
+}
+
+// terminates the current triangle strip in the index buffer
+static inline void pvr2_ta_end_strip(struct pvr2 *pvr2) {
+    struct pvr2_ta *ta = &pvr2->ta;
+    if (ta->pvr2_ta_idx_buf_count >= PVR2_TA_IDX_BUF_LEN) {
+        LOG_WARN("PVR2 TA index buffer overflow\n");
+        return;
+    }
+    if (ta->pvr2_ta_idx_buf_count > ta->pvr2_ta_idx_cur_group &&
+        ta->pvr2_ta_idx_buf[ta->pvr2_ta_idx_buf_count - 1] != GFX_PRIM_RESTART)
+        ta->pvr2_ta_idx_buf[ta->pvr2_ta_idx_buf_count++] = GFX_PRIM_RESTART;
 }
 
 static inline void
@@ -406,6 +457,8 @@ static void on_pkt_hdr_received(struct pvr2 *pvr2, struct pvr2_pkt const *pkt) {
     struct pvr2_pkt_hdr const *hdr = &pkt->dat.hdr;
     struct pvr2_ta *ta = &pvr2->ta;
 
+    if (ta->strip_len)
+        pvr2_ta_end_strip(pvr2);
     ta->strip_len = 0;
 
 #ifdef PVR2_LOG_VERBOSE
@@ -585,7 +638,7 @@ static void
 on_quad_received(struct pvr2 *pvr2, struct pvr2_pkt_vtx const *vtx) {
     struct pvr2_ta *ta = &pvr2->ta;
     float ta_fifo_float[PVR2_CMD_MAX_LEN];
-    memcpy(ta_fifo_float, ta->ta_fifo32, sizeof(ta_fifo_float));
+    memcpy(ta_fifo_float, ta->pkt, 16 * sizeof(float));
 
     /*
      * four quadrilateral vertices.  the z-coordinate of p4 is determined
@@ -723,13 +776,17 @@ on_quad_received(struct pvr2 *pvr2, struct pvr2_pkt_vtx const *vtx) {
         .tex_coord = { uv[3][0], uv[3][1] }
     };
 
-    pvr2_ta_push_vert(pvr2, vert1);
-    pvr2_ta_push_vert(pvr2, vert2);
-    pvr2_ta_push_vert(pvr2, vert3);
-
-    pvr2_ta_push_vert(pvr2, vert1);
-    pvr2_ta_push_vert(pvr2, vert3);
-    pvr2_ta_push_vert(pvr2, vert4);
+    /*
+     * the quad goes out as a two-triangle strip: (v2, v1, v3) and (v1, v3, v4)
+     * cover the same area as the (v1, v2, v3) and (v1, v3, v4) pair.
+     */
+    if (pvr2_ta_push_vert(pvr2, &vert2) &&
+        pvr2_ta_push_vert(pvr2, &vert1) &&
+        pvr2_ta_push_vert(pvr2, &vert3) &&
+        pvr2_ta_push_vert(pvr2, &vert4)) {
+        ta->group_tri_count += 2;
+    }
+    pvr2_ta_end_strip(pvr2);
 
     if (p1[2] < ta->clip_min)
         ta->clip_min = p1[2];
@@ -752,11 +809,48 @@ on_quad_received(struct pvr2 *pvr2, struct pvr2_pkt_vtx const *vtx) {
         ta->clip_max = p4[2];
 }
 
+static void
+on_mod_vol_tri_received(struct pvr2 *pvr2,
+                        struct pvr2_pkt_mod_vol_tri const *tri) {
+    struct pvr2_ta *ta = &pvr2->ta;
+    unsigned vert_no;
+    bool pushed = true;
+
+    ta->open_group = true;
+
+    /*
+     * modifier volumes only ever go to the renderer as independent triangles;
+     * there's no index list and no color or texture data.
+     */
+    for (vert_no = 0; vert_no < 3; vert_no++) {
+        float z_recip = 1.0 / tri->pos[vert_no][2];
+        if (z_recip < ta->clip_min)
+            ta->clip_min = z_recip;
+        if (z_recip > ta->clip_max)
+            ta->clip_max = z_recip;
+
+        struct pvr2_ta_vert vert = {
+            .pos = { tri->pos[vert_no][0], tri->pos[vert_no][1], z_recip }
+        };
+
+        if (pushed)
+            pushed = pvr2_ta_push_vert(pvr2, &vert);
+    }
+
+    if (pushed)
+        ta->group_tri_count++;
+}
+
 static void
 on_pkt_vtx_received(struct pvr2 *pvr2, struct pvr2_pkt const *pkt) {
     struct pvr2_ta *ta = &pvr2->ta;
     struct pvr2_pkt_vtx const *vtx = &pkt->dat.vtx;
 
+    if (pkt->tp == PVR2_PKT_MOD_VOL_TRI) {
+        on_mod_vol_tri_received(pvr2, &pkt->dat.mod_vol_tri);
+        return;
+    }
+
     if (ta->hdr.tp == PVR2_HDR_QUAD) {
         on_quad_received(pvr2, vtx);
         return;
@@ -764,20 +858,6 @@ on_pkt_vtx_received(struct pvr2 *pvr2, struct pvr2_pkt const *pkt) {
 
     ta->open_group = true;
 
-    /*
-     * un-strip triangle strips by duplicating the previous two vertices.
-     *
-     * TODO: obviously it would be best to preserve the triangle strips and
-     * send them to OpenGL via GL_TRIANGLE_STRIP in the rendering backend, but
-     * then I need to come up with some way to signal the renderer to stop and
-     * re-start strips.  It might also be possible to stitch separate strips
-     * together with degenerate triangles...
-     */
-    if (ta->strip_len >= 3) {
-        pvr2_ta_push_vert(pvr2, ta->strip_vert_1);
-        pvr2_ta_push_vert(pvr2, ta->strip_vert_2);
-    }
-
     // first update the clipping planes
     /*
      * TODO: there are FPU instructions on x86 that can do this without
@@ -801,22 +881,18 @@ on_pkt_vtx_received(struct pvr2 *pvr2, struct pvr2_pkt const *pkt) {
     memcpy(vert.base_color, vtx->base_color, sizeof(vtx->base_color));
     memcpy(vert.offs_color, vtx->offs_color, sizeof(vtx->offs_color));
 
-    pvr2_ta_push_vert(pvr2, vert);
+    /*
+     * triangle strips are kept intact; every vert is stored once and the
+     * renderer gets an index list with a restart at the end of each strip.
+     * Strips which end before their third vert don't produce any triangles,
+     * and the renderer skips them.
+     */
+    if (pvr2_ta_push_vert(pvr2, &vert) && ++ta->strip_len >= 3)
+        ta->group_tri_count++;
 
     if (vtx->end_of_strip) {
-        /*
-         * TODO: handle degenerate cases where the user sends an
-         * end-of-strip on the first or second vertex
-         */
+        pvr2_ta_end_strip(pvr2);
         ta->strip_len = 0;
-    } else {
-        /*
-         * shift the new vert into strip_vert2 and
-         * shift strip_vert2 into strip_vert1
-         */
-        ta->strip_vert_1 = ta->strip_vert_2;
-        ta->strip_vert_2 = vert;
-        ta->strip_len++;
     }
 }
 
@@ -836,7 +912,7 @@ static void on_pkt_user_clip_received(struct pvr2 *pvr2, struct pvr2_pkt const *
 
 static void handle_packet(struct pvr2 *pvr2) {
     struct pvr2_pkt pkt;
-    uint32_t const *ta_fifo32 = (uint32_t const*)pvr2->ta.ta_fifo32;
+    uint32_t const *ta_fifo32 = pvr2->ta.pkt;
     unsigned cmd_tp = (ta_fifo32[0] & TA_CMD_TYPE_MASK) >> TA_CMD_TYPE_SHIFT;
     struct pvr2_ta *ta = &pvr2->ta;
 
@@ -912,10 +988,58 @@ inline static void input_poly_fifo(struct pvr2 *pvr2, uint32_t byte) {
         handle_packet(pvr2);
 }
 
+void pvr2_ta_fifo_poly_write_bulk(struct pvr2 *pvr2, uint32_t const *words,
+                                  unsigned n_words) {
+    struct pvr2_ta *ta = &pvr2->ta;
+
+    while (n_words) {
+        if (ta->ta_fifo_word_count || n_words < 8) {
+            /*
+             * either part of a packet is already sitting in the FIFO, or
+             * there aren't enough words left to make up a full packet.  Feed
+             * words in until the FIFO is empty again.
+             */
+            input_poly_fifo(pvr2, *words++);
+            n_words--;
+            continue;
+        }
+
+        /*
+         * Decode straight out of the source buffer.  Packets are either 8 or
+         * 16 words long, and the decoders report that they need more words
+         * by leaving ta_fifo_word_count alone.
+         */
+        unsigned pkt_len = 8;
+        ta->pkt = words;
+        ta->ta_fifo_word_count = pkt_len;
+        handle_packet(pvr2);
+        if (ta->ta_fifo_word_count && n_words >= 16) {
+            pkt_len = 16;
+            ta->ta_fifo_word_count = pkt_len;
+            handle_packet(pvr2);
+        }
+        ta->pkt = ta->ta_fifo32;
+
+        if (ta->ta_fifo_word_count) {
+            /*
+             * the packet is longer than what's left in the source buffer;
+             * leave its first half in the FIFO so the next write can finish
+             * it.
+             */
+            pkt_len = 8;
+            memcpy(ta->ta_fifo32, words, pkt_len * sizeof(uint32_t));
+            ta->ta_fifo_word_count = pkt_len;
+        }
+
+        words += pkt_len;
+        n_words -= pkt_len;
+    }
+}
+
 static void dump_fifo(struct pvr2 *pvr2) {
 #ifdef ENABLE_LOG_DEBUG
     unsigned idx;
-    uint32_t const *ta_fifo32 = (uint32_t const*)pvr2->ta.ta_fifo;
+    uint32_t const *ta_fifo32 = pvr2->ta.pkt;
     LOG_DBG("Dumping FIFO: %u bytes\n", pvr2->ta.ta_fifo_word_count*4);
     for (idx = 0; idx < pvr2->ta.ta_fifo_word_count; idx++)
         LOG_DBG("\t0x%08x\n", (unsigned)ta_fifo32[idx]);
@@ -929,7 +1053,7 @@ static int decode_end_of_list(struct pvr2 *pvr2, struct pvr2_pkt *pkt) {
 
 static int decode_vtx(struct pvr2 *pvr2, struct pvr2_pkt *pkt) {
     struct pvr2_ta *ta = &pvr2->ta;
-    uint32_t const *ta_fifo32 = (uint32_t const*)ta->ta_fifo32;
+    uint32_t const *ta_fifo32 = ta->pkt;
 
     if (ta->ta_fifo_word_count < ta->hdr.vtx_len)
         return -1;
@@ -939,6 +1063,13 @@ static int decode_vtx(struct pvr2 *pvr2, struct pvr2_pkt *pkt) {
         RAISE_ERROR(ERROR_INTEGRITY);
     }
 
+    if (ta->hdr.list == DISPLAY_LIST_OPAQUE_MOD ||
+        ta->hdr.list == DISPLAY_LIST_TRANS_MOD) {
+        pkt->tp = PVR2_PKT_MOD_VOL_TRI;
+        memcpy(pkt->dat.mod_vol_tri.pos, ta_fifo32 + 1, 9 * sizeof(float));
+        return 0;
+    }
+
     pkt->tp = PVR2_PKT_VTX;
     struct pvr2_pkt_vtx *vtx = &pkt->dat.vtx;
 
@@ -1092,7 +1223,7 @@ static int decode_vtx(struct pvr2 *pvr2, struct pvr2_pkt *pkt) {
 }
 
 static int decode_user_clip(struct pvr2 *pvr2, struct pvr2_pkt *pkt) {
-    uint32_t const *ta_fifo32 = (uint32_t const*)pvr2->ta.ta_fifo32;
+    uint32_t const *ta_fifo32 = pvr2->ta.pkt;
     struct pvr2_pkt_user_clip *user_clip = &pkt->dat.user_clip;
 
     pkt->tp = PVR2_PKT_USER_CLIP;
@@ -1106,7 +1237,7 @@ static int decode_user_clip(struct pvr2 *pvr2, struct pvr2_pkt *pkt) {
 
 static int decode_poly_hdr(struct pvr2 *pvr2, struct pvr2_pkt *pkt) {
     struct pvr2_ta *ta = &pvr2->ta;
-    uint32_t const *ta_fifo32 = (uint32_t const*)ta->ta_fifo32;
+    uint32_t const *ta_fifo32 = ta->pkt;
     struct pvr2_pkt_hdr *hdr = &pkt->dat.hdr;
 
     unsigned param_tp = (ta_fifo32[0] & TA_CMD_TYPE_MASK) >> TA_CMD_TYPE_SHIFT;
@@ -1249,6 +1380,23 @@ static int decode_poly_hdr(struct pvr2 *pvr2, struct pvr2_pkt *pkt) {
 
     hdr->shadow = (bool)(ta_fifo32[0] & TA_CMD_SHADOW_MASK);
 
+    if (disp_list == DISPLAY_LIST_OPAQUE_MOD ||
+        disp_list == DISPLAY_LIST_TRANS_MOD) {
+        switch ((ta_fifo32[1] & ISP_MOD_VOL_INST_MASK) >>
+                ISP_MOD_VOL_INST_SHIFT) {
+        case 1:
+            hdr->mod_vol_inst = PVR2_MOD_VOL_INSIDE_LAST;
+            break;
+        case 2:
+            hdr->mod_vol_inst = PVR2_MOD_VOL_OUTSIDE_LAST;
+            break;
+        default:
+            hdr->mod_vol_inst = PVR2_MOD_VOL_NORMAL;
+        }
+    } else {
+        hdr->mod_vol_inst = PVR2_MOD_VOL_NORMAL;
+    }
+
     if (((ta_fifo32[0] & TA_CMD_TYPE_MASK) >> TA_CMD_TYPE_SHIFT) ==
         TA_CMD_TYPE_SPRITE_HDR) {
         hdr->tex_coord_16_bit_enable = true; // force this on
@@ -1438,13 +1586,33 @@ void pvr2_ta_startrender(struct pvr2 *pvr2) {
     /* uint32_t backgnd_depth_as_int = get_isp_backgnd_d(); */
     /* memcpy(&geo->bgdepth, &backgnd_depth_as_int, sizeof(float)); */
 
-    pvr2_tex_cache_xmit(pvr2);
+    /*
+     * When we're behind realtime, don't send anything to the renderer.  The
+     * texture cache keeps its dirty pages until the next real render, and
+     * everything the guest can observe (the frame stamp, the display lists
+     * getting reset, the render-complete interrupt) still happens below.
+     * Only renders to a framebuffer that has been scanned out to the display
+     * get skipped; the first render to a new address might be a
+     * render-to-texture or something the CPU reads back, and skipping it would
+     * leave stale data in texture memory.
+     */
+    bool skip_render = frameskip_skipping() &&
+        framebuffer_render_target_skippable(pvr2);
+
+    if (!skip_render)
+        pvr2_tex_cache_xmit(pvr2);
 
     if (ta->cur_list != DISPLAY_LIST_NONE)
         RAISE_ERROR(ERROR_UNIMPLEMENTED);
     /* finish_poly_group(poly_state.current_list); */
 
     int tgt = framebuffer_set_render_target(pvr2);
+    int tgt_obj = framebuffer_get_render_target_obj(pvr2, tgt);
+
+    if (skip_render) {
+        framebuffer_mark_skipped(pvr2, tgt);
+        goto render_done;
+    }
 
     /*
      * This is really driving me insane and I don't know what to do about it.
@@ -1487,7 +1655,7 @@ void pvr2_ta_startrender(struct pvr2 *pvr2) {
     cmd.op = GFX_IL_BEGIN_REND;
     cmd.arg.begin_rend.screen_width = width;
     cmd.arg.begin_rend.screen_height = height;
-    cmd.arg.begin_rend.rend_tgt_obj = tgt;
+    cmd.arg.begin_rend.rend_tgt_obj = tgt_obj;
     rend_exec_il(&cmd, 1);
 
     cmd.op = GFX_IL_SET_CLIP_RANGE;
@@ -1503,10 +1671,37 @@ void pvr2_ta_startrender(struct pvr2 *pvr2) {
     cmd.arg.clear.bgcolor[3] = ta->pvr2_bgcolor[3];
     rend_exec_il(&cmd, 1);
 
-    // execute queued gfx_il commands
-    enum display_list_type list;
-    for (list = DISPLAY_LIST_FIRST; list <= DISPLAY_LIST_LAST; list++) {
+    /*
+     * execute queued gfx_il commands.  The lists go in the same order the
+     * hardware renders them in so that each modifier volume list gets applied
+     * to everything drawn before it.
+     */
+    static enum display_list_type const list_order[] = {
+        DISPLAY_LIST_OPAQUE,
+        DISPLAY_LIST_PUNCH_THROUGH,
+        DISPLAY_LIST_OPAQUE_MOD,
+        DISPLAY_LIST_TRANS,
+        DISPLAY_LIST_TRANS_MOD
+    };
+    /*
+     * bit 8 of FPU_SHAD_SCALE enables "cheap shadow" mode, where polygons
+     * inside a modifier volume just get their color scaled.  Without it,
+     * polygons inside a modifier volume get drawn with their second
+     * parameter set instead, which isn't implemented yet, so in that case
+     * the modifier volumes are dropped.
+     */
+    bool cheap_shadow = pvr2->reg_backing[PVR2_FPU_SHAD_SCALE] & (1 << 8);
+
+    unsigned list_idx;
+    for (list_idx = 0; list_idx < sizeof(list_order) / sizeof(list_order[0]);
+         list_idx++) {
+        enum display_list_type list = list_order[list_idx];
         bool sort_mode = false;
+
+        if ((list == DISPLAY_LIST_OPAQUE_MOD ||
+             list == DISPLAY_LIST_TRANS_MOD) && !cheap_shadow)
+            continue;
+
         if (list == DISPLAY_LIST_TRANS) {
             /*
              * order-independent transparency is enabled when bit 0 of
@@ -1527,13 +1722,26 @@ void pvr2_ta_startrender(struct pvr2 *pvr2) {
             cmd.op = GFX_IL_END_DEPTH_SORT;
             rend_exec_il(&cmd, 1);
         }
+
+        if ((list == DISPLAY_LIST_OPAQUE_MOD ||
+             list == DISPLAY_LIST_TRANS_MOD) && ta->disp_list_begin[list]) {
+            /*
+             * In cheap-shadow mode, the low 8 bits of FPU_SHAD_SCALE are the
+             * intensity that shadowed pixels get scaled by.
+             */
+            cmd.op = GFX_IL_APPLY_MOD_VOL;
+            cmd.arg.apply_mod_vol.shadow_scale =
+                (pvr2->reg_backing[PVR2_FPU_SHAD_SCALE] & 0xff) / 256.0f;
+            rend_exec_il(&cmd, 1);
+        }
     }
 
     // tear down rendering context
     cmd.op = GFX_IL_END_REND;
-    cmd.arg.end_rend.rend_tgt_obj = tgt;
+    cmd.arg.end_rend.rend_tgt_obj = tgt_obj;
     rend_exec_il(&cmd, 1);
 
+render_done:
     ta->next_frame_stamp++;
     render_frame_init(pvr2);
 
@@ -1559,11 +1767,22 @@ static void next_poly_group(struct pvr2 *pvr2, enum display_list_type disp_list)
         return;
     }
 
+    /*
+     * a modifier volume can span several headers; it doesn't end until the
+     * previous header said that it was the last one.
+     */
+    if ((disp_list == DISPLAY_LIST_OPAQUE_MOD ||
+         disp_list == DISPLAY_LIST_TRANS_MOD) &&
+        ta->hdr.mod_vol_inst == PVR2_MOD_VOL_NORMAL)
+        return;
+
     if (ta->open_group)
         finish_poly_group(pvr2, disp_list);
     ta->open_group = true;
 
     ta->pvr2_ta_vert_cur_group = ta->pvr2_ta_vert_buf_count;
+    ta->pvr2_ta_idx_cur_group = ta->pvr2_ta_idx_buf_count;
+    ta->group_tri_count = 0;
 }
 
 static void finish_poly_group(struct pvr2 *pvr2, enum display_list_type disp_list) {
@@ -1576,17 +1795,34 @@ static void finish_poly_group(struct pvr2 *pvr2, enum display_list_type disp_lis
         return;
     }
 
-    // filter out modifier volumes from being rendered
-    if (disp_list == DISPLAY_LIST_OPAQUE_MOD ||
-        disp_list == DISPLAY_LIST_TRANS_MOD)
-        return;
-
     if (!ta->open_group) {
         LOG_WARN("%s - still waiting for a polygon header to be opened!\n",
                __func__);
         return;
     }
 
+    if (disp_list == DISPLAY_LIST_OPAQUE_MOD ||
+        disp_list == DISPLAY_LIST_TRANS_MOD) {
+        pvr2->stat.per_frame_counters.poly_count[disp_list] +=
+            ta->group_tri_count;
+
+        cmd.op = GFX_IL_DRAW_MOD_VOL;
+        cmd.arg.draw_mod_vol.n_verts =
+            ta->pvr2_ta_vert_buf_count - ta->pvr2_ta_vert_cur_group;
+        cmd.arg.draw_mod_vol.verts =
+            ta->pvr2_ta_vert_buf + ta->pvr2_ta_vert_cur_group;
+        cmd.arg.draw_mod_vol.exclude =
+            (ta->hdr.mod_vol_inst == PVR2_MOD_VOL_OUTSIDE_LAST);
+        pvr2_ta_push_gfx_il(pvr2, cmd);
+
+        ta->pvr2_ta_vert_cur_group = ta->pvr2_ta_vert_buf_count;
+        ta->pvr2_ta_idx_cur_group = ta->pvr2_ta_idx_buf_count;
+        ta->group_tri_count = 0;
+
+        ta->open_group = false;
+        return;
+    }
+
     cmd.op = GFX_IL_SET_REND_PARAM;
     if (ta->hdr.tex_enable) {
         PVR2_TRACE("tex_enable should be true\n");
@@ -1605,6 +1841,7 @@ static void finish_poly_group(struct pvr2 *pvr2, enum display_list_type disp_lis
     cmd.arg.set_rend_param.param.enable_depth_writes =
         ta->hdr.enable_depth_writes;
     cmd.arg.set_rend_param.param.depth_func = ta->hdr.depth_func;
+    cmd.arg.set_rend_param.param.shadow = ta->hdr.shadow;
 
     cmd.arg.set_rend_param.param.tex_inst = ta->hdr.tex_inst;
     cmd.arg.set_rend_param.param.tex_filter = ta->hdr.tex_filter;
@@ -1641,15 +1878,21 @@ static void finish_poly_group(struct pvr2 *pvr2, enum display_list_type disp_lis
     pvr2_ta_push_gfx_il(pvr2, cmd);
 
     unsigned n_verts = ta->pvr2_ta_vert_buf_count - ta->pvr2_ta_vert_cur_group;
-    pvr2->stat.per_frame_counters.poly_count[disp_list] += n_verts / 3;
+    unsigned n_indices = ta->pvr2_ta_idx_buf_count - ta->pvr2_ta_idx_cur_group;
+    pvr2->stat.per_frame_counters.poly_count[disp_list] += ta->group_tri_count;
 
     cmd.op = GFX_IL_DRAW_ARRAY;
     cmd.arg.draw_array.n_verts = n_verts;
     cmd.arg.draw_array.verts =
-        ta->pvr2_ta_vert_buf + ta->pvr2_ta_vert_cur_group * GFX_VERT_LEN;
+        ta->pvr2_ta_vert_buf + ta->pvr2_ta_vert_cur_group;
+    cmd.arg.draw_array.n_indices = n_indices;
+    cmd.arg.draw_array.indices =
+        ta->pvr2_ta_idx_buf + ta->pvr2_ta_idx_cur_group;
     pvr2_ta_push_gfx_il(pvr2, cmd);
 
     ta->pvr2_ta_vert_cur_group = ta->pvr2_ta_vert_buf_count;
+    ta->pvr2_ta_idx_cur_group = ta->pvr2_ta_idx_buf_count;
+    ta->group_tri_count = 0;
 
     ta->open_group = false;
 }
@@ -1664,6 +1907,9 @@ static void render_frame_init(struct pvr2 *pvr2) {
     // free vertex arrays
     ta->pvr2_ta_vert_buf_count = 0;
     ta->pvr2_ta_vert_cur_group = 0;
+    ta->pvr2_ta_idx_buf_count = 0;
+    ta->pvr2_ta_idx_cur_group = 0;
+    ta->group_tri_count = 0;
 
     ta->open_group = false;
 
@@ -111,6 +111,14 @@ void pvr2_ta_fifo_poly_write_16(addr32_t addr, uint16_t val, void *ctxt);
 uint8_t pvr2_ta_fifo_poly_read_8(addr32_t addr, void *ctxt);
 void pvr2_ta_fifo_poly_write_8(addr32_t addr, uint8_t val, void *ctxt);
 
+/*
+ * feed a block of words to the TA polygon FIFO.  Whole packets are decoded
+ * in-place from words, so this is much faster than calling
+ * pvr2_ta_fifo_poly_write_32 once per word.
+ */
+void pvr2_ta_fifo_poly_write_bulk(struct pvr2 *pvr2, uint32_t const *words,
+                                  unsigned n_words);
+
 extern struct memory_interface pvr2_ta_fifo_intf;
 
 void pvr2_ta_startrender(struct pvr2 *pvr2);
@@ -168,7 +176,8 @@ enum pvr2_pkt_tp {
     PVR2_PKT_VTX,
     PVR2_PKT_END_OF_LIST,
     PVR2_PKT_INPUT_LIST,
-    PVR2_PKT_USER_CLIP
+    PVR2_PKT_USER_CLIP,
+    PVR2_PKT_MOD_VOL_TRI
 };
 
 struct pvr2_pkt_vtx {
@@ -180,6 +189,22 @@ struct pvr2_pkt_vtx {
     bool end_of_strip;
 };
 
+// one triangle of a modifier volume
+struct pvr2_pkt_mod_vol_tri {
+    float pos[3][3];
+};
+
+/*
+ * The volume instruction in a modifier volume's header says whether the
+ * triangles which follow are the last ones in their volume.  A volume keeps
+ * going across headers until one of them is marked as the last.
+ */
+enum pvr2_mod_vol_inst {
+    PVR2_MOD_VOL_NORMAL,
+    PVR2_MOD_VOL_INSIDE_LAST,
+    PVR2_MOD_VOL_OUTSIDE_LAST
+};
+
 enum pvr2_hdr_tp {
     PVR2_HDR_TRIANGLE_STRIP,
     PVR2_HDR_QUAD
@@ -223,6 +248,10 @@ struct pvr2_pkt_hdr {
 
     bool shadow;
     bool two_volumes_mode;
+
+    // only meaningful for headers in the modifier volume lists
+    enum pvr2_mod_vol_inst mod_vol_inst;
+
     /* enum ta_color_type color_type; */
     bool offset_color_enable;
     bool gourad_shading_enable;
@@ -245,6 +274,7 @@ struct pvr2_pkt_user_clip {
 
 union pvr2_pkt_inner {
     struct pvr2_pkt_vtx vtx;
+    struct pvr2_pkt_mod_vol_tri mod_vol_tri;
     struct pvr2_pkt_hdr hdr;
     struct pvr2_pkt_user_clip user_clip;
 };
@@ -279,16 +309,16 @@ struct pvr2_ta {
     uint32_t ta_fifo32[PVR2_CMD_MAX_LEN];
     unsigned ta_fifo_word_count;
 
+    /*
+     * the packet being decoded.  This normally points at ta_fifo32, but bulk
+     * writes point it directly at the source buffer to avoid a copy.
+     */
+    uint32_t const *pkt;
+
     bool list_submitted[DISPLAY_LIST_COUNT];
 
     struct pvr2_pkt_hdr hdr;
 
-    /*
-     * used to store the previous two verts when we're
-     * rendering a triangle strip
-     */
-    struct pvr2_ta_vert strip_vert_1;
-    struct pvr2_ta_vert strip_vert_2;
     unsigned strip_len; // number of verts in the current triangle strip
 
     float clip_min, clip_max;
@@ -298,10 +328,22 @@ struct pvr2_ta {
 
     bool open_group;
 
-    float *pvr2_ta_vert_buf;
+    struct gfx_vert *pvr2_ta_vert_buf;
     unsigned pvr2_ta_vert_buf_count;
     unsigned pvr2_ta_vert_cur_group;
 
+    /*
+     * triangle-strip indices for the verts in pvr2_ta_vert_buf.  Indices are
+     * relative to the first vert in the current polygon group and each strip
+     * is terminated by GFX_PRIM_RESTART.
+     */
+    uint32_t *pvr2_ta_idx_buf;
+    unsigned pvr2_ta_idx_buf_count;
+    unsigned pvr2_ta_idx_cur_group;
+
+    // number of triangles in the current polygon group
+    unsigned group_tri_count;
+
     struct gfx_il_inst_chain *disp_list_begin[DISPLAY_LIST_COUNT];
     struct gfx_il_inst_chain *disp_list_end[DISPLAY_LIST_COUNT];
 
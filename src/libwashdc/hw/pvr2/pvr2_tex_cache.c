@@ -35,8 +35,10 @@
 #include "washdc/error.h"
 #include "gfx/gfx_il.h"
 #include "gfx/gfx_tex_cache.h"
+#include "gfx/gfx_hash.h"
 #include "dreamcast.h"
 #include "pvr2_reg.h"
+#include "washdc/config_file.h"
 
 #include "pvr2_tex_cache.h"
 
@@ -85,6 +87,26 @@ static unsigned tex_twiddle(unsigned x, unsigned y,
 static enum gfx_tex_fmt
 translate_palette_to_pix_format(enum palette_tp palette_tp);
 
+static uint64_t pvr2_tex_src_hash(struct pvr2 *pvr2,
+                                  struct pvr2_tex_meta const *meta);
+static bool pvr2_tex_obj_shared(struct pvr2 *pvr2, struct pvr2_tex const *tex);
+static void pvr2_tex_release_obj(struct pvr2 *pvr2, struct pvr2_tex *tex);
+
+static void pvr2_tex_cache_grow(struct pvr2 *pvr2);
+static void pvr2_tex_cache_evict(struct pvr2 *pvr2, struct pvr2_tex *tex);
+static void pvr2_tex_cache_make_room(struct pvr2 *pvr2, size_t n_bytes);
+static void pvr2_tex_lru_unlink(struct pvr2_tex_cache *cache,
+                                struct pvr2_tex *tex);
+static void pvr2_tex_lru_push(struct pvr2_tex_cache *cache,
+                              struct pvr2_tex *tex);
+static unsigned pvr2_tex_hash_bucket(uint32_t addr);
+static unsigned pvr2_tex_src_hash_bucket(uint64_t src_hash);
+static void pvr2_tex_src_link(struct pvr2_tex_cache *cache,
+                              struct pvr2_tex *tex);
+static void pvr2_tex_src_unlink(struct pvr2_tex_cache *cache,
+                                struct pvr2_tex *tex);
+static void pvr2_tex_update_stat(struct pvr2 *pvr2);
+
 /*
  * maps from a normal row-major configuration to the
  * pvr2's own "twiddled" format.
@@ -147,22 +169,209 @@ static unsigned tex_twiddle(unsigned x, unsigned y, unsigned w_shift, unsigned h
 void pvr2_tex_cache_init(struct pvr2 *pvr2) {
     struct pvr2_tex_cache *cache = &pvr2->tex_cache;
 
-    unsigned idx;
-    for (idx = 0; idx < PVR2_TEX_CACHE_SIZE; idx++) {
-        memset(cache->tex_cache + idx, 0, sizeof(cache->tex_cache[idx]));
-        cache->tex_cache[idx].obj_no = -1;
+    memset(cache, 0, sizeof(*cache));
+    cache->lru_head = cache->lru_tail = cache->free_head = -1;
+
+    unsigned bucket;
+    for (bucket = 0; bucket < PVR2_TEX_HASH_BUCKETS; bucket++) {
+        cache->hash_buckets[bucket] = -1;
+        cache->src_hash_buckets[bucket] = -1;
     }
 
-    memset(cache->page_stamps, 0, sizeof(cache->page_stamps));
+    int budget_mb;
+    if (cfg_get_int("gfx.tex-cache.budget-mb", &budget_mb) != 0 ||
+        budget_mb <= 0) {
+        budget_mb = PVR2_TEX_CACHE_DEFAULT_BUDGET_MB;
+    }
+    cache->budget = (size_t)budget_mb * 1024 * 1024;
+    LOG_INFO("PVR2: texture cache budget is %d MB\n", budget_mb);
+
+    pvr2_tex_cache_grow(pvr2);
+    pvr2_tex_update_stat(pvr2);
 }
 
 void pvr2_tex_cache_cleanup(struct pvr2 *pvr2) {
     struct pvr2_tex_cache *cache = &pvr2->tex_cache;
 
     unsigned idx;
-    for (idx = 0; idx < PVR2_TEX_CACHE_SIZE; idx++)
-        if (cache->tex_cache[idx].obj_no >= 0)
-            pvr2_free_gfx_obj(cache->tex_cache[idx].obj_no);
+    for (idx = 0; idx < cache->n_slots; idx++) {
+        struct pvr2_tex *tex = cache->tex_cache + idx;
+        if (tex->obj_no >= 0) {
+            // shared gfx_objs get freed by the last texture that uses them
+            if (--cache->obj_refs[tex->obj_no] == 0) {
+                cache->n_bytes -= cache->obj_bytes[tex->obj_no];
+                cache->obj_bytes[tex->obj_no] = 0;
+                pvr2_free_gfx_obj(tex->obj_no);
+            }
+            tex->obj_no = -1;
+        }
+    }
+
+    free(cache->tex_cache);
+    cache->tex_cache = NULL;
+    cache->n_slots = 0;
+}
+
+/*
+ * double the number of slots in the cache.  The new slots all go on the free
+ * list.  Slot indices stay the same, but any pointers into the cache are
+ * invalidated.
+ */
+static void pvr2_tex_cache_grow(struct pvr2 *pvr2) {
+    struct pvr2_tex_cache *cache = &pvr2->tex_cache;
+    unsigned old_n_slots = cache->n_slots;
+    unsigned new_n_slots = old_n_slots ?
+        2 * old_n_slots : PVR2_TEX_CACHE_INITIAL_SIZE;
+
+    if (new_n_slots > PVR2_TEX_CACHE_SIZE)
+        new_n_slots = PVR2_TEX_CACHE_SIZE;
+    if (new_n_slots <= old_n_slots)
+        return;
+
+    struct pvr2_tex *tex_cache =
+        realloc(cache->tex_cache, new_n_slots * sizeof(struct pvr2_tex));
+    if (!tex_cache)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+
+    /*
+     * push the new slots onto the free list in reverse order so that they
+     * get used in ascending order.
+     */
+    unsigned idx;
+    for (idx = new_n_slots; idx > old_n_slots; idx--) {
+        struct pvr2_tex *tex = tex_cache + (idx - 1);
+        memset(tex, 0, sizeof(*tex));
+        tex->obj_no = -1;
+        tex->state = PVR2_TEX_INVALID;
+        tex->lru_prev = -1;
+        tex->hash_next = -1;
+        tex->src_hash_next = -1;
+        tex->lru_next = cache->free_head;
+        cache->free_head = idx - 1;
+    }
+
+    cache->tex_cache = tex_cache;
+    cache->n_slots = new_n_slots;
+}
+
+unsigned pvr2_tex_cache_n_slots(struct pvr2 *pvr2) {
+    return pvr2->tex_cache.n_slots;
+}
+
+static void pvr2_tex_update_stat(struct pvr2 *pvr2) {
+    struct pvr2_tex_cache const *cache = &pvr2->tex_cache;
+    pvr2->stat.tex_cache.n_bytes = cache->n_bytes;
+    pvr2->stat.tex_cache.budget = cache->budget;
+    pvr2->stat.tex_cache.n_resident = cache->n_resident;
+    pvr2->stat.tex_cache.n_slots = cache->n_slots;
+}
+
+// remove the given texture from the LRU list
+static void pvr2_tex_lru_unlink(struct pvr2_tex_cache *cache,
+                                struct pvr2_tex *tex) {
+    if (tex->lru_prev >= 0)
+        cache->tex_cache[tex->lru_prev].lru_next = tex->lru_next;
+    else
+        cache->lru_head = tex->lru_next;
+
+    if (tex->lru_next >= 0)
+        cache->tex_cache[tex->lru_next].lru_prev = tex->lru_prev;
+    else
+        cache->lru_tail = tex->lru_prev;
+
+    tex->lru_prev = tex->lru_next = -1;
+}
+
+// insert the given texture at the most-recently-used end of the LRU list
+static void pvr2_tex_lru_push(struct pvr2_tex_cache *cache,
+                              struct pvr2_tex *tex) {
+    int idx = tex - cache->tex_cache;
+
+    tex->lru_prev = -1;
+    tex->lru_next = cache->lru_head;
+    if (cache->lru_head >= 0)
+        cache->tex_cache[cache->lru_head].lru_prev = idx;
+    else
+        cache->lru_tail = idx;
+    cache->lru_head = idx;
+}
+
+static unsigned pvr2_tex_hash_bucket(uint32_t addr) {
+    return (uint32_t)(addr * 0x9e3779b1) >> (32 - PVR2_TEX_HASH_SHIFT);
+}
+
+// src_hash is already well-mixed, so its top bits can be used directly
+static unsigned pvr2_tex_src_hash_bucket(uint64_t src_hash) {
+    return src_hash >> (64 - PVR2_TEX_HASH_SHIFT);
+}
+
+// add the given texture to the bucket for its src_hash
+static void pvr2_tex_src_link(struct pvr2_tex_cache *cache,
+                              struct pvr2_tex *tex) {
+    unsigned bucket = pvr2_tex_src_hash_bucket(tex->src_hash);
+    tex->src_hash_next = cache->src_hash_buckets[bucket];
+    cache->src_hash_buckets[bucket] = tex - cache->tex_cache;
+}
+
+// remove the given texture from the bucket for its src_hash
+static void pvr2_tex_src_unlink(struct pvr2_tex_cache *cache,
+                                struct pvr2_tex *tex) {
+    int idx = tex - cache->tex_cache;
+    int *linkp = cache->src_hash_buckets +
+        pvr2_tex_src_hash_bucket(tex->src_hash);
+    while (*linkp != idx)
+        linkp = &cache->tex_cache[*linkp].src_hash_next;
+    *linkp = tex->src_hash_next;
+    tex->src_hash_next = -1;
+}
+
+/*
+ * kick the given texture out of the cache.  Its slot goes back onto the free
+ * list.
+ */
+static void pvr2_tex_cache_evict(struct pvr2 *pvr2, struct pvr2_tex *tex) {
+    struct pvr2_tex_cache *cache = &pvr2->tex_cache;
+    int idx = tex - cache->tex_cache;
+
+    pvr2_tex_release_obj(pvr2, tex);
+
+    int *linkp = cache->hash_buckets +
+        pvr2_tex_hash_bucket(tex->meta.addr_first);
+    while (*linkp != idx)
+        linkp = &cache->tex_cache[*linkp].hash_next;
+    *linkp = tex->hash_next;
+    tex->hash_next = -1;
+
+    pvr2_tex_lru_unlink(cache, tex);
+
+    cache->n_resident--;
+    tex->state = PVR2_TEX_INVALID;
+    tex->lru_next = cache->free_head;
+    cache->free_head = idx;
+}
+
+/*
+ * Get back under the budget with room for n_bytes more by kicking out
+ * textures, least-recently used first.  Textures that were used this frame
+ * are never evicted since they are still needed for rendering; if the tail of
+ * the LRU list was used this frame then so was everything else, so the budget
+ * just gets exceeded until the next frame.
+ *
+ * Evicting a texture whose gfx_obj is shared does not free anything, but the
+ * loop still terminates because every iteration removes one texture.
+ */
+static void pvr2_tex_cache_make_room(struct pvr2 *pvr2, size_t n_bytes) {
+    struct pvr2_tex_cache *cache = &pvr2->tex_cache;
+    unsigned cur_frame_stamp = get_cur_frame_stamp(pvr2);
+
+    while (cache->lru_tail >= 0 && cache->n_bytes + n_bytes > cache->budget) {
+        struct pvr2_tex *tex = cache->tex_cache + cache->lru_tail;
+        if (tex->frame_stamp_last_used >= cur_frame_stamp)
+            break;
+        pvr2->stat.persistent_counters.tex_budget_eviction_count++;
+        pvr2->stat.persistent_counters.texture_overwrite_count++;
+        pvr2_tex_cache_evict(pvr2, tex);
+    }
 }
 
 struct pvr2_tex_hash {
@@ -207,9 +416,8 @@ struct pvr2_tex *pvr2_tex_cache_find(struct pvr2 *pvr2,
                                      int tex_fmt, bool twiddled,
                                      bool vq_compression, bool mipmap,
                                      bool stride_sel) {
-    unsigned idx;
+    struct pvr2_tex_cache *cache = &pvr2->tex_cache;
     struct pvr2_tex *tex;
-    struct pvr2_tex *tex_cache = pvr2->tex_cache.tex_cache;
 
     struct pvr2_tex_hash search_hash = {
         .addr_first = addr,
@@ -222,11 +430,10 @@ struct pvr2_tex *pvr2_tex_cache_find(struct pvr2 *pvr2,
         .tex_palette_start = pal_addr
     };
 
-    for (idx = 0; idx < PVR2_TEX_CACHE_SIZE; idx++) {
-        tex = tex_cache + idx;
-
-        if (!pvr2_tex_valid(tex->state))
-            continue;
+    int idx;
+    for (idx = cache->hash_buckets[pvr2_tex_hash_bucket(addr)];
+         idx >= 0; idx = tex->hash_next) {
+        tex = cache->tex_cache + idx;
 
         struct pvr2_tex_meta *meta = &tex->meta;
 
@@ -243,6 +450,8 @@ struct pvr2_tex *pvr2_tex_cache_find(struct pvr2 *pvr2,
 
         if (pvr2_tex_hash_eq(&search_hash, &tex_hash)) {
             tex->frame_stamp_last_used = get_cur_frame_stamp(pvr2);
+            pvr2_tex_lru_unlink(cache, tex);
+            pvr2_tex_lru_push(cache, tex);
             return tex;
         }
     }
@@ -270,45 +479,49 @@ struct pvr2_tex *pvr2_tex_cache_add(struct pvr2 *pvr2,
     }
 #endif
 
-    unsigned idx;// = addr & PVR2_TEX_CACHE_MASK;
-    struct pvr2_tex *tex_cache = pvr2->tex_cache.tex_cache;
-    struct pvr2_tex *tex, *oldest_tex = NULL;
-    for (idx = 0; idx < PVR2_TEX_CACHE_SIZE; idx++) {
-        tex = tex_cache + idx;
-
-        if (!pvr2_tex_valid(tex->state))
-            break;
+    struct pvr2_tex_cache *cache = &pvr2->tex_cache;
+    struct pvr2_tex *tex;
+    enum gfx_tex_fmt pix_fmt;
 
-        if (tex->frame_stamp_last_used < cur_frame_stamp) {
-            if (!oldest_tex ||
-                tex->frame_stamp_last_used < oldest_tex->frame_stamp_last_used)
-                oldest_tex = tex;
-        }
+    if (tex_fmt != TEX_CTRL_PIX_FMT_4_BPP_PAL &&
+        tex_fmt != TEX_CTRL_PIX_FMT_8_BPP_PAL) {
+        pix_fmt = pvr2_tex_fmt_to_gfx(tex_fmt);
+    } else {
+        pix_fmt = translate_palette_to_pix_format(get_palette_tp(pvr2));
     }
 
-    if (idx >= PVR2_TEX_CACHE_SIZE) {
+    if (cache->free_head < 0)
+        pvr2_tex_cache_grow(pvr2);
+
+    if (cache->free_head < 0) {
         // kick the oldest tex out of the cache to make room
 
         pvr2->stat.persistent_counters.texture_overwrite_count++;
 
-        if (oldest_tex) {
-            tex = oldest_tex;
+        if (cache->lru_tail >= 0 &&
+            cache->tex_cache[cache->lru_tail].frame_stamp_last_used <
+            cur_frame_stamp) {
+            pvr2_tex_cache_evict(pvr2, cache->tex_cache + cache->lru_tail);
         } else {
             LOG_ERROR("ERROR: TEXTURE CACHE OVERFLOW\n");
+            pvr2_tex_update_stat(pvr2);
             return NULL;
         }
-
-        if (tex->obj_no >= 0) {
-            struct gfx_il_inst cmd;
-            cmd.op = GFX_IL_FREE_OBJ;
-            cmd.arg.free_obj.obj_no = tex->obj_no;
-            rend_exec_il(&cmd, 1);
-            pvr2_free_gfx_obj(tex->obj_no);
-        }
     } else {
         pvr2->stat.persistent_counters.fresh_texture_upload_count++;
     }
 
+    int idx = cache->free_head;
+    tex = cache->tex_cache + idx;
+    cache->free_head = tex->lru_next;
+
+    unsigned bucket = pvr2_tex_hash_bucket(addr);
+    tex->hash_next = cache->hash_buckets[bucket];
+    cache->hash_buckets[bucket] = idx;
+    pvr2_tex_lru_push(cache, tex);
+
+    cache->n_resident++;
+
     tex->meta.addr_first = addr;
     tex->meta.w_shift = w_shift;
     tex->meta.h_shift = h_shift;
@@ -320,13 +533,7 @@ struct pvr2_tex *pvr2_tex_cache_add(struct pvr2 *pvr2,
     tex->meta.tex_palette_start = pal_addr;
     tex->frame_stamp_last_used = cur_frame_stamp;
     tex->obj_no = -1;
-
-    if (tex_fmt != TEX_CTRL_PIX_FMT_4_BPP_PAL &&
-        tex_fmt != TEX_CTRL_PIX_FMT_8_BPP_PAL) {
-        tex->meta.pix_fmt = pvr2_tex_fmt_to_gfx(tex_fmt);
-    } else {
-        tex->meta.pix_fmt = translate_palette_to_pix_format(get_palette_tp(pvr2));
-    }
+    tex->meta.pix_fmt = pix_fmt;
 
     if (tex->meta.vq_compression && (tex->meta.w_shift != tex->meta.h_shift)) {
         LOG_WARN("PVR2: WARNING - DISABLING VQ COMPRESSION FOR 0x%x "
@@ -377,6 +584,7 @@ struct pvr2_tex *pvr2_tex_cache_add(struct pvr2 *pvr2,
 
     tex->state = PVR2_TEX_DIRTY;
     tex->last_update = 0;
+    pvr2_tex_update_stat(pvr2);
     /*
      * We defer reading the actual data from texture memory until we're ready
      * to transmit this to the rendering thread.
@@ -424,9 +632,9 @@ pvr2_tex_cache_notify_palette_write(struct pvr2 *pvr2,
 
 void pvr2_tex_cache_notify_palette_tp_change(struct pvr2 *pvr2) {
     unsigned idx;
-    struct pvr2_tex *tex_cache = pvr2->tex_cache.tex_cache;
-    for (idx = 0; idx < PVR2_TEX_CACHE_SIZE; idx++) {
-        struct pvr2_tex *tex = tex_cache + idx;
+    struct pvr2_tex_cache *cache = &pvr2->tex_cache;
+    for (idx = 0; idx < cache->n_slots; idx++) {
+        struct pvr2_tex *tex = cache->tex_cache + idx;
         if (tex->state == PVR2_TEX_READY &&
             (tex->meta.tex_fmt == TEX_CTRL_PIX_FMT_4_BPP_PAL ||
              tex->meta.tex_fmt == TEX_CTRL_PIX_FMT_8_BPP_PAL)) {
@@ -795,7 +1003,7 @@ void pvr2_tex_cache_xmit(struct pvr2 *pvr2) {
     dc_cycle_stamp_t *page_stamps = cache->page_stamps;
     struct pvr2_tex *tex_cache = pvr2->tex_cache.tex_cache;
 
-    for (idx = 0; idx < PVR2_TEX_CACHE_SIZE; idx++) {
+    for (idx = 0; idx < cache->n_slots; idx++) {
         struct pvr2_tex *tex_in = tex_cache + idx;
 
         if (tex_in->state != PVR2_TEX_INVALID) {
@@ -821,50 +1029,96 @@ void pvr2_tex_cache_xmit(struct pvr2 *pvr2) {
             }
         }
 
-        if (need_update) {
-            pvr2->stat.persistent_counters.tex_xmit_count++;
+        if (!need_update)
+            continue;
 
-            /*
-             * If the texture has been written to this frame but it is not
-             * actively in use then tell the gfx system to evict it from the
-             * cache.
-             */
-            if (tex_in->frame_stamp_last_used != cur_frame_stamp) {
-                pvr2->stat.persistent_counters.tex_eviction_count++;
+        /*
+         * If the texture has been written to this frame but it is not
+         * actively in use then tell the gfx system to evict it from the
+         * cache.
+         */
+        if (tex_in->frame_stamp_last_used != cur_frame_stamp) {
+            pvr2->stat.persistent_counters.tex_xmit_count++;
+            pvr2->stat.persistent_counters.tex_eviction_count++;
 
-                tex_in->state = PVR2_TEX_INVALID;
+            pvr2_tex_cache_evict(pvr2, tex_in);
+            continue;
+        }
 
-                cmd.op = GFX_IL_UNBIND_TEX;
-                cmd.arg.unbind_tex.tex_no = idx;
-                rend_exec_il(&cmd, 1);
+        /*
+         * A lot of games rewrite texture memory with the exact same data
+         * every frame, so the texture only gets re-read if its source data
+         * actually changed since the last time it was sent.
+         */
+        uint64_t src_hash = pvr2_tex_src_hash(pvr2, &tex_in->meta);
+        if (tex_in->obj_no >= 0 && tex_in->src_hash == src_hash) {
+            pvr2->stat.persistent_counters.tex_hash_match_count++;
+            tex_in->state = PVR2_TEX_READY;
+            tex_in->last_update = clock_cycle_stamp(pvr2->clk);
+            continue;
+        }
 
-                cmd.op = GFX_IL_FREE_OBJ;
-                cmd.arg.free_obj.obj_no = tex_in->obj_no;
-                rend_exec_il(&cmd, 1);
+        /*
+         * if the old data is still being used by another texture then this
+         * texture needs a gfx_obj of its own for the new data.
+         */
+        if (tex_in->obj_no >= 0 && pvr2_tex_obj_shared(pvr2, tex_in))
+            pvr2_tex_release_obj(pvr2, tex_in);
 
-                pvr2_free_gfx_obj(tex_in->obj_no);
-                tex_in->obj_no = -1;
+        struct pvr2_tex_meta tmp = tex_in->meta;
+        if (tex_in->meta.tex_fmt == TEX_CTRL_PIX_FMT_8_BPP_PAL ||
+            tex_in->meta.tex_fmt == TEX_CTRL_PIX_FMT_4_BPP_PAL) {
+            tmp.pix_fmt = translate_palette_to_pix_format(get_palette_tp(pvr2));
+        }
 
-                continue;
+        if (tex_in->obj_no < 0) {
+            /*
+             * look for another texture which has the same source data and is
+             * decoded the same way; if there is one then its gfx_obj already
+             * holds exactly what this texture would upload.
+             */
+            struct pvr2_tex const *twin = NULL;
+            int other;
+            for (other = cache->src_hash_buckets[
+                     pvr2_tex_src_hash_bucket(src_hash)];
+                 other >= 0; other = tex_cache[other].src_hash_next) {
+                struct pvr2_tex const *cand = tex_cache + other;
+                if (cand->state == PVR2_TEX_READY &&
+                    cand->src_hash == src_hash &&
+                    cand->meta.w_shift == tmp.w_shift &&
+                    cand->meta.h_shift == tmp.h_shift &&
+                    cand->meta.tex_fmt == tmp.tex_fmt &&
+                    cand->meta.pix_fmt == tmp.pix_fmt &&
+                    cand->meta.twiddled == tmp.twiddled &&
+                    cand->meta.vq_compression == tmp.vq_compression &&
+                    cand->meta.mipmap == tmp.mipmap &&
+                    cand->meta.stride_sel == tmp.stride_sel) {
+                    twin = cand;
+                    break;
+                }
             }
 
-            if (tex_in->obj_no < 0) {
+            if (twin) {
+                pvr2->stat.persistent_counters.tex_dedup_count++;
+                tex_in->obj_no = twin->obj_no;
+                cache->obj_refs[tex_in->obj_no]++;
+            } else {
                 /*
                  * This is a new texture; we need to create a data store,
                  * upload the texture and bind the store to the texture object.
                  */
-                tex_in->obj_no = pvr2_alloc_gfx_obj();
+                pvr2->stat.persistent_counters.tex_xmit_count++;
 
                 void *tex_dat;
                 size_t n_bytes;
-                struct pvr2_tex_meta tmp = tex_in->meta;
-                if (tex_in->meta.tex_fmt == TEX_CTRL_PIX_FMT_8_BPP_PAL ||
-                    tex_in->meta.tex_fmt == TEX_CTRL_PIX_FMT_4_BPP_PAL) {
-                    tmp.pix_fmt =
-                        translate_palette_to_pix_format(get_palette_tp(pvr2));
-                }
                 pvr2_tex_cache_read(pvr2, &tex_dat, &n_bytes, &tmp);
 
+                pvr2_tex_cache_make_room(pvr2, n_bytes);
+                tex_in->obj_no = pvr2_alloc_gfx_obj();
+                cache->obj_refs[tex_in->obj_no] = 1;
+                cache->obj_bytes[tex_in->obj_no] = n_bytes;
+                cache->n_bytes += n_bytes;
+
                 cmd.op = GFX_IL_INIT_OBJ;
                 cmd.arg.init_obj.obj_no = tex_in->obj_no;
                 cmd.arg.init_obj.n_bytes = n_bytes;
@@ -876,41 +1130,118 @@ void pvr2_tex_cache_xmit(struct pvr2 *pvr2) {
                 cmd.arg.write_obj.n_bytes = n_bytes;
                 rend_exec_il(&cmd, 1);
                 free(tex_dat);
+            }
 
-                cmd.op = GFX_IL_BIND_TEX;
-                cmd.arg.bind_tex.gfx_obj_handle = tex_in->obj_no;
-                cmd.arg.bind_tex.tex_no = idx;
-                cmd.arg.bind_tex.pix_fmt = tmp.pix_fmt;
-                cmd.arg.bind_tex.width = 1 << tex_in->meta.w_shift;
-                cmd.arg.bind_tex.height = 1 << tex_in->meta.h_shift;
+            cmd.op = GFX_IL_BIND_TEX;
+            cmd.arg.bind_tex.gfx_obj_handle = tex_in->obj_no;
+            cmd.arg.bind_tex.tex_no = idx;
+            cmd.arg.bind_tex.pix_fmt = tmp.pix_fmt;
+            cmd.arg.bind_tex.width = 1 << tex_in->meta.w_shift;
+            cmd.arg.bind_tex.height = 1 << tex_in->meta.h_shift;
 
-                rend_exec_il(&cmd, 1);
-            } else {
-                /*
-                 * This is a pre-existing texture; since the data-store has
-                 * already been created and bound, all we have to do is write
-                 * to it.
-                 */
-                struct pvr2_tex_meta tmp = tex_in->meta;
-                if (tex_in->meta.tex_fmt == TEX_CTRL_PIX_FMT_8_BPP_PAL ||
-                    tex_in->meta.tex_fmt == TEX_CTRL_PIX_FMT_4_BPP_PAL) {
-                    tmp.pix_fmt = translate_palette_to_pix_format(get_palette_tp(pvr2));
-                }
-                void *tex_dat;
-                size_t n_bytes;
-                pvr2_tex_cache_read(pvr2, &tex_dat, &n_bytes, &tmp);
-                cmd.op = GFX_IL_WRITE_OBJ;
-                cmd.arg.write_obj.dat = tex_dat;
-                cmd.arg.write_obj.obj_no = tex_in->obj_no;
-                cmd.arg.write_obj.n_bytes = n_bytes;
-                rend_exec_il(&cmd, 1);
-                free(tex_dat);
-            }
+            rend_exec_il(&cmd, 1);
+        } else {
+            /*
+             * This is a pre-existing texture; since the data-store has
+             * already been created and bound, all we have to do is write
+             * to it.
+             */
+            pvr2->stat.persistent_counters.tex_xmit_count++;
+            pvr2_tex_src_unlink(cache, tex_in);
+
+            void *tex_dat;
+            size_t n_bytes;
+            pvr2_tex_cache_read(pvr2, &tex_dat, &n_bytes, &tmp);
+
+            // the palette format might have changed the decoded size
+            size_t *obj_bytes = cache->obj_bytes + tex_in->obj_no;
+            if (n_bytes > *obj_bytes)
+                pvr2_tex_cache_make_room(pvr2, n_bytes - *obj_bytes);
+            cache->n_bytes = cache->n_bytes - *obj_bytes + n_bytes;
+            *obj_bytes = n_bytes;
+
+            cmd.op = GFX_IL_WRITE_OBJ;
+            cmd.arg.write_obj.dat = tex_dat;
+            cmd.arg.write_obj.obj_no = tex_in->obj_no;
+            cmd.arg.write_obj.n_bytes = n_bytes;
+            rend_exec_il(&cmd, 1);
+            free(tex_dat);
+        }
 
-            tex_in->state = PVR2_TEX_READY;
-            tex_in->last_update = clock_cycle_stamp(pvr2->clk);
+        tex_in->src_hash = src_hash;
+        pvr2_tex_src_link(cache, tex_in);
+        tex_in->state = PVR2_TEX_READY;
+        tex_in->last_update = clock_cycle_stamp(pvr2->clk);
+    }
+
+    pvr2_tex_update_stat(pvr2);
+}
+
+/*
+ * hash everything pvr2_tex_cache_read would read for the given texture: the
+ * bytes in texture memory and, for paletted textures, the palette format and
+ * the palette entries the texture can reference.
+ */
+static uint64_t pvr2_tex_src_hash(struct pvr2 *pvr2,
+                                  struct pvr2_tex_meta const *meta) {
+    uint32_t addr_last = meta->addr_last;
+    if (addr_last >= PVR2_TEX_MEM_LEN)
+        addr_last = PVR2_TEX_MEM_LEN - 1;
+
+    uint64_t hash = gfx_hash_bytes(GFX_HASH_INIT,
+                                   pvr2->mem.tex64 + meta->addr_first,
+                                   addr_last - meta->addr_first + 1);
+
+    if (meta->tex_fmt == TEX_CTRL_PIX_FMT_8_BPP_PAL ||
+        meta->tex_fmt == TEX_CTRL_PIX_FMT_4_BPP_PAL) {
+        uint32_t pal_start, n_entries;
+        if (meta->tex_fmt == TEX_CTRL_PIX_FMT_8_BPP_PAL) {
+            pal_start = (meta->tex_palette_start & 0x30) << 4;
+            n_entries = 256;
+        } else {
+            pal_start = meta->tex_palette_start << 4;
+            n_entries = 16;
         }
+        hash = gfx_hash_bytes(hash ^ get_palette_tp(pvr2),
+                              pvr2_get_palette_ram(pvr2) + pal_start * 4,
+                              n_entries * 4);
+    }
+
+    return hash;
+}
+
+// returns true if any other texture in the cache is bound to tex's gfx_obj
+static bool pvr2_tex_obj_shared(struct pvr2 *pvr2, struct pvr2_tex const *tex) {
+    return pvr2->tex_cache.obj_refs[tex->obj_no] > 1;
+}
+
+/*
+ * unbind the texture from its gfx_obj, and free the gfx_obj unless another
+ * texture is still sharing it.
+ */
+static void pvr2_tex_release_obj(struct pvr2 *pvr2, struct pvr2_tex *tex) {
+    if (tex->obj_no < 0)
+        return;
+
+    pvr2_tex_src_unlink(&pvr2->tex_cache, tex);
+
+    struct gfx_il_inst cmd;
+    cmd.op = GFX_IL_UNBIND_TEX;
+    cmd.arg.unbind_tex.tex_no = pvr2_tex_cache_get_idx(pvr2, tex);
+    rend_exec_il(&cmd, 1);
+
+    if (--pvr2->tex_cache.obj_refs[tex->obj_no] == 0) {
+        pvr2->tex_cache.n_bytes -= pvr2->tex_cache.obj_bytes[tex->obj_no];
+        pvr2->tex_cache.obj_bytes[tex->obj_no] = 0;
+
+        cmd.op = GFX_IL_FREE_OBJ;
+        cmd.arg.free_obj.obj_no = tex->obj_no;
+        rend_exec_il(&cmd, 1);
+
+        pvr2_free_gfx_obj(tex->obj_no);
     }
+
+    tex->obj_no = -1;
 }
 
 int pvr2_tex_cache_get_idx(struct pvr2 *pvr2, struct pvr2_tex const *tex) {
@@ -919,6 +1250,9 @@ int pvr2_tex_cache_get_idx(struct pvr2 *pvr2, struct pvr2_tex const *tex) {
 
 int pvr2_tex_get_meta(struct pvr2 *pvr2,
                       struct pvr2_tex_meta *meta, unsigned tex_idx) {
+    if (tex_idx >= pvr2->tex_cache.n_slots)
+        return -1;
+
     struct pvr2_tex const *tex_in = pvr2->tex_cache.tex_cache + tex_idx;
     if (pvr2_tex_valid(tex_in->state)) {
         memcpy(meta, &tex_in->meta, sizeof(struct pvr2_tex_meta));
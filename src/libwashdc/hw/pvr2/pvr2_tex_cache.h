@@ -29,12 +29,27 @@
 #include <stdbool.h>
 
 #include "gfx/gfx_tex_cache.h"
+#include "gfx/gfx_obj.h"
 #include "pvr2_ta.h"
 #include "dc_sched.h"
 #include "mem_areas.h"
 
+/*
+ * The texture cache starts out with PVR2_TEX_CACHE_INITIAL_SIZE slots and
+ * doubles whenever it runs out, up to PVR2_TEX_CACHE_SIZE slots.  In practice
+ * the number of slots in use is governed by the byte budget (see
+ * pvr2_tex_cache_add) long before it hits the upper limit.
+ */
 #define PVR2_TEX_CACHE_SIZE GFX_TEX_CACHE_SIZE
 #define PVR2_TEX_CACHE_MASK GFX_TEX_CACHE_MASK
+#define PVR2_TEX_CACHE_INITIAL_SIZE 256
+
+// budget used when gfx.tex-cache.budget-mb is missing from the config
+#define PVR2_TEX_CACHE_DEFAULT_BUDGET_MB 64
+
+// textures are looked up by way of a hash table keyed on their address
+#define PVR2_TEX_HASH_SHIFT 10
+#define PVR2_TEX_HASH_BUCKETS (1 << PVR2_TEX_HASH_SHIFT)
 
 struct pvr2_tex_meta {
     uint32_t addr_first, addr_last;
@@ -93,12 +108,38 @@ struct pvr2_tex {
     dc_cycle_stamp_t last_update;
     struct pvr2_tex_meta meta;
 
-    // this refers to the gfx_obj bound to the texture
+    /*
+     * this refers to the gfx_obj bound to the texture.  Textures whose source
+     * data and format are identical share the same gfx_obj, so this is not
+     * necessarily unique.
+     */
     int obj_no;
 
+    /*
+     * hash of the source data (and palette, for paletted textures) as of the
+     * last time the gfx_obj was written.  Only meaningful when obj_no >= 0.
+     */
+    uint64_t src_hash;
+
     // the frame stamp from the last time this texture was referenced
     unsigned frame_stamp_last_used;
 
+    /*
+     * slot indices of the neighbors in the LRU list, or -1.  prev is the more
+     * recently used neighbor.  Invalid slots are kept on the free list, which
+     * is linked through lru_next.
+     */
+    int lru_prev, lru_next;
+
+    // slot index of the next texture in the same hash bucket, or -1
+    int hash_next;
+
+    /*
+     * slot index of the next texture in the same src_hash bucket, or -1.
+     * Only textures with obj_no >= 0 are linked into the src_hash buckets.
+     */
+    int src_hash_next;
+
     enum pvr2_tex_state state;
 };
 
@@ -118,7 +159,41 @@ struct pvr2_tex {
 
 struct pvr2_tex_cache {
     dc_cycle_stamp_t page_stamps[PVR2_TEX_N_PAGES];
-    struct pvr2_tex tex_cache[PVR2_TEX_CACHE_SIZE];
+
+    // this array has n_slots elements, and can grow up to PVR2_TEX_CACHE_SIZE
+    struct pvr2_tex *tex_cache;
+    unsigned n_slots;
+
+    // number of slots which hold valid textures
+    unsigned n_resident;
+
+    /*
+     * lru_head is the most-recently used texture, lru_tail is the
+     * least-recently used texture.  free_head is the first invalid slot.
+     * These are all slot indices, or -1 if the list is empty.
+     */
+    int lru_head, lru_tail, free_head;
+
+    int hash_buckets[PVR2_TEX_HASH_BUCKETS];
+
+    /*
+     * textures which are bound to a gfx_obj, bucketed by src_hash.  This is
+     * how textures with identical source data find each other's gfx_obj.
+     */
+    int src_hash_buckets[PVR2_TEX_HASH_BUCKETS];
+
+    // number of textures bound to each gfx_obj
+    uint16_t obj_refs[GFX_OBJ_COUNT];
+
+    /*
+     * number of bytes last uploaded to each gfx_obj.  This is what the obj
+     * is charged against the budget, once no matter how many textures share
+     * it.
+     */
+    size_t obj_bytes[GFX_OBJ_COUNT];
+
+    // total of obj_bytes over all gfx_objs in use, and the limit for that total
+    size_t n_bytes, budget;
 };
 
 /*
@@ -157,6 +232,9 @@ int pvr2_tex_cache_get_idx(struct pvr2 *pvr2, struct pvr2_tex const *tex);
 // this function sends the texture cache over to gfx by way of the gfx_il
 void pvr2_tex_cache_xmit(struct pvr2 *pvr2);
 
+// returns the number of slots the texture cache currently has
+unsigned pvr2_tex_cache_n_slots(struct pvr2 *pvr2);
+
 /*
  * Read the meta-information of the given texture.  This function will return
  * -1 if the slot indicated by tex_idx points to an invalid texture; else it
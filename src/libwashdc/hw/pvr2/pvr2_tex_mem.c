@@ -351,6 +351,45 @@ void pvr2_tex_mem_area64_write_double(addr32_t addr, double val, void *ctxt) {
     ((double*)pvr2->mem.tex64)[(addr - ADDR_TEX64_FIRST) / sizeof(val)] = val;
 }
 
+void pvr2_tex_mem_area32_write_bulk(struct pvr2 *pvr2, addr32_t addr,
+                                    void const *src, size_t n_bytes) {
+    if (!n_bytes)
+        return;
+
+    if (addr < ADDR_TEX32_FIRST || addr > ADDR_TEX32_LAST ||
+        ((addr - 1 + n_bytes) > ADDR_TEX32_LAST) ||
+        ((addr - 1 + n_bytes) < ADDR_TEX32_FIRST)) {
+        error_set_feature("out-of-bounds PVR2 texture memory write");
+        error_set_address(addr);
+        error_set_length(n_bytes);
+        RAISE_ERROR(ERROR_UNIMPLEMENTED);
+    }
+
+    pvr2_framebuffer_notify_write(pvr2, addr, n_bytes);
+
+    memcpy(pvr2->mem.tex32 + (addr - ADDR_TEX32_FIRST), src, n_bytes);
+}
+
+void pvr2_tex_mem_area64_write_bulk(struct pvr2 *pvr2, addr32_t addr,
+                                    void const *src, size_t n_bytes) {
+    if (!n_bytes)
+        return;
+
+    if (addr < ADDR_TEX64_FIRST || addr > ADDR_TEX64_LAST ||
+        ((addr - 1 + n_bytes) > ADDR_TEX64_LAST) ||
+        ((addr - 1 + n_bytes) < ADDR_TEX64_FIRST)) {
+        error_set_feature("out-of-bounds PVR2 texture memory write");
+        error_set_address(addr);
+        error_set_length(n_bytes);
+        RAISE_ERROR(ERROR_UNIMPLEMENTED);
+    }
+
+    pvr2_framebuffer_notify_write(pvr2, addr, n_bytes);
+    pvr2_tex_cache_notify_write(pvr2, addr, n_bytes);
+
+    memcpy(pvr2->mem.tex64 + (addr - ADDR_TEX64_FIRST), src, n_bytes);
+}
+
 struct memory_interface pvr2_tex_mem_area32_intf = {
     .readdouble = pvr2_tex_mem_area32_read_double,
     .readfloat = pvr2_tex_mem_area32_read_float,
@@ -62,6 +62,18 @@ void pvr2_tex_mem_area64_write_float(addr32_t addr, float val, void *ctxt);
 double pvr2_tex_mem_area64_read_double(addr32_t addr, void *ctxt);
 void pvr2_tex_mem_area64_write_double(addr32_t addr, double val, void *ctxt);
 
+struct pvr2;
+
+/*
+ * copy a block of data into texture memory (this is used for DMA transfers).
+ * This does the same bookkeeping as the single-access write functions, but
+ * only once for the whole block.
+ */
+void pvr2_tex_mem_area32_write_bulk(struct pvr2 *pvr2, addr32_t addr,
+                                    void const *src, size_t n_bytes);
+void pvr2_tex_mem_area64_write_bulk(struct pvr2 *pvr2, addr32_t addr,
+                                    void const *src, size_t n_bytes);
+
 extern struct memory_interface pvr2_tex_mem_area32_intf,
     pvr2_tex_mem_area64_intf;
 
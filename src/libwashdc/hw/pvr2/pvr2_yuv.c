@@ -20,6 +20,13 @@
  *
  ******************************************************************************/
 
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "log.h"
 #include "washdc/error.h"
 #include "pvr2_tex_mem.h"
@@ -33,7 +40,8 @@
 
 #include "pvr2_yuv.h"
 
-static void pvr2_yuv_input_byte(struct pvr2 *pvr2, unsigned byte);
+static void pvr2_yuv_macroblock(struct pvr2 *pvr2, uint8_t const *src);
+static void pvr2_yuv_flush_notify(struct pvr2 *pvr2);
 static void
 pvr2_yuv_complete_int_event_handler(struct SchedEvent *event);
 
@@ -41,6 +49,8 @@ void pvr2_yuv_init(struct pvr2 *pvr2) {
     pvr2->yuv.pvr2_yuv_complete_int_event.handler =
         pvr2_yuv_complete_int_event_handler;
     pvr2->yuv.pvr2_yuv_complete_int_event.arg_ptr = pvr2;
+    pvr2->yuv.dirty_first = UINT32_MAX;
+    pvr2->yuv.dirty_last = 0;
 }
 
 void pvr2_yuv_cleanup(struct pvr2 *pvr2) {
@@ -80,6 +90,8 @@ void pvr2_yuv_set_base(struct pvr2 *pvr2, uint32_t new_base) {
      * TODO: what happens if any of these settings change without updating the
      * base address?
      */
+    pvr2_yuv_flush_notify(pvr2);
+
     yuv->dst_addr = new_base;
     yuv->fmt = PVR2_YUV_FMT_420;
     yuv->macroblock_offset = 0;
@@ -90,30 +102,105 @@ void pvr2_yuv_set_base(struct pvr2 *pvr2, uint32_t new_base) {
 }
 
 void pvr2_yuv_input_data(struct pvr2 *pvr2, void const *dat, unsigned n_bytes) {
+    struct pvr2_yuv *yuv = &pvr2->yuv;
     uint32_t tex_ctrl = get_ta_yuv_tex_ctrl(pvr2);
 
     if (tex_ctrl & (1 << 16))
         RAISE_ERROR(ERROR_UNIMPLEMENTED);
     if (tex_ctrl & (1 << 24))
         RAISE_ERROR(ERROR_UNIMPLEMENTED);
+    if (yuv->fmt != PVR2_YUV_FMT_420)
+        RAISE_ERROR(ERROR_UNIMPLEMENTED);
 
     if ((pvr2->yuv.dst_addr + 3) >= (ADDR_TEX64_LAST - ADDR_TEX64_FIRST + 1))
         RAISE_ERROR(ERROR_INTEGRITY);
 
     uint8_t const *dat8 = (uint8_t const*)dat;
 
-    while (n_bytes) {
-        uint8_t dat_byte;
-        memcpy(&dat_byte, dat8, sizeof(dat_byte));
-        pvr2_yuv_input_byte(pvr2, dat_byte);
-        dat8++;
-        n_bytes--;
+    // finish off any macroblock left over from the last call
+    if (yuv->macroblock_offset) {
+        unsigned n_copy = PVR2_YUV_MACROBLOCK_LEN - yuv->macroblock_offset;
+        if (n_copy > n_bytes)
+            n_copy = n_bytes;
+        memcpy(yuv->macroblock + yuv->macroblock_offset, dat8, n_copy);
+        yuv->macroblock_offset += n_copy;
+        dat8 += n_copy;
+        n_bytes -= n_copy;
+
+        if (yuv->macroblock_offset == PVR2_YUV_MACROBLOCK_LEN) {
+            yuv->macroblock_offset = 0;
+            pvr2_yuv_macroblock(pvr2, yuv->macroblock);
+        }
+    }
+
+    // whole macroblocks get converted straight out of the input
+    while (n_bytes >= PVR2_YUV_MACROBLOCK_LEN) {
+        pvr2_yuv_macroblock(pvr2, dat8);
+        dat8 += PVR2_YUV_MACROBLOCK_LEN;
+        n_bytes -= PVR2_YUV_MACROBLOCK_LEN;
+    }
+
+    // hang on to whatever's left until the rest of the macroblock comes in
+    if (n_bytes) {
+        memcpy(yuv->macroblock, dat8, n_bytes);
+        yuv->macroblock_offset = n_bytes;
+    }
+
+    pvr2_yuv_flush_notify(pvr2);
+}
+
+/*
+ * tell the texture cache and the framebuffer about everything that has been
+ * written since the last time this was called.
+ */
+static void pvr2_yuv_flush_notify(struct pvr2 *pvr2) {
+    struct pvr2_yuv *yuv = &pvr2->yuv;
+
+    if (yuv->dirty_first > yuv->dirty_last)
+        return;
+
+    uint32_t addr = ADDR_TEX64_FIRST + yuv->dirty_first;
+    uint32_t len = yuv->dirty_last - yuv->dirty_first + 1;
+    pvr2_framebuffer_notify_write(pvr2, addr, len);
+    pvr2_tex_cache_notify_write(pvr2, addr, len);
+
+    yuv->dirty_first = UINT32_MAX;
+    yuv->dirty_last = 0;
+}
+
+/*
+ * Interleave one 16-pixel row of YUV420 into YUV422.  Each pair of pixels is
+ * output as U, Y0, V, Y1, and each U/V sample is shared by a pair of pixels
+ * (the vertical sharing between rows is handled by the caller).
+ */
+static inline void pvr2_yuv_conv_row(uint8_t *dst, uint8_t const *u_row,
+                                     uint8_t const *v_row,
+                                     uint8_t const *y_left,
+                                     uint8_t const *y_right) {
+#ifdef __SSE2__
+    __m128i u = _mm_loadl_epi64((__m128i const*)u_row);
+    __m128i v = _mm_loadl_epi64((__m128i const*)v_row);
+    __m128i y = _mm_unpacklo_epi64(_mm_loadl_epi64((__m128i const*)y_left),
+                                   _mm_loadl_epi64((__m128i const*)y_right));
+    __m128i uv = _mm_unpacklo_epi8(u, v);
+
+    _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi8(uv, y));
+    _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi8(uv, y));
+#else
+    unsigned col;
+    for (col = 0; col < 8; col++) {
+        uint8_t const *y_src = col < 4 ? y_left + col * 2 :
+            y_right + (col - 4) * 2;
+        dst[col * 4] = u_row[col];
+        dst[col * 4 + 1] = y_src[0];
+        dst[col * 4 + 2] = v_row[col];
+        dst[col * 4 + 3] = y_src[1];
     }
+#endif
 }
 
-static void pvr2_yuv_macroblock(struct pvr2 *pvr2) {
+static void pvr2_yuv_macroblock(struct pvr2 *pvr2, uint8_t const *src) {
     struct pvr2_yuv *yuv = &pvr2->yuv;
-    uint32_t block[16][8];
 
     if (yuv->cur_macroblock_x >= yuv->macroblock_count_x) {
         LOG_ERROR("yuv->cur_macroblock_x is %u\n", yuv->cur_macroblock_x);
@@ -127,49 +214,6 @@ static void pvr2_yuv_macroblock(struct pvr2 *pvr2) {
         RAISE_ERROR(ERROR_UNIMPLEMENTED);
     }
 
-    unsigned row, col;
-    for (row = 0; row < 16; row++) {
-        for (col = 0; col < 8; col++) {
-            /*
-             * For the luminance component, each macro block is stored as four
-             * 8x8 sub-macroblocks, each of which is contiguous.
-             */
-            unsigned col_lum, row_lum;
-            unsigned lum_start;
-            if (row < 8) {
-                if (col < 4) {
-                    lum_start = 0;
-                    col_lum = col;
-                    row_lum = row;
-                } else {
-                    lum_start = 0x40;
-                    col_lum = col - 4;
-                    row_lum = row;
-                }
-            } else {
-                if (col < 4) {
-                    lum_start = 0x80;
-                    col_lum = col;
-                    row_lum = row - 8;
-                } else {
-                    lum_start = 0xc0;
-                    col_lum = col - 4;
-                    row_lum = row - 8;
-                }
-            }
-
-            unsigned lum[2] = {
-                yuv->y_buf[row_lum * 8 + col_lum * 2 + lum_start],
-                yuv->y_buf[row_lum * 8 + col_lum * 2 + lum_start + 1],
-            };
-
-            unsigned u_val = yuv->u_buf[(row / 2) * 8 + col];
-            unsigned v_val = yuv->v_buf[(row / 2) * 8 + col];
-
-            block[row][col] = (lum[0] << 8) | (lum[1] << 24) | u_val | (v_val << 16);
-        }
-    }
-
     /*
      * TODO: how to know the output linestride?  For now it is hardocoded to
      * 1024 bytes (512 pixels) because that is what NBA2K expects.  Maybe it's
@@ -181,57 +225,52 @@ static void pvr2_yuv_macroblock(struct pvr2 *pvr2) {
      */
 
     unsigned linestride = 512 * 2;
-    unsigned macroblock_offs = linestride * 16 * yuv->cur_macroblock_y +
-        yuv->cur_macroblock_x * 8 * sizeof(uint32_t);
+    unsigned row_len = 16 * 2;
+    uint32_t addr_first = yuv->dst_addr + linestride * 16 *
+        yuv->cur_macroblock_y + yuv->cur_macroblock_x * row_len;
+    uint32_t addr_last = addr_first + linestride * 15 + row_len - 1;
 
-    uint32_t row_offs32 = yuv->dst_addr / 4 + macroblock_offs / 4;
-    uint32_t *row_ptr = ((uint32_t*)pvr2->mem.tex64) + row_offs32;
-    uint32_t addr_base = 4 * row_offs32;
+    if (addr_last >= ADDR_TEX64_LAST - ADDR_TEX64_FIRST + 1) {
+        error_set_address(addr_first);
+        RAISE_ERROR(ERROR_INTEGRITY);
+    }
 
+    uint8_t const *u_src = src + PVR2_YUV_U_OFFS;
+    uint8_t const *v_src = src + PVR2_YUV_V_OFFS;
+    uint8_t const *y_src = src + PVR2_YUV_Y_OFFS;
+    uint8_t *dst = pvr2->mem.tex64 + addr_first;
+
+    unsigned row;
     for (row = 0; row < 16; row++) {
-        memcpy(row_ptr, block[row], 8 * sizeof(uint32_t));
-        row_ptr += linestride / 4;
-        addr_base += linestride;
-
-        pvr2_framebuffer_notify_write(pvr2, ADDR_TEX64_FIRST + addr_base,
-                                      8 * sizeof(uint32_t));
-        pvr2_tex_cache_notify_write(pvr2, ADDR_TEX64_FIRST + addr_base,
-                                    8 * sizeof(uint32_t));
+        /*
+         * For the luminance component, each macro block is stored as four
+         * 8x8 sub-macroblocks, each of which is contiguous.  The upper-left
+         * one comes first, followed by upper-right, lower-left and
+         * lower-right.
+         */
+        uint8_t const *y_left = y_src + (row < 8 ? 0 : 0x80) + (row % 8) * 8;
+        unsigned chroma_offs = (row / 2) * 8;
+
+        pvr2_yuv_conv_row(dst, u_src + chroma_offs, v_src + chroma_offs,
+                          y_left, y_left + 0x40);
+        dst += linestride;
     }
 
+    if (addr_first < yuv->dirty_first)
+        yuv->dirty_first = addr_first;
+    if (addr_last > yuv->dirty_last)
+        yuv->dirty_last = addr_last;
+
     yuv->cur_macroblock_x++;
     if (yuv->cur_macroblock_x >= yuv->macroblock_count_x) {
         yuv->cur_macroblock_x = 0;
         yuv->cur_macroblock_y++;
+
+        // notify once for each completed row of macroblocks
+        pvr2_yuv_flush_notify(pvr2);
     }
 
     if (yuv->cur_macroblock_y == yuv->macroblock_count_y) {
         pvr2_yuv_schedule_int(pvr2);
     }
 }
-
-static void pvr2_yuv_input_byte(struct pvr2 *pvr2, unsigned dat) {
-    struct pvr2_yuv *yuv = &pvr2->yuv;
-    if (yuv->fmt != PVR2_YUV_FMT_420)
-        RAISE_ERROR(ERROR_UNIMPLEMENTED);
-
-    if (yuv->macroblock_offset < 64) {
-        yuv->u_buf[yuv->macroblock_offset++] = dat;
-    } else if (yuv->macroblock_offset < 128) {
-        yuv->v_buf[yuv->macroblock_offset++ - 64] = dat;
-    } else if (yuv->macroblock_offset < 384) {
-        yuv->y_buf[yuv->macroblock_offset++ - 128] = dat;
-    } else {
-        RAISE_ERROR(ERROR_INTEGRITY);
-    }
-
-    if (yuv->macroblock_offset == 384) {
-        yuv->macroblock_offset = 0;
-
-        if (yuv->cur_macroblock_x >= yuv->macroblock_count_x ||
-            yuv->cur_macroblock_y >= yuv->macroblock_count_y)
-            RAISE_ERROR(ERROR_INTEGRITY);
-
-        pvr2_yuv_macroblock(pvr2);
-    }
-}
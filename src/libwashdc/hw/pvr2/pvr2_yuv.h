@@ -32,6 +32,15 @@ void pvr2_yuv_set_base(struct pvr2 *pvr2, uint32_t new_base);
 
 void pvr2_yuv_input_data(struct pvr2 *pvr2, void const *dat, unsigned n_bytes);
 
+/*
+ * In YUV420 format, each 16x16 macroblock is 64 bytes of U, followed by 64
+ * bytes of V, followed by 256 bytes of Y.
+ */
+#define PVR2_YUV_U_OFFS 0
+#define PVR2_YUV_V_OFFS 64
+#define PVR2_YUV_Y_OFFS 128
+#define PVR2_YUV_MACROBLOCK_LEN 384
+
 enum pvr2_yuv_fmt {
     PVR2_YUV_FMT_420,
     PVR2_YUV_FMT_422
@@ -47,9 +56,20 @@ struct pvr2_yuv {
     // width and height, in terms of 16x16 macroblocks
     unsigned macroblock_count_x, macroblock_count_y;
 
-    uint8_t u_buf[64];
-    uint8_t v_buf[64];
-    uint8_t y_buf[256];
+    /*
+     * partial macroblock that is still being received.  This is only used
+     * when a macroblock is split between calls to pvr2_yuv_input_data;
+     * otherwise macroblocks are converted straight from the input.
+     */
+    uint8_t macroblock[PVR2_YUV_MACROBLOCK_LEN];
+
+    /*
+     * range of texture memory (relative to the start of 64-bit texture
+     * memory) that has been written since the last time the texture cache
+     * and the framebuffer were notified.  dirty_first > dirty_last when
+     * there's nothing pending.
+     */
+    uint32_t dirty_first, dirty_last;
 
     bool yuv_complete_event_scheduled;
 
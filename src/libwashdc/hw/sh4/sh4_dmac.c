@@ -31,6 +31,7 @@
 #include "washdc/MemoryMap.h"
 #include "sh4_dmac.h"
 #include "mem_areas.h"
+#include "memory.h"
 #include "hw/sys/holly_intc.h"
 #include "log.h"
 #include "dc_sched.h"
@@ -297,6 +298,14 @@ void sh4_dmac_dmaor_reg_write_handler(Sh4 *sh4,
 void sh4_dmac_transfer_to_mem(Sh4 *sh4, addr32_t transfer_dst, size_t unit_sz,
                               size_t n_units, void const *dat) {
     size_t total_len = unit_sz * n_units;
+
+    void *dst = memory_dma_ptr(sh4->mem.map,
+                               transfer_dst & ~0xe0000000, total_len);
+    if (dst) {
+        memcpy(dst, dat, total_len);
+        return;
+    }
+
     if (total_len % 4 == 0) {
         total_len /= 4;
         uint32_t const *dat32 = (uint32_t const*)dat;
@@ -32,6 +32,9 @@ extern "C" {
  * does not get included by code which is not OpenGL-specific.
  */
 
+// every shader's source starts with this, ahead of the preamble
+#define SHADER_VERSION_STR "#version 330 core\n"
+
 struct shader {
     GLuint vert_shader;
     GLuint frag_shader;
@@ -73,6 +76,13 @@ void shader_load_frag(struct shader *out, char const *frag_shader_src);
 
 void shader_link(struct shader *out);
 
+/*
+ * same as shader_link, but tells the driver that the caller intends to fetch
+ * the linked program with glGetProgramBinary.  Only call this if the driver
+ * supports ARB_get_program_binary.
+ */
+void shader_link_retrievable(struct shader *out);
+
 void shader_cleanup(struct shader *shader);
 
 #ifdef __cplusplus
@@ -31,10 +31,26 @@ extern "C" {
 
 typedef int32_t washdc_sample_type;
 
+/*
+ * Audio is submitted in frames.  Each frame holds one sample for every
+ * channel, interleaved in this order.
+ */
+enum washdc_sound_chan {
+    WASHDC_SOUND_CHAN_LEFT,
+    WASHDC_SOUND_CHAN_RIGHT,
+
+    WASHDC_SOUND_CHAN_COUNT
+};
+
 struct washdc_sound_intf {
     void (*init)(void);
     void (*cleanup)(void);
-    void (*submit_samples)(washdc_sample_type *samples, unsigned count);
+
+    /*
+     * submit n_frames frames of audio (n_frames * WASHDC_SOUND_CHAN_COUNT
+     * samples).  The emulator calls this with a block of frames at a time.
+     */
+    void (*submit_frames)(washdc_sample_type const *frames, unsigned n_frames);
 };
 
 #ifdef __cplusplus
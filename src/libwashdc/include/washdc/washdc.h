@@ -24,6 +24,7 @@
 #define LIBWASHDC_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "sound_intf.h"
@@ -122,6 +123,34 @@ struct washdc_launch_settings {
 
     // if true, the flash image will be written out at the end
     bool write_to_flash;
+
+    /*
+     * headless mode: nothing gets rendered and no graphics API is used.  The
+     * frontend should supply a win_intf, overlay_intf and sndsrv that don't
+     * need a display or an audio device.
+     *
+     * If soft_render is true, everything is drawn on the CPU by the software
+     * renderer instead of being thrown away.
+     *
+     * If render_hash is also true, a hash of everything sent to the renderer
+     * (or with soft_render, of every frame it draws) is printed at exit.
+     */
+    bool headless;
+    bool soft_render;
+    bool render_hash;
+
+    /*
+     * if nonzero, emulation ends after this many frames or this many seconds
+     * of emulated time.
+     */
+    unsigned frame_limit;
+    unsigned emu_time_limit;
+
+    /*
+     * if non-NULL, every frame gets written to this file in the background.
+     * Paths ending in .y4m get YUV4MPEG2, everything else gets raw RGBA.
+     */
+    char const *path_frame_dump;
 };
 
 int washdc_save_screenshot(char const *path);
@@ -135,6 +164,9 @@ char const *washdc_win_get_title(void);
 void washdc_gfx_toggle_wireframe(void);
 void washdc_gfx_toggle_filter(void);
 
+// switch the GD-ROM between turbo-load mode and its configured timing model
+void washdc_gdrom_toggle_turbo(void);
+
 #define WASHDC_CONT_BTN_C_SHIFT 0
 #define WASHDC_CONT_BTN_C_MASK (1 << WASHDC_CONT_BTN_C_SHIFT)
 
@@ -257,6 +289,37 @@ struct washdc_pvr2_stat {
      * since that's generally how textures end up in this situation.
      */
     unsigned tex_eviction_count;
+
+    /*
+     * number of times an invalidated texture was not transmitted because
+     * its source data hashed the same as what was already uploaded.
+     */
+    unsigned tex_hash_match_count;
+
+    /*
+     * number of times a texture was not transmitted because another
+     * texture with identical source data was already uploaded, so the two
+     * share a gfx_obj.
+     */
+    unsigned tex_dedup_count;
+
+    /*
+     * number of times a texture got kicked out of the cache because the
+     * cache was over its byte budget.
+     */
+    unsigned tex_budget_eviction_count;
+
+    // decoded size of all textures in the cache, and the limit for that
+    size_t tex_cache_bytes, tex_cache_budget;
+
+    // number of textures in the cache, and the number of slots it has
+    unsigned tex_cache_resident, tex_cache_slots;
+
+    /*
+     * number of frames which were not rendered because emulation was
+     * running behind realtime, in total and out of the last 64 frames.
+     */
+    unsigned frames_skipped, frames_skipped_recent;
 };
 
 void washdc_get_pvr2_stat(struct washdc_pvr2_stat *stat);
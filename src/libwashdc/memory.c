@@ -49,3 +49,23 @@ struct memory_interface ram_intf = {
     .write16 = memory_write_16,
     .write8 = memory_write_8
 };
+
+void *memory_dma_ptr(struct memory_map *map, addr32_t addr, size_t n_bytes) {
+#ifdef ENABLE_WATCHPOINTS
+    return NULL;
+#else
+    if (!n_bytes)
+        return NULL;
+
+    struct memory_map_region *region =
+        memory_map_get_region(map, addr, n_bytes);
+    if (!region || region->id != MEMORY_MAP_REGION_RAM)
+        return NULL;
+
+    addr32_t offs = addr & region->mask;
+    if (offs + n_bytes > MEMORY_SIZE)
+        return NULL;
+
+    return ((struct Memory*)region->ctxt)->mem + offs;
+#endif
+}
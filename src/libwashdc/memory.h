@@ -137,4 +137,15 @@ memory_read_double(addr32_t addr, void *ctxt) {
 
 extern struct memory_interface ram_intf;
 
+/*
+ * returns a host pointer to the given range of guest memory if the entire
+ * range is backed by system RAM, else NULL.  DMA engines can use this to
+ * move a whole transfer with memcpy instead of going through the memory map
+ * one unit at a time.
+ *
+ * This always returns NULL when watchpoints are enabled, since anything
+ * that bypasses the memory map would also bypass the watchpoint checks.
+ */
+void *memory_dma_ptr(struct memory_map *map, addr32_t addr, size_t n_bytes);
+
 #endif
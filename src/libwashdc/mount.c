@@ -89,6 +89,39 @@ int mount_read_sectors(void *buf_out, unsigned fad_start,
     return 0;
 }
 
+void const *mount_get_sector(void *buf, unsigned fad) {
+    if (!mount_check())
+        return NULL;
+
+    if (img.ops->get_sector)
+        return img.ops->get_sector(&img, buf, fad);
+
+    if (img.ops->read_sector && img.ops->read_sector(&img, buf, fad) == 0)
+        return buf;
+
+    return NULL;
+}
+
+int mount_check_sectors(unsigned fad_start, unsigned sector_count) {
+    if (!mount_check())
+        return -1;
+
+    if (!img.ops->has_sector)
+        return 0;
+
+    unsigned fad;
+    for (fad = fad_start; fad < (fad_start + sector_count); fad++)
+        if (!img.ops->has_sector(&img, fad))
+            return -1;
+
+    return 0;
+}
+
+void mount_prefetch(unsigned fad_start, unsigned sector_count) {
+    if (mount_check() && img.ops->prefetch)
+        img.ops->prefetch(&img, fad_start, sector_count);
+}
+
 void const* mount_encode_toc(struct mount_toc const *toc) {
     static uint8_t toc_out[CDROM_TOC_SIZE];
 
@@ -147,3 +180,19 @@ int mount_get_meta(struct mount_meta *meta) {
 
     return img.ops->get_meta(&img, meta);
 }
+
+void mount_decode_meta(struct mount_meta *meta, uint8_t const *ip_bin) {
+    memset(meta, 0, sizeof(*meta));
+
+    memcpy(meta->hardware, ip_bin, MOUNT_META_HARDWARE_LEN);
+    memcpy(meta->maker, ip_bin + 16, MOUNT_META_MAKER_LEN);
+    memcpy(meta->dev_info, ip_bin + 32, MOUNT_META_DEV_INFO_LEN);
+    memcpy(meta->region, ip_bin + 48, MOUNT_META_REGION_LEN);
+    memcpy(meta->periph_support, ip_bin + 56, MOUNT_META_PERIPH_LEN);
+    memcpy(meta->product_id, ip_bin + 64, MOUNT_META_PRODUCT_ID_LEN);
+    memcpy(meta->product_version, ip_bin + 74, MOUNT_META_PRODUCT_VERSION_LEN);
+    memcpy(meta->rel_date, ip_bin + 80, MOUNT_META_REL_DATE_LEN);
+    memcpy(meta->boot_file, ip_bin + 96, MOUNT_META_BOOT_FILE_LEN);
+    memcpy(meta->company, ip_bin + 112, MOUNT_META_COMPANY_LEN);
+    memcpy(meta->title, ip_bin + 128, MOUNT_META_TITLE_LEN);
+}
@@ -27,10 +27,11 @@
  * mount.h
  *
  * virtual interface for mounting disc-images of various formats such as .cdi,
- * .gdi, .cue, etc.  Currently only .gdi is supported.
+ * .gdi, .cue, etc.  Currently .gdi and .gdz are supported.
  */
 
 #include <stdbool.h>
+#include <stdint.h>
 
 struct mount_ops;
 
@@ -107,6 +108,28 @@ struct mount_ops {
 
     int(*read_sector)(struct mount*, void*, unsigned);
 
+    /*
+     * return a pointer to the data in the given sector, or NULL on error.  The
+     * pointer only needs to stay valid until the next call to get_sector.
+     * Mounts which already have the sector in memory can return a pointer to
+     * that instead of copying it into the buffer.  This is optional; if it's
+     * NULL then read_sector gets used instead.
+     */
+    void const *(*get_sector)(struct mount*, void*, unsigned);
+
+    /*
+     * return true if the given sector exists on the disc.  This is optional;
+     * if it's NULL then every sector is assumed to exist until an attempt to
+     * read it fails.
+     */
+    bool (*has_sector)(struct mount*, unsigned);
+
+    /*
+     * hint that the given range of sectors is about to be read.  This is
+     * optional.
+     */
+    void (*prefetch)(struct mount*, unsigned, unsigned);
+
     // release resources held by the mount
     void (*cleanup)(struct mount*);
 
@@ -129,8 +152,33 @@ int mount_read_toc(struct mount_toc* out, unsigned session);
 
 int mount_read_sectors(void *buf_out, unsigned fad, unsigned sector_count);
 
+/*
+ * return a pointer to the CDROM_FRAME_DATA_SIZE bytes of data in the given
+ * sector, or NULL on error.  buf is CDROM_FRAME_DATA_SIZE bytes of space which
+ * the sector may or may not get read into; mounts which already have the
+ * sector in memory return a pointer to their own copy instead.  Either way,
+ * the pointer is only valid until the next call to mount_get_sector.
+ */
+void const *mount_get_sector(void *buf, unsigned fad);
+
+/*
+ * return 0 if every sector in the given range is on the disc, else return
+ * nonzero.
+ */
+int mount_check_sectors(unsigned fad_start, unsigned sector_count);
+
+// hint that the given range of sectors is about to be read
+void mount_prefetch(unsigned fad_start, unsigned sector_count);
+
 int mount_get_meta(struct mount_meta *meta);
 
+/*
+ * fill in meta from the 256-byte IP.BIN header at the start of the first
+ * sector of the high-density area.  This is meant for mount implementations
+ * to use in their get_meta op.
+ */
+void mount_decode_meta(struct mount_meta *meta, uint8_t const *ip_bin);
+
 /*
  * size of an actual CD-ROM Table-Of-Contents structure.  This is the length of
  * the data returned by mount_encode_toc.
@@ -20,32 +20,151 @@
  *
  ******************************************************************************/
 
+
+/*
+ * Screenshots and frame dumps.
+ *
+ * Grabbing the framebuffer has to happen on the emulation thread because
+ * that's where the renderer lives, but everything after that (PNG
+ * compression, colorspace conversion and file I/O) happens on worker threads
+ * so that capturing doesn't disturb frame timing.  Each kind of capture has a
+ * capture_pipe, which is a fixed pool of frame buffers that get recycled
+ * between the emulation thread and the workers.
+ */
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <png.h>
 #include <time.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "washdc/hostfile.h"
+#include "washdc/error.h"
 #include "gfx/gfx_il.h"
 #include "log.h"
 
-static int do_save_screenshot(FILE *stream, char const *path);
-static int grab_screen(uint32_t **fb_out, unsigned *fb_width_out,
-                       unsigned *fb_height_out, bool *do_flip_out);
+#include "screenshot.h"
+
+#define TIMESTR_LEN 32
+#define PATH_LEN 1024
+
+#define CAPTURE_MAX_BUFS 8
+#define CAPTURE_MAX_THREADS 4
+
+#define SCREENSHOT_N_BUFS 4
+#define SCREENSHOT_N_THREADS 2
+
+/*
+ * Frame dumps are written by a single thread so that frames stay in order.
+ * When all of the buffers are full the emulation thread waits for one to
+ * free up rather than dropping frames.
+ */
+#define FRAME_DUMP_N_BUFS 8
+#define FRAME_DUMP_N_THREADS 1
+
+struct capture_buf {
+    // framebuffer contents, RGBA with red in the low byte
+    uint32_t *dat;
+    size_t dat_len;
+    unsigned width, height;
+    bool flip;
+
+    // screenshots only: where to write the PNG
+    FILE *stream;
+    char path[PATH_LEN];
+};
+
+struct capture_pipe {
+    char const *name;
+    void (*handler)(struct capture_buf *buf);
+
+    struct capture_buf bufs[CAPTURE_MAX_BUFS];
+    unsigned n_bufs;
+
+    // buffers which the emulation thread can grab the framebuffer into
+    struct capture_buf *free_bufs[CAPTURE_MAX_BUFS];
+    unsigned n_free;
+
+    // ring of buffers waiting for a worker
+    struct capture_buf *jobs[CAPTURE_MAX_BUFS];
+    unsigned job_first, n_jobs;
+
+    pthread_t threads[CAPTURE_MAX_THREADS];
+    unsigned n_threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t job_cond, free_cond;
+    bool quit;
+
+    // backpressure accounting
+    unsigned n_stalls, max_jobs;
+    double stall_seconds;
+};
+
+static struct capture_pipe screenshot_pipe, dump_pipe;
+
+static struct frame_dump {
+    FILE *stream;
+    enum frame_dump_fmt fmt;
+    bool active;
+
+    /*
+     * the dimensions of the first frame.  Neither format can handle the
+     * resolution changing, so frames that don't match get skipped.
+     */
+    unsigned width, height;
+
+    unsigned n_frames, n_skipped;
+
+    // only touched by the dump thread
+    bool header_written;
+    uint8_t *row;
+    size_t row_len;
+} dump;
+
+static void capture_pipe_init(struct capture_pipe *pipe, char const *name,
+                              void (*handler)(struct capture_buf*),
+                              unsigned n_bufs, unsigned n_threads);
+static void capture_pipe_cleanup(struct capture_pipe *pipe);
+static struct capture_buf *capture_pipe_acquire(struct capture_pipe *pipe);
+static void capture_pipe_release(struct capture_pipe *pipe,
+                                 struct capture_buf *buf);
+static void capture_pipe_submit(struct capture_pipe *pipe,
+                                struct capture_buf *buf);
+static void capture_pipe_drain(struct capture_pipe *pipe);
+static void *capture_pipe_main(void *arg);
+
+static int grab_screen(struct capture_buf *buf);
+static int queue_screenshot(FILE *stream, char const *path);
+static void save_png(struct capture_buf *buf);
+static void dump_frame(struct capture_buf *buf);
+
+void screenshot_init(void) {
+    capture_pipe_init(&screenshot_pipe, "screenshot", save_png,
+                      SCREENSHOT_N_BUFS, SCREENSHOT_N_THREADS);
+    capture_pipe_init(&dump_pipe, "frame dump", dump_frame,
+                      FRAME_DUMP_N_BUFS, FRAME_DUMP_N_THREADS);
+}
+
+void screenshot_cleanup(void) {
+    frame_dump_stop();
+    capture_pipe_cleanup(&dump_pipe);
+    capture_pipe_cleanup(&screenshot_pipe);
+
+    free(dump.row);
+    dump.row = NULL;
+    dump.row_len = 0;
+}
 
 int save_screenshot(char const *path) {
     FILE *stream = fopen(path, "wb");
     if (!stream)
         return -1;
-    int ret = do_save_screenshot(stream, path);
-    fclose(stream);
-    return ret;
+    return queue_screenshot(stream, path);
 }
 
-#define TIMESTR_LEN 32
-#define PATH_LEN 1024
-
 int save_screenshot_dir(void) {
     time_t rawtime;
     struct tm *timeinfo;
@@ -76,72 +195,176 @@ int save_screenshot_dir(void) {
     if (!stream)
         return -1;
 
-    int ret = do_save_screenshot(stream, path);
-    fclose(stream);
-    return ret;
+    return queue_screenshot(stream, path);
 }
 
-static int do_save_screenshot(FILE *stream, char const *path) {
-    int err_val = 0;
-    uint32_t *fb_tmp = NULL;
-    unsigned fb_width, fb_height;
-    bool do_flip;
+/*
+ * grab the screen and hand it off to be saved.  The stream gets closed by
+ * the worker once it's done (or here, if the screen can't be grabbed).
+ */
+static int queue_screenshot(FILE *stream, char const *path) {
+    struct capture_buf *buf = capture_pipe_acquire(&screenshot_pipe);
 
-    if (grab_screen(&fb_tmp, &fb_width, &fb_height, &do_flip) < 0) {
-        LOG_ERROR("%s - Failed to capture screenshot\n", __func__);
+    if (grab_screen(buf) < 0) {
+        LOG_WARN("Unable to save screenshot to %s due to failure to obtain "
+                 "screengrab\n", path);
+        capture_pipe_release(&screenshot_pipe, buf);
+        fclose(stream);
         return -1;
     }
 
-    if (!fb_tmp) {
-        LOG_WARN("Unable to save screenshot to %s due to failure to obtain "
-                 "screengrab\n", path);
-        err_val = -1;
-        goto free_screengrab;
+    buf->stream = stream;
+    strncpy(buf->path, path, PATH_LEN);
+    buf->path[PATH_LEN - 1] = '\0';
+
+    capture_pipe_submit(&screenshot_pipe, buf);
+    return 0;
+}
+
+int frame_dump_start(char const *path, enum frame_dump_fmt fmt) {
+    if (dump.active)
+        frame_dump_stop();
+
+    FILE *stream = fopen(path, "wb");
+    if (!stream) {
+        LOG_ERROR("Unable to open %s to dump frames\n", path);
+        return -1;
     }
 
+    dump.stream = stream;
+    dump.fmt = fmt;
+    dump.width = dump.height = 0;
+    dump.n_frames = dump.n_skipped = 0;
+    dump.header_written = false;
+    dump_pipe.n_stalls = dump_pipe.max_jobs = 0;
+    dump_pipe.stall_seconds = 0.0;
+    dump.active = true;
+
+    LOG_INFO("dumping frames to %s as %s\n", path,
+             fmt == FRAME_DUMP_FMT_Y4M ? "YUV4MPEG2" : "raw RGBA");
+    return 0;
+}
+
+void frame_dump_stop(void) {
+    if (!dump.active)
+        return;
+
+    dump.active = false;
+    capture_pipe_drain(&dump_pipe);
+    fclose(dump.stream);
+    dump.stream = NULL;
+
+    LOG_INFO("frame dump: %u frames (%ux%u) written, %u skipped due to "
+             "resolution changes\n",
+             dump.n_frames, dump.width, dump.height, dump.n_skipped);
+    LOG_INFO("frame dump: emulation waited on the writer %u times for a "
+             "total of %f seconds; at most %u frames were queued\n",
+             dump_pipe.n_stalls, dump_pipe.stall_seconds, dump_pipe.max_jobs);
+}
+
+void frame_dump_frame(void) {
+    if (!dump.active)
+        return;
+
+    struct capture_buf *buf = capture_pipe_acquire(&dump_pipe);
+
+    if (grab_screen(buf) < 0) {
+        capture_pipe_release(&dump_pipe, buf);
+        return;
+    }
+
+    if (!dump.width) {
+        dump.width = buf->width;
+        dump.height = buf->height;
+    } else if (buf->width != dump.width || buf->height != dump.height) {
+        if (!dump.n_skipped++) {
+            LOG_WARN("frame dump: resolution changed from %ux%u to %ux%u; "
+                     "frames at the new resolution will be skipped\n",
+                     dump.width, dump.height, buf->width, buf->height);
+        }
+        capture_pipe_release(&dump_pipe, buf);
+        return;
+    }
+
+    dump.n_frames++;
+    capture_pipe_submit(&dump_pipe, buf);
+}
+
+static int grab_screen(struct capture_buf *buf) {
+    struct gfx_framebuffer fb = {
+        .dat = buf->dat,
+        .dat_len = buf->dat_len
+    };
+    struct gfx_il_inst cmd = {
+        .op = GFX_IL_GRAB_FRAMEBUFFER,
+        .arg = {
+            .grab_framebuffer = {
+                .fb = &fb
+            }
+        }
+    };
+    rend_exec_il(&cmd, 1);
+
+    // the buffer may have been reallocated even if the grab failed
+    buf->dat = fb.dat;
+    buf->dat_len = fb.dat_len;
+
+    if (!fb.valid ||
+        fb.dat_len < (size_t)fb.width * fb.height * sizeof(uint32_t))
+        return -1;
+
+    buf->width = fb.width;
+    buf->height = fb.height;
+    buf->flip = fb.flip;
+    return 0;
+}
+
+// returns the index of the pixel at the given row, counting from the top
+static inline unsigned capture_row_idx(struct capture_buf const *buf,
+                                       unsigned row) {
+    if (!buf->flip)
+        return (buf->height - 1 - row) * buf->width;
+    return row * buf->width;
+}
+
+static void save_png(struct capture_buf *buf) {
+    FILE *stream = buf->stream;
+    unsigned fb_width = buf->width, fb_height = buf->height;
+    // volatile because it's read on the error path after a longjmp
+    png_bytepp volatile row_pointers = NULL;
+    unsigned row, col;
+
     png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING,
                                                   NULL, NULL, NULL);
-    if (!png_ptr) {
-        err_val = -1;
+    if (!png_ptr)
         goto close_file;
-    }
 
     png_infop info_ptr = png_create_info_struct(png_ptr);
 
-    if (!info_ptr) {
-        err_val = -1;
+    if (!info_ptr)
         goto cleanup_png;
-    }
 
-    if (setjmp(png_jmpbuf(png_ptr))) {
-        err_val = -1;
+    row_pointers = (png_bytepp)calloc(fb_height, sizeof(png_bytep));
+    if (!row_pointers)
         goto cleanup_png;
-    }
 
-    png_init_io(png_ptr, stream);
-
-    png_bytepp row_pointers = (png_bytepp)calloc(fb_height, sizeof(png_bytep));
-    if (!row_pointers)
+    if (setjmp(png_jmpbuf(png_ptr)))
         goto cleanup_png;
 
-    unsigned row, col;
+    png_init_io(png_ptr, stream);
+
     for (row = 0; row < fb_height; row++) {
         png_bytep cur_row = row_pointers[row] =
             (png_bytep)malloc(sizeof(png_byte) * fb_width * 3);
+        if (!cur_row)
+            goto cleanup_png;
 
+        uint32_t const *in_row = buf->dat + capture_row_idx(buf, row);
         for (col = 0; col < fb_width; col++) {
-            unsigned pix_idx;
-            if (!do_flip)
-                pix_idx = (fb_height - 1 - row) * fb_width + col;
-            else
-                pix_idx = row * fb_width + col;
-            uint32_t in_px = fb_tmp[pix_idx];
-            unsigned red = in_px & 0xff;
-            unsigned green = (in_px >> 8) & 0xff;
-            unsigned blue = (in_px >> 16) & 0xff;
-            cur_row[col * 3] = (png_byte)red;
-            cur_row[col * 3 + 1] = (png_byte)green;
-            cur_row[col * 3 + 2] = (png_byte)blue;
+            uint32_t in_px = in_row[col];
+            cur_row[col * 3] = (png_byte)(in_px & 0xff);
+            cur_row[col * 3 + 1] = (png_byte)((in_px >> 8) & 0xff);
+            cur_row[col * 3 + 2] = (png_byte)((in_px >> 16) & 0xff);
         }
     }
 
@@ -153,38 +376,222 @@ static int do_save_screenshot(FILE *stream, char const *path) {
     png_write_image(png_ptr, row_pointers);
     png_write_end(png_ptr, info_ptr);
 
-    for (row = 0; row < fb_height; row++)
-        free(row_pointers[row]);
-    free(row_pointers);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    LOG_INFO("screenshot saved to %s\n", buf->path);
+    goto free_rows;
+
  cleanup_png:
     png_destroy_write_struct(&png_ptr, &info_ptr);
  close_file:
- free_screengrab:
-    free(fb_tmp);
-    return err_val;
+    LOG_ERROR("%s - failed to save screenshot to %s\n", __func__, buf->path);
+ free_rows:
+    if (row_pointers) {
+        for (row = 0; row < fb_height; row++)
+            free(row_pointers[row]);
+        free(row_pointers);
+    }
+    fclose(stream);
+    buf->stream = NULL;
 }
 
-static int grab_screen(uint32_t **fb_out, unsigned *fb_width_out,
-                       unsigned *fb_height_out, bool *do_flip_out) {
-    struct gfx_framebuffer fb;
-    struct gfx_il_inst cmd = {
-        .op = GFX_IL_GRAB_FRAMEBUFFER,
-        .arg = {
-            .grab_framebuffer = {
-                .fb = &fb
+static void dump_write(void const *dat, size_t len) {
+    if (fwrite(dat, 1, len, dump.stream) != len)
+        LOG_ERROR("frame dump: write error\n");
+}
+
+/*
+ * YUV4MPEG2 output is 4:4:4 (so that no detail gets lost to chroma
+ * subsampling), converted using BT.601 studio-swing coefficients.
+ */
+static void dump_frame_y4m(struct capture_buf *buf) {
+    unsigned width = buf->width, height = buf->height;
+    unsigned row, col, plane;
+
+    if (!dump.header_written) {
+        fprintf(dump.stream, "YUV4MPEG2 W%u H%u F60000:1001 Ip A1:1 C444\n",
+                width, height);
+        dump.header_written = true;
+    }
+    fputs("FRAME\n", dump.stream);
+
+    for (plane = 0; plane < 3; plane++) {
+        for (row = 0; row < height; row++) {
+            uint32_t const *in_row = buf->dat + capture_row_idx(buf, row);
+            for (col = 0; col < width; col++) {
+                int red = in_row[col] & 0xff;
+                int green = (in_row[col] >> 8) & 0xff;
+                int blue = (in_row[col] >> 16) & 0xff;
+                int val;
+
+                /*
+                 * the constants fold in the +16/+128 offsets and the rounding
+                 * so that the sum is never negative before the shift.
+                 */
+                switch (plane) {
+                case 0:
+                    val = (66 * red + 129 * green + 25 * blue + 4224) >> 8;
+                    break;
+                case 1:
+                    val = (-38 * red - 74 * green + 112 * blue + 32896) >> 8;
+                    break;
+                default:
+                    val = (112 * red - 94 * green - 18 * blue + 32896) >> 8;
+                    break;
+                }
+                dump.row[col] = val;
             }
+            dump_write(dump.row, width);
         }
-    };
-    rend_exec_il(&cmd, 1);
+    }
+}
 
-    if (fb.valid) {
-        *fb_out = fb.dat;
-        *fb_width_out = fb.width;
-        *fb_height_out = fb.height;
-        *do_flip_out = fb.flip;
-        return 0;
+static void dump_frame_rgba(struct capture_buf *buf) {
+    unsigned row;
+    for (row = 0; row < buf->height; row++) {
+        dump_write(buf->dat + capture_row_idx(buf, row),
+                   buf->width * sizeof(uint32_t));
     }
+}
 
-    return -1;
+static void dump_frame(struct capture_buf *buf) {
+    if (dump.row_len < buf->width) {
+        uint8_t *row = realloc(dump.row, buf->width);
+        if (!row) {
+            LOG_ERROR("frame dump: failed to allocate a row buffer\n");
+            return;
+        }
+        dump.row = row;
+        dump.row_len = buf->width;
+    }
+
+    if (dump.fmt == FRAME_DUMP_FMT_Y4M)
+        dump_frame_y4m(buf);
+    else
+        dump_frame_rgba(buf);
 }
 
+static void capture_pipe_init(struct capture_pipe *pipe, char const *name,
+                              void (*handler)(struct capture_buf*),
+                              unsigned n_bufs, unsigned n_threads) {
+    memset(pipe, 0, sizeof(*pipe));
+
+    pipe->name = name;
+    pipe->handler = handler;
+    pipe->n_bufs = n_bufs;
+    pipe->n_threads = n_threads;
+
+    unsigned idx;
+    for (idx = 0; idx < n_bufs; idx++)
+        pipe->free_bufs[pipe->n_free++] = pipe->bufs + idx;
+
+    if (pthread_mutex_init(&pipe->lock, NULL) != 0 ||
+        pthread_cond_init(&pipe->job_cond, NULL) != 0 ||
+        pthread_cond_init(&pipe->free_cond, NULL) != 0)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+
+    for (idx = 0; idx < n_threads; idx++) {
+        if (pthread_create(pipe->threads + idx, NULL,
+                           capture_pipe_main, pipe) != 0) {
+            LOG_ERROR("unable to create %s thread\n", name);
+            RAISE_ERROR(ERROR_FAILED_ALLOC);
+        }
+    }
+}
+
+// finishes all outstanding work before returning
+static void capture_pipe_cleanup(struct capture_pipe *pipe) {
+    pthread_mutex_lock(&pipe->lock);
+    pipe->quit = true;
+    pthread_cond_broadcast(&pipe->job_cond);
+    pthread_mutex_unlock(&pipe->lock);
+
+    unsigned idx;
+    for (idx = 0; idx < pipe->n_threads; idx++)
+        pthread_join(pipe->threads[idx], NULL);
+
+    pthread_cond_destroy(&pipe->free_cond);
+    pthread_cond_destroy(&pipe->job_cond);
+    pthread_mutex_destroy(&pipe->lock);
+
+    for (idx = 0; idx < pipe->n_bufs; idx++)
+        free(pipe->bufs[idx].dat);
+    memset(pipe, 0, sizeof(*pipe));
+}
+
+/*
+ * Get a buffer to grab the framebuffer into.  If they're all in use this
+ * waits for a worker to finish one, and the time spent waiting is counted.
+ */
+static struct capture_buf *capture_pipe_acquire(struct capture_pipe *pipe) {
+    pthread_mutex_lock(&pipe->lock);
+
+    if (!pipe->n_free) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        pipe->n_stalls++;
+        while (!pipe->n_free)
+            pthread_cond_wait(&pipe->free_cond, &pipe->lock);
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        pipe->stall_seconds += (end.tv_sec - start.tv_sec) +
+            (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+    }
+
+    struct capture_buf *buf = pipe->free_bufs[--pipe->n_free];
+    pthread_mutex_unlock(&pipe->lock);
+    return buf;
+}
+
+// give back a buffer that was acquired but not submitted
+static void capture_pipe_release(struct capture_pipe *pipe,
+                                 struct capture_buf *buf) {
+    pthread_mutex_lock(&pipe->lock);
+    pipe->free_bufs[pipe->n_free++] = buf;
+    pthread_cond_broadcast(&pipe->free_cond);
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+static void capture_pipe_submit(struct capture_pipe *pipe,
+                                struct capture_buf *buf) {
+    pthread_mutex_lock(&pipe->lock);
+    pipe->jobs[(pipe->job_first + pipe->n_jobs++) % CAPTURE_MAX_BUFS] = buf;
+    if (pipe->n_jobs > pipe->max_jobs)
+        pipe->max_jobs = pipe->n_jobs;
+    pthread_cond_signal(&pipe->job_cond);
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+// wait for the workers to finish everything that has been submitted
+static void capture_pipe_drain(struct capture_pipe *pipe) {
+    pthread_mutex_lock(&pipe->lock);
+    while (pipe->n_free < pipe->n_bufs)
+        pthread_cond_wait(&pipe->free_cond, &pipe->lock);
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+static void *capture_pipe_main(void *arg) {
+    struct capture_pipe *pipe = (struct capture_pipe*)arg;
+
+    pthread_mutex_lock(&pipe->lock);
+    for (;;) {
+        while (!pipe->n_jobs && !pipe->quit)
+            pthread_cond_wait(&pipe->job_cond, &pipe->lock);
+        if (!pipe->n_jobs)
+            break;
+
+        struct capture_buf *buf = pipe->jobs[pipe->job_first];
+        pipe->job_first = (pipe->job_first + 1) % CAPTURE_MAX_BUFS;
+        pipe->n_jobs--;
+        pthread_mutex_unlock(&pipe->lock);
+
+        pipe->handler(buf);
+
+        pthread_mutex_lock(&pipe->lock);
+        pipe->free_bufs[pipe->n_free++] = buf;
+        pthread_cond_broadcast(&pipe->free_cond);
+    }
+    pthread_mutex_unlock(&pipe->lock);
+
+    return NULL;
+}
@@ -23,7 +23,35 @@
 #ifndef SCREENSHOT_H_
 #define SCREENSHOT_H_
 
+/*
+ * Screenshots are grabbed immediately but saved in the background, so these
+ * return 0 once the screenshot has been queued.  Failures after that point
+ * are logged.
+ */
 int save_screenshot(char const *path);
 int save_screenshot_dir(void);
 
+enum frame_dump_fmt {
+    // YUV4MPEG2 with 4:4:4 chroma
+    FRAME_DUMP_FMT_Y4M,
+
+    // headerless 32-bit RGBA frames, one after the other, top row first
+    FRAME_DUMP_FMT_RGBA
+};
+
+/*
+ * start writing every frame to the given path.  Frames are written in the
+ * background; if the writer falls behind, emulation waits for it (and the
+ * time spent waiting is reported when the dump is stopped).
+ */
+int frame_dump_start(char const *path, enum frame_dump_fmt fmt);
+void frame_dump_stop(void);
+
+// called at the end of every frame
+void frame_dump_frame(void);
+
+// these start and stop the worker threads
+void screenshot_init(void);
+void screenshot_cleanup(void);
+
 #endif
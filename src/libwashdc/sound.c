@@ -36,6 +36,7 @@ void dc_sound_cleanup(void) {
     sndsrv = NULL;
 }
 
-void dc_submit_sound_samples(washdc_sample_type *samples, unsigned count) {
-    sndsrv->submit_samples(samples, count);
+void dc_submit_sound_frames(washdc_sample_type const *frames,
+                            unsigned n_frames) {
+    sndsrv->submit_frames(frames, n_frames);
 }
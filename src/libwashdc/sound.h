@@ -28,6 +28,7 @@
 void dc_sound_init(struct washdc_sound_intf const *intf);
 void dc_sound_cleanup(void);
 
-void dc_submit_sound_samples(washdc_sample_type *samples, unsigned count);
+void dc_submit_sound_frames(washdc_sample_type const *frames,
+                            unsigned n_frames);
 
 #endif
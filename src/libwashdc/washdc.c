@@ -25,7 +25,9 @@
 #include "config.h"
 #include "dreamcast.h"
 #include "screenshot.h"
+#include "frameskip.h"
 #include "hw/maple/maple_controller.h"
+#include "hw/gdrom/gdrom_timing.h"
 #include "gfx/gfx.h"
 #include "gfx/gfx_config.h"
 #include "title.h"
@@ -70,6 +72,12 @@ washdc_init(struct washdc_launch_settings const *settings) {
     config_set_dc_flash_path(settings->path_dc_flash);
     config_set_ser_srv_enable(settings->enable_serial);
     config_set_dc_path_rtc(settings->path_rtc);
+    config_set_headless(settings->headless);
+    config_set_soft_render(settings->soft_render);
+    config_set_render_hash(settings->render_hash);
+    config_set_frame_limit(settings->frame_limit);
+    config_set_emu_time_limit(settings->emu_time_limit);
+    config_set_frame_dump_path(settings->path_frame_dump);
 
     win_set_intf(settings->win_intf);
     gfx_set_overlay_intf(settings->overlay_intf);
@@ -141,6 +149,12 @@ void washdc_gfx_toggle_filter(void) {
     gfx_toggle_output_filter();
 }
 
+void washdc_gdrom_toggle_turbo(void) {
+    bool turbo = !gdrom_timing_get_turbo();
+    gdrom_timing_set_turbo(turbo);
+    LOG_INFO("GD-ROM turbo-load %s\n", turbo ? "enabled" : "disabled");
+}
+
 static uint32_t trans_bind_washdc_to_maple(uint32_t wash) {
     uint32_t ret = 0;
 
@@ -224,6 +238,18 @@ void washdc_get_pvr2_stat(struct washdc_pvr2_stat *stat) {
         src.persistent_counters.fresh_texture_upload_count;
     stat->tex_eviction_count =
         src.persistent_counters.tex_eviction_count;
+    stat->tex_hash_match_count =
+        src.persistent_counters.tex_hash_match_count;
+    stat->tex_dedup_count =
+        src.persistent_counters.tex_dedup_count;
+    stat->tex_budget_eviction_count =
+        src.persistent_counters.tex_budget_eviction_count;
+    stat->tex_cache_bytes = src.tex_cache.n_bytes;
+    stat->tex_cache_budget = src.tex_cache.budget;
+    stat->tex_cache_resident = src.tex_cache.n_resident;
+    stat->tex_cache_slots = src.tex_cache.n_slots;
+    stat->frames_skipped = frameskip_total();
+    stat->frames_skipped_recent = frameskip_recent();
 }
 
 void washdc_pause(void) {
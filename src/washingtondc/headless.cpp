@@ -0,0 +1,104 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#include "headless.hpp"
+
+static unsigned win_width, win_height;
+
+static void win_null_init(unsigned width, unsigned height) {
+    win_width = width;
+    win_height = height;
+}
+
+static void win_null_cleanup(void) {
+}
+
+static void win_null_check_events(void) {
+}
+
+static void win_null_update(void) {
+}
+
+static void win_null_make_context_current(void) {
+}
+
+static void win_null_update_title(void) {
+}
+
+static int win_null_get_width(void) {
+    return win_width;
+}
+
+static int win_null_get_height(void) {
+    return win_height;
+}
+
+static void snd_null_init(void) {
+}
+
+static void snd_null_cleanup(void) {
+}
+
+static void snd_null_submit_frames(washdc_sample_type const *frames,
+                                   unsigned n_frames) {
+}
+
+static void overlay_null_set_fps(double fps) {
+}
+
+static void overlay_null_set_virt_fps(double fps) {
+}
+
+struct win_intf const *headless::get_win_intf(void) {
+    static struct win_intf win_intf_null = { };
+
+    win_intf_null.init = win_null_init;
+    win_intf_null.cleanup = win_null_cleanup;
+    win_intf_null.check_events = win_null_check_events;
+    win_intf_null.update = win_null_update;
+    win_intf_null.make_context_current = win_null_make_context_current;
+    win_intf_null.get_width = win_null_get_width;
+    win_intf_null.get_height = win_null_get_height;
+    win_intf_null.update_title = win_null_update_title;
+
+    return &win_intf_null;
+}
+
+struct washdc_sound_intf const *headless::get_sound_intf(void) {
+    static struct washdc_sound_intf snd_intf_null = { };
+
+    snd_intf_null.init = snd_null_init;
+    snd_intf_null.cleanup = snd_null_cleanup;
+    snd_intf_null.submit_frames = snd_null_submit_frames;
+
+    return &snd_intf_null;
+}
+
+struct washdc_overlay_intf const *headless::get_overlay_intf(void) {
+    static struct washdc_overlay_intf overlay_intf_null = { };
+
+    // overlay_draw is left NULL so that gfx skips it
+    overlay_intf_null.overlay_set_fps = overlay_null_set_fps;
+    overlay_intf_null.overlay_set_virt_fps = overlay_null_set_virt_fps;
+
+    return &overlay_intf_null;
+}
@@ -0,0 +1,43 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef HEADLESS_HPP_
+#define HEADLESS_HPP_
+
+#include "washdc/washdc.h"
+#include "washdc/win.h"
+#include "washdc/sound_intf.h"
+
+/*
+ * interfaces used in headless mode.  None of these need a display or an audio
+ * device.  The sound interface discards every sample without blocking, so
+ * emulation runs as fast as the host allows.
+ */
+namespace headless {
+
+struct win_intf const *get_win_intf(void);
+struct washdc_sound_intf const *get_sound_intf(void);
+struct washdc_overlay_intf const *get_overlay_intf(void);
+
+}
+
+#endif
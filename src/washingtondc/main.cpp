@@ -32,6 +32,7 @@
 #include "washdc/washdc.h"
 #include "washdc/buildconfig.h"
 #include "window.hpp"
+#include "headless.hpp"
 #include "overlay.hpp"
 #include "sound.hpp"
 #include "washdc/hostfile.h"
@@ -63,7 +64,7 @@ void create_screenshot_dir(void);
 static struct washdc_sound_intf snd_intf = {
     .init = sound::init,
     .cleanup = sound::cleanup,
-    .submit_samples = sound::submit_samples
+    .submit_frames = sound::submit_frames
 };
 
 static struct washdc_hostfile_api const hostfile_api = {
@@ -98,7 +99,17 @@ static void print_usage(char const *cmd) {
             "\t-j\t\tenable dynamic recompiler (as opposed to interpreter)\n"
             "\t-v\t\tenable verbose logging\n"
             "\t-x\t\tenable native x86_64 dynamic recompiler backend "
-            "(default)\n");
+            "(default)\n"
+            "\t-H\t\theadless mode: no window, no audio and no rendering\n"
+            "\t-S\t\tdraw everything with the software renderer "
+            "(headless mode only)\n"
+            "\t-R\t\tprint a hash of the renderer's input at exit "
+            "(headless mode only)\n"
+            "\t-F <frames>\texit after the given number of frames\n"
+            "\t-T <seconds>\texit after the given number of seconds of "
+            "emulated time\n"
+            "\t-D <path>\twrite every frame to the given file (YUV4MPEG2 "
+            "if it ends in .y4m, else raw RGBA)\n");
 }
 
 struct washdc_overlay_intf overlay_intf;
@@ -192,12 +203,15 @@ int main(int argc, char **argv) {
     bool launch_wizard = false;
     char const *dc_bios_path = NULL, *dc_flash_path = NULL;
     bool write_to_flash_mem = false;
+    bool headless = false, soft_render = false, render_hash = false;
+    unsigned frame_limit = 0, emu_time_limit = 0;
+    char const *path_frame_dump = NULL;
 
     create_cfg_dir();
     create_data_dir();
     create_screenshot_dir();
 
-    while ((opt = getopt(argc, argv, "w:b:f:c:s:m:d:u:g:htjxpnlv")) != -1) {
+    while ((opt = getopt(argc, argv, "w:b:f:c:s:m:d:u:g:F:T:D:htjxpnlvHSR")) != -1) {
         switch (opt) {
         case 'g':
             enable_debugger = true;
@@ -254,6 +268,24 @@ int main(int argc, char **argv) {
         case 'w':
             launch_wizard = true;
             break;
+        case 'H':
+            headless = true;
+            break;
+        case 'S':
+            soft_render = true;
+            break;
+        case 'R':
+            render_hash = true;
+            break;
+        case 'F':
+            frame_limit = strtoul(optarg, NULL, 0);
+            break;
+        case 'T':
+            emu_time_limit = strtoul(optarg, NULL, 0);
+            break;
+        case 'D':
+            path_frame_dump = optarg;
+            break;
         }
     }
 
@@ -393,19 +425,42 @@ int main(int argc, char **argv) {
         settings.path_rtc = console_get_rtc_path(console_name);
     settings.enable_serial = enable_serial;
     settings.path_gdi = path_gdi;
-    settings.win_intf = get_win_intf_glfw();
+
+    if (render_hash && !headless) {
+        fprintf(stderr, "ERROR: -R can only be used in headless mode (-H)\n");
+        exit(1);
+    }
+
+    if (soft_render && !headless) {
+        fprintf(stderr, "ERROR: -S can only be used in headless mode (-H)\n");
+        exit(1);
+    }
+
+    settings.headless = headless;
+    settings.soft_render = soft_render;
+    settings.render_hash = render_hash;
+    settings.frame_limit = frame_limit;
+    settings.emu_time_limit = emu_time_limit;
+    settings.path_frame_dump = path_frame_dump;
 
 #ifdef ENABLE_TCP_SERIAL
     settings.sersrv = &sersrv_intf;
 #endif
 
-    settings.sndsrv = &snd_intf;
+    if (headless) {
+        settings.win_intf = headless::get_win_intf();
+        settings.sndsrv = headless::get_sound_intf();
+        settings.overlay_intf = headless::get_overlay_intf();
+    } else {
+        settings.win_intf = get_win_intf_glfw();
+        settings.sndsrv = &snd_intf;
 
-    overlay_intf.overlay_draw = overlay::draw;
-    overlay_intf.overlay_set_fps = overlay::set_fps;
-    overlay_intf.overlay_set_virt_fps = overlay::set_virt_fps;
+        overlay_intf.overlay_draw = overlay::draw;
+        overlay_intf.overlay_set_fps = overlay::set_fps;
+        overlay_intf.overlay_set_virt_fps = overlay::set_virt_fps;
 
-    settings.overlay_intf = &overlay_intf;
+        settings.overlay_intf = &overlay_intf;
+    }
 
 #ifdef USE_LIBEVENT
     io::init();
@@ -413,11 +468,13 @@ int main(int argc, char **argv) {
 
     console = washdc_init(&settings);
 
-    overlay::init(enable_debugger || enable_washdbg);
+    if (!headless)
+        overlay::init(enable_debugger || enable_washdbg);
 
     washdc_run();
 
-    overlay::cleanup();
+    if (!headless)
+        overlay::cleanup();
 
 #ifdef USE_LIBEVENT
     io::kick();
@@ -21,8 +21,11 @@
  ******************************************************************************/
 
 #include <cmath>
-#include <mutex>
-#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
 
 #include <portaudio.h>
 
@@ -43,13 +46,68 @@ static int snd_cb(const void *input, void *output,
                   PaStreamCallbackFlags flags,
                   void *argp);
 
-static std::mutex buffer_lock;
-static std::condition_variable samples_submitted;
+/*
+ * XXX: if you ever change the sample frequency to something other than
+ * 44.1kHz, then AICA_EXTERNAL_FREQ in libwashdc/hw/aica/aica.c needs to be
+ * changed to match it.
+ */
+static const unsigned SAMPLE_FREQ = 44100;
+
+/*
+ * single-producer/single-consumer ring of stereo frames.  The emulation
+ * thread is the only writer and the portaudio callback is the only reader,
+ * so neither side ever takes a lock.  The indices count frames and are never
+ * wrapped; the buffer index is the count modulo BUF_LEN, which is why BUF_LEN
+ * has to be a power of two.
+ */
+
+// a little less than 1/10 of a second
+static const unsigned BUF_LEN = 4096;
+static_assert((BUF_LEN & (BUF_LEN - 1)) == 0, "BUF_LEN must be a power of two");
+static washdc_sample_type frame_buf[BUF_LEN][WASHDC_SOUND_CHAN_COUNT];
+static std::atomic<unsigned> read_idx, write_idx;
+
+/*
+ * The emulator and the audio device run off of different clocks, so the
+ * callback resamples whatever is in the ring to keep it about half-full.
+ * When the ring is fuller than that the callback reads slightly faster than
+ * realtime and when it's emptier it reads slightly slower.  The adjustment
+ * is limited to RESAMPLE_MAX_ADJ so the change in pitch isn't audible.
+ */
+static const unsigned RESAMPLE_TARGET_FILL = BUF_LEN / 2;
+static const double RESAMPLE_MAX_ADJ = 0.005;
+
+/*
+ * resampler state, only touched by the callback.  resample_hist holds the
+ * last four input frames and resample_pos is the position of the next output
+ * frame between the second and third of them.
+ */
+static double resample_hist[4][WASHDC_SOUND_CHAN_COUNT];
+static double resample_pos;
+
+/*
+ * The resampler can only refill the ring at RESAMPLE_MAX_ADJ of the sample
+ * rate, so starting playback from an empty ring would underrun for several
+ * seconds.  Instead the callback outputs silence until the ring first
+ * reaches RESAMPLE_TARGET_FILL, and goes back to waiting after every
+ * underrun (which is also what happens after a pause).  Only touched by the
+ * callback, except in init.
+ */
+static bool resample_primed;
+
+/*
+ * in SYNC_MODE_NORM, the emulation thread paces itself against the
+ * wall-clock by the number of frames it's submitted since pace_start.
+ */
+static std::chrono::steady_clock::time_point pace_start;
+static unsigned long long pace_frames;
+
+/*
+ * if emulation falls further behind than this, the pacing starts over
+ * instead of letting the emulator run fast to catch up.
+ */
+static const std::chrono::milliseconds PACE_MAX_LAG(100);
 
-// 1/10 of a second
-static const unsigned BUF_LEN = 4410;
-static washdc_sample_type sample_buf[BUF_LEN];
-static unsigned read_buf_idx, write_buf_idx;
 static bool do_mute;
 static enum sync_mode audio_sync_mode;
 
@@ -58,7 +116,17 @@ void init(void) {
     audio_sync_mode = SYNC_MODE_NORM;
     cfg_get_bool("audio.mute", &do_mute);
 
-    read_buf_idx = write_buf_idx = 0;
+    read_idx.store(0);
+    write_idx.store(0);
+
+    for (auto& frame : resample_hist)
+        for (double& sample : frame)
+            sample = 0.0;
+    resample_pos = 0.0;
+    resample_primed = false;
+
+    pace_start = std::chrono::steady_clock::now();
+    pace_frames = 0;
 
     int err;
     if ((err = Pa_Initialize()) != paNoError) {
@@ -67,12 +135,8 @@ void init(void) {
         RAISE_ERROR(ERROR_EXT_FAILURE);
     }
 
-    /*
-     * XXX: if you ever change the sample frequency to something other than
-     * 44.1kHz, then AICA_EXTERNAL_FREQ in libwashdc/hw/aica/aica.c needs to be
-     * changed to match it.
-     */
-    err = Pa_OpenDefaultStream(&snd_stream, 0, 2, paInt32, 44100*1,
+    err = Pa_OpenDefaultStream(&snd_stream, 0, WASHDC_SOUND_CHAN_COUNT,
+                               paInt32, SAMPLE_FREQ,
                                paFramesPerBufferUnspecified,
                                snd_cb, NULL);
     if (err != paNoError) {
@@ -103,22 +167,72 @@ static int snd_cb(const void *input, void *output,
                   PaStreamCallbackTimeInfo const *ti,
                   PaStreamCallbackFlags flags,
                   void *argp) {
-    std::unique_lock<std::mutex> lck(buffer_lock);
     washdc_sample_type *outbuf = (washdc_sample_type*)output;
-    int frame_no;
-    for (frame_no = 0; frame_no < n_frames; frame_no++) {
-        // TODO: stereo
-        washdc_sample_type sample;
-        if (read_buf_idx != write_buf_idx) {
-            sample = sample_buf[read_buf_idx];
-            read_buf_idx = (1 + read_buf_idx) % BUF_LEN;
-        } else {
-            sample = 0;
+    unsigned rd = read_idx.load(std::memory_order_relaxed);
+    unsigned n_avail = write_idx.load(std::memory_order_acquire) - rd;
+    unsigned long frame_no = 0;
+
+    if (!resample_primed && n_avail >= RESAMPLE_TARGET_FILL)
+        resample_primed = true;
+
+    if (resample_primed) {
+        // the ratio only gets steered once per callback
+        double fill_err = ((double)n_avail - (double)RESAMPLE_TARGET_FILL) /
+            (double)RESAMPLE_TARGET_FILL;
+        if (fill_err > 1.0)
+            fill_err = 1.0;
+        else if (fill_err < -1.0)
+            fill_err = -1.0;
+        double step = 1.0 + fill_err * RESAMPLE_MAX_ADJ;
+
+        for (; frame_no < n_frames; frame_no++) {
+            while (resample_pos >= 1.0 && n_avail) {
+                washdc_sample_type const *frame = frame_buf[rd++ % BUF_LEN];
+                n_avail--;
+                std::copy(resample_hist[1], resample_hist[4], resample_hist[0]);
+                std::copy(frame, frame + WASHDC_SOUND_CHAN_COUNT,
+                          resample_hist[3]);
+                resample_pos -= 1.0;
+            }
+
+            if (resample_pos >= 1.0) {
+                // underrun; wait for the ring to fill back up
+                resample_primed = false;
+                break;
+            }
+
+            double t = resample_pos;
+            unsigned chan;
+            for (chan = 0; chan < WASHDC_SOUND_CHAN_COUNT; chan++) {
+                double p0 = resample_hist[0][chan];
+                double p1 = resample_hist[1][chan];
+                double p2 = resample_hist[2][chan];
+                double p3 = resample_hist[3][chan];
+
+                // cubic (Catmull-Rom) interpolation between p1 and p2
+                double val = p1 + 0.5 * t *
+                    (p2 - p0 + t * (2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3 +
+                                    t * (3.0 * (p1 - p2) + p3 - p0)));
+
+                if (val > INT32_MAX)
+                    val = INT32_MAX;
+                else if (val < INT32_MIN)
+                    val = INT32_MIN;
+                *outbuf++ = (washdc_sample_type)val;
+            }
+
+            resample_pos += step;
         }
-        *outbuf++ = sample;
-        *outbuf++ = sample;
     }
-    samples_submitted.notify_one();
+
+    // underrun, or still waiting for the ring to fill
+    for (; frame_no < n_frames; frame_no++) {
+        unsigned chan;
+        for (chan = 0; chan < WASHDC_SOUND_CHAN_COUNT; chan++)
+            *outbuf++ = 0;
+    }
+
+    read_idx.store(rd, std::memory_order_release);
     return 0;
 }
 
@@ -142,24 +256,62 @@ static washdc_sample_type scale_sample(washdc_sample_type sample) {
     return sat_shift(sample, 8);
 }
 
-void submit_samples(washdc_sample_type *samples, unsigned count) {
-    std::unique_lock<std::mutex> lck(buffer_lock);
+/*
+ * In SYNC_MODE_NORM, sleep until the wall-clock catches up with the audio
+ * that's been submitted so far.  This is what keeps emulation running at 100%
+ * speed; it doesn't depend on when the audio device happens to call snd_cb.
+ */
+static void pace(unsigned n_frames) {
+    using namespace std::chrono;
 
-    while (count) {
-        unsigned next_write_buf_idx = (1 + write_buf_idx) % BUF_LEN;
-        if (audio_sync_mode == SYNC_MODE_NORM)
-            while (next_write_buf_idx == read_buf_idx) {
-                samples_submitted.wait(lck);
-            }
-        if (do_mute)
-            sample_buf[write_buf_idx] = 0;
-        else
-            sample_buf[write_buf_idx] = scale_sample(*samples++);
-        write_buf_idx = next_write_buf_idx;
-        count--;
+    steady_clock::time_point now = steady_clock::now();
+
+    if (audio_sync_mode != SYNC_MODE_NORM) {
+        pace_start = now;
+        pace_frames = 0;
+        return;
+    }
+
+    pace_frames += n_frames;
+    steady_clock::time_point due = pace_start +
+        duration_cast<steady_clock::duration>(
+            duration<double>((double)pace_frames / SAMPLE_FREQ));
+
+    if (due > now) {
+        std::this_thread::sleep_until(due);
+    } else if (now - due > PACE_MAX_LAG) {
+        // we're running slow (or we were paused), so start over from here
+        pace_start = now;
+        pace_frames = 0;
     }
 }
 
+void submit_frames(washdc_sample_type const *frames, unsigned n_frames) {
+    unsigned wr = write_idx.load(std::memory_order_relaxed);
+    unsigned n_free =
+        BUF_LEN - (wr - read_idx.load(std::memory_order_acquire));
+
+    /*
+     * anything that doesn't fit gets dropped.  This only happens when frames
+     * are produced faster than the resampler can absorb, like in
+     * SYNC_MODE_UNLIMITED, and that audio is simply lost.
+     */
+    unsigned n_copy = n_frames < n_free ? n_frames : n_free;
+    unsigned frame_no;
+    for (frame_no = 0; frame_no < n_copy; frame_no++) {
+        washdc_sample_type *frame = frame_buf[wr++ % BUF_LEN];
+        unsigned chan;
+        for (chan = 0; chan < WASHDC_SOUND_CHAN_COUNT; chan++) {
+            frame[chan] = do_mute ? 0 : scale_sample(*frames);
+            frames++;
+        }
+    }
+
+    write_idx.store(wr, std::memory_order_release);
+
+    pace(n_frames);
+}
+
 void mute(bool en_mute) {
     do_mute = en_mute;
 }
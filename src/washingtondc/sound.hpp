@@ -32,12 +32,19 @@ namespace sound {
 void init(void);
 void cleanup(void);
 
-void submit_samples(washdc_sample_type *samples, unsigned count);
+void submit_frames(washdc_sample_type const *frames, unsigned n_frames);
 
 void mute(bool en_mute);
 
 bool is_muted(void);
 
+/*
+ * SYNC_MODE_NORM paces emulation against the wall-clock so it runs at 100%
+ * speed, and the audio gets resampled slightly to absorb the drift between
+ * the emulator's clock and the audio device's.  SYNC_MODE_UNLIMITED doesn't
+ * pace emulation at all; the resampling can only make up for a fraction of a
+ * percent, so whatever audio is produced faster than realtime gets dropped.
+ */
 enum sync_mode {
     SYNC_MODE_NORM,
     SYNC_MODE_UNLIMITED
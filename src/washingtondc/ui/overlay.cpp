@@ -186,6 +186,11 @@ void overlay::draw() {
             ImGui::EndMenu();
         }
 
+        struct washdc_pvr2_stat stat;
+        washdc_get_pvr2_stat(&stat);
+        if (stat.frames_skipped_recent)
+            ImGui::Text("Frameskip: %u/64", stat.frames_skipped_recent);
+
         ImGui::EndMainMenuBar();
     }
 
@@ -290,6 +295,18 @@ static void overlay::show_perf_win(void) {
     ImGui::Text("%u texture overwrites", stat.texture_overwrite_count);
     ImGui::Text("%u fresh texture uploads", stat.fresh_texture_upload_count);
     ImGui::Text("%u texture cache evictions", stat.tex_eviction_count);
+    ImGui::Text("%u unchanged texture invalidates",
+                stat.tex_hash_match_count);
+    ImGui::Text("%u deduplicated textures", stat.tex_dedup_count);
+    ImGui::Text("%u texture cache budget evictions",
+                stat.tex_budget_eviction_count);
+    ImGui::Text("texture cache: %u KB used out of %u KB",
+                (unsigned)(stat.tex_cache_bytes / 1024),
+                (unsigned)(stat.tex_cache_budget / 1024));
+    ImGui::Text("texture cache: %u textures in %u slots",
+                stat.tex_cache_resident, stat.tex_cache_slots);
+    ImGui::Text("%u frames skipped (%u of the last 64)",
+                stat.frames_skipped, stat.frames_skipped_recent);
     ImGui::End();
 }
 
@@ -195,6 +195,7 @@ static void win_glfw_init(unsigned width, unsigned height) {
     bind_ctrl_from_cfg("toggle-wireframe", "wash.ctrl.toggle-wireframe");
     bind_ctrl_from_cfg("screenshot", "wash.ctrl.screenshot");
     bind_ctrl_from_cfg("toggle-mute", "wash.ctrl.toggle-mute");
+    bind_ctrl_from_cfg("toggle-turbo-load", "wash.ctrl.toggle-turbo-load");
     bind_ctrl_from_cfg("resume-execution", "wash.ctrl.resume-execution");
     bind_ctrl_from_cfg("run-one-frame", "wash.ctrl.run-one-frame");
     bind_ctrl_from_cfg("pause-execution", "wash.ctrl.pause-execution");
@@ -487,6 +488,12 @@ static void scan_input(void) {
         sound::mute(!sound::is_muted());
     mute_key_prev = mute_key;
 
+    static bool turbo_key_prev = false;
+    bool turbo_key = ctrl_get_button("toggle-turbo-load");
+    if (turbo_key && !turbo_key_prev)
+        washdc_gdrom_toggle_turbo();
+    turbo_key_prev = turbo_key;
+
     static bool resume_key_prev = false;
     bool resume_key = ctrl_get_button("resume-execution");
     if (resume_key && !resume_key_prev) {
@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+
+################################################################################
+#
+#
+#   WashingtonDC Dreamcast Emulator
+#   Copyright (C) 2019 snickerbockers
+#   chimerasaurusrex@gmail.com
+#
+#   This program is free software; you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation; either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program; if not, write to the
+#   Free Software Foundation, Inc.,
+#   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+#
+#
+################################################################################
+
+################################################################################
+#
+# This script converts a gdi-format image into a hunk-compressed .gdz image
+# which WashingtonDC can mount directly.  See src/libwashdc/gdz.h for a
+# description of the format.
+#
+# usage: gdi2gdz.py [-s sectors_per_hunk] [-j jobs] [-l level] in.gdi out.gdz
+#
+################################################################################
+
+import argparse
+import concurrent.futures
+import os
+import shlex
+import struct
+import sys
+import zlib
+
+GDZ_MAGIC = b"WASHGDZ\0"
+GDZ_VERSION = 1
+
+GDZ_HUNK_ZLIB = 0
+GDZ_HUNK_RAW = 1
+
+HEADER_FMT = "<8sIIIIQ"
+TRACK_FMT = "<IIII"
+HUNK_FMT = "<QII"
+
+CDROM_FRAME_SIZE = 2352
+CDROM_FRAME_DATA_SIZE = 2048
+CDROM_MODE1_DATA_OFFSET = 16
+
+def parse_gdi(gdi_path):
+    gdi_dir = os.path.dirname(gdi_path)
+    with open(gdi_path, "r") as gdi_file:
+        lines = [ln for ln in gdi_file.read().splitlines() if ln.strip()]
+
+    n_tracks = int(lines[0])
+    if n_tracks < 3 or len(lines) < n_tracks + 1:
+        raise ValueError("%s: bad track count" % gdi_path)
+
+    tracks = []
+    for line in lines[1:n_tracks + 1]:
+        fields = shlex.split(line)
+        if len(fields) != 6:
+            raise ValueError("%s: malformed track \"%s\"" % (gdi_path, line))
+        sector_size = int(fields[3])
+        if sector_size not in (CDROM_FRAME_SIZE, CDROM_FRAME_DATA_SIZE):
+            raise ValueError("%s: unsupported sector size %d" %
+                             (gdi_path, sector_size))
+        tracks.append({
+            "fad": int(fields[1]) + 150,
+            "ctrl": int(fields[2]),
+            "sector_size": sector_size,
+            "path": os.path.join(gdi_dir, fields[4]),
+            "offset": int(fields[5])
+        })
+    return tracks
+
+def read_hunk(track, first_sector, n_sectors):
+    """ read the user data out of n_sectors sectors of the given track """
+    sector_size = track["sector_size"]
+    data_offs = CDROM_MODE1_DATA_OFFSET if sector_size == CDROM_FRAME_SIZE else 0
+    with open(track["path"], "rb") as stream:
+        # the offset field is ignored to match what gdi.c does when it
+        # mounts the .gdi, so both images hold the same sectors
+        stream.seek(first_sector * sector_size)
+        raw = stream.read(n_sectors * sector_size)
+    raw = raw.ljust(n_sectors * sector_size, b"\0")
+    return b"".join(raw[idx * sector_size + data_offs:
+                        idx * sector_size + data_offs + CDROM_FRAME_DATA_SIZE]
+                    for idx in range(n_sectors))
+
+def compress_hunk(job):
+    track, first_sector, n_sectors, level = job
+    dat = read_hunk(track, first_sector, n_sectors)
+    packed = zlib.compress(dat, level)
+    if len(packed) < len(dat):
+        return (GDZ_HUNK_ZLIB, packed)
+    return (GDZ_HUNK_RAW, dat)
+
+def main():
+    parser = argparse.ArgumentParser(description="convert a .gdi into a .gdz")
+    parser.add_argument("-s", "--hunk-sectors", type=int, default=16,
+                        help="number of sectors in each hunk")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count(),
+                        help="number of hunks to compress in parallel")
+    parser.add_argument("-l", "--level", type=int, default=9,
+                        help="zlib compression level")
+    parser.add_argument("gdi_path")
+    parser.add_argument("gdz_path")
+    args = parser.parse_args()
+
+    if args.hunk_sectors < 1 or args.hunk_sectors > 1024:
+        sys.exit("sectors per hunk must be between 1 and 1024")
+
+    tracks = parse_gdi(args.gdi_path)
+
+    for track in tracks:
+        if track["offset"] != 0:
+            sys.stderr.write("WARNING: ignoring nonzero offset %d for %s, "
+                             "like WashingtonDC does when it mounts the "
+                             ".gdi\n" % (track["offset"], track["path"]))
+
+    jobs = []
+    for track in tracks:
+        n_sectors = os.path.getsize(track["path"]) // track["sector_size"]
+        track["n_sectors"] = n_sectors
+        track["first_hunk"] = len(jobs)
+        for first_sector in range(0, n_sectors, args.hunk_sectors):
+            jobs.append((track, first_sector,
+                         min(args.hunk_sectors, n_sectors - first_sector),
+                         args.level))
+
+    track_tbl = b"".join(struct.pack(TRACK_FMT, track["fad"], track["ctrl"],
+                                     track["n_sectors"], track["first_hunk"])
+                         for track in tracks)
+
+    with open(args.gdz_path, "wb") as out:
+        # the header gets filled in once the hunk table's offset is known
+        out.write(b"\0" * struct.calcsize(HEADER_FMT))
+        out.write(track_tbl)
+
+        hunk_tbl = []
+        with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as pool:
+            for tp, dat in pool.map(compress_hunk, jobs):
+                hunk_tbl.append(struct.pack(HUNK_FMT, out.tell(), len(dat), tp))
+                out.write(dat)
+
+        hunk_tbl_offs = out.tell()
+        out.write(b"".join(hunk_tbl))
+
+        out.seek(0)
+        out.write(struct.pack(HEADER_FMT, GDZ_MAGIC, GDZ_VERSION,
+                              args.hunk_sectors, len(tracks), len(jobs),
+                              hunk_tbl_offs))
+
+if __name__ == "__main__":
+    main()